@@ -0,0 +1,220 @@
+/* apic.c - Local APIC and IO-APIC
+ *
+ * Every CPU has a local APIC (LAPIC) at the same address. It accepts interrupts, takes their EOI,
+ * sends the start-up IPIs to the other CPUs and runs a per-CPU timer. Once the IO-APIC is set up,
+ * the ISA IRQs are routed through it to the boot CPU with the vectors the 8259 used, and
+ * enable_irq/disable_irq/send_eoi in i8259.c forward here.
+ */
+
+#include "apic.h"
+#include "lib.h"
+#include "i8259.h"
+#include "pit.h"
+
+static volatile uint32_t* lapic = NULL;     // LAPIC registers, NULL if there is no LAPIC
+static uint32_t lapic_timer_count = 0;      // LAPIC timer ticks (divided by 16) per 1/APIC_TIMER_HZ s
+static volatile uint32_t* ioapic = NULL;    // IO-APIC registers
+static uint32_t ioapic_on = 0;              // 1 once the ISA IRQs go through the IO-APIC
+static uint32_t ioapic_dest;                // APIC ID of the CPU that takes the IRQs
+static uint8_t ioapic_pins[ISA_IRQS];       // IO-APIC input of every ISA IRQ
+static uint16_t ioapic_flags[ISA_IRQS];     // MP table polarity and trigger flags of every ISA IRQ
+
+/* Reads a LAPIC register */
+static uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+/* Writes a LAPIC register, reading the ID register after waits for the write to land */
+static void lapic_write(uint32_t reg, uint32_t val) {
+    lapic[reg / 4] = val;
+    (void)lapic[LAPIC_ID / 4];
+}
+
+/* Writes an IO-APIC register */
+static void ioapic_write(uint32_t reg, uint32_t val) {
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    ioapic[IOAPIC_WIN / 4] = val;
+}
+
+/* Reads an IO-APIC register */
+static uint32_t ioapic_read(uint32_t reg) {
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    return ioapic[IOAPIC_WIN / 4];
+}
+
+/*
+ * pit_delay_us
+ *   DESCRIPTION: Busy waits on a one-shot count of PIT channel 2, which nothing else uses.
+ *   INPUTS: us - microseconds to wait, at most PIT_MAX_DELAY_US
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Reprograms PIT channel 2 and turns the speaker off
+ */
+void pit_delay_us(uint32_t us) {
+    uint32_t count;
+
+    if(us > PIT_MAX_DELAY_US)
+        us = PIT_MAX_DELAY_US;
+    count = us * (PIT_HZ / 1000) / 1000;
+
+    outb((inb(PIT_CH2_GATE_PORT) & ~PIT_CH2_SPEAKER) | PIT_CH2_GATE, PIT_CH2_GATE_PORT);
+    outb(PIT_CH2_ONESHOT, PIT_CMD_REG);
+    outb(count & 0xFF, PIT_CH2_PORT);
+    outb((count >> 8) & 0xFF, PIT_CH2_PORT);
+
+    while(!(inb(PIT_CH2_GATE_PORT) & PIT_CH2_OUT));
+}
+
+/*
+ * lapic_init
+ *   DESCRIPTION: Sets up the boot CPU's LAPIC and measures how fast the LAPIC timer runs, so every
+ *                CPU can tick at APIC_TIMER_HZ.
+ *   INPUTS: base - physical (identity mapped) address of the LAPIC
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Enables the LAPIC and its timer on this CPU
+ */
+void lapic_init(uint32_t base) {
+    lapic = (volatile uint32_t*)base;
+
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    pit_delay_us(1000000 / APIC_TIMER_HZ);
+    lapic_timer_count = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    lapic_cpu_init();
+}
+
+/*
+ * lapic_cpu_init
+ *   DESCRIPTION: Enables the LAPIC of the calling CPU and starts its periodic timer.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Timer interrupts arrive on APIC_TIMER_VEC once interrupts are on
+ */
+void lapic_cpu_init(void) {
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VEC);
+    lapic_write(LAPIC_TPR, 0);
+
+    // Clear errors left over from start-up, the ESR needs two writes
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | APIC_TIMER_VEC);
+    lapic_write(LAPIC_TIMER_INIT, lapic_timer_count);
+
+    lapic_eoi();
+}
+
+/* Returns 1 if lapic_init found a LAPIC */
+uint32_t lapic_present(void) {
+    return lapic != NULL;
+}
+
+/* Returns the APIC ID of the calling CPU */
+uint32_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> LAPIC_ID_SHIFT;
+}
+
+/* Acknowledges the interrupt being handled on the calling CPU */
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+ * lapic_send_ipi
+ *   DESCRIPTION: Sends an inter-processor interrupt and waits for it to be delivered.
+ *   INPUTS: apic_id - target CPU
+ *           icr - low word of the interrupt command register (type, vector, level)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr) {
+    lapic_write(LAPIC_ICR_HI, apic_id << LAPIC_ID_SHIFT);
+    lapic_write(LAPIC_ICR_LO, icr);
+    while(lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING);
+}
+
+/*
+ * ioapic_route
+ *   DESCRIPTION: Writes the redirection entry of an ISA IRQ.
+ *   INPUTS: irq - ISA IRQ
+ *           masked - 1 to keep the IRQ from being delivered
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void ioapic_route(uint32_t irq, uint32_t masked) {
+    uint32_t low = ISA_IRQ_VEC + irq;
+    uint32_t reg = IOAPIC_REDTBL + 2 * ioapic_pins[irq];
+
+    if((ioapic_flags[irq] & MP_POLARITY_MASK) == MP_POLARITY_LOW)
+        low |= IOAPIC_LOW_ACTIVE;
+    if((ioapic_flags[irq] & MP_TRIGGER_MASK) == MP_TRIGGER_LEVEL)
+        low |= IOAPIC_LEVEL;
+    if(masked)
+        low |= IOAPIC_MASKED;
+
+    ioapic_write(reg + 1, ioapic_dest << LAPIC_ID_SHIFT);
+    ioapic_write(reg, low);
+}
+
+/*
+ * ioapic_init
+ *   DESCRIPTION: Masks every IO-APIC input, then moves the ISA IRQs the 8259 has enabled over to the
+ *                IO-APIC and masks the 8259 for good.
+ *   INPUTS: base - physical (identity mapped) address of the IO-APIC
+ *           apic_id - CPU that takes the IRQs
+ *           irq_pins - IO-APIC input of every ISA IRQ
+ *           irq_flags - MP table/MADT polarity and trigger flags of every ISA IRQ (0 = ISA default)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must run with interrupts off, lapic_init must have run
+ */
+void ioapic_init(uint32_t base, uint32_t apic_id, const uint8_t* irq_pins, const uint16_t* irq_flags) {
+    uint32_t pic_mask;
+    uint32_t max_pin;
+    uint32_t i;
+
+    ioapic = (volatile uint32_t*)base;
+    ioapic_dest = apic_id;
+    memcpy(ioapic_pins, irq_pins, sizeof(ioapic_pins));
+    memcpy(ioapic_flags, irq_flags, sizeof(ioapic_flags));
+
+    max_pin = (ioapic_read(IOAPIC_VER) >> 16) & 0xFF;
+    for(i = 0; i <= max_pin; i++)
+        ioapic_write(IOAPIC_REDTBL + 2 * i, IOAPIC_MASKED);
+
+    pic_mask = inb(MASTER_8259_PORT_DATA) | (inb(SLAVE_8259_PORT_DATA) << MASTER_MAX_IRQ_NUM);
+    for(i = 0; i < ISA_IRQS; i++){
+        if(i != MASTER_SLAVE_PORT_NUM && ioapic_pins[i] <= max_pin)
+            ioapic_route(i, (pic_mask >> i) & 1);
+    }
+
+    outb(INIT_MASK, MASTER_8259_PORT_DATA);
+    outb(INIT_MASK, SLAVE_8259_PORT_DATA);
+    ioapic_on = 1;
+}
+
+/* Returns 1 if ISA IRQs go through the IO-APIC */
+uint32_t ioapic_active(void) {
+    return ioapic_on;
+}
+
+/* Lets an ISA IRQ through the IO-APIC */
+void ioapic_unmask(uint32_t irq) {
+    if(irq < ISA_IRQS && irq != MASTER_SLAVE_PORT_NUM)
+        ioapic_route(irq, 0);
+}
+
+/* Blocks an ISA IRQ at the IO-APIC */
+void ioapic_mask(uint32_t irq) {
+    if(irq < ISA_IRQS && irq != MASTER_SLAVE_PORT_NUM)
+        ioapic_route(irq, 1);
+}
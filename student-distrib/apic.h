@@ -0,0 +1,81 @@
+/* apic.h - Defines for the local APIC and the IO-APIC */
+
+#ifndef _APIC_H
+#define _APIC_H
+
+#include "types.h"
+
+/* Local APIC registers, offsets from the LAPIC base */
+#define LAPIC_ID            0x020
+#define LAPIC_TPR           0x080
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0
+#define LAPIC_ESR           0x280
+#define LAPIC_ICR_LO        0x300
+#define LAPIC_ICR_HI        0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_LVT_ERROR     0x370
+#define LAPIC_TIMER_INIT    0x380
+#define LAPIC_TIMER_CUR     0x390
+#define LAPIC_TIMER_DIV     0x3E0
+
+#define LAPIC_SVR_ENABLE    0x100       // APIC software enable
+#define LAPIC_LVT_MASKED    0x10000
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_TIMER_DIV_16  0x3
+#define LAPIC_ICR_INIT      0x00000500
+#define LAPIC_ICR_STARTUP   0x00000600
+#define LAPIC_ICR_LEVEL     0x00008000  // Level triggered
+#define LAPIC_ICR_ASSERT    0x00004000
+#define LAPIC_ICR_PENDING   0x00001000  // Delivery status: still being sent
+#define LAPIC_ID_SHIFT      24
+
+/* IO-APIC registers */
+#define IOAPIC_REGSEL       0x00        // Offset of the register select window
+#define IOAPIC_WIN          0x10        // Offset of the data window
+#define IOAPIC_VER          0x01
+#define IOAPIC_REDTBL       0x10        // First redirection entry, two registers each
+#define IOAPIC_MASKED       0x10000
+#define IOAPIC_LOW_ACTIVE   0x2000
+#define IOAPIC_LEVEL        0x8000
+
+#define APIC_TIMER_VEC      0x40
+#define APIC_SPURIOUS_VEC   0xFF
+#define APIC_TIMER_HZ       100         // Same rate as the PIT
+#define ISA_IRQS            16
+#define ISA_IRQ_VEC         0x20        // IRQ n keeps the vector the 8259 gave it
+#define MP_POLARITY_MASK    0x3         // MP table and MADT interrupt flags: polarity
+#define MP_POLARITY_LOW     0x3
+#define MP_TRIGGER_MASK     0xC         // MP table and MADT interrupt flags: trigger mode
+#define MP_TRIGGER_LEVEL    0xC
+
+/* PIT channel 2, used to time the LAPIC timer and the AP start-up delays */
+#define PIT_CH2_PORT        0x42
+#define PIT_CH2_GATE_PORT   0x61
+#define PIT_CH2_GATE        0x01
+#define PIT_CH2_SPEAKER     0x02
+#define PIT_CH2_OUT         0x20
+#define PIT_CH2_ONESHOT     0xB0        // Channel 2, lobyte/hibyte, mode 0
+#define PIT_HZ              1193182
+#define PIT_MAX_DELAY_US    50000       // Longest delay one count of channel 2 can time
+
+/* Local APIC */
+void lapic_init(uint32_t base);
+void lapic_cpu_init(void);
+uint32_t lapic_present(void);
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr);
+
+/* IO-APIC */
+void ioapic_init(uint32_t base, uint32_t apic_id, const uint8_t* irq_pins, const uint16_t* irq_flags);
+uint32_t ioapic_active(void);
+void ioapic_unmask(uint32_t irq);
+void ioapic_mask(uint32_t irq);
+
+/* Busy wait, times up to PIT_MAX_DELAY_US per call */
+void pit_delay_us(uint32_t us);
+
+#endif /* _APIC_H */
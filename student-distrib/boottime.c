@@ -0,0 +1,126 @@
+/* boottime.c - Boot timeline and boot flags
+ *
+ * entry() closes a step after every piece of initialization it does, the first read of the
+ * shell closes the last one, so the time to the first prompt is the sum of the steps. Times
+ * are kept as TSC cycles and only turned into microseconds when the timeline is printed,
+ * which is also when the TSC gets measured against the PIT (boot doesn't wait for that).
+ * The flags are bool parameters of the command line (param.c).
+ */
+
+#include "boottime.h"
+#include "lib.h"
+#include "apic.h"
+#include "param.h"
+
+typedef struct boot_step {
+    const int8_t* name;
+    uint32_t cycles;                    // TSC cycles since the previous step
+} boot_step_t;
+
+static boot_step_t boot_steps[BOOT_MAX_STEPS];
+static uint32_t boot_nsteps = 0;
+static uint32_t boot_last_tsc = 0;      // When the previous step ended
+static uint32_t boot_finished = 0;
+uint32_t boot_flags = 0;                // BOOT_* flags, set by param_parse
+
+/*
+ * boot_begin
+ *   DESCRIPTION: Starts the timeline and sets the parameters given on the command line, the
+ *                boot flags among them.
+ *   INPUTS: cmdline - multiboot command line, NULL if the boot loader didn't pass one
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must run before paging hides the multiboot data
+ */
+void boot_begin(const int8_t* cmdline) {
+    boot_last_tsc = rdtsc_low();
+    param_parse(cmdline);
+}
+
+/*
+ * boot_step
+ *   DESCRIPTION: Closes a step: the time since the previous one (or boot_begin) is charged to it.
+ *   INPUTS: name - what the step did, a string that stays around
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void boot_step(const int8_t* name) {
+    uint32_t now = rdtsc_low();
+
+    if(boot_nsteps < BOOT_MAX_STEPS) {
+        boot_steps[boot_nsteps].name = name;
+        boot_steps[boot_nsteps].cycles = now - boot_last_tsc;
+        boot_nsteps++;
+    }
+    boot_last_tsc = now;
+}
+
+/*
+ * boot_flag
+ *   DESCRIPTION: Tells whether a flag was on the command line.
+ *   INPUTS: flag - BOOT_* flag
+ *   OUTPUTS: none
+ *   RETURN VALUE: nonzero if it was
+ *   SIDE EFFECTS: none
+ */
+uint32_t boot_flag(uint32_t flag) {
+    return boot_flags & flag;
+}
+
+/*
+ * boot_quiet
+ *   DESCRIPTION: Tells whether boot messages are off.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: nonzero for a quiet boot
+ *   SIDE EFFECTS: none
+ */
+uint32_t boot_quiet(void) {
+    return boot_flags & BOOT_QUIET;
+}
+
+/*
+ * boot_done
+ *   DESCRIPTION: Closes the last step when the shell first waits for input, and prints the
+ *                timeline if "boottime" was given. Does nothing after the first call.
+ *   INPUTS: none
+ *   OUTPUTS: the timeline with "boottime"
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void boot_done(void) {
+    if(boot_finished)
+        return;
+    boot_finished = 1;
+
+    boot_step("first shell prompt");
+    if(boot_flags & BOOT_TIMELINE)
+        boot_timeline_print();
+}
+
+/*
+ * boot_timeline_print
+ *   DESCRIPTION: Prints the time of every step and the total. The TSC is counted over
+ *                BOOT_CALIBRATE_US of PIT channel 2 first, to convert cycles to microseconds.
+ *   INPUTS: none
+ *   OUTPUTS: one line per step
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Busy waits BOOT_CALIBRATE_US
+ */
+void boot_timeline_print(void) {
+    uint32_t start, per_us, total, i;
+
+    start = rdtsc_low();
+    pit_delay_us(BOOT_CALIBRATE_US);
+    per_us = (rdtsc_low() - start) / BOOT_CALIBRATE_US;
+    if(per_us == 0)
+        per_us = 1;
+
+    total = 0;
+    for(i = 0; i < boot_nsteps; i++) {
+        printf("boot: %s: %u us\n", boot_steps[i].name, boot_steps[i].cycles / per_us);
+        total += boot_steps[i].cycles / per_us;
+    }
+    printf("boot: total %u us (%u cycles per us)\n", total, per_us);
+}
@@ -0,0 +1,36 @@
+/* boottime.h - Boot timeline and boot flags */
+
+#ifndef _BOOTTIME_H
+#define _BOOTTIME_H
+
+#include "types.h"
+
+#define BOOT_MAX_STEPS          24          // Steps the timeline keeps, later ones are dropped
+#define BOOT_CALIBRATE_US       10000       // PIT time the TSC is counted over to convert cycles
+
+/* Flags from the multiboot command line, e.g. "/boot/kernel quiet boottime" (bool parameters) */
+#define BOOT_QUIET              0x1         // "quiet": no multiboot dump or progress messages
+#define BOOT_TIMELINE           0x2         // "boottime": print the timeline at the first shell prompt
+#define BOOT_TESTS              0x4         // "tests": run launch_tests before the shell (RUN_TESTS builds)
+
+extern uint32_t boot_flags;
+
+/* Start the timeline and read the command line parameters, first thing in entry */
+void boot_begin(const int8_t* cmdline);
+
+/* Close a step of the timeline: the time since the previous step is charged to it */
+void boot_step(const int8_t* name);
+
+/* Tells whether a BOOT_* flag was given */
+uint32_t boot_flag(uint32_t flag);
+
+/* Shorthand for boot_flag(BOOT_QUIET), for init code that reports progress */
+uint32_t boot_quiet(void);
+
+/* The shell is waiting for input: close the timeline, print it if asked to. Runs once. */
+void boot_done(void);
+
+/* Print every step with its time and the total */
+void boot_timeline_print(void);
+
+#endif /* _BOOTTIME_H */
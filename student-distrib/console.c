@@ -0,0 +1,227 @@
+/* console.c - Shadow cell buffers of the terminals, flushed to video memory by dirty row
+ *
+ * The screen functions in lib.c draw into the shadow buffer of a terminal (console_select)
+ * and set a bit for every row they touch. console_flush copies runs of dirty rows to the
+ * terminal's video memory: the screen if it's shown, its backing page otherwise. A burst of
+ * output costs one copy per dirty row instead of a store to video memory per character.
+ * Whoever draws flushes when done, the RTC catches anything left over. Once the framebuffer is
+ * on (console_use_fb), the screen is gone: every terminal keeps its text in its backing page
+ * and the shown terminal's dirty rows are also drawn on the framebuffer.
+ */
+
+#include "console.h"
+#include "spinlock.h"
+#include "softirq.h"
+#include "fb.h"
+
+#define CONSOLE_BYTES       (NUM_ROWS * NUM_COLS * 2)
+
+static console_t consoles[NUM_CONSOLES];
+static uint8_t console_shown = 0;                   // Terminal whose video memory is the screen
+static uint32_t console_ready = 1 << 0;             // Bit t set once terminal t's screen was set up, 0 by the boot clear
+uint32_t console_flush_ticks = CONSOLE_FLUSH_TICKS;
+
+// Taken in the periodic flush, so irqsave everywhere; nests inside term_lock
+static spinlock_t console_lock = SPINLOCK_INIT("console");
+
+static void console_flush_tasklet(uint32_t data);
+static tasklet_t console_flush_work = TASKLET_INIT(console_flush_tasklet, 0);
+
+/*
+ * console_video
+ *   DESCRIPTION: Video memory a terminal's rows are flushed to, the caller holds console_lock.
+ *   INPUTS: t - terminal
+ *   OUTPUTS: none
+ *   RETURN VALUE: the screen if the terminal is shown in text mode, its backing page otherwise
+ *   SIDE EFFECTS: none
+ */
+static uint16_t* console_video(uint8_t t) {
+    return (uint16_t*)((t == console_shown && !fb_active()) ? VIDEO : CONSOLE_BACKING(t));
+}
+
+/*
+ * console_flush_locked
+ *   DESCRIPTION: Copies the dirty rows of a terminal to its video memory, consecutive dirty
+ *                rows in one copy. The caller holds console_lock with interrupts off.
+ *   INPUTS: t - terminal to flush
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Writes video memory, clears the terminal's dirty rows
+ */
+static void console_flush_locked(uint8_t t) {
+    console_t* con = &consoles[t];
+    uint16_t* video = console_video(t);
+    uint32_t dirty;
+    int y, end;
+
+    // Nothing else runs with interrupts off, rows drawn from now on stay dirty for next time
+    dirty = con->dirty;
+    con->dirty = 0;
+
+    y = 0;
+    while(dirty != 0) {
+        while(!(dirty & (1 << y)))
+            y++;
+        for(end = y; end < NUM_ROWS && (dirty & (1 << end)); end++)
+            dirty &= ~(1 << end);
+        memcpy(video + y * NUM_COLS, con->cells + y * NUM_COLS, (end - y) * NUM_COLS * 2);
+        if(t == console_shown && fb_active())
+            fb_draw_rows(con->cells, y, end);
+        y = end;
+    }
+}
+
+/*
+ * console_select
+ *   DESCRIPTION: Makes putc, printf, clear and the other screen functions of lib.c draw into a
+ *                terminal's shadow buffer.
+ *   INPUTS: t - terminal to draw on
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void console_select(uint8_t t) {
+    if(t < NUM_CONSOLES)
+        screen_target(consoles[t].cells, &consoles[t].dirty);
+}
+
+/*
+ * console_cells
+ *   DESCRIPTION: Shadow cells of a terminal, what the kernel last drew on it.
+ *   INPUTS: t - terminal
+ *   OUTPUTS: none
+ *   RETURN VALUE: NUM_ROWS * NUM_COLS cells, NULL for a bad terminal
+ *   SIDE EFFECTS: none
+ */
+uint16_t* console_cells(uint8_t t) {
+    return (t < NUM_CONSOLES) ? consoles[t].cells : NULL;
+}
+
+/*
+ * console_flush
+ *   DESCRIPTION: Copies the rows of a terminal drawn since its last flush to its video memory.
+ *   INPUTS: t - terminal to flush
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Writes video memory
+ */
+void console_flush(uint8_t t) {
+    uint32_t flags;
+
+    if(t >= NUM_CONSOLES || consoles[t].dirty == 0)
+        return;
+
+    spin_lock_irqsave(&console_lock, flags);
+    console_flush_locked(t);
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/*
+ * console_flush_all
+ *   DESCRIPTION: Flushes every terminal.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Writes video memory
+ */
+void console_flush_all(void) {
+    uint8_t t;
+
+    for(t = 0; t < NUM_CONSOLES; t++)
+        console_flush(t);
+}
+
+/*
+ * console_show
+ *   DESCRIPTION: Puts another terminal on the screen. Both are flushed first, then the screen
+ *                is saved to the old terminal's backing page and the new one's page is copied
+ *                in. Whole pages are swapped rather than redrawn from the shadows, they also
+ *                hold what programs drew through vidmap. On the framebuffer the new terminal
+ *                is redrawn from its shadow. A terminal shown for the first time gets blank
+ *                pages then, boot doesn't set up screens nobody may look at.
+ *   INPUTS: from - terminal on the screen now
+ *           to - terminal to show
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Rewrites the screen
+ */
+void console_show(uint8_t from, uint8_t to) {
+    uint32_t flags;
+
+    if(from >= NUM_CONSOLES || to >= NUM_CONSOLES || from == to)
+        return;
+
+    spin_lock_irqsave(&console_lock, flags);
+    if(!(console_ready & (1 << to))) {
+        memset_word(consoles[to].cells, CONSOLE_BLANK, NUM_ROWS * NUM_COLS);
+        memset_word((void*)CONSOLE_BACKING(to), CONSOLE_BLANK, NUM_ROWS * NUM_COLS);
+        consoles[to].dirty = 0;
+        console_ready |= 1 << to;
+    }
+    console_flush_locked(from);
+    console_flush_locked(to);
+    if(fb_active()) {
+        console_shown = to;
+        consoles[to].dirty = CONSOLE_ALL_ROWS;
+        console_flush_locked(to);
+    } else {
+        memcpy((void*)CONSOLE_BACKING(from), (void*)VIDEO, CONSOLE_BYTES);
+        memcpy((void*)VIDEO, (void*)CONSOLE_BACKING(to), CONSOLE_BYTES);
+        console_shown = to;
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/*
+ * console_use_fb
+ *   DESCRIPTION: Moves the console to the framebuffer: switches the display mode, keeps what
+ *                the shown terminal had on the screen in its backing page and draws it again
+ *                from its shadow. Does nothing if the framebuffer is on already.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if there is no framebuffer
+ *   SIDE EFFECTS: Leaves text mode for good
+ */
+int32_t console_use_fb(void) {
+    uint32_t flags;
+    int32_t ret = 0;
+
+    spin_lock_irqsave(&console_lock, flags);
+    if(!fb_active()) {
+        console_flush_locked(console_shown);
+        memcpy((void*)CONSOLE_BACKING(console_shown), (void*)VIDEO, CONSOLE_BYTES);
+        ret = fb_enable();
+        if(ret == 0) {
+            consoles[console_shown].dirty = CONSOLE_ALL_ROWS;
+            console_flush_locked(console_shown);
+        }
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+
+    return ret;
+}
+
+/*
+ * console_flush_tasklet
+ *   DESCRIPTION: Periodic flush, for output nobody flushed.
+ *   INPUTS: data - unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Writes video memory
+ */
+static void console_flush_tasklet(uint32_t data) {
+    console_flush_all();
+}
+
+/*
+ * console_tick
+ *   DESCRIPTION: Schedules the periodic flush every console_flush_ticks RTC interrupts.
+ *   INPUTS: ticks - RTC interrupts since boot
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May schedule a tasklet
+ */
+void console_tick(uint32_t ticks) {
+    if((ticks & (console_flush_ticks - 1)) == 0)
+        tasklet_schedule(&console_flush_work);
+}
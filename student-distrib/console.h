@@ -0,0 +1,48 @@
+/* console.h - Shadow cell buffers of the terminals, flushed to video memory by dirty row */
+
+#ifndef _CONSOLE_H
+#define _CONSOLE_H
+
+#include "types.h"
+#include "lib.h"
+
+#define NUM_CONSOLES        3
+#define CONSOLE_FLUSH_TICKS 16          /* RTC interrupts between periodic flushes (64 a second, power of two) */
+#define CONSOLE_MAX_FLUSH_TICKS 1024    /* Most console.flush may be set to */
+#define CONSOLE_ALL_ROWS    ((1 << NUM_ROWS) - 1)
+#define CONSOLE_BLANK       0x0720      /* Space, light gray on black */
+
+/* Where a terminal's screen lives while another one is shown */
+#define CONSOLE_BACKING(t)  (VIDEO + ((t) + 1) * 4096)
+
+/* What the kernel last drew on a terminal, and the rows video memory hasn't caught up with */
+typedef struct console {
+    uint16_t cells[NUM_ROWS * NUM_COLS];
+    volatile uint32_t dirty;            /* Bit y set: row y changed since the last flush */
+} console_t;
+
+/* RTC interrupts between periodic flushes, CONSOLE_FLUSH_TICKS unless console.flush says otherwise */
+extern uint32_t console_flush_ticks;
+
+/* Make the screen functions in lib.c draw into a terminal's shadow buffer */
+void console_select(uint8_t t);
+
+/* Shadow cells of a terminal */
+uint16_t* console_cells(uint8_t t);
+
+/* Copy a terminal's dirty rows to its video memory (the screen or its backing page) */
+void console_flush(uint8_t t);
+
+/* console_flush every terminal */
+void console_flush_all(void);
+
+/* Flush both terminals, then swap the screen from one to the other */
+void console_show(uint8_t from, uint8_t to);
+
+/* Draw the shown terminal on the framebuffer from now on */
+int32_t console_use_fb(void);
+
+/* Called from the RTC interrupt every tick, schedules the periodic flush */
+void console_tick(uint32_t ticks);
+
+#endif /* _CONSOLE_H */
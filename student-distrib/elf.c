@@ -0,0 +1,220 @@
+/* elf.c - ELF32 executable loader
+ *
+ * Every PT_LOAD segment is mapped at its page aligned address in the new process' page table.
+ * Pages holding file data are filled in right away. The rest of a segment (BSS) is left
+ * unmapped and gets zeroed pages on first touch from the page fault handler. Pages of read
+ * only segments are kept in a small cache and mapped read only into every instance of the
+ * same program, so they are read from the file system and stored only once.
+ */
+
+#include "elf.h"
+#include "lib.h"
+#include "paging.h"
+#include "filesys.h"
+
+/* A read only page of a program, the cache holds one reference to the frame */
+typedef struct text_page {
+    uint32_t inode;
+    uint32_t vaddr;
+    uint8_t* frame;         // NULL if the slot is free
+} text_page_t;
+
+static text_page_t text_cache[TEXT_CACHE_SIZE];
+uint32_t text_cache_slots = TEXT_CACHE_SIZE;
+
+/*
+ * fill_page
+ *   DESCRIPTION: Copies the part of a segment's file data that falls into one page into a frame.
+ *   INPUTS: inode - executable
+ *           page - page aligned user address the frame is for
+ *           ph - segment the page belongs to
+ *           frame - frame to fill, bytes outside of the file data are left alone
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the file can't be read
+ *   SIDE EFFECTS: none
+ */
+static int32_t fill_page(uint32_t inode, uint32_t page, const elf_phdr_t* ph, uint8_t* frame) {
+    uint32_t start = (ph->vaddr > page) ? ph->vaddr : page;
+    uint32_t end = ph->vaddr + ph->filesz;
+
+    if(end > page + FRAME_SIZE)
+        end = page + FRAME_SIZE;
+    if(start >= end)
+        return 0;
+
+    if(read_data(inode, ph->offset + (start - ph->vaddr), frame + (start - page), end - start) != (int32_t)(end - start))
+        return -1;
+    return 0;
+}
+
+/*
+ * load_page
+ *   DESCRIPTION: Gets a zeroed frame holding a segment's file data for one page.
+ *   INPUTS: inode - executable
+ *           page - page aligned user address
+ *           ph - segment the page belongs to
+ *   OUTPUTS: none
+ *   RETURN VALUE: the frame, NULL on failure
+ *   SIDE EFFECTS: Takes a frame from the frame pool
+ */
+static uint8_t* load_page(uint32_t inode, uint32_t page, const elf_phdr_t* ph) {
+    uint8_t* frame = (uint8_t*)alloc_frame();
+
+    if(frame == NULL)
+        return NULL;
+
+    memset(frame, 0, FRAME_SIZE);
+    if(fill_page(inode, page, ph, frame) == -1){
+        free_frame(frame);
+        return NULL;
+    }
+    return frame;
+}
+
+/*
+ * text_page
+ *   DESCRIPTION: Gets the frame of a read only page, from the cache if another instance of the
+ *                program already loaded it. A new page goes into a free slot or replaces one no
+ *                process maps anymore; if there is none it is simply not cached.
+ *   INPUTS: inode - executable
+ *           page - page aligned user address
+ *           ph - segment the page belongs to
+ *   OUTPUTS: none
+ *   RETURN VALUE: the frame with a reference for the caller, NULL on failure
+ *   SIDE EFFECTS: May take a frame from the frame pool
+ */
+static uint8_t* text_page(uint32_t inode, uint32_t page, const elf_phdr_t* ph) {
+    text_page_t* slot = NULL;
+    uint8_t* frame;
+    int i;
+
+    for(i = 0; i < TEXT_CACHE_SIZE; i++){
+        if(text_cache[i].frame != NULL && text_cache[i].inode == inode && text_cache[i].vaddr == page){
+            frame_get(text_cache[i].frame);
+            return text_cache[i].frame;
+        }
+    }
+
+    frame = load_page(inode, page, ph);
+    if(frame == NULL)
+        return NULL;
+
+    for(i = 0; i < text_cache_slots && slot == NULL; i++){
+        if(text_cache[i].frame == NULL)
+            slot = &text_cache[i];
+    }
+    for(i = 0; i < text_cache_slots && slot == NULL; i++){
+        if(frame_refcount(text_cache[i].frame) == 1){
+            free_frame(text_cache[i].frame);
+            slot = &text_cache[i];
+        }
+    }
+
+    if(slot != NULL){
+        frame_get(frame);
+        slot->inode = inode;
+        slot->vaddr = page;
+        slot->frame = frame;
+    }
+    return frame;
+}
+
+/*
+ * elf_load
+ *   DESCRIPTION: Checks that a file is an i386 ELF32 executable whose PT_LOAD segments all lie in user
+ *                memory and maps them into a page table: read only segments first (shared through the
+ *                text cache), then writable ones (private copies). A page two segments share becomes a
+ *                private writable page holding both.
+ *   INPUTS: inode - executable
+ *           page_table - empty user page table of the new process
+ *   OUTPUTS: entry - the program's entry point
+ *   RETURN VALUE: 0 on success, -1 on failure (pages mapped so far stay in the page table)
+ *   SIDE EFFECTS: Takes frames from the frame pool, flushes the TLB
+ */
+int32_t elf_load(uint32_t inode, uint32_t* page_table, uint32_t* entry) {
+    elf_header_t hdr;
+    elf_phdr_t phdrs[ELF_MAX_PHDRS];
+    elf_phdr_t* ph;
+    uint32_t writable;
+    uint32_t page;
+    uint8_t* frame;
+    uint8_t* shared;
+    int32_t entry_ok = 0;
+    int i;
+
+    if(read_data(inode, 0, (uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr))
+        return -1;
+    if(hdr.magic != ELF_MAGIC || hdr.elf_class != ELF_CLASS_32 || hdr.data != ELF_DATA_LSB ||
+       hdr.type != ELF_TYPE_EXEC || hdr.machine != ELF_MACHINE_386 ||
+       hdr.phentsize != sizeof(elf_phdr_t) || hdr.phnum == 0 || hdr.phnum > ELF_MAX_PHDRS)
+        return -1;
+    if(read_data(inode, hdr.phoff, (uint8_t*)phdrs, hdr.phnum * sizeof(elf_phdr_t)) != (int32_t)(hdr.phnum * sizeof(elf_phdr_t)))
+        return -1;
+
+    for(i = 0; i < hdr.phnum; i++){
+        ph = &phdrs[i];
+        if(ph->type != ELF_PT_LOAD)
+            continue;
+        if(ph->filesz > ph->memsz || ph->vaddr < USER_PAGES_START || ph->vaddr >= USER_PAGES_END ||
+           ph->memsz > USER_PAGES_END - ph->vaddr)
+            return -1;
+        if(hdr.entry >= ph->vaddr && hdr.entry < ph->vaddr + ph->memsz)
+            entry_ok = 1;
+    }
+    if(!entry_ok)
+        return -1;
+
+    for(writable = 0; writable <= 1; writable++){
+        for(i = 0; i < hdr.phnum; i++){
+            ph = &phdrs[i];
+            if(ph->type != ELF_PT_LOAD || ((ph->flags & ELF_PF_W) != 0) != writable)
+                continue;
+
+            // Only pages with file data, the BSS is filled with zeroed pages when it is touched
+            for(page = ph->vaddr & ~(FRAME_SIZE - 1); page < ph->vaddr + ph->filesz; page += FRAME_SIZE){
+                shared = (uint8_t*)user_page_frame(page_table, page);
+                if(shared != NULL){
+                    frame = (uint8_t*)alloc_frame();
+                    if(frame == NULL)
+                        return -1;
+                    memcpy(frame, shared, FRAME_SIZE);
+                    if(fill_page(inode, page, ph, frame) == -1){
+                        free_frame(frame);
+                        return -1;
+                    }
+                    map_user_page(page_table, page, frame, 1);
+                    continue;
+                }
+
+                frame = writable ? load_page(inode, page, ph) : text_page(inode, page, ph);
+                if(frame == NULL)
+                    return -1;
+                map_user_page(page_table, page, frame, writable);
+            }
+        }
+    }
+
+    flush_tlb();
+    *entry = hdr.entry;
+    return 0;
+}
+
+/*
+ * elf_forget_inode
+ *   DESCRIPTION: Drops the cached text pages of a file. Running instances keep the pages they map,
+ *                new ones load the changed file.
+ *   INPUTS: inode - file that is about to change
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May return frames to the frame pool
+ */
+void elf_forget_inode(uint32_t inode) {
+    int i;
+
+    for(i = 0; i < TEXT_CACHE_SIZE; i++){
+        if(text_cache[i].frame != NULL && text_cache[i].inode == inode){
+            free_frame(text_cache[i].frame);
+            text_cache[i].frame = NULL;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+/* elf.h - Defines used for loading ELF32 executables */
+
+#ifndef _ELF_H
+#define _ELF_H
+
+#include "types.h"
+
+#define ELF_MAGIC           0x464C457F  // "\x7F" "ELF" read as a little endian word
+#define ELF_CLASS_32        1
+#define ELF_DATA_LSB        1
+#define ELF_TYPE_EXEC       2
+#define ELF_MACHINE_386     3
+#define ELF_PT_LOAD         1           // Program header type of a segment to map
+#define ELF_PF_W            0x2         // Segment flag: writable
+#define ELF_MAX_PHDRS       16          // Most program headers an executable may have
+#define TEXT_CACHE_SIZE     64          // Read only pages that can be kept for sharing between instances
+
+/* File header */
+typedef struct elf_header {
+    uint32_t magic;
+    uint8_t elf_class;
+    uint8_t data;
+    uint8_t ident_version;
+    uint8_t ident_pad[9];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint32_t entry;
+    uint32_t phoff;
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} __attribute__((packed)) elf_header_t;
+
+/* Program header */
+typedef struct elf_phdr {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+} __attribute__((packed)) elf_phdr_t;
+
+/* Text cache slots in use, TEXT_CACHE_SIZE unless cache.text says otherwise (0 turns sharing off) */
+extern uint32_t text_cache_slots;
+
+/* Map the PT_LOAD segments of an executable into a user page table */
+int32_t elf_load(uint32_t inode, uint32_t* page_table, uint32_t* entry);
+
+/* Drop cached text pages of a file that is being changed */
+void elf_forget_inode(uint32_t inode);
+
+#endif /* _ELF_H */
@@ -0,0 +1,281 @@
+/* fb.c - Linear framebuffer through the Bochs/QEMU VBE "DISPI" registers
+ *
+ * fb_enable switches the Bochs/QEMU VGA to FB_WIDTH x FB_HEIGHT at 32 bits per pixel, after
+ * copying the text mode font out of VGA plane 2 (the framebuffer shares that memory). Text is
+ * drawn a whole row of cells at a time: every glyph line is looked up in a table of pixel masks
+ * built once from the font, the 8 pixels are written as 32-bit words into a band in RAM, and
+ * the band goes to the framebuffer in one copy of FONT_HEIGHT whole pixel lines.
+ */
+
+#include "fb.h"
+#include "paging.h"
+
+static uint32_t fb_on = 0;
+static uint32_t fb_addr = 0;                        // Physical address of the framebuffer
+static uint32_t font_loaded = 0;
+
+static uint8_t font[FONT_GLYPHS][FONT_HEIGHT];     // Line bitmaps, bit 7 is the leftmost pixel
+static uint32_t line_masks[FONT_GLYPHS][FONT_WIDTH];    // Line bitmap -> all-ones word per lit pixel
+
+// One text row in pixels, what fb_draw_rows copies to the framebuffer
+static uint32_t fb_band[FONT_HEIGHT * FB_WIDTH] __attribute__((aligned(16)));
+
+// VGA text colors in 0x00RRGGBB
+static const uint32_t fb_palette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+/*
+ * dispi_write
+ *   DESCRIPTION: Writes a DISPI register.
+ *   INPUTS: index - VBE_DISPI_INDEX_* register
+ *           value - value to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Programs the display adapter
+ */
+static void dispi_write(uint16_t index, uint16_t value) {
+    outw(index, VBE_DISPI_INDEX_PORT);
+    outw(value, VBE_DISPI_DATA_PORT);
+}
+
+/*
+ * dispi_read
+ *   DESCRIPTION: Reads a DISPI register.
+ *   INPUTS: index - VBE_DISPI_INDEX_* register
+ *   OUTPUTS: none
+ *   RETURN VALUE: value of the register
+ *   SIDE EFFECTS: none
+ */
+static uint16_t dispi_read(uint16_t index) {
+    outw(index, VBE_DISPI_INDEX_PORT);
+    return inw(VBE_DISPI_DATA_PORT);
+}
+
+/*
+ * pci_read
+ *   DESCRIPTION: Reads a dword of a PCI device's configuration space on bus 0.
+ *   INPUTS: dev - device number
+ *           reg - offset of the dword
+ *   OUTPUTS: none
+ *   RETURN VALUE: the dword, all ones if there is no device
+ *   SIDE EFFECTS: none
+ */
+static uint32_t pci_read(uint32_t dev, uint32_t reg) {
+    outl(PCI_CONFIG_ENABLE | (dev << 11) | (reg & 0xFC), PCI_CONFIG_ADDR);
+    return inl(PCI_CONFIG_DATA);
+}
+
+/*
+ * fb_find
+ *   DESCRIPTION: Looks for the Bochs/QEMU VGA on PCI bus 0 and takes the framebuffer address
+ *                from its first BAR.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the framebuffer, VBE_LFB_DEFAULT if the device isn't found
+ *   SIDE EFFECTS: none
+ */
+static uint32_t fb_find(void) {
+    uint32_t dev;
+
+    for(dev = 0; dev < PCI_DEVICES; dev++) {
+        if(pci_read(dev, 0) == BOCHS_VGA_ID)
+            return pci_read(dev, PCI_BAR0) & PCI_BAR_MEM_MASK;
+    }
+    return VBE_LFB_DEFAULT;
+}
+
+/*
+ * vga_read_reg
+ *   DESCRIPTION: Reads an indexed VGA register.
+ *   INPUTS: port - index port of the register group
+ *           index - register number
+ *   OUTPUTS: none
+ *   RETURN VALUE: value of the register
+ *   SIDE EFFECTS: none
+ */
+static uint8_t vga_read_reg(uint16_t port, uint8_t index) {
+    outb(index, port);
+    return inb(port + 1);
+}
+
+/*
+ * fb_load_font
+ *   DESCRIPTION: Copies the font the BIOS loaded for text mode out of VGA plane 2 and builds the
+ *                mask table: for every possible glyph line, one word per pixel that is all ones
+ *                if the pixel is lit. Has to run while the adapter is still in text mode.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0
+ *   SIDE EFFECTS: Briefly reprograms the sequencer and graphics controller
+ */
+int32_t fb_load_font(void) {
+    uint8_t seq_mask, seq_mem, gc_read, gc_mode, gc_misc;
+    uint8_t* plane = (uint8_t*)VGA_FONT_ADDR;
+    uint32_t flags;
+    int g, x;
+
+    if(font_loaded)
+        return 0;
+
+    cli_and_save(flags);
+    seq_mask = vga_read_reg(VGA_SEQ_PORT, 0x2);
+    seq_mem = vga_read_reg(VGA_SEQ_PORT, 0x4);
+    gc_read = vga_read_reg(VGA_GC_PORT, 0x4);
+    gc_mode = vga_read_reg(VGA_GC_PORT, 0x5);
+    gc_misc = vga_read_reg(VGA_GC_PORT, 0x6);
+
+    // Plane 2 only, sequential addressing, mapped at 0xA0000
+    outw(0x0402, VGA_SEQ_PORT);
+    outw(0x0704, VGA_SEQ_PORT);
+    outw(0x0204, VGA_GC_PORT);
+    outw(0x0005, VGA_GC_PORT);
+    outw(0x0406, VGA_GC_PORT);
+
+    map_low_pages(VGA_FONT_ADDR, VGA_FONT_ADDR + FONT_GLYPHS * VGA_FONT_STRIDE, 1);
+    for(g = 0; g < FONT_GLYPHS; g++)
+        memcpy(font[g], plane + g * VGA_FONT_STRIDE, FONT_HEIGHT);
+    map_low_pages(VGA_FONT_ADDR, VGA_FONT_ADDR + FONT_GLYPHS * VGA_FONT_STRIDE, 0);
+
+    outw((seq_mask << 8) | 0x2, VGA_SEQ_PORT);
+    outw((seq_mem << 8) | 0x4, VGA_SEQ_PORT);
+    outw((gc_read << 8) | 0x4, VGA_GC_PORT);
+    outw((gc_mode << 8) | 0x5, VGA_GC_PORT);
+    outw((gc_misc << 8) | 0x6, VGA_GC_PORT);
+    restore_flags(flags);
+
+    for(g = 0; g < FONT_GLYPHS; g++) {
+        for(x = 0; x < FONT_WIDTH; x++)
+            line_masks[g][x] = (g & (0x80 >> x)) ? 0xFFFFFFFF : 0;
+    }
+
+    font_loaded = 1;
+    return 0;
+}
+
+/*
+ * fb_enable
+ *   DESCRIPTION: Switches the display to the framebuffer, FB_WIDTH x FB_HEIGHT at 32 bits per
+ *                pixel, and maps it for the kernel. Needs the Bochs/QEMU VGA.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if there is no DISPI interface or the framebuffer doesn't
+ *                 fit in one 4MB page
+ *   SIDE EFFECTS: Leaves text mode for good, the console draws through fb_draw_rows from now on
+ */
+int32_t fb_enable(void) {
+    uint16_t id;
+
+    if(fb_on)
+        return 0;
+
+    id = dispi_read(VBE_DISPI_INDEX_ID);
+    if(id < VBE_DISPI_ID_MIN || id > VBE_DISPI_ID_MAX)
+        return -1;
+
+    fb_addr = fb_find();
+    if(fb_addr & (FOUR_MB - 1))
+        return -1;
+
+    // The font lives in video memory the framebuffer is about to cover
+    fb_load_font();
+
+    dispi_write(VBE_DISPI_INDEX_ENABLE, 0);
+    dispi_write(VBE_DISPI_INDEX_XRES, FB_WIDTH);
+    dispi_write(VBE_DISPI_INDEX_YRES, FB_HEIGHT);
+    dispi_write(VBE_DISPI_INDEX_BPP, FB_BPP);
+    dispi_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED);
+
+    map_mmio(fb_addr);
+    fb_on = 1;
+    return 0;
+}
+
+/*
+ * fb_active
+ *   DESCRIPTION: Tells whether the display is in framebuffer mode.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 once fb_enable succeeded, 0 in text mode
+ *   SIDE EFFECTS: none
+ */
+uint32_t fb_active(void) {
+    return fb_on;
+}
+
+/*
+ * fb_phys
+ *   DESCRIPTION: Physical address of the framebuffer.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the address, 0 before fb_enable
+ *   SIDE EFFECTS: none
+ */
+uint32_t fb_phys(void) {
+    return fb_addr;
+}
+
+/*
+ * fb_render_row
+ *   DESCRIPTION: Draws NUM_COLS text cells as FONT_HEIGHT lines of pixels. Each glyph line is
+ *                8 masked words, background where the mask is clear and foreground where it's
+ *                set; the blink bit of the attribute is ignored.
+ *   INPUTS: cells - attribute << 8 | character of every cell
+ *           dst - top left pixel
+ *           pitch - pixels from one line to the next
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void fb_render_row(const uint16_t* cells, uint32_t* dst, uint32_t pitch) {
+    const uint8_t* glyph;
+    const uint32_t* mask;
+    uint32_t fg, bg, diff;
+    uint32_t* p;
+    int x, line;
+
+    for(x = 0; x < NUM_COLS; x++) {
+        glyph = font[cells[x] & 0xFF];
+        fg = fb_palette[(cells[x] >> 8) & 0xF];
+        bg = fb_palette[(cells[x] >> 12) & 0x7];
+        diff = fg ^ bg;
+
+        p = dst + x * FONT_WIDTH;
+        for(line = 0; line < FONT_HEIGHT; line++, p += pitch) {
+            mask = line_masks[glyph[line]];
+            p[0] = bg ^ (diff & mask[0]);
+            p[1] = bg ^ (diff & mask[1]);
+            p[2] = bg ^ (diff & mask[2]);
+            p[3] = bg ^ (diff & mask[3]);
+            p[4] = bg ^ (diff & mask[4]);
+            p[5] = bg ^ (diff & mask[5]);
+            p[6] = bg ^ (diff & mask[6]);
+            p[7] = bg ^ (diff & mask[7]);
+        }
+    }
+}
+
+/*
+ * fb_draw_rows
+ *   DESCRIPTION: Draws text rows on the framebuffer, each one rendered into a band in RAM and
+ *                copied out in one go (whole lines, so one contiguous copy per row).
+ *   INPUTS: cells - NUM_ROWS * NUM_COLS cells of the screen
+ *           top - first row to draw
+ *           end - row past the last one
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Writes the framebuffer
+ */
+void fb_draw_rows(const uint16_t* cells, int top, int end) {
+    uint32_t* fb = (uint32_t*)fb_addr;
+    int y;
+
+    if(!fb_on)
+        return;
+
+    for(y = top; y < end && y < NUM_ROWS; y++) {
+        fb_render_row(cells + y * NUM_COLS, fb_band, FB_WIDTH);
+        memcpy(fb + (FB_TEXT_TOP + y * FONT_HEIGHT) * FB_WIDTH, fb_band, sizeof(fb_band));
+    }
+}
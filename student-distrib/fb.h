@@ -0,0 +1,76 @@
+/* fb.h - Linear framebuffer through the Bochs/QEMU VBE "DISPI" registers */
+
+#ifndef _FB_H
+#define _FB_H
+
+#include "types.h"
+#include "lib.h"
+
+/* DISPI registers, selected through the index port */
+#define VBE_DISPI_INDEX_PORT    0x01CE
+#define VBE_DISPI_DATA_PORT     0x01CF
+#define VBE_DISPI_INDEX_ID      0x0
+#define VBE_DISPI_INDEX_XRES    0x1
+#define VBE_DISPI_INDEX_YRES    0x2
+#define VBE_DISPI_INDEX_BPP     0x3
+#define VBE_DISPI_INDEX_ENABLE  0x4
+#define VBE_DISPI_ID_MIN        0xB0C2      // First version with 32 bits per pixel
+#define VBE_DISPI_ID_MAX        0xB0C5
+#define VBE_DISPI_ENABLED       0x01
+#define VBE_DISPI_LFB_ENABLED   0x40
+#define VBE_LFB_DEFAULT         0xE0000000  // Where Bochs puts the framebuffer if PCI doesn't say
+
+/* PCI configuration space, mechanism #1, to find the framebuffer of the Bochs/QEMU VGA */
+#define PCI_CONFIG_ADDR         0xCF8
+#define PCI_CONFIG_DATA         0xCFC
+#define PCI_CONFIG_ENABLE       0x80000000
+#define PCI_BAR0                0x10
+#define PCI_BAR_MEM_MASK        0xFFFFFFF0
+#define PCI_DEVICES             32
+#define BOCHS_VGA_ID            0x11111234  // Device 0x1111 << 16 | vendor 0x1234
+
+/* VGA registers used to read the BIOS font out of plane 2 */
+#define VGA_SEQ_PORT            0x3C4
+#define VGA_GC_PORT             0x3CE
+#define VGA_FONT_ADDR           0xA0000
+#define VGA_FONT_STRIDE         32          // Bytes per glyph in plane 2, only FONT_HEIGHT are used
+
+/* Mode the framebuffer is set to, and the text the console draws on it */
+#define FB_WIDTH                640
+#define FB_HEIGHT               480
+#define FB_BPP                  32
+#define FB_PITCH                (FB_WIDTH * 4)
+#define FB_SIZE                 (FB_PITCH * FB_HEIGHT)
+#define FONT_WIDTH              8
+#define FONT_HEIGHT             16
+#define FONT_GLYPHS             256
+#define FB_TEXT_TOP             ((FB_HEIGHT - NUM_ROWS * FONT_HEIGHT) / 2)     // Text is centered vertically
+
+/* What fbmap hands to user space */
+typedef struct fb_info {
+    uint32_t addr;                      // Virtual address of the first pixel
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;                     // Bytes per line
+    uint32_t bpp;
+} fb_info_t;
+
+/* Switch to the framebuffer mode, does nothing if it's on already */
+int32_t fb_enable(void);
+
+/* 1 once fb_enable succeeded */
+uint32_t fb_active(void);
+
+/* Physical address of the framebuffer */
+uint32_t fb_phys(void);
+
+/* Copy the VGA font out of plane 2 and build the glyph masks, done once */
+int32_t fb_load_font(void);
+
+/* Draw one row of text cells as pixels, pitch in pixels */
+void fb_render_row(const uint16_t* cells, uint32_t* dst, uint32_t pitch);
+
+/* Draw text rows top up to end (not included) on the framebuffer */
+void fb_draw_rows(const uint16_t* cells, int top, int end);
+
+#endif /* _FB_H */
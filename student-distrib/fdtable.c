@@ -0,0 +1,236 @@
+/* fdtable.c - Growable file descriptor tables
+ *
+ * A table starts with FD_TABLE_INIT descriptors stored inside it and moves to a frame
+ * holding MAX_FILES descriptors the first time it fills up. Free descriptors are tracked
+ * in a bitmap, so finding the lowest free one is a bit scan per 32 descriptors.
+ */
+
+#include "fdtable.h"
+#include "lib.h"
+#include "paging.h"
+
+/* One table per process */
+static fd_table_t fd_tables[MAX_TASKS];
+
+/*
+ * lowest_set_bit
+ *   DESCRIPTION: Index of the lowest set bit using bsf.
+ *   INPUTS: bits - word to scan, must not be 0
+ *   OUTPUTS: none
+ *   RETURN VALUE: bit index
+ *   SIDE EFFECTS: none
+ */
+static inline uint32_t lowest_set_bit(uint32_t bits) {
+    uint32_t idx;
+    asm volatile("bsfl %1, %0" : "=r"(idx) : "rm"(bits) : "cc");
+    return idx;
+}
+
+/*
+ * fd_table_alloc
+ *   DESCRIPTION: Finds an unused table and resets it to FD_TABLE_INIT closed descriptors.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the table, NULL if all tables are in use
+ *   SIDE EFFECTS: none
+ */
+fd_table_t* fd_table_alloc(void) {
+    uint32_t flags;
+    fd_table_t* table;
+    int i;
+
+    cli_and_save(flags);
+    for(i = 0; i < MAX_TASKS; i++){
+        table = &fd_tables[i];
+        if(!table->in_use){
+            table->in_use = 1;
+            table->size = FD_TABLE_INIT;
+            table->fds = table->inline_fds;
+            memset(table->inline_fds, 0, sizeof(table->inline_fds));
+            memset(table->free_map, 0, sizeof(table->free_map));
+            table->free_map[0] = (1 << FD_TABLE_INIT) - 1;
+            restore_flags(flags);
+            return table;
+        }
+    }
+    restore_flags(flags);
+    return NULL;
+}
+
+/*
+ * fd_table_free
+ *   DESCRIPTION: Frees a table, and its frame if it grew.
+ *   INPUTS: table - table to release
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May return a frame to the frame pool
+ */
+void fd_table_free(fd_table_t* table) {
+    uint32_t flags;
+
+    if(table == NULL)
+        return;
+
+    cli_and_save(flags);
+    if(table->in_use){
+        table->in_use = 0;
+        if(table->fds != table->inline_fds)
+            free_frame(table->fds);
+        table->fds = table->inline_fds;
+        table->size = FD_TABLE_INIT;
+    }
+    restore_flags(flags);
+}
+
+/*
+ * fd_table_grow
+ *   DESCRIPTION: Moves a full table's descriptors into a frame with room for MAX_FILES.
+ *   INPUTS: table - table to grow
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the table is at its largest or no frame is left
+ *   SIDE EFFECTS: Takes a frame from the frame pool
+ */
+static int32_t fd_table_grow(fd_table_t* table) {
+    file_descriptor_t* fds;
+    uint32_t fd;
+
+    if(table->size >= MAX_FILES)
+        return -1;
+
+    fds = (file_descriptor_t*)alloc_frame();
+    if(fds == NULL)
+        return -1;
+
+    memset(fds, 0, MAX_FILES * sizeof(file_descriptor_t));
+    memcpy(fds, table->fds, table->size * sizeof(file_descriptor_t));
+
+    for(fd = table->size; fd < MAX_FILES; fd++)
+        table->free_map[fd / 32] |= (1 << (fd % 32));
+
+    table->fds = fds;
+    table->size = MAX_FILES;
+    return 0;
+}
+
+/*
+ * fd_table_copy
+ *   DESCRIPTION: Gives dst a copy of every descriptor in src (file positions included). The drivers are
+ *                not told, callers take whatever references the copies need.
+ *   INPUTS: dst - table to fill, its own descriptors are dropped without being closed
+ *           src - table to copy
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if dst can't grow to the size of src
+ *   SIDE EFFECTS: May grow dst
+ */
+int32_t fd_table_copy(fd_table_t* dst, const fd_table_t* src) {
+    uint32_t flags;
+    uint32_t fd;
+
+    if(dst == NULL || src == NULL)
+        return -1;
+
+    cli_and_save(flags);
+    if(dst->size < src->size && fd_table_grow(dst) == -1){
+        restore_flags(flags);
+        return -1;
+    }
+    memset(dst->fds, 0, dst->size * sizeof(file_descriptor_t));
+    memcpy(dst->fds, src->fds, src->size * sizeof(file_descriptor_t));
+    memcpy(dst->free_map, src->free_map, sizeof(dst->free_map));
+
+    // dst may be the bigger table, the descriptors src doesn't have are free
+    for(fd = src->size; fd < dst->size; fd++)
+        dst->free_map[fd / 32] |= (1 << (fd % 32));
+    restore_flags(flags);
+
+    return 0;
+}
+
+/*
+ * fd_alloc
+ *   DESCRIPTION: Reserves the lowest free descriptor at or above min_fd. The caller fills it in.
+ *   INPUTS: table - table to allocate from
+ *           min_fd - lowest descriptor that may be returned
+ *   OUTPUTS: none
+ *   RETURN VALUE: the descriptor number, -1 if the table is full and can't grow
+ *   SIDE EFFECTS: May grow the table
+ */
+int32_t fd_alloc(fd_table_t* table, int32_t min_fd) {
+    uint32_t flags;
+    uint32_t word;
+    uint32_t bits;
+    int32_t fd;
+
+    if(table == NULL || min_fd < 0 || min_fd >= MAX_FILES)
+        return -1;
+
+    cli_and_save(flags);
+    do {
+        for(word = min_fd / 32; word < FD_MAP_WORDS; word++){
+            bits = table->free_map[word];
+            if(word == min_fd / 32)
+                bits &= ~0U << (min_fd % 32);
+            if(bits != 0){
+                fd = word * 32 + lowest_set_bit(bits);
+                table->free_map[word] &= ~(1 << (fd % 32));
+                restore_flags(flags);
+                return fd;
+            }
+        }
+    } while(fd_table_grow(table) == 0);
+    restore_flags(flags);
+
+    return -1;
+}
+
+/*
+ * fd_install
+ *   DESCRIPTION: Copies a descriptor into a slot (reserved or not) and marks it open.
+ *   INPUTS: table - table to install into
+ *           fd - slot to use
+ *           desc - descriptor to copy
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Overwrites whatever was in the slot
+ */
+void fd_install(fd_table_t* table, int32_t fd, const file_descriptor_t* desc) {
+    if(table == NULL || fd < 0 || fd >= table->size)
+        return;
+
+    table->fds[fd] = *desc;
+    table->fds[fd].flags = desc->flags | FD_IN_USE;      // Copies keep O_NONBLOCK
+    table->free_map[fd / 32] &= ~(1 << (fd % 32));
+}
+
+/*
+ * fd_free
+ *   DESCRIPTION: Marks a descriptor closed so fd_alloc can hand it out again.
+ *   INPUTS: table - table the descriptor is in
+ *           fd - descriptor to free
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void fd_free(fd_table_t* table, int32_t fd) {
+    if(table == NULL || fd < 0 || fd >= table->size)
+        return;
+
+    table->fds[fd].flags = 0;
+    table->fds[fd].file_pos = 0;
+    table->free_map[fd / 32] |= (1 << (fd % 32));
+}
+
+/*
+ * fd_get
+ *   DESCRIPTION: Looks up an open descriptor.
+ *   INPUTS: table - table to look in
+ *           fd - descriptor number
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the descriptor, NULL if fd is out of range or closed
+ *   SIDE EFFECTS: none
+ */
+file_descriptor_t* fd_get(fd_table_t* table, int32_t fd) {
+    if(table == NULL || fd < 0 || fd >= table->size || table->fds[fd].flags == 0)
+        return NULL;
+    return &table->fds[fd];
+}
@@ -0,0 +1,30 @@
+/* fdtable.h - Growable file descriptor tables */
+
+#ifndef _FDTABLE_H
+#define _FDTABLE_H
+
+#include "types.h"
+#include "syscallhandler.h"
+
+/* Get an empty table, NULL if none are left */
+fd_table_t* fd_table_alloc(void);
+
+/* Free a table (its descriptors must be closed already) */
+void fd_table_free(fd_table_t* table);
+
+/* Make dst hold the same open descriptors as src, growing dst if needed */
+int32_t fd_table_copy(fd_table_t* dst, const fd_table_t* src);
+
+/* Reserve the lowest free descriptor that is at least min_fd, growing the table if it is full */
+int32_t fd_alloc(fd_table_t* table, int32_t min_fd);
+
+/* Copy a descriptor into a slot and mark it open */
+void fd_install(fd_table_t* table, int32_t fd, const file_descriptor_t* desc);
+
+/* Mark a descriptor closed and free for reuse */
+void fd_free(fd_table_t* table, int32_t fd);
+
+/* Look up an open descriptor, NULL if fd is out of range or closed */
+file_descriptor_t* fd_get(fd_table_t* table, int32_t fd);
+
+#endif /* _FDTABLE_H */
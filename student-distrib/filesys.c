@@ -2,6 +2,12 @@
 
 #include "filesys.h"
 #include "lib.h"
+#include "paging.h"
+#include "syscallhandler.h"
+#include "uaccess.h"
+#include "fdtable.h"
+#include "elf.h"
+#include "spinlock.h"
 
 #define SUCCESS 0
 #define FAILURE -1
@@ -15,18 +21,166 @@ unsigned int file_index = 0;
 dentry_t dentry_1;
 dentry_t * dentry_1_ptr = &dentry_1;
 
+/* The boot image is never written. bb points at a RAM copy of the boot block so new
+ * dentries can be added, inode_table points each inode number either at the image inode
+ * or at a private RAM copy, and data block numbers >= image_data_count name RAM blocks. */
+static boot_block_t * image_bb;
+static inode_t * inode_table[MAX_INODES];
+static uint8_t inode_in_ram[MAX_INODES];
+static uint32_t image_data_count;
+static uint8_t * ram_blocks[MAX_RAM_BLOCKS];
+static uint16_t ram_block_free[MAX_RAM_BLOCKS];    // stack of free RAM block indices
+static uint32_t ram_block_free_top;
+
+/* Protects the RAM boot block's dentries, the inode copies and their block lists */
+static spinlock_t fs_lock = SPINLOCK_INIT("fs");
+
 /* MP3.2!!! 
 *  filesys_init  
  *   DESCRIPTION: creates the datastructure for our file system
  *   INPUTS: uint32_t boot_block_address
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *  
+ *   SIDE EFFECTS: copies the boot block into a frame so the RAM layer can add dentries
  */ 
 void filesys_init(uint32_t boot_block_address) {
-    bb = (boot_block_t *)boot_block_address; // boot block 
-    inode_init = (inode_t *)(bb+1); // inode block
-    db = (unsigned int *) (inode_init + (bb->inode_count)); // data block 
+    int i;
+
+    image_bb = (boot_block_t *)boot_block_address; // boot block 
+    inode_init = (inode_t *)(image_bb+1); // inode block
+    db = (unsigned int *) (inode_init + (image_bb->inode_count)); // data block 
+    image_data_count = image_bb->data_count;
+
+    // Writable copy of the boot block, fall back to the image if the pool is empty
+    bb = (boot_block_t *)alloc_frame();
+    if(bb == NULL)
+        bb = image_bb;
+    else
+        memcpy(bb, image_bb, BLOCK_SIZE);
+
+    for(i = 0; i < MAX_INODES; i++){
+        inode_table[i] = (i < image_bb->inode_count) ? (inode_init + i) : NULL;
+        inode_in_ram[i] = 0;
+    }
+
+    // Hand out low block indices first
+    for(i = 0; i < MAX_RAM_BLOCKS; i++){
+        ram_blocks[i] = NULL;
+        ram_block_free[i] = MAX_RAM_BLOCKS - 1 - i;
+    }
+    ram_block_free_top = MAX_RAM_BLOCKS;
+}
+
+/*
+ *  get_inode
+ *   DESCRIPTION: Looks up the current version of an inode (image or RAM copy).
+ *   INPUTS: uint32_t inode - inode number
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the inode, NULL if it does not exist
+ */
+static inode_t * get_inode(uint32_t inode) {
+    if(inode >= MAX_INODES)
+        return NULL;
+    return inode_table[inode];
+}
+
+/*
+ *  get_block
+ *   DESCRIPTION: Translates a data block number into the address of its 4KB of data.
+ *   INPUTS: uint32_t block_num - block number stored in an inode
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the block, NULL if the block number is invalid
+ */
+static uint8_t * get_block(uint32_t block_num) {
+    if(block_num < image_data_count)
+        return (uint8_t *)(inode_init + image_bb->inode_count + block_num);
+    if(block_num - image_data_count < MAX_RAM_BLOCKS)
+        return ram_blocks[block_num - image_data_count];
+    return NULL;
+}
+
+/*
+ *  alloc_ram_block
+ *   DESCRIPTION: Pops a free RAM block index and backs it with a zeroed frame, O(1).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: block number usable in an inode, FAILURE if out of space
+ */
+static int32_t alloc_ram_block() {
+    uint32_t idx;
+    uint32_t flags;
+    uint8_t * frame;
+
+    frame = (uint8_t *)alloc_frame();
+    if(frame == NULL)
+        return FAILURE;
+    memset(frame, 0, BLOCK_SIZE);
+
+    cli_and_save(flags);
+    if(ram_block_free_top == 0){
+        restore_flags(flags);
+        free_frame(frame);
+        return FAILURE;
+    }
+    idx = ram_block_free[--ram_block_free_top];
+    ram_blocks[idx] = frame;
+    restore_flags(flags);
+
+    return image_data_count + idx;
+}
+
+/*
+ *  free_ram_block
+ *   DESCRIPTION: Returns a RAM block to the free stack. Image blocks are ignored.
+ *   INPUTS: uint32_t block_num - block number stored in an inode
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ */
+static void free_ram_block(uint32_t block_num) {
+    uint32_t idx;
+    uint32_t flags;
+
+    if(block_num < image_data_count)
+        return;
+    idx = block_num - image_data_count;
+    if(idx >= MAX_RAM_BLOCKS || ram_blocks[idx] == NULL)
+        return;
+
+    cli_and_save(flags);
+    free_frame(ram_blocks[idx]);
+    ram_blocks[idx] = NULL;
+    ram_block_free[ram_block_free_top++] = idx;
+    restore_flags(flags);
+}
+
+/*
+ *  writable_inode
+ *   DESCRIPTION: Returns a RAM copy of an inode, copying it out of the image on first write.
+ *   INPUTS: uint32_t inode - inode number
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the writable inode, NULL on failure
+ *   SIDE EFFECTS: Drops cached text pages of the file, the caller holds fs_lock
+ */
+static inode_t * writable_inode(uint32_t inode) {
+    inode_t * copy;
+    inode_t * cur = get_inode(inode);
+
+    if(cur == NULL)
+        return NULL;
+
+    // New instances of a changed program must not get the old text
+    elf_forget_inode(inode);
+
+    if(inode_in_ram[inode])
+        return cur;
+
+    copy = (inode_t *)alloc_frame();
+    if(copy == NULL)
+        return NULL;
+    memcpy(copy, cur, BLOCK_SIZE);
+    inode_table[inode] = copy;
+    inode_in_ram[inode] = 1;
+    return copy;
 }
 
 /* MP3.2!!! 
@@ -42,7 +196,7 @@ int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry) {
      int string_comparison;
     
 
-    for(i=0; i<63; i++){  // here 63 is the number of directory entries
+    for(i=0; i<MAX_DENTRIES; i++){  // every directory entry the boot block has room for
           // compares the filename that inputs with the file name in the directory
         string_comparison = strncmp((int8_t*)fname,(int8_t*)bb->dentries[i].filename,32); // here 32 is the number of bytes to copy
 
@@ -80,12 +234,12 @@ int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry){
        int source; 
        int destination; 
 
-      if(index >= bb->inode_count && index <= 0)  {
+      if(index >= MAX_INODES)  {
         return FAILURE;
       }
 
       else {
-        for(i = 0; i<63; i++) { // here 63 is the number of directory entries
+        for(i = 0; i<MAX_DENTRIES; i++) { // every directory entry the boot block has room for
          // checks if the index passed by the user is equivalent to an entry in the directory
             if(index == bb->dentries[i].inode_num) {
                 source = (int) bb->dentries[i].filename;
@@ -107,6 +261,7 @@ int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry){
 /* MP3.2!!! 
 *  read_data  
  *   DESCRIPTION: The function reads data associated with files from the data block.
+ *                Copies a block-sized span at a time instead of byte by byte.
  *   INPUTS: uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length
  *   OUTPUTS: none
  *   RETURN VALUE: returns bytes read
@@ -114,49 +269,45 @@ int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry){
  */ 
 int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length) { 
 
-    int first_block; 
-    int starting_byte; 
-  
-    uint32_t block_num;
-    int i;
+    uint32_t copied = 0;
+    uint32_t block_off;
+    uint32_t chunk;
+    uint8_t* block;
     inode_t* cur_inode;
 
-
     // sets up current node
-    cur_inode = (inode_t*)(inode_init + inode);
-
-    // math done to figure out the starting block and starting byte to read from
-    first_block = offset/4096; // 4096 is the blocksize
-    starting_byte = offset%4096; // 4096 is the blocksize
-
-    for(i=0 ; i<length; i++){
+    cur_inode = get_inode(inode);
+    if(cur_inode == NULL){
+        return FAILURE;
+    }
 
-    // overflow check 
-    if(starting_byte >= 4096){ // 4096 is the blocksize
-      starting_byte = 0;
-      first_block++;
+    // sanity check, never read past the end of the file
+    if(offset >= cur_inode->length){
+        return 0;
+    }
+    if(length > cur_inode->length - offset){
+        length = cur_inode->length - offset;
     }
 
-    // figures out the current block number
-      block_num = cur_inode->data_block_num[first_block];
-      if(block_num >= bb->data_count){
-        return FAILURE;
-      }
+    while(copied < length){
+        // figures out the current block and where in it to start
+        block_off = (offset + copied) % BLOCK_SIZE;
+        block = get_block(cur_inode->data_block_num[(offset + copied) / BLOCK_SIZE]);
+        if(block == NULL){
+            return FAILURE;
+        }
 
-      // sanity check
-       if((i+offset) >= cur_inode->length ){
-        return i;
-      }
+        chunk = BLOCK_SIZE - block_off;
+        if(chunk > length - copied){
+            chunk = length - copied;
+        }
 
-      // populates the buffer with the data
-      buf[i] =   ((uint8_t*)(inode_init+bb->inode_count+block_num))[starting_byte];
-    
-      // read for next byte
-      starting_byte++; 
-      
+        // populates the buffer with the data
+        memcpy(buf + copied, block + block_off, chunk);
+        copied += chunk;
     }
 
-    return i;
+    return copied;
 
 }
 
@@ -177,7 +328,7 @@ int32_t read_file(int32_t inode_num, int32_t off, int32_t nbytes, void* buf) {
         // if(read_offset > nbytes){
         //   read_offset = 0;
         // }
-        for(i = 0; i <63; i++ ) {// 63 is the number of directory entries
+        for(i = 0; i <MAX_DENTRIES; i++ ) {// every directory entry the boot block has room for
 
         // string comparison to figure out the filename input gives exists in the directory entry 
 
@@ -190,6 +341,9 @@ int32_t read_file(int32_t inode_num, int32_t off, int32_t nbytes, void* buf) {
 
         // call read data to read from the file
 
+        // Check the whole destination once, read_data then copies straight into it block by block
+        if(nbytes < 0 || !user_range_writable(buf, nbytes))
+          return -1;
         bytes_read = read_data (inode_num, ( uint32_t)off,  (uint8_t*)buf, nbytes);
 
         // read offset used to accomodate for the offset read file test. 
@@ -215,8 +369,8 @@ int32_t read_file(int32_t inode_num, int32_t off, int32_t nbytes, void* buf) {
  */ 
 int32_t read_directory(int32_t inode_num, int32_t off, int32_t nbytes, void* buf){
   int8_t*  source;
-  int8_t* destination;
-  if(file_index > 63){ // 63 the number of directory entries
+  int8_t destination[FILENAME_LEN + 1];
+  if(file_index >= MAX_DENTRIES){ // past the last directory entry
     file_index = 0;
   }
   if(bb->dentries[file_index].filename == NULL){
@@ -229,12 +383,13 @@ int32_t read_directory(int32_t inode_num, int32_t off, int32_t nbytes, void* buf
   //   ((char*)buf)[i] = '\0';
   //   i++;
   // }
-  memset(buf, (int32_t)'\0', 33);
+  memset(destination, (int32_t)'\0', FILENAME_LEN + 1);
 
-  // populates the directory names into the buffer
+  // populates the directory name into a local buffer, then hands the caller as much as fits
   source = (int8_t*) bb->dentries[file_index].filename;
-  destination = (int8_t*) buf;
-  strncpy(destination, source, 32);
+  strncpy(destination, source, FILENAME_LEN);
+  if(nbytes < 0 || copy_to_user(buf, destination, (nbytes < FILENAME_LEN + 1) ? nbytes : FILENAME_LEN + 1) == -1)
+    return -1;
   file_index++;
 
   if(strlen(destination) == 0)
@@ -275,14 +430,17 @@ int32_t read_directory(int32_t inode_num, int32_t off, int32_t nbytes, void* buf
 
 /* MP3.2!!! 
 *  write_file  
- *   DESCRIPTION: The function writes file.
+ *   DESCRIPTION: The function writes file at the descriptor's current position.
  *   INPUTS: int32_t fd, const void* buf, int32_t nbytes
  *   OUTPUTS: none
- *   RETURN VALUE: returns success or fail
- *  
+ *   RETURN VALUE: returns bytes written or fail
+ *   SIDE EFFECTS: the write system call advances the file position
  */ 
  int32_t write_file (int32_t fd, const void* buf, int32_t nbytes) {
-    return -1; // -1 is fail
+    file_descriptor_t* file = fd_get(get_cur_pcb()->files, fd);
+    if(file == NULL || nbytes < 0 || !user_range_ok(buf, nbytes))
+      return -1;
+    return fs_write(file->inode, file->file_pos, (const uint8_t*)buf, nbytes);
  }
 
 /* MP3.2!!! 
@@ -325,6 +483,231 @@ int32_t read_directory(int32_t inode_num, int32_t off, int32_t nbytes, void* buf
     return -1;  // failure
  }
 
+////////////////////////////////////////////////// RAM filesystem layer ///////////////////////////////
+
+/*
+*  truncate_inode
+ *   DESCRIPTION: Drops every data block of a file and sets its length to 0.
+ *   INPUTS: uint32_t inode
+ *   OUTPUTS: none
+ *   RETURN VALUE: returns success or fail
+ *   SIDE EFFECTS: the caller holds fs_lock
+ */
+static int32_t truncate_inode(uint32_t inode) {
+    uint32_t i;
+    uint32_t nblocks;
+    inode_t* cur_inode = writable_inode(inode);
+
+    if(cur_inode == NULL){
+        return FAILURE;
+    }
+
+    nblocks = (cur_inode->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    for(i = 0; i < nblocks; i++){
+        free_ram_block(cur_inode->data_block_num[i]);
+        cur_inode->data_block_num[i] = 0;
+    }
+    cur_inode->length = 0;
+
+    return SUCCESS;
+}
+
+/*
+*  fs_create
+ *   DESCRIPTION: Creates an empty regular file, or truncates it if it already exists.
+ *   INPUTS: const uint8_t* fname
+ *   OUTPUTS: none
+ *   RETURN VALUE: inode number of the file, or fail
+ *  
+ */
+int32_t fs_create(const uint8_t* fname) {
+    int i;
+    uint32_t inode;
+    uint32_t flags;
+    inode_t* new_inode;
+    dentry_t dentry;
+
+    if(fname == NULL || fname[0] == '\0' || strlen((const int8_t*)fname) > FILENAME_LEN){
+        return FAILURE;
+    }
+
+    spin_lock_irqsave(&fs_lock, flags);
+
+    // Existing file: only regular files may be truncated
+    if(read_dentry_by_name(fname, &dentry) == SUCCESS){
+        if(dentry.filetype != FILE_TYPE_REG || truncate_inode(dentry.inode_num) == FAILURE){
+            spin_unlock_irqrestore(&fs_lock, flags);
+            return FAILURE;
+        }
+        spin_unlock_irqrestore(&fs_lock, flags);
+        return dentry.inode_num;
+    }
+
+    if(bb == image_bb || bb->dir_count >= MAX_DENTRIES){
+        spin_unlock_irqrestore(&fs_lock, flags);
+        return FAILURE;
+    }
+
+    // Pick the first inode number nobody uses
+    for(inode = 0; inode < MAX_INODES; inode++){
+        if(inode_table[inode] == NULL){
+            break;
+        }
+    }
+    if(inode == MAX_INODES){
+        spin_unlock_irqrestore(&fs_lock, flags);
+        return FAILURE;
+    }
+
+    new_inode = (inode_t*)alloc_frame();
+    if(new_inode == NULL){
+        spin_unlock_irqrestore(&fs_lock, flags);
+        return FAILURE;
+    }
+    memset(new_inode, 0, BLOCK_SIZE);
+    inode_table[inode] = new_inode;
+    inode_in_ram[inode] = 1;
+
+    // Entries are packed, so the new one goes right after the last
+    i = bb->dir_count;
+    strncpy((int8_t*)bb->dentries[i].filename, (const int8_t*)fname, FILENAME_LEN);
+    bb->dentries[i].filetype = FILE_TYPE_REG;
+    bb->dentries[i].inode_num = inode;
+    bb->dir_count++;
+
+    spin_unlock_irqrestore(&fs_lock, flags);
+    return inode;
+}
+
+/*
+*  fs_truncate
+ *   DESCRIPTION: Drops every data block of a file and sets its length to 0.
+ *   INPUTS: uint32_t inode
+ *   OUTPUTS: none
+ *   RETURN VALUE: returns success or fail
+ *  
+ */
+int32_t fs_truncate(uint32_t inode) {
+    uint32_t flags;
+    int32_t ret;
+
+    spin_lock_irqsave(&fs_lock, flags);
+    ret = truncate_inode(inode);
+    spin_unlock_irqrestore(&fs_lock, flags);
+    return ret;
+}
+
+/*
+*  fs_write
+ *   DESCRIPTION: Writes into a file, overwriting in place and appending past the end.
+ *                Blocks shared with the boot image are copied before the first write,
+ *                appended blocks come straight off the RAM block free stack.
+ *   INPUTS: uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length
+ *   OUTPUTS: none
+ *   RETURN VALUE: returns bytes written (short if the layer runs out of blocks) or fail
+ *  
+ */
+int32_t fs_write(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length) {
+    uint32_t written = 0;
+    uint32_t block_idx;
+    uint32_t block_off;
+    uint32_t chunk;
+    uint32_t nblocks;
+    uint32_t old_nblocks;
+    uint32_t i;
+    uint32_t flags;
+    int32_t new_block;
+    uint8_t* block;
+    inode_t* cur_inode;
+
+    if(buf == NULL){
+        return FAILURE;
+    }
+
+    // Clamp to the largest file an inode can describe
+    if(offset >= MAX_FILE_BLOCKS * BLOCK_SIZE){
+        return FAILURE;
+    }
+    if(length > MAX_FILE_BLOCKS * BLOCK_SIZE - offset){
+        length = MAX_FILE_BLOCKS * BLOCK_SIZE - offset;
+    }
+
+    spin_lock_irqsave(&fs_lock, flags);
+
+    cur_inode = writable_inode(inode);
+    if(cur_inode == NULL){
+        spin_unlock_irqrestore(&fs_lock, flags);
+        return FAILURE;
+    }
+
+    nblocks = (cur_inode->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    old_nblocks = nblocks;
+
+    while(written < length){
+        block_idx = (offset + written) / BLOCK_SIZE;
+        block_off = (offset + written) % BLOCK_SIZE;
+
+        // Grow the block list up to the block being written (zero filled)
+        while(nblocks <= block_idx){
+            new_block = alloc_ram_block();
+            if(new_block == FAILURE){
+                break;
+            }
+            cur_inode->data_block_num[nblocks++] = new_block;
+        }
+        if(nblocks <= block_idx){
+            break;
+        }
+
+        // Copy on write for blocks still owned by the image
+        if(cur_inode->data_block_num[block_idx] < image_data_count){
+            new_block = alloc_ram_block();
+            if(new_block == FAILURE){
+                break;
+            }
+            memcpy(get_block(new_block), get_block(cur_inode->data_block_num[block_idx]), BLOCK_SIZE);
+            cur_inode->data_block_num[block_idx] = new_block;
+        }
+
+        block = get_block(cur_inode->data_block_num[block_idx]);
+        chunk = BLOCK_SIZE - block_off;
+        if(chunk > length - written){
+            chunk = length - written;
+        }
+        memcpy(block + block_off, buf + written, chunk);
+        written += chunk;
+    }
+
+    if(offset + written > cur_inode->length){
+        cur_inode->length = offset + written;
+    }
+
+    // Blocks added for a write that failed before reaching them lie past the length, which is
+    // all fs_truncate and the next append look at, so give them back now
+    for(i = (cur_inode->length + BLOCK_SIZE - 1) / BLOCK_SIZE; i < nblocks; i++){
+        if(i >= old_nblocks){
+            free_ram_block(cur_inode->data_block_num[i]);
+            cur_inode->data_block_num[i] = 0;
+        }
+    }
+
+    spin_unlock_irqrestore(&fs_lock, flags);
+
+    if(written == 0 && length > 0){
+        return FAILURE;
+    }
+    return written;
+}
+
+/* Getter for the length of a file, fail if the inode does not exist */
+int32_t fs_file_length(uint32_t inode) {
+    inode_t* cur_inode = get_inode(inode);
+    if(cur_inode == NULL){
+        return FAILURE;
+    }
+    return cur_inode->length;
+}
+
 ////////////////////////////////////////////////// Checkpoint 3 /////////////////////////////////////// 
 
 
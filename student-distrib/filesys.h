@@ -6,6 +6,16 @@
 #include "types.h"
 
 #define FILENAME_LEN 32
+#define BLOCK_SIZE 4096
+#define MAX_DENTRIES 63
+#define MAX_FILE_BLOCKS 1023
+
+/* Writable RAM layer on top of the boot image */
+#define MAX_INODES 128          // inode numbers available to the image plus files created at runtime
+#define MAX_RAM_BLOCKS 2048     // data blocks the RAM layer can own (8MB)
+#define FILE_TYPE_RTC 0
+#define FILE_TYPE_DIR 1
+#define FILE_TYPE_REG 2
 
 typedef struct dentry {
   int8_t filename[FILENAME_LEN];
@@ -19,7 +29,7 @@ typedef struct boot_block {
   int32_t inode_count;
   int32_t data_count; 
   int8_t rsvd[52]; // 52 reserved 
-  dentry_t dentries[63]; // 63 no of entries
+  dentry_t dentries[MAX_DENTRIES];
 } boot_block_t; 
 
 typedef struct inode {
@@ -51,6 +61,16 @@ int32_t close_dir(int32_t fd);
 
 int32_t write_dir(int32_t fd, const void* buf, int32_t nbytes);
 
+///////////////////////RAM filesystem layer/////////////////////////////////////////
+
+int32_t fs_create(const uint8_t* fname);
+
+int32_t fs_truncate(uint32_t inode);
+
+int32_t fs_write(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length);
+
+int32_t fs_file_length(uint32_t inode);
+
 ///////////////////////Checkpoint 3///////////////////////////////////////////////// 
 
 int32_t executable_file_check(int32_t* filename);
@@ -0,0 +1,196 @@
+/* fpu.c - Lazy FPU/SSE context switching
+ *
+ * The FPU registers belong to at most one process at a time, fpu_owner. Switching to any other
+ * process sets CR0.TS, so its first x87/SSE instruction raises #NM. Only then is the owner's state
+ * saved to its PCB and the new process' state loaded, so processes that never use the FPU never pay
+ * for a save or restore.
+ */
+
+#include "fpu.h"
+#include "lib.h"
+
+static uint32_t fpu_present = 0;    // 1 if there is an x87 FPU to hand out
+static uint32_t fpu_fxsr = 0;       // 1 if fxsave/fxrstor (and so the SSE registers) are used
+static uint32_t fpu_sse = 0;        // 1 if SSE is enabled
+static pcb_t* fpu_owner = NULL;     // Process whose state is in the FPU registers
+
+/* Set CR0.TS */
+static void stts(void) {
+    uint32_t cr0;
+
+    asm volatile("movl %%cr0, %0" : "=r"(cr0));
+    asm volatile("movl %0, %%cr0" : : "r"(cr0 | CR0_TS) : "memory");
+}
+
+/* Clear CR0.TS */
+static void clts(void) {
+    asm volatile("clts" : : : "memory");
+}
+
+/*
+ * fpu_save
+ *   DESCRIPTION: Stores the FPU registers in a PCB. TS must be clear.
+ *   INPUTS: pcb - process the registers belong to
+ *   OUTPUTS: pcb->fpu_state
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Without fxsave, fnsave resets the FPU
+ */
+static void fpu_save(pcb_t* pcb) {
+    if(fpu_fxsr)
+        asm volatile("fxsave %0" : "=m"(pcb->fpu_state));
+    else
+        asm volatile("fnsave %0; fwait" : "=m"(pcb->fpu_state));
+}
+
+/*
+ * fpu_restore
+ *   DESCRIPTION: Loads the FPU registers from a PCB. TS must be clear.
+ *   INPUTS: pcb - process to load
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Overwrites the FPU registers
+ */
+static void fpu_restore(pcb_t* pcb) {
+    if(fpu_fxsr)
+        asm volatile("fxrstor %0" : : "m"(pcb->fpu_state));
+    else
+        asm volatile("frstor %0" : : "m"(pcb->fpu_state));
+}
+
+/*
+ * fpu_init
+ *   DESCRIPTION: Checks CPUID for an FPU, fxsave and SSE, and enables what is there. TS starts set,
+ *                so the first process to use the FPU takes it through #NM. Without an FPU EM stays
+ *                set and x87 instructions are treated as faults. With SSE2 memcpy and memset switch to
+ *                their SSE2 variants.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Changes CR0 and CR4, may enable the SSE2 memcpy/memset
+ */
+void fpu_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t cr0, cr4;
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+
+    asm volatile("movl %%cr0, %0" : "=r"(cr0));
+    if(!(edx & CPUID_FEAT_FPU)){
+        asm volatile("movl %0, %%cr0" : : "r"(cr0 | CR0_EM));
+        return;
+    }
+    fpu_present = 1;
+    asm volatile("movl %0, %%cr0" : : "r"((cr0 & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS));
+
+    if(edx & CPUID_FEAT_FXSR){
+        fpu_fxsr = 1;
+        asm volatile("movl %%cr4, %0" : "=r"(cr4));
+        cr4 |= CR4_OSFXSR;
+        if(edx & CPUID_FEAT_SSE){
+            fpu_sse = 1;
+            cr4 |= CR4_OSXMMEXCPT;
+        }
+        asm volatile("movl %0, %%cr4" : : "r"(cr4));
+
+        // Large kernel copies can use SSE2 now that the SSE registers are enabled
+        if(edx & CPUID_FEAT_SSE2)
+            mem_enable_sse2();
+    }
+}
+
+/*
+ * fpu_switch
+ *   DESCRIPTION: Lets the process about to run use the FPU directly if it still owns the registers,
+ *                otherwise arms #NM. Called wherever curr_process changes.
+ *   INPUTS: next - process that runs next
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Changes CR0.TS
+ */
+void fpu_switch(pcb_t* next) {
+    if(!fpu_present)
+        return;
+
+    if(next != NULL && next == fpu_owner)
+        clts();
+    else
+        stts();
+}
+
+/*
+ * fpu_take
+ *   DESCRIPTION: Handles #NM: saves the owner's registers, then loads the current process' saved state,
+ *                or a clean FPU on its first use.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the faulting instruction can be retried, -1 if there is no FPU or process
+ *   SIDE EFFECTS: Changes fpu_owner and CR0.TS
+ */
+int32_t fpu_take(void) {
+    pcb_t* cur = curr_process;
+
+    if(!fpu_present || cur == NULL || cur->PID == -1)
+        return -1;
+
+    clts();
+    if(fpu_owner == cur)
+        return 0;
+
+    if(fpu_owner != NULL)
+        fpu_save(fpu_owner);
+
+    if(cur->fpu_used){
+        fpu_restore(cur);
+    } else {
+        uint32_t mxcsr = MXCSR_DEFAULT;
+
+        asm volatile("fninit");
+        if(fpu_sse)
+            asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+        cur->fpu_used = 1;
+    }
+    fpu_owner = cur;
+    return 0;
+}
+
+/*
+ * fpu_copy
+ *   DESCRIPTION: Gives a new process the FPU state of another one, as fork needs.
+ *   INPUTS: dst - process to set up
+ *           src - process to copy
+ *   OUTPUTS: dst->fpu_state, dst->fpu_used
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Saves src's registers if it owns the FPU
+ */
+void fpu_copy(pcb_t* dst, pcb_t* src) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if(src == fpu_owner && src != NULL){
+        clts();
+        fpu_save(src);
+        // fnsave reset the registers, src keeps using them
+        if(!fpu_fxsr)
+            fpu_restore(src);
+        fpu_switch(curr_process);
+    }
+    memcpy(dst->fpu_state, src->fpu_state, FPU_STATE_SIZE);
+    dst->fpu_used = src->fpu_used;
+    restore_flags(flags);
+}
+
+/*
+ * fpu_release
+ *   DESCRIPTION: Drops a process' FPU state without saving it.
+ *   INPUTS: pcb - process that halted or is being set up again
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Sets TS if pcb owned the FPU
+ */
+void fpu_release(pcb_t* pcb) {
+    pcb->fpu_used = 0;
+    if(pcb == fpu_owner){
+        fpu_owner = NULL;
+        fpu_switch(NULL);
+    }
+}
@@ -0,0 +1,36 @@
+/* fpu.h - Defines for lazy FPU/SSE context switching */
+
+#ifndef _FPU_H
+#define _FPU_H
+
+#include "types.h"
+#include "syscallhandler.h"
+
+#define CPUID_FEAT_FPU      0x00000001  // CPUID.1:EDX, x87 on chip
+#define CPUID_FEAT_FXSR     0x01000000  // CPUID.1:EDX, fxsave/fxrstor
+#define CPUID_FEAT_SSE      0x02000000  // CPUID.1:EDX, SSE
+#define CPUID_FEAT_SSE2     0x04000000  // CPUID.1:EDX, SSE2
+#define CR0_MP              0x00000002  // WAIT honours TS
+#define CR0_EM              0x00000004  // No FPU, every x87 instruction traps
+#define CR0_TS              0x00000008  // Task switched, next FPU instruction raises #NM
+#define CR0_NE              0x00000020  // Report x87 errors through #MF instead of IRQ 13
+#define CR4_OSFXSR          0x00000200  // OS saves SSE state with fxsave
+#define CR4_OSXMMEXCPT      0x00000400  // OS handles #XM
+#define MXCSR_DEFAULT       0x1F80      // All SSE exceptions masked, round to nearest
+
+/* Detect the FPU and enable x87/SSE with TS set */
+void fpu_init(void);
+
+/* Set or clear TS for the process about to run */
+void fpu_switch(pcb_t* next);
+
+/* Give the FPU to the current process, called on #NM */
+int32_t fpu_take(void);
+
+/* Copy a process' FPU state to another one (fork) */
+void fpu_copy(pcb_t* dst, pcb_t* src);
+
+/* Forget the FPU state of a process that is going away */
+void fpu_release(pcb_t* pcb);
+
+#endif /* _FPU_H */
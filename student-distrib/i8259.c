@@ -4,6 +4,7 @@
 
 #include "i8259.h"
 #include "lib.h"
+#include "apic.h"
 
 /* Interrupt masks to determine which interrupts are enabled and disabled */
 uint8_t master_mask = INIT_MASK; /* IRQs 0-7  */
@@ -59,6 +60,12 @@ void enable_irq(uint32_t irq_num) {
     if(irq_num > MAX_IRQ_NUM){
         return;
     }
+
+    /* After smp_init the 8259 is masked for good and the IO-APIC takes the IRQs */
+    if(ioapic_active()){
+        ioapic_unmask(irq_num);
+        return;
+    }
  
     if(irq_num < MASTER_MAX_IRQ_NUM) {
         /* if irq_num < 8, then unmask specifed IRQ on master 8259 */
@@ -89,6 +96,11 @@ void disable_irq(uint32_t irq_num) {
     if(irq_num > MAX_IRQ_NUM){
         return;
     }
+
+    if(ioapic_active()){
+        ioapic_mask(irq_num);
+        return;
+    }
  
     if(irq_num < MASTER_MAX_IRQ_NUM) {
          /* if irq_num < 8, then mask specifed IRQ on master 8259 */
@@ -117,6 +129,12 @@ void send_eoi(uint32_t irq_num) {
         return;
     }
 
+    /* IO-APIC interrupts are acknowledged at the local APIC */
+    if(ioapic_active()){
+        lapic_eoi();
+        return;
+    }
+
     /* If irq_num is >= 8 (on secondary PIC), send EOI for both; else send for primary */
     if(irq_num < MASTER_MAX_IRQ_NUM) {
         outb(irq_num | EOI, MASTER_8259_PORT_CMD);                          /* Send EOI to master 8259 (OR as specified by spec) */
@@ -1,5 +1,9 @@
 
 #include "idt.h"
+#include "paging.h"
+#include "signal.h"
+#include "fpu.h"
+#include "apic.h"
 
 /* Array of exception names */
 char * exceptions[] = {
@@ -99,6 +103,13 @@ void idt_init(){
     idt[KEYBOARD_VEC].reserved3 = 0x1;
     SET_IDT_ENTRY(idt[KEYBOARD_VEC], key_intr);
 
+    // LAPIC interrupts (see smp.c) stay interrupt gates
+    idt[APIC_TIMER_VEC].present = 0x1;
+    SET_IDT_ENTRY(idt[APIC_TIMER_VEC], apic_timer_intr);
+
+    idt[APIC_SPURIOUS_VEC].present = 0x1;
+    SET_IDT_ENTRY(idt[APIC_SPURIOUS_VEC], apic_spurious_intr);
+
     // Set system calls
     // Set system call entry to present
 
@@ -121,28 +132,112 @@ void systemcall_handler_test(){
     printf("System Call was called.\n");
 }
 
+/* Kernel crash dump
+ * 
+ * Prints the state of a kernel fault and a backtrace of return addresses found by
+ * following the saved frame pointers up the kernel stack
+ * Inputs: id - exception number, regs - saved registers, err - error code, frame - IRET frame
+ * Outputs: Prints the dump to the screen
+ * Return value: None
+ */
+static void crash_dump(uint32_t id, struct pushal_t* regs, uint32_t err, struct iret_frame_t* frame) {
+    uint32_t* ebp;
+    uint32_t cr2;
+    int depth;
+
+    printf("\nKERNEL PANIC: %s\n", (id < NUM_EXCEPTIONS) ? exceptions[id] : "Unknown Exception");
+    printf("PID: %d  Error Code: %#x\n", (curr_process != NULL) ? (int32_t)curr_process->PID : -1, err);
+    printf("EIP=%#x CS=%#x EFLAGS=%#x\n", frame->eip, frame->cs, frame->eflags);
+    printf("EAX=%#x EBX=%#x ECX=%#x EDX=%#x\n", regs->eax, regs->ebx, regs->ecx, regs->edx);
+    // The fault pushed an error code (or the wrapper a 0) and a three word IRET frame above where ESP was
+    printf("ESI=%#x EDI=%#x EBP=%#x ESP=%#x\n", regs->esi, regs->edi, regs->ebp, regs->esp + CRASH_FRAME_BYTES);
+    if(id == PAGE_FAULT_ID) {
+        asm volatile("movl %%cr2, %0" : "=r"(cr2));
+        printf("CR2=%#x\n", cr2);
+    }
+
+    printf("Backtrace:\n  %#x\n", frame->eip);
+    ebp = (uint32_t*)regs->ebp;
+    for(depth = 0; depth < MAX_BACKTRACE; depth++) {
+        // Stop at the first frame pointer that leaves the kernel stacks or doesn't go up
+        if((uint32_t)ebp < KERNEL_START_ADDR || (uint32_t)ebp >= KERNEL_END_ADDR - 2 * sizeof(uint32_t) || ((uint32_t)ebp & 0x3))
+            break;
+        printf("  %#x\n", ebp[1]);
+        if(ebp[0] <= (uint32_t)ebp)
+            break;
+        ebp = (uint32_t*)ebp[0];
+    }
+}
+
 /* Exception interrupt handler
  * 
- * Handles exception calls by printing the exception to screen
- * Inputs: None
+ * Classifies exceptions by the privilege level of the saved CS. An exception in user mode
+ * only costs that process: it gets a signal if it handles one, otherwise it is halted with
+ * status 256 and every other process keeps running. An exception in the kernel can't be
+ * recovered from and ends in a crash dump.
+ * Inputs: id - exception number, flags, pushal - saved state, err - error code, frame - IRET frame
  * Outputs: Prints statement if working
  * Return value: None
  */
-void exception_handler(uint32_t id,  uint32_t flags, struct pushal_t pushal, uint32_t err) {
+void exception_handler(uint32_t id,  uint32_t flags, struct pushal_t pushal, uint32_t err, struct iret_frame_t frame) {
+    pcb_t* pcb;
+    int32_t signum;
 
     cli();
 
-    if(id < NUM_EXCEPTIONS)
-        printf("Exception: %s\n", exceptions[id]);
-    
-    // Used for debugging purposes
-    // printf("PUSHAL Information: \n");
-    // printf("EAX=0x%x, EBX=0x%x, ECX=0x%x, EDX=0x%x\n", pushal.eax, pushal.ebx, pushal.ecx, pushal.edx);
-    // printf("ESI=0x%x, EDI=0x%x, EBP=0x%x, ESP=0x%x\n", pushal.esi, pushal.edi, pushal.ebp, pushal.esp);
+    if((frame.cs & 0x3) == 0x3) {
+        pcb = get_cur_pcb();
+        signum = (id == 0) ? SIG_DIV_ZERO : SIG_SEGFAULT;
+
+        // The signal goes out on the way back to user mode
+        if(pcb->sig_handlers[signum] != 0 && !(pcb->sig_masked & (1 << signum))) {
+            send_signal(pcb, signum);
+            return;
+        }
+
+        if(id < NUM_EXCEPTIONS)
+            printf("Exception: %s\n", exceptions[id]);
+        halt_process(SIGNAL_KILL_STATUS);
+        return;
+    }
 
-    // printf("\n Error Code: %x\n", err);
+    crash_dump(id, &pushal, err, &frame);
 
     while(1);
 
     sti();
 }
+
+/* Page fault handler
+ * 
+ * Lets paging fill in missing user pages and copy copy-on-write pages, any other
+ * page fault is handled like the rest of the exceptions
+ * Inputs: id - exception number, flags, pushal - saved state, err - page fault error code, frame - IRET frame
+ * Outputs: None
+ * Return value: None
+ */
+void page_fault_handler(uint32_t id,  uint32_t flags, struct pushal_t pushal, uint32_t err, struct iret_frame_t frame) {
+    uint32_t addr;
+
+    asm volatile("movl %%cr2, %0" : "=r"(addr));
+
+    if(handle_user_page_fault(addr, err) == 0)
+        return;
+
+    exception_handler(id, flags, pushal, err, frame);
+}
+
+/* Device not available handler
+ * 
+ * Gives the FPU to the current process (see fpu.c) so the FPU instruction can be
+ * retried, without an FPU it is handled like the rest of the exceptions
+ * Inputs: id - exception number, flags, pushal - saved state, err - 0, frame - IRET frame
+ * Outputs: None
+ * Return value: None
+ */
+void device_not_avail_handler(uint32_t id,  uint32_t flags, struct pushal_t pushal, uint32_t err, struct iret_frame_t frame) {
+    if(fpu_take() == 0)
+        return;
+
+    exception_handler(id, flags, pushal, err, frame);
+}
@@ -15,6 +15,9 @@
 #define RTC_VEC             0x28
 #define NUM_EXCEPTIONS      20
 #define PIT_VEC             0x20
+#define PAGE_FAULT_ID       0x0E
+#define MAX_BACKTRACE       16      // Most return addresses a crash dump prints
+#define CRASH_FRAME_BYTES   16      // Error code, EIP, CS and EFLAGS pushed on a kernel fault
 
 // This gets pushed on stack when pushal is called in exception wrap
 struct pushal_t {  
@@ -28,9 +31,20 @@ struct pushal_t {
     uint32_t eax;
 };
 
+// What the processor pushes when a trap comes from user mode (esp and ss only then)
+struct iret_frame_t {
+    uint32_t eip;
+    uint32_t cs;
+    uint32_t eflags;
+    uint32_t esp;
+    uint32_t ss;
+};
+
 // Declare functions.
 void idt_init();
-void exception_handler(uint32_t id,  uint32_t flags, struct pushal_t pushal, uint32_t err);
+void exception_handler(uint32_t id,  uint32_t flags, struct pushal_t pushal, uint32_t err, struct iret_frame_t frame);
+void page_fault_handler(uint32_t id,  uint32_t flags, struct pushal_t pushal, uint32_t err, struct iret_frame_t frame);
+void device_not_avail_handler(uint32_t id,  uint32_t flags, struct pushal_t pushal, uint32_t err, struct iret_frame_t frame);
 
 #endif /* _IDT_H */
 
@@ -1,12 +1,22 @@
 #ifndef INTERRUPTS_LINK_H
 #define INTERRUPTS_LINK_H
 
+#include "types.h"
+
 // Delcare the interrupt handler links
 extern void rtc_intr();
 extern void key_intr();
 extern void pit_intr();
+extern void apic_timer_intr();
+extern void apic_spurious_intr();
 
 // Declare the system call link
 extern void sys_intr();
 
+// Switch kernel stacks between processes
+extern void context_switch(uint32_t* prev_esp, uint32_t next_esp);
+
+// Entry point for processes that have never run
+extern void task_start();
+
 #endif
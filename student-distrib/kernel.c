@@ -15,6 +15,12 @@
 #include "filesys.h"
 #include "syscallhandler.h"
 #include "pit.h"
+#include "fpu.h"
+#include "smp.h"
+#include "softirq.h"
+#include "workqueue.h"
+#include "boottime.h"
+#include "param.h"
 
 #define RUN_TESTS
 
@@ -22,25 +28,8 @@
 /* Check if the bit BIT in FLAGS is set. */
 #define CHECK_FLAG(flags, bit)   ((flags) & (1 << (bit)))
 
-/* Check if MAGIC is valid and print the Multiboot information structure
-   pointed by ADDR. */
-void entry(unsigned long magic, unsigned long addr) {
-
-    multiboot_info_t *mbi;
-    uint32_t* fileSysPntr;
-
-    /* Clear the screen. */
-    clear();
-
-    /* Am I booted by a Multiboot-compliant boot loader? */
-    if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
-        printf("Invalid magic number: 0x%#x\n", (unsigned)magic);
-        return;
-    }
-
-    /* Set MBI to the address of the Multiboot information structure. */
-    mbi = (multiboot_info_t *) addr;
-
+/* Print the Multiboot information structure pointed by MBI. */
+static void multiboot_dump(multiboot_info_t *mbi) {
     /* Print out the flags. */
     printf("flags = 0x%#x\n", (unsigned)mbi->flags);
 
@@ -60,7 +49,6 @@ void entry(unsigned long magic, unsigned long addr) {
         int mod_count = 0;
         int i;
         module_t* mod = (module_t*)mbi->mods_addr;
-        fileSysPntr = (uint32_t *)mod->mod_start;
         while (mod_count < mbi->mods_count) {
             printf("Module %d loaded at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_start);
             printf("Module %d ends at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_end);
@@ -73,14 +61,9 @@ void entry(unsigned long magic, unsigned long addr) {
             mod++;
         }
     }
-    /* Bits 4 and 5 are mutually exclusive! */
-    if (CHECK_FLAG(mbi->flags, 4) && CHECK_FLAG(mbi->flags, 5)) {
-        printf("Both bits 4 and 5 are set.\n");
-        return;
-    }
 
     /* Is the section header table of ELF valid? */
-    if (CHECK_FLAG(mbi->flags, 5)) {
+    if (CHECK_FLAG(mbi->flags, 5) && !CHECK_FLAG(mbi->flags, 4)) {
         elf_section_header_table_t *elf_sec = &(mbi->elf_sec);
         printf("elf_sec: num = %u, size = 0x%#x, addr = 0x%#x, shndx = 0x%#x\n",
                 (unsigned)elf_sec->num, (unsigned)elf_sec->size,
@@ -103,6 +86,53 @@ void entry(unsigned long magic, unsigned long addr) {
                     (unsigned)mmap->length_high,
                     (unsigned)mmap->length_low);
     }
+}
+
+/* Check if MAGIC is valid and print the Multiboot information structure
+   pointed by ADDR. */
+void entry(unsigned long magic, unsigned long addr) {
+
+    multiboot_info_t *mbi;
+    uint32_t* fileSysPntr;
+
+    /* Start the boot timeline and set the tunables, the command line is only reachable until paging is on */
+    mbi = (multiboot_info_t *) addr;
+    boot_begin((magic == MULTIBOOT_BOOTLOADER_MAGIC && CHECK_FLAG(mbi->flags, 2)) ? (const int8_t *)mbi->cmdline : NULL);
+
+    /* Clear the screen. */
+    clear();
+    param_report();
+
+    /* Am I booted by a Multiboot-compliant boot loader? */
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
+        printf("Invalid magic number: 0x%#x\n", (unsigned)magic);
+        return;
+    }
+
+    /* The filesystem is the first module */
+    if (CHECK_FLAG(mbi->flags, 3)) {
+        int mod_count = 0;
+        module_t* mod = (module_t*)mbi->mods_addr;
+        fileSysPntr = (uint32_t *)mod->mod_start;
+        while (mod_count < mbi->mods_count) {
+            // Kernel stacks grow down from 8MB, one per task
+            if (mod->mod_end > KERNEL_END_ADDR - MAX_TASKS * KERNEL_TASK_SIZE)
+                printf("Module %d overlaps the kernel stacks!\n", mod_count);
+            mod_count++;
+            mod++;
+        }
+    }
+
+    /* Print out the flags, unless booting quietly */
+    if (!boot_quiet())
+        multiboot_dump(mbi);
+    boot_step("multiboot");
+
+    /* Bits 4 and 5 are mutually exclusive! */
+    if (CHECK_FLAG(mbi->flags, 4) && CHECK_FLAG(mbi->flags, 5)) {
+        printf("Both bits 4 and 5 are set.\n");
+        return;
+    }
 
     /* Construct an LDT entry in the GDT */
     {
@@ -145,18 +175,33 @@ void entry(unsigned long magic, unsigned long addr) {
         ltr(KERNEL_TSS);
     }
     
+    boot_step("descriptor tables");
+
     /* Init the IDT */
     idt_init();
+    /* Init deferred interrupt work, drivers register their softirqs as they start */
+    softirq_init();
     /* Init the PIC */
     i8259_init();
     /* Init the RTC */
     rtc_init();
+    boot_step("interrupts");
     /*initialize paging*/
     initialize_paging();
+    /* Init the physical frame pool (needs the pool mapped by paging), frames are handed out
+     * untouched until they are first allocated */
+    init_frame_pool();
+    boot_step("paging");
+    /* Init the FPU, processes take it on first use */
+    fpu_init();
+    /* Find the other CPUs, move the IRQs to the IO-APIC and start the APs */
+    smp_init();
+    boot_step("smp");
     /* Init the keyboard */
     keyboard_init();
     /* Init the filesystem */
     filesys_init((uint32_t)fileSysPntr);
+    boot_step("keyboard, filesystem");
 
     init_pcbs();
     
@@ -164,10 +209,18 @@ void entry(unsigned long magic, unsigned long addr) {
 
     occupy(2);
 
+    /* Start the kernel worker thread, keeping PID 0 for the first shell */
+    occupy(0);
+    if(workqueue_init() == -1)
+        printf("No PCB for the worker thread, deferred jobs will wait\n");
+    unoccupy(0);
 
+    /* Terminals 1 and 2 get their screens on the first switch to them */
     init_terminals();
-    /* Init the PIT */
-    // pit_init();
+    boot_step("processes, terminals");
+    /* Init the PIT, processes are only preempted with sched.preempt on the command line */
+    if (sched_preempt)
+        pit_init();
 
     /* Initialize devices, memory, filesystem, enable device interrupts on the
      * PIC, any other initialization stuff... */
@@ -176,17 +229,20 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Do not enable the following until after you have set up your
      * IDT correctly otherwise QEMU will triple fault and simple close
      * without showing you any output */
-    printf("Enabling Interrupts\n");
+    if (!boot_quiet())
+        printf("Enabling Interrupts\n");
     sti();
     
 
 
 #ifdef RUN_TESTS
-    /* Run tests */
-    // launch_tests();
+    /* Run tests, only when asked for on the command line */
+    if (boot_flag(BOOT_TESTS))
+        launch_tests();
 #endif
-    /* Execute the first program ("shell") ... */
-    clear();
+    boot_step("enable interrupts");
+
+    /* Execute the first program ("shell") ... the boot messages stay above its prompt */
     execute((const uint8_t*)"shell");
     /* Spin (nicely, so we don't chew up cycles) */
     asm volatile (".1: hlt; jmp .1;");
@@ -6,6 +6,16 @@
 #include "syscallhandler.h"
 #include "paging.h"
 #include "pit.h"
+#include "uaccess.h"
+#include "signal.h"
+#include "spinlock.h"
+#include "softirq.h"
+#include "ldisc.h"
+#include "rtc.h"
+#include "vt100.h"
+#include "console.h"
+#include "fb.h"
+#include "boottime.h"
 
 #define VIDEO       0xB8000
 #define NUM_COLS    80
@@ -39,8 +49,33 @@ int screen_buffer_idx;
 int last_ent = 0;
 int first_t1_switch = 0;
 int first_t2_switch = 0;
-int t1_execute = 0;
-int t2_execute = 0;
+
+// Processes waiting in terminal_read for enter on each terminal
+static wait_queue_t terminal_wait[3];
+
+// Protects the line buffers, the terminals' saved state and curr_term_num. The keyboard
+// softirq takes it with interrupts on but preemption off; everybody else takes it with
+// interrupts off, so the softirq never runs on top of a holder.
+static spinlock_t term_lock = SPINLOCK_INIT("term");
+
+// Input mode and raw input queue of each terminal, protected by term_lock
+static ldisc_t term_ldisc[3];
+
+// Escape sequence state and colors of each terminal's output, protected by term_lock
+static vt100_t term_vt[3];
+
+static int32_t do_switch_terminals(int8_t t_num);
+static void keyboard_bottom_half(uint8_t keycode);
+static void keyboard_softirq(void);
+
+// Scancodes the interrupt handler received and the bottom half hasn't decoded yet. Single
+// producer (the handler) and single consumer (the bottom half), so no lock: only the
+// handler moves kbd_head and only the bottom half moves kbd_tail. Both run free and are
+// masked on use.
+static volatile uint8_t kbd_ring[KBD_RING_SIZE];
+static volatile uint32_t kbd_head = 0;
+static volatile uint32_t kbd_tail = 0;
+static uint32_t kbd_dropped = 0;            // Scancodes lost to a full ring
 
 
 /* keyboard_init
@@ -51,32 +86,172 @@ int t2_execute = 0;
  *   SIDE EFFECTS: keyboard is set to generate interrupts
  */  
 void keyboard_init() {
+    open_softirq(SOFTIRQ_KEYBOARD, keyboard_softirq);
     enable_irq(KEYBOARD_IRQ);
 }
 
+/*
+ * kbd_ring_push
+ *   DESCRIPTION: Adds a scancode to the ring, called only from the interrupt handler.
+ *   INPUTS: keycode - scancode to add
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the ring is full and the scancode was dropped
+ *   SIDE EFFECTS: none
+ */
+static int32_t kbd_ring_push(uint8_t keycode) {
+    uint32_t head = kbd_head;
+
+    if(head - kbd_tail == KBD_RING_SIZE) {
+        kbd_dropped++;
+        return -1;
+    }
+
+    kbd_ring[head & (KBD_RING_SIZE - 1)] = keycode;
+    // The scancode has to be in the ring before the consumer can see the new head
+    asm volatile("" : : : "memory");
+    kbd_head = head + 1;
+    return 0;
+}
+
+/*
+ * kbd_ring_pop
+ *   DESCRIPTION: Takes the oldest scancode out of the ring, called only from the bottom half.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the scancode, -1 if the ring is empty
+ *   SIDE EFFECTS: none
+ */
+static int32_t kbd_ring_pop(void) {
+    uint32_t tail = kbd_tail;
+    uint8_t keycode;
+
+    if(tail == kbd_head)
+        return -1;
+
+    keycode = kbd_ring[tail & (KBD_RING_SIZE - 1)];
+    // Read the slot before handing it back to the producer
+    asm volatile("" : : : "memory");
+    kbd_tail = tail + 1;
+    return keycode;
+}
+
+/*
+ * kbd_ring_count
+ *   DESCRIPTION: Tells how many scancodes are waiting for the bottom half and how many were lost.
+ *   INPUTS: dropped - where to store the number of dropped scancodes, may be NULL
+ *   OUTPUTS: dropped - scancodes dropped because the ring was full
+ *   RETURN VALUE: number of scancodes in the ring
+ *   SIDE EFFECTS: none
+ */
+uint32_t kbd_ring_count(uint32_t* dropped) {
+    if(dropped != NULL)
+        *dropped = kbd_dropped;
+    return kbd_head - kbd_tail;
+}
+
 /* keyboard_interrupt_handler
- *   DESCRIPTION: This function handles interrupts from 
- *                the keyboard
+ *   DESCRIPTION: Top half of the keyboard interrupt: queues the scancode, acknowledges
+ *                the interrupt and raises the keyboard softirq to decode it.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: inputted key is echoed to monitor
+ *   SIDE EFFECTS: inputted key is echoed to monitor (by the bottom half)
  */  
 void keyboard_interrupt_handler(void) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+
+    kbd_ring_push(inb(KEYBOARD_PORT));
+    raise_softirq(SOFTIRQ_KEYBOARD);
+
+    // Signal end of interrupt
+    send_eoi(KEYBOARD_IRQ);
+
+    restore_flags(flags);
+}
+
+/*
+ * keyboard_softirq
+ *   DESCRIPTION: Keyboard softirq, the only consumer of the scancode ring. Decodes
+ *                scancodes until the ring is empty.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: inputted keys are echoed to monitor
+ */
+static void keyboard_softirq(void) {
+    int32_t keycode;
+
+    while((keycode = kbd_ring_pop()) != -1)
+        keyboard_bottom_half((uint8_t)keycode);
+}
 
-    // Begin critical section
-    cli();
+/*
+ * raw_key
+ *   DESCRIPTION: Queues the byte a key press stands for on the shown terminal's line discipline
+ *                (raw mode), echoing it with LDISC_ECHO. Modifiers, key releases, Alt combinations
+ *                and Ctrl+C are left to the caller. The caller holds term_lock.
+ *   INPUTS: keycode - scancode from the ring
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the key was queued (or dropped on a full queue), 0 if the caller handles it
+ *   SIDE EFFECTS: Wakes up readers of the terminal
+ */
+static int32_t raw_key(uint8_t keycode) {
+    ldisc_t* ld = &term_ldisc[curr_term_num];
+    char c;
+
+    if(keycode > 57 || alt_pressed)
+        return 0;
+
+    c = scancode_conversion[keycode][shift_pressed ^ caps_lock_pressed];
+    if(keycode == 0x0F)             // Tab
+        c = '\t';
+    if(c == '\0')
+        return 0;
+
+    if(ctrl_pressed){
+        // Ctrl+C still interrupts, other combinations become control characters
+        if(c == 'c' || c == 'C')
+            return 0;
+        c &= 0x1F;
+    }
+
+    if(ldisc_receive(ld, c) == 0 && (ld->mode.lflag & LDISC_ECHO)){
+        if(c == '\b')
+            backspace();
+        else
+            putc(c);
+    }
+
+    wake_up(&terminal_wait[curr_term_num]);
+    return 1;
+}
+
+/*
+ * keyboard_bottom_half
+ *   DESCRIPTION: Decodes a scancode, updates the line buffer and echoes it
+ *   INPUTS: keycode - scancode from the ring
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: inputted key is echoed to monitor
+ */
+static void keyboard_bottom_half(uint8_t keycode) {
+    // Begin critical section, interrupts stay on
+    spin_lock(&term_lock);
     
     // To store character to add to buffer 
     char pressed_key;
 
-    // Read inputted key from keyboard 
-    uint8_t keycode = 0;
-    
-    keycode = inb(KEYBOARD_PORT);
+    // Raw mode: keystrokes go straight to the reader
+    if(!(term_ldisc[curr_term_num].mode.lflag & LDISC_ICANON) && raw_key(keycode)){
+        update_cursor();
+        spin_unlock(&term_lock);
+        return;
+    }
 
-    // Clear char buffer if newline
-    if(last_ent){
+    // Clear char buffer if newline, unless the line hasn't been read yet
+    if(last_ent && !terminals[curr_term_num].line_ready){
         last_ent = 0;
         clear_char_buf();
     }
@@ -115,34 +290,35 @@ void keyboard_interrupt_handler(void) {
             if(!terminals[curr_term_num].enter_pressed){     
                 enter_char();
                 terminals[curr_term_num].enter_pressed = 1;
+                terminals[curr_term_num].line_ready = 1;
+                wake_up(&terminal_wait[curr_term_num]);
             }
             break;
         case 0x3B:      // F1 pressed
             if(alt_pressed){
-                switch_terminals(0);
-                curr_process = terminal_pcb_top[0];
+                do_switch_terminals(0);
             }
             break;
         case 0x3C:      // F2 pressed
             if(alt_pressed){
-                switch_terminals(1);
+                do_switch_terminals(1);
                 // Allow execute to take PID value resevered for it
                 if(!first_t1_switch){
                     first_t1_switch = 1;
                     unoccupy(1);
+                    terminal_pcb_top[1] = create_process((uint8_t*)"shell", 1, NULL, NULL);
                 }
-                curr_process = terminal_pcb_top[1];
             }
             break;
         case 0x3D:      // F3 pressed
             if(alt_pressed){
-                switch_terminals(2);
+                do_switch_terminals(2);
                 // Allow execute to take PID value resevered for it
                 if(!first_t2_switch){
                     first_t2_switch = 1;
                     unoccupy(2);
+                    terminal_pcb_top[2] = create_process((uint8_t*)"shell", 2, NULL, NULL);
                 }
-                curr_process = terminal_pcb_top[2];
             }
             break;
         default:
@@ -158,19 +334,13 @@ void keyboard_interrupt_handler(void) {
                 if(pressed_key == 'l' || pressed_key == 'L') {
                     //clear the screen 
                     clear();
-                    clear_char_buf();
+                    if(!terminals[curr_term_num].line_ready)
+                        clear_char_buf();
                     clear_screen_buf();
                 }
                 else if (pressed_key == 'c' || pressed_key == 'C'){
-                    //signal end of interrupt
-                    send_eoi(KEYBOARD_IRQ);
-
-                    //end of critical section
-                    sti();
-                    
-                    //halt the process - do the same as exceptions when that gets fixed
-                    sys_halt(255);
-                    return;
+                    //interrupt the foreground process of this terminal, whatever process happens to be running
+                    send_signal(terminal_pcb_top[curr_term_num], SIG_INTERRUPT);
                 }
                 break;
             }
@@ -178,7 +348,6 @@ void keyboard_interrupt_handler(void) {
 
             }
             else if (!terminals[curr_term_num].enter_pressed && keycode == 0x0F){   //add three spaces for tab
-                vidmem_set(get_curr_term());
                 char_buffer[char_buffer_idx] = ' ';
                 char_buffer[char_buffer_idx + 1] = ' ';
                 char_buffer[char_buffer_idx + 2] = ' ';
@@ -187,23 +356,17 @@ void keyboard_interrupt_handler(void) {
                 screen_buffer[screen_buffer_idx + 1] = ' ';
                 screen_buffer[screen_buffer_idx + 2] = ' ';
                 screen_buffer[screen_buffer_idx + 3] = ' ';
-                printf(" ");
-                printf(" ");
-                printf(" ");
-                printf(" ");
+                puts("    ");
                 char_buffer_idx += 4;
                 screen_buffer_idx += 4;        
-                vidmem_set(get_round_robin_term());
             }
             // If nothing special, add the character to buffer and print to screen
             else if (!terminals[curr_term_num].enter_pressed && char_buffer_idx < BUFFER_SIZE - 1){
-                vidmem_set(get_curr_term());
                 char_buffer[char_buffer_idx] = pressed_key;
                 screen_buffer[screen_buffer_idx] = pressed_key;
                 char_buffer_idx++;
                 screen_buffer_idx++;
                 putc(pressed_key);       
-                vidmem_set(get_round_robin_term());
             }
 
     }
@@ -211,20 +374,8 @@ void keyboard_interrupt_handler(void) {
     // Update the cursor_pos
     update_cursor();
 
-    // Signal end of interrupt
-    send_eoi(KEYBOARD_IRQ);
-    
-    if(first_t1_switch && !t1_execute) {
-        t1_execute = 1;
-        execute((uint8_t*)"shell");
-    }
-    if(first_t2_switch && !t2_execute) {
-        t2_execute = 1;
-        execute((uint8_t*)"shell");
-    }
-
     // End of critical section
-    sti();
+    spin_unlock(&term_lock);
 
 }
 
@@ -352,42 +503,248 @@ int32_t terminal_open(const uint8_t* filename) {
 }
 
 
+/*
+ * process_terminal
+ *   DESCRIPTION: Terminal the current process belongs to, the shown one before any process runs.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: terminal number
+ *   SIDE EFFECTS: none
+ */
+static uint8_t process_terminal(void) {
+    if(curr_process != NULL && curr_process->PID != -1)
+        return curr_process->terminal_number;
+    return curr_term_num;
+}
+
+/*
+ * terminal_read_raw
+ *   DESCRIPTION: Raw mode read, waits as the terminal's VMIN and VTIME say and returns the queued
+ *                keystrokes in one batch.
+ *   INPUTS: t_num - terminal to read from
+ *           nbytes - most bytes to return
+ *   OUTPUTS: buf - the keystrokes
+ *   RETURN VALUE: number of bytes read (0 on a timeout), -1 on a signal or bad buffer
+ *   SIDE EFFECTS: May sleep
+ */
+static int32_t terminal_read_raw(uint8_t t_num, int32_t nbytes, void* buf) {
+    uint8_t raw_buffer[LDISC_QUEUE_SIZE];
+    ldisc_t* ld = &term_ldisc[t_num];
+    uint32_t start = rtc_get_ticks();
+    uint32_t deadline;
+    uint32_t flags;
+    int32_t taken;
+
+    if(nbytes <= 0)
+        return 0;
+    if(nbytes > LDISC_QUEUE_SIZE)
+        nbytes = LDISC_QUEUE_SIZE;
+
+    spin_lock_irqsave(&term_lock, flags);
+    while(!ldisc_read_ready(ld, nbytes)) {
+        if(signal_pending(get_cur_pcb())) {
+            spin_unlock_irqrestore(&term_lock, flags);
+            return -1;
+        }
+
+        deadline = ldisc_read_deadline(ld, start);
+        if(deadline != 0 && (int32_t)(rtc_get_ticks() - deadline) >= 0)
+            break;
+
+        // Interrupts stay off across the unlock so a keystroke can't slip in before we sleep
+        spin_unlock(&term_lock);
+        if(deadline != 0)
+            sleep_on_timeout(&terminal_wait[t_num], deadline - rtc_get_ticks());
+        else
+            sleep_on(&terminal_wait[t_num]);
+        spin_lock(&term_lock);
+    }
+    taken = ldisc_take(ld, raw_buffer, nbytes);
+    spin_unlock_irqrestore(&term_lock, flags);
+
+    if(taken > 0 && copy_to_user(buf, raw_buffer, taken) == -1)
+        return -1;
+    return taken;
+}
+
+/*
+ * terminal_ioctl
+ *   DESCRIPTION: Terminal ioctl: reads or changes the input mode (TCGETMODE, TCSETMODE) of the
+ *                process' terminal, or drops its unread raw input (TCFLUSH). A changed mode goes
+ *                back to the default when the process that set it halts.
+ *   INPUTS: inode - unused
+ *           cmd - TCGETMODE, TCSETMODE or TCFLUSH
+ *           arg - user term_mode_t* for TCGETMODE and TCSETMODE
+ *   OUTPUTS: *arg - the mode for TCGETMODE
+ *   RETURN VALUE: 0 on success, -1 for an unknown command, bad mode or bad pointer
+ *   SIDE EFFECTS: Wakes up readers of the terminal so they follow the new mode
+ */
+int32_t terminal_ioctl(int32_t inode, uint32_t cmd, uint32_t arg) {
+    uint8_t t_num = process_terminal();
+    term_mode_t mode;
+    uint32_t flags;
+    int32_t ret;
+
+    switch(cmd) {
+        case TCGETMODE:
+            spin_lock_irqsave(&term_lock, flags);
+            mode = term_ldisc[t_num].mode;
+            spin_unlock_irqrestore(&term_lock, flags);
+            return copy_to_user((void*)arg, &mode, sizeof(mode));
+
+        case TCSETMODE:
+            if(copy_from_user(&mode, (const void*)arg, sizeof(mode)) == -1)
+                return -1;
+            spin_lock_irqsave(&term_lock, flags);
+            ret = ldisc_set_mode(&term_ldisc[t_num], &mode, get_cur_pcb()->PID);
+            spin_unlock_irqrestore(&term_lock, flags);
+            wake_up(&terminal_wait[t_num]);
+            return ret;
+
+        case TCFLUSH:
+            spin_lock_irqsave(&term_lock, flags);
+            ldisc_flush(&term_ldisc[t_num]);
+            spin_unlock_irqrestore(&term_lock, flags);
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+/*
+ * terminal_process_exit
+ *   DESCRIPTION: Puts every terminal whose mode a halting process changed back to canonical mode,
+ *                so the shell it returns to gets lines again.
+ *   INPUTS: pid - PID of the halting process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Drops the terminal's unread raw input
+ */
+void terminal_process_exit(int32_t pid) {
+    uint32_t flags;
+    int t;
+
+    spin_lock_irqsave(&term_lock, flags);
+    for(t = 0; t < 3; t++) {
+        if(term_ldisc[t].owner == pid)
+            ldisc_init(&term_ldisc[t]);
+    }
+    spin_unlock_irqrestore(&term_lock, flags);
+}
+
+/*
+ * terminal_poll
+ *   DESCRIPTION: Terminal readiness for the process' terminal. In canonical mode it is readable
+ *                once a line is finished; polling starts taking input the way a waiting
+ *                terminal_read does. In raw mode it is readable once VMIN keystrokes (at least
+ *                one) are queued, so the read that follows doesn't wait.
+ *   INPUTS: inode - unused
+ *           pt - poll call to put on the terminal's wait queue, NULL to just check
+ *   OUTPUTS: none
+ *   RETURN VALUE: POLLIN if a read won't sleep, POLLOUT always
+ *   SIDE EFFECTS: Lets the keyboard fill a new line
+ */
+uint32_t terminal_poll(int32_t inode, poll_table_t* pt) {
+    uint8_t t_num = process_terminal();
+    ldisc_t* ld = &term_ldisc[t_num];
+    uint32_t events = POLLOUT;
+    uint32_t want;
+    uint32_t flags;
+
+    spin_lock_irqsave(&term_lock, flags);
+    poll_wait(pt, &terminal_wait[t_num]);
+    if(ld->mode.lflag & LDISC_ICANON) {
+        if(terminals[t_num].line_ready)
+            events |= POLLIN;
+        else if(pt != NULL)
+            terminals[t_num].enter_pressed = 0;
+    } else {
+        want = (ld->mode.vmin != 0) ? ld->mode.vmin : 1;
+        if(ldisc_count(ld) >= want)
+            events |= POLLIN;
+    }
+    spin_unlock_irqrestore(&term_lock, flags);
+
+    return events;
+}
+
 /* MP3.2!!! 
 *  terminal_read 
- *   DESCRIPTION: This function handles interrupts from 
- *                the keyboard
+ *   DESCRIPTION: Sleeps until a line is entered on the
+ *                process' terminal and copies it to buf
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: inputted key is echoed to monitor
  */ 
 int32_t terminal_read(int32_t inode, int32_t offset, int32_t nbytes, void* buf) {
-    char* curr_buffer = (char*) buf;
+    char curr_buffer[BUFFER_SIZE];
     int32_t curr_bytes = 0;
+    int32_t copy_bytes;
+    uint32_t flags;
     int i = 0;
+    uint8_t t_num = curr_term_num;
 
-    // Wait for the enter input.
-    sti();
+    // Fail before waiting for a line nobody can receive
+    if (!user_range_writable(buf, nbytes)) {
+        return -1;
+    }
+
+    // The first read is the first shell waiting at its prompt, the end of the boot timeline
+    boot_done();
+
+    // Read from the terminal the process belongs to
+    if(curr_process != NULL && curr_process->PID != -1)
+        t_num = curr_process->terminal_number;
 
-    terminals[curr_term_num].enter_pressed = 0;
+    // Keystrokes rather than lines
+    if(!(term_ldisc[t_num].mode.lflag & LDISC_ICANON))
+        return terminal_read_raw(t_num, nbytes, buf);
 
-    while(terminals[curr_term_num].enter_pressed == 0);
+    // Sleep until enter is pressed on that terminal, unless a line is waiting already
+    // (one a poll call let the keyboard take)
+    spin_lock_irqsave(&term_lock, flags);
+
+    if(!terminals[t_num].line_ready)
+        terminals[t_num].enter_pressed = 0;
+
+    while(!terminals[t_num].line_ready) {
+        // Let a signal (Ctrl+C) through instead of waiting for the line
+        if(signal_pending(get_cur_pcb())) {
+            spin_unlock_irqrestore(&term_lock, flags);
+            return -1;
+        }
+        // Interrupts stay off across the unlock so the enter can't slip in before we sleep
+        spin_unlock(&term_lock);
+        sleep_on(&terminal_wait[t_num]);
+        spin_lock(&term_lock);
+    }
 
-    cli();
-    // Copy characters from char_buffer to buf. 
+    // Copy characters from char_buffer to a line buffer. 
     for (i = 0; i < char_buffer_idx - 1 && curr_bytes < nbytes; i++) {
         curr_buffer[i] = char_buffer[i];
         curr_bytes++;
     }
     // We shouldn't directly copy the buffer, in cases of overflow (?)
+    copy_bytes = curr_bytes;
     if (curr_bytes < nbytes) {
         curr_buffer[curr_bytes] = '\n';
+        copy_bytes++;
     }
 
-    sti();
+    spin_unlock_irqrestore(&term_lock, flags);
 
+    // Hand the whole line to the caller in one copy
+    if (copy_to_user(buf, curr_buffer, copy_bytes) == -1) {
+        return -1;
+    }
+
+    spin_lock_irqsave(&term_lock, flags);
+    terminals[t_num].line_ready = 0;
     clear_char_buf();
     clear_screen_buf();
+    spin_unlock_irqrestore(&term_lock, flags);
     
     // Return the number of characters read.
     return curr_bytes;
@@ -395,26 +752,41 @@ int32_t terminal_read(int32_t inode, int32_t offset, int32_t nbytes, void* buf)
 
 /* MP3.2!!!
 *  terminal_write 
- *   DESCRIPTION: 
- *   INPUTS: none
+ *   DESCRIPTION: Writes to the terminal on screen, interpreting VT100 escape
+ *                sequences (see vt100.c)
+ *   INPUTS: fd - unused
+ *           buf - bytes to write
+ *           nbytes - number of bytes
  *   OUTPUTS: none
- *   RETURN VALUE: none
- *   SIDE EFFECTS: 
+ *   RETURN VALUE: number of bytes written, -1 for a bad buffer
+ *   SIDE EFFECTS: Writes video memory and moves the cursor
  */ 
 int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes){
-    char* curr_buffer = (char*) buf;
+    char curr_buffer[BUFFER_SIZE];
     int32_t curr_bytes = 0;
-    int i = 0;
+    int32_t chunk;
+    uint32_t flags;
 
-    if (curr_buffer == NULL || nbytes == 0) {
+    if (buf == NULL || nbytes <= 0 || !user_range_ok(buf, nbytes)) {
         return -1;
     }
 
-    for (i = 0; i < nbytes /*&& i < BUFFER_SIZE*/; i++) {       
-        vidmem_set(curr_term_num);
-        putc(curr_buffer[i]);
-        vidmem_set(get_round_robin_term());
-        curr_bytes++;
+    // Pull the text into the kernel a buffer at a time
+    while (curr_bytes < nbytes) {
+        chunk = (nbytes - curr_bytes < BUFFER_SIZE) ? nbytes - curr_bytes : BUFFER_SIZE;
+        if (copy_from_user(curr_buffer, (const uint8_t*)buf + curr_bytes, chunk) == -1) {
+            break;
+        }
+
+        // Keep the keyboard from switching terminals halfway through the chunk. The renderer
+        // handles escape sequences and draws the chunk into the terminal's shadow buffer in
+        // spans, the rows it touched go to video memory in one flush.
+        spin_lock_irqsave(&term_lock, flags);
+        console_select(curr_term_num);
+        vt100_write(&term_vt[curr_term_num], (const uint8_t*)curr_buffer, chunk);
+        console_flush(curr_term_num);
+        spin_unlock_irqrestore(&term_lock, flags);
+        curr_bytes += chunk;
     }
     return curr_bytes;
 }
@@ -451,7 +823,27 @@ int32_t terminal_close(int32_t fd) {
  *   SIDE EFFECTS: changes vidmem and the terminal.
  */ 
 int32_t switch_terminals(int8_t t_num) {
+    uint32_t flags;
+    int32_t ret;
+
+    spin_lock_irqsave(&term_lock, flags);
+    ret = do_switch_terminals(t_num);
+    spin_unlock_irqrestore(&term_lock, flags);
+
+    return ret;
+}
+
+/*
+*  do_switch_terminals
+ *   DESCRIPTION: Switches terminals, the caller holds term_lock with interrupts off.
+ *   INPUTS: t_num - the terminal to switch into
+ *   OUTPUTS: none
+ *   RETURN VALUE: int32_t - -1 for failure, 0 for success
+ *   SIDE EFFECTS: changes vidmem and the terminal.
+ */
+static int32_t do_switch_terminals(int8_t t_num) {
     int i;
+    uint8_t old_term;
     
     // Check for garbage input
     if(t_num > 2)
@@ -461,9 +853,6 @@ int32_t switch_terminals(int8_t t_num) {
     if(t_num == curr_term_num)
         return 0;
 
-    // Enter critcal section
-    cli();
-
     // Save the information of the old terminal
     terminals[curr_term_num].term_char_buffer_idx = char_buffer_idx;
 
@@ -478,10 +867,9 @@ int32_t switch_terminals(int8_t t_num) {
     // screen_x = &terminals[t_num].cursor_x_pos;
     // screen_y = &terminals[t_num].cursor_y_pos;
 
-    // Deal with paging
-    vidmem_set(curr_term_num);
-
-    memcpy((void*) terminals[curr_term_num].term_vid_mem, (void*) VIDEO, ALIGNBYTES);
+    // Save the screen to the old terminal's page and bring in the new one's
+    console_show(curr_term_num, t_num);
+    old_term = curr_term_num;
 
     // Get the information of the new terminal
     curr_term_num = t_num;
@@ -496,12 +884,9 @@ int32_t switch_terminals(int8_t t_num) {
     set_screen_x(terminals[curr_term_num].cursor_x_pos);
     set_screen_y(terminals[curr_term_num].cursor_y_pos);
 
-    memcpy((void*) VIDEO, (void*) terminals[curr_term_num].term_vid_mem, ALIGNBYTES);
-    
-    // Deal with paging
-    vidmem_set(get_round_robin_term());
-
-    sti();
+    // Vidmap programs of the old terminal go to its page, the new one's to the screen
+    vidmem_set(old_term);
+    vidmem_set(curr_term_num);
 
     return 0;
 }
@@ -528,13 +913,17 @@ void init_terminals(){
         terminals[i].term_char_buffer_idx = 0;
         terminals[i].running_pid = -1;
         terminals[i].enter_pressed = 1;
+        terminals[i].line_ready = 0;
+        ldisc_init(&term_ldisc[i]);
+        vt100_init(&term_vt[i]);
  
         // Set up vidmem buffers
-        terminals[i].term_vid_mem = VIDEO + (i+1)*ALIGNBYTES;
+        terminals[i].term_vid_mem = CONSOLE_BACKING(i);
         
         initialize_terminal_vidmem_paging(terminals[i].term_vid_mem >> 12);
 
     }
+    initialize_paging_vidmem();
     
     flush_tlb();
 
@@ -544,31 +933,23 @@ void init_terminals(){
 
 /* MP3.5!!!
 *  vidmem_set  
- *   DESCRIPTION: This function deals with paging when switching terminals.
- *   INPUTS: t_num - terminal to switch into
+ *   DESCRIPTION: Points a terminal's vidmap page at the screen if the terminal is shown, at
+ *                its backing page otherwise. Only vidmap programs need this: the kernel draws
+ *                into shadow buffers (console.c) and always sees the screen itself at VIDEO.
+ *   INPUTS: t_num - terminal whose vidmap page to update
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: changes paging for vidmem buffers.
+ *   SIDE EFFECTS: changes one PTE of the terminal's vidmap page table.
  */ 
 void vidmem_set(uint8_t t_num){
-    
-    // screen_x = &terminals[t_num].cursor_x_pos;
-    // screen_y = &terminals[t_num].cursor_y_pos;
-    
-    // Setting up paging
-    int32_t p_val = VIDEO >> 12;
+    if(t_num > 2)
+        return;
 
-    if(t_num == curr_term_num){
-        pte[p_val].address = p_val;
-        pte_vidmap[p_val].P = 1;
-        pte_vidmap[p_val].address = p_val; 
-    } else {
-        pte[p_val].address = terminals[t_num].term_vid_mem >> 12;
-        pte_vidmap[p_val].P = 1;
-        pte_vidmap[p_val].address = terminals[t_num].term_vid_mem >> 12;
-    }
-    
-    flush_tlb();
+    // On the framebuffer the screen page isn't the screen any more, text stays in the backing page
+    if(t_num == curr_term_num && !fb_active())
+        map_to_vidmem_page(t_num, VIDEO);
+    else
+        map_to_vidmem_page(t_num, terminals[t_num].term_vid_mem);
 }
 
 /* Getter for curr_term_num */
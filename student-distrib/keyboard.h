@@ -13,6 +13,8 @@
 #define NUM_SCANCODES       58
 /* Number of characters in the buffer */
 #define BUFFER_SIZE         129
+/* Scancodes queued between the interrupt and the bottom half (power of two) */
+#define KBD_RING_SIZE       256
 
 /* Holds terminal information for switching */
 typedef struct {
@@ -26,6 +28,7 @@ typedef struct {
     uint8_t running;
     uint8_t running_pid;
     uint8_t enter_pressed;
+    uint8_t line_ready;         // A finished line waits in the buffer for terminal_read
 } terminal_t;
 
 volatile terminal_t terminals[3];
@@ -33,9 +36,12 @@ volatile terminal_t terminals[3];
 /* Initialize the keyboard */
 void keyboard_init(void);
 
-/* Handler for RTC interrupts */
+/* Handler for keyboard interrupts */
 extern void keyboard_interrupt_handler(void);
 
+/* Scancodes waiting for the bottom half, and how many were dropped */
+uint32_t kbd_ring_count(uint32_t* dropped);
+
 /* Dealing with enter and backspace */
 void backspace_char();
 void enter_char();
@@ -49,6 +55,12 @@ int32_t terminal_open(const uint8_t* filename);
 int32_t terminal_read(int32_t inode, int32_t offset, int32_t nbytes, void* buf);
 int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes);
 int32_t terminal_close(int32_t fd);
+int32_t terminal_ioctl(int32_t inode, uint32_t cmd, uint32_t arg);
+struct poll_table;
+uint32_t terminal_poll(int32_t inode, struct poll_table* pt);
+
+/* Put terminals a halting process switched to raw mode back to canonical */
+void terminal_process_exit(int32_t pid);
 
 /* Switching terminals */
 int32_t switch_terminals(int8_t t_num);
@@ -0,0 +1,163 @@
+/* ldisc.c - Terminal line discipline: canonical and raw input modes
+ *
+ * In canonical mode the keyboard edits a line and terminal_read returns it once enter is
+ * pressed, as it always has. In raw mode the keyboard softirq queues every keystroke here
+ * (echoing it only with LDISC_ECHO) and terminal_read hands over whatever is queued, in
+ * batches decided by VMIN and VTIME. The caller serializes access with term_lock.
+ */
+
+#include "ldisc.h"
+#include "lib.h"
+#include "rtc.h"
+
+uint32_t ldisc_queue_size = LDISC_QUEUE_SIZE;
+
+/*
+ * ldisc_init
+ *   DESCRIPTION: Puts a line discipline back to canonical mode with echo and an empty queue.
+ *   INPUTS: ld - line discipline
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Drops queued input
+ */
+void ldisc_init(ldisc_t* ld) {
+    ld->mode.lflag = LDISC_DEFAULT;
+    ld->mode.vmin = 1;
+    ld->mode.vtime = 0;
+    ld->owner = -1;
+    ld->head = ld->tail = 0;
+    ld->last_rx = 0;
+}
+
+/*
+ * ldisc_receive
+ *   DESCRIPTION: Queues a raw input byte.
+ *   INPUTS: ld - line discipline
+ *           c - byte to queue
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the queue is full and the byte was dropped
+ *   SIDE EFFECTS: none
+ */
+int32_t ldisc_receive(ldisc_t* ld, uint8_t c) {
+    if(ld->head - ld->tail >= ldisc_queue_size)
+        return -1;
+
+    ld->queue[ld->head & (LDISC_QUEUE_SIZE - 1)] = c;
+    ld->head++;
+    ld->last_rx = rtc_get_ticks();
+    return 0;
+}
+
+/*
+ * ldisc_count
+ *   DESCRIPTION: Tells how many raw bytes are waiting to be read.
+ *   INPUTS: ld - line discipline
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of queued bytes
+ *   SIDE EFFECTS: none
+ */
+uint32_t ldisc_count(ldisc_t* ld) {
+    return ld->head - ld->tail;
+}
+
+/*
+ * ldisc_take
+ *   DESCRIPTION: Takes the oldest queued bytes.
+ *   INPUTS: ld - line discipline
+ *           n - most bytes to take
+ *   OUTPUTS: buf - the bytes taken
+ *   RETURN VALUE: number of bytes taken
+ *   SIDE EFFECTS: none
+ */
+uint32_t ldisc_take(ldisc_t* ld, uint8_t* buf, uint32_t n) {
+    uint32_t taken = 0;
+
+    while(taken < n && ld->tail != ld->head) {
+        buf[taken++] = ld->queue[ld->tail & (LDISC_QUEUE_SIZE - 1)];
+        ld->tail++;
+    }
+    return taken;
+}
+
+/*
+ * ldisc_flush
+ *   DESCRIPTION: Drops every queued byte.
+ *   INPUTS: ld - line discipline
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void ldisc_flush(ldisc_t* ld) {
+    ld->tail = ld->head;
+}
+
+/*
+ * ldisc_set_mode
+ *   DESCRIPTION: Switches a line discipline to a new mode. Raw input still queued is dropped when
+ *                going back to canonical mode, where nobody would read it.
+ *   INPUTS: ld - line discipline
+ *           mode - mode to switch to
+ *           pid - process asking, the mode goes back to the default when it halts
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the mode has unknown flags
+ *   SIDE EFFECTS: none
+ */
+int32_t ldisc_set_mode(ldisc_t* ld, const term_mode_t* mode, int32_t pid) {
+    if(mode->lflag & ~LDISC_DEFAULT)
+        return -1;
+
+    if(mode->lflag & LDISC_ICANON)
+        ldisc_flush(ld);
+
+    ld->mode = *mode;
+    ld->owner = (mode->lflag == LDISC_DEFAULT) ? -1 : pid;
+    return 0;
+}
+
+/*
+ * ldisc_read_ready
+ *   DESCRIPTION: Tells whether a raw read of nbytes can return without waiting (any longer).
+ *   INPUTS: ld - line discipline
+ *           nbytes - size of the read
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the read is done, 0 if it has to wait
+ *   SIDE EFFECTS: none
+ */
+int32_t ldisc_read_ready(ldisc_t* ld, int32_t nbytes) {
+    uint32_t count = ldisc_count(ld);
+    uint32_t want = ld->mode.vmin;
+
+    if(want > (uint32_t)nbytes)
+        want = nbytes;
+
+    // VMIN 0 reads finish as soon as there is anything, with VTIME 0 even with nothing
+    if(want == 0)
+        return count > 0 || ld->mode.vtime == 0;
+    return count >= want;
+}
+
+/*
+ * ldisc_read_deadline
+ *   DESCRIPTION: Works out when a raw read that is not ready yet stops waiting. With VMIN 0 the
+ *                VTIME timer runs from the start of the read; otherwise it runs from the last byte
+ *                and only once a first byte has arrived.
+ *   INPUTS: ld - line discipline
+ *           start - RTC tick the read started at
+ *   OUTPUTS: none
+ *   RETURN VALUE: RTC tick to give up at, 0 to wait without a timeout
+ *   SIDE EFFECTS: none
+ */
+uint32_t ldisc_read_deadline(ldisc_t* ld, uint32_t start) {
+    uint32_t deadline;
+
+    if(ld->mode.vtime == 0)
+        return 0;
+    if(ld->mode.vmin == 0)
+        deadline = start + ld->mode.vtime * RTC_TENTH;
+    else if(ldisc_count(ld) > 0)
+        deadline = ld->last_rx + ld->mode.vtime * RTC_TENTH;
+    else
+        return 0;
+
+    return (deadline == 0) ? 1 : deadline;
+}
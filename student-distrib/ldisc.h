@@ -0,0 +1,67 @@
+/* ldisc.h - Terminal line discipline: canonical and raw input modes */
+
+#ifndef _LDISC_H
+#define _LDISC_H
+
+#include "types.h"
+
+/* term_mode_t.lflag bits */
+#define LDISC_ICANON        0x1         // Line at a time with editing, otherwise raw keystrokes
+#define LDISC_ECHO          0x2         // Echo raw input (canonical input is always echoed)
+#define LDISC_DEFAULT       (LDISC_ICANON | LDISC_ECHO)
+
+/* Terminal ioctl commands */
+#define TCGETMODE           0x5401      // arg: term_mode_t* to fill in
+#define TCSETMODE           0x5402      // arg: term_mode_t* to switch to
+#define TCFLUSH             0x540B      // Drop raw input nobody has read yet
+
+#define LDISC_QUEUE_SIZE    256         // Raw input bytes a terminal can hold (power of two)
+
+/* Input mode of a terminal, VMIN/VTIME only matter in raw mode:
+ *   vmin > 0, vtime = 0: wait for vmin bytes
+ *   vmin = 0, vtime = 0: return whatever is there, possibly nothing
+ *   vmin > 0, vtime > 0: wait for a first byte, then for vmin bytes or a gap of vtime tenths of a second
+ *   vmin = 0, vtime > 0: wait at most vtime tenths of a second for a byte */
+typedef struct term_mode {
+    uint32_t lflag;
+    uint8_t vmin;
+    uint8_t vtime;
+} term_mode_t;
+
+typedef struct ldisc {
+    term_mode_t mode;
+    int32_t owner;                      // PID that changed the mode, -1 while it is the default
+    uint8_t queue[LDISC_QUEUE_SIZE];    // Raw input, head and tail run free
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t last_rx;                   // RTC tick the last byte arrived at, for VTIME
+} ldisc_t;
+
+/* Raw input bytes a terminal holds, LDISC_QUEUE_SIZE unless tty.queue says otherwise */
+extern uint32_t ldisc_queue_size;
+
+/* Put a line discipline back to canonical mode with an empty queue */
+void ldisc_init(ldisc_t* ld);
+
+/* Queue a raw input byte, -1 if the queue is full */
+int32_t ldisc_receive(ldisc_t* ld, uint8_t c);
+
+/* Bytes waiting to be read */
+uint32_t ldisc_count(ldisc_t* ld);
+
+/* Take up to n bytes, returns how many were taken */
+uint32_t ldisc_take(ldisc_t* ld, uint8_t* buf, uint32_t n);
+
+/* Drop every queued byte */
+void ldisc_flush(ldisc_t* ld);
+
+/* Check and apply a new mode, -1 if it has unknown flags */
+int32_t ldisc_set_mode(ldisc_t* ld, const term_mode_t* mode, int32_t pid);
+
+/* Whether enough raw input is there to finish a read of nbytes right away */
+int32_t ldisc_read_ready(ldisc_t* ld, int32_t nbytes);
+
+/* RTC tick a raw read that started at start gives up at, 0 if it waits without a timeout */
+uint32_t ldisc_read_deadline(ldisc_t* ld, uint32_t start);
+
+#endif /* _LDISC_H */
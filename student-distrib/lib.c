@@ -4,32 +4,65 @@
 #include "lib.h"
 #include "keyboard.h"
 #include "pit.h"
+#include "console.h"
 
 #define ATTRIB      0x7
+#define BLANK_CELL  ((ATTRIB << 8) | ' ')
 
 #define CRTC_ADD    0x3D4
 #define CRTC_DATA   0x3D5
 
 static int screen_x;
 static int screen_y;
-static char* video_mem = (char *)VIDEO;
+static uint16_t* video_mem = (uint16_t *)VIDEO;         // Cells the screen functions draw into
+static volatile uint32_t no_dirty;
+static volatile uint32_t* video_dirty = &no_dirty;      // Bit y set once row y of video_mem changed
+static uint32_t mem_sse2 = 0;       // 1 once memcpy and memset may use SSE2
+
+/* What sse_begin saves for sse_end */
+typedef struct sse_state {
+    uint32_t flags;
+    uint32_t cr0;
+    uint8_t xmm[SSE_SAVED_REGS * SSE_ALIGN];
+} sse_state_t;
+
+static void screen_putc(uint8_t c);
+static int32_t screen_puts(int8_t* s);
+
+/* void mark_rows(int top, int bottom);
+ * Inputs: top, bottom = first and last row that changed
+ * Return Value: none
+ * Function: Marks rows of video_mem for the next console flush */
+static void mark_rows(int top, int bottom) {
+    uint32_t rows = ((1U << (bottom + 1)) - 1) & ~((1U << top) - 1);
+    asm volatile("lock; orl %1, %0" : "+m"(*video_dirty) : "r"(rows) : "memory", "cc");
+}
+
+/* void screen_target(uint16_t* cells, volatile uint32_t* dirty);
+ * Inputs: cells = NUM_ROWS * NUM_COLS cells to draw into
+ *         dirty = row bitmap to mark changed rows in
+ * Return Value: none
+ * Function: Points the screen functions at a buffer, called by console_select */
+void screen_target(uint16_t* cells, volatile uint32_t* dirty) {
+    video_mem = cells;
+    video_dirty = dirty;
+}
 
 /* void clear(void);
  * Inputs: void
  * Return Value: none
  * Function: Clears video memory */
 void clear(void) {
-    int32_t i;
-    vidmem_set(get_curr_term());
-    for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
-        *(uint8_t *)(video_mem + (i << 1)) = ' ';
-        *(uint8_t *)(video_mem + (i << 1) + 1) = ATTRIB;
-    }
+    uint8_t t = get_curr_term();
+
+    console_select(t);
+    memset_word(video_mem, BLANK_CELL, NUM_ROWS * NUM_COLS);
+    mark_rows(0, NUM_ROWS - 1);
 
     screen_x = 0;
     screen_y = 0;
 
-    vidmem_set(get_round_robin_term());
+    console_flush(t);
 }
 
 /* Standard printf().
@@ -50,6 +83,7 @@ void clear(void) {
  *       Also note: %x is the only conversion specifier that can use
  *       the "#" modifier to alter output. */
 int32_t printf(int8_t *format, ...) {
+    uint8_t t = get_curr_term();
 
     /* Pointer to the format string */
     int8_t* buf = format;
@@ -58,6 +92,9 @@ int32_t printf(int8_t *format, ...) {
     int32_t* esp = (void *)&format;
     esp++;
 
+    /* Draw the whole string, then flush the rows it touched once */
+    console_select(t);
+
     while (*buf != '\0') {
         switch (*buf) {
             case '%':
@@ -70,7 +107,7 @@ format_char_switch:
                     switch (*buf) {
                         /* Print a literal '%' character */
                         case '%':
-                            putc('%');
+                            screen_putc('%');
                             break;
 
                         /* Use alternate formatting */
@@ -88,7 +125,7 @@ format_char_switch:
                                 int8_t conv_buf[64];
                                 if (alternate == 0) {
                                     itoa(*((uint32_t *)esp), conv_buf, 16);
-                                    puts(conv_buf);
+                                    screen_puts(conv_buf);
                                 } else {
                                     int32_t starting_index;
                                     int32_t i;
@@ -98,7 +135,7 @@ format_char_switch:
                                         conv_buf[i] = '0';
                                         i++;
                                     }
-                                    puts(&conv_buf[starting_index]);
+                                    screen_puts(&conv_buf[starting_index]);
                                 }
                                 esp++;
                             }
@@ -109,7 +146,7 @@ format_char_switch:
                             {
                                 int8_t conv_buf[36];
                                 itoa(*((uint32_t *)esp), conv_buf, 10);
-                                puts(conv_buf);
+                                screen_puts(conv_buf);
                                 esp++;
                             }
                             break;
@@ -125,20 +162,20 @@ format_char_switch:
                                 } else {
                                     itoa(value, conv_buf, 10);
                                 }
-                                puts(conv_buf);
+                                screen_puts(conv_buf);
                                 esp++;
                             }
                             break;
 
                         /* Print a single character */
                         case 'c':
-                            putc((uint8_t) *((int32_t *)esp));
+                            screen_putc((uint8_t) *((int32_t *)esp));
                             esp++;
                             break;
 
                         /* Print a NULL-terminated string */
                         case 's':
-                            puts(*((int8_t **)esp));
+                            screen_puts(*((int8_t **)esp));
                             esp++;
                             break;
 
@@ -150,11 +187,13 @@ format_char_switch:
                 break;
 
             default:
-                putc(*buf);
+                screen_putc(*buf);
                 break;
         }
         buf++;
     }
+
+    console_flush(t);
     return (buf - format);
 }
 
@@ -163,9 +202,23 @@ format_char_switch:
  *   Return Value: Number of bytes written
  *    Function: Output a string to the console */
 int32_t puts(int8_t* s) {
+    uint8_t t = get_curr_term();
+    int32_t index;
+
+    console_select(t);
+    index = screen_puts(s);
+    console_flush(t);
+    return index;
+}
+
+/* int32_t screen_puts(int8_t* s);
+ *   Inputs: int_8* s = pointer to a string of characters
+ *   Return Value: Number of bytes written
+ *    Function: Draw a string without flushing it */
+static int32_t screen_puts(int8_t* s) {
     register int32_t index = 0;
     while (s[index] != '\0') {
-        putc(s[index]);
+        screen_putc(s[index]);
         index++;
     }
     return index;
@@ -176,8 +229,18 @@ int32_t puts(int8_t* s) {
  * Return Value: void
  *  Function: Output a character to the console */
 void putc(uint8_t c) {
-    vidmem_set(get_curr_term());
+    uint8_t t = get_curr_term();
+
+    console_select(t);
+    screen_putc(c);
+    console_flush(t);
+}
 
+/* void screen_putc(uint8_t c);
+ * Inputs: uint_8* c = character to print
+ * Return Value: void
+ *  Function: Draw a character without flushing it */
+static void screen_putc(uint8_t c) {
     if(c == '\n' || c == '\r') {
         screen_y++;
         if(screen_y >= NUM_ROWS){
@@ -185,8 +248,8 @@ void putc(uint8_t c) {
         }
         screen_x = 0;
     } else {
-        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = c;
-        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
+        video_mem[NUM_COLS * screen_y + screen_x] = (ATTRIB << 8) | c;
+        mark_rows(screen_y, screen_y);
         screen_x++;
         if (screen_x >= NUM_COLS){
             screen_x = 0;
@@ -198,8 +261,6 @@ void putc(uint8_t c) {
     }
 
     update_cursor();
-    
-    vidmem_set(get_round_robin_term());
 }
 
 /* void update_cursor();
@@ -223,30 +284,70 @@ void update_cursor()
  * Return Value: void
  *  Function: Move every row up one */
 void scroll_up(){
-    uint32_t y;
-    uint32_t x;
-    uint32_t old_loc;
-    uint32_t new_loc;
-
-    // Move each row up
-    for(y = 0; y < NUM_ROWS - 1; y++){
-        for(x = 0; x < NUM_COLS; x++){
-            old_loc = NUM_COLS*(y+1) + x;
-            new_loc = NUM_COLS*y + x;
-            *(uint8_t *)(video_mem + (new_loc<< 1)) = *(uint8_t *)(video_mem + (old_loc << 1));
-        }
-    }
-
-    // Clean bottom row
-    for(x = 0; x < NUM_COLS; x++){
-        *(uint8_t *)(video_mem + ((NUM_COLS * (NUM_ROWS - 1) + x) << 1)) = ' ';
-    }
+    // Move each row up (attributes too, colored text keeps its color) and clean the bottom row
+    screen_scroll(0, NUM_ROWS - 1, 1, BLANK_CELL);
 
     // Set screen_x and screen_y
     screen_x = 0;
     screen_y = NUM_ROWS - 1;
 }
 
+/* void screen_scroll(int top, int bottom, int n, uint16_t blank);
+ * Inputs: top, bottom = first and last row of the region to scroll
+ *         n = rows to scroll, up if positive and down if negative
+ *         blank = cell (attribute << 8 | character) the uncovered rows get
+ * Return Value: void
+ *  Function: Scrolls part of the screen with one move for the whole region.
+ *            Doesn't move the cursor. */
+void screen_scroll(int top, int bottom, int n, uint16_t blank){
+    uint16_t* cells = video_mem;
+    int rows;
+
+    if(top < 0 || bottom >= NUM_ROWS || top > bottom || n == 0)
+        return;
+    mark_rows(top, bottom);
+
+    rows = bottom - top + 1;
+    if(n >= rows || -n >= rows){
+        memset_word(cells + NUM_COLS * top, blank, NUM_COLS * rows);
+        return;
+    }
+
+    if(n > 0){
+        memmove(cells + NUM_COLS * top, cells + NUM_COLS * (top + n), NUM_COLS * (rows - n) * 2);
+        memset_word(cells + NUM_COLS * (bottom - n + 1), blank, NUM_COLS * n);
+    } else {
+        memmove(cells + NUM_COLS * (top - n), cells + NUM_COLS * top, NUM_COLS * (rows + n) * 2);
+        memset_word(cells + NUM_COLS * top, blank, NUM_COLS * -n);
+    }
+}
+
+/* void screen_write_cells(int x, int y, const uint16_t* cells, int n);
+ * Inputs: x, y = first cell to write
+ *         cells = attribute << 8 | character of every cell
+ *         n = number of cells, they must fit on the screen
+ * Return Value: void
+ *  Function: Copies a span of cells to video memory in one go */
+void screen_write_cells(int x, int y, const uint16_t* cells, int n){
+    if(n > 0){
+        memcpy(video_mem + NUM_COLS * y + x, cells, n * 2);
+        mark_rows(y, y);
+    }
+}
+
+/* void screen_fill_cells(int x, int y, uint16_t cell, int n);
+ * Inputs: x, y = first cell to fill
+ *         cell = attribute << 8 | character to fill with
+ *         n = number of cells, may run on to the next rows but must fit on the screen
+ * Return Value: void
+ *  Function: Fills a span of the screen with one cell */
+void screen_fill_cells(int x, int y, uint16_t cell, int n){
+    if(n > 0){
+        memset_word(video_mem + NUM_COLS * y + x, cell, n);
+        mark_rows(y, (NUM_COLS * y + x + n - 1) / NUM_COLS);
+    }
+}
+
 // /* void clear();
 //  * Inputs: none
 //  * Return Value: void
@@ -275,7 +376,13 @@ void scroll_up(){
  * Return Value: void
  *  Function: Deletes last character printed */
 void backspace(){
-    vidmem_set(get_curr_term());
+    uint8_t t = get_curr_term();
+
+    // Nothing before the top left corner
+    if (screen_x == 0 && screen_y == 0)
+        return;
+
+    console_select(t);
 
     if (screen_x == 0){
         screen_x = NUM_COLS - 1;
@@ -285,9 +392,9 @@ void backspace(){
         screen_x--;
     }
     
-    *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = ' ';
-    *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
-    vidmem_set(get_round_robin_term());
+    video_mem[NUM_COLS * screen_y + screen_x] = BLANK_CELL;
+    mark_rows(screen_y, screen_y);
+    console_flush(t);
 }
 
 /* void set_screen_x();
@@ -395,8 +502,21 @@ uint32_t strlen(const int8_t* s) {
  *          int32_t c = value to set memory to
  *         uint32_t n = number of bytes to set
  * Return Value: new string
- * Function: set n consecutive bytes of pointer s to value c */
+ * Function: set n consecutive bytes of pointer s to value c, large
+ *           blocks use SSE2 stores when the CPU has them */
 void* memset(void* s, int32_t c, uint32_t n) {
+    if(mem_sse2 && n >= MEM_SSE_MIN)
+        return memset_sse2(s, c, n);
+    return memset_rep(s, c, n);
+}
+
+/* void* memset_rep(void* s, int32_t c, uint32_t n);
+ * Inputs:    void* s = pointer to memory
+ *          int32_t c = value to set memory to
+ *         uint32_t n = number of bytes to set
+ * Return Value: new string
+ * Function: set n consecutive bytes of pointer s to value c with rep stosl */
+void* memset_rep(void* s, int32_t c, uint32_t n) {
     c &= 0xFF;
     asm volatile ("                 \n\
             .memset_top:            \n\
@@ -478,8 +598,21 @@ void* memset_dword(void* s, int32_t c, uint32_t n) {
  *         const void* src = source of copy
  *              uint32_t n = number of byets to copy
  * Return Value: pointer to dest
- * Function: copy n bytes of src to dest */
+ * Function: copy n bytes of src to dest, large blocks use SSE2
+ *           when the CPU has it */
 void* memcpy(void* dest, const void* src, uint32_t n) {
+    if(mem_sse2 && n >= MEM_SSE_MIN)
+        return memcpy_sse2(dest, src, n);
+    return memcpy_rep(dest, src, n);
+}
+
+/* void* memcpy_rep(void* dest, const void* src, uint32_t n);
+ * Inputs:      void* dest = destination of copy
+ *         const void* src = source of copy
+ *              uint32_t n = number of byets to copy
+ * Return Value: pointer to dest
+ * Function: copy n bytes of src to dest with rep movsl */
+void* memcpy_rep(void* dest, const void* src, uint32_t n) {
     asm volatile ("                 \n\
             .memcpy_top:            \n\
             testl   %%ecx, %%ecx    \n\
@@ -518,6 +651,209 @@ void* memcpy(void* dest, const void* src, uint32_t n) {
     return dest;
 }
 
+/* Saves the SSE registers the copy loops use and lets the kernel touch them.
+ * Interrupts stay off until sse_end, so nothing else can run in between. */
+static void sse_begin(sse_state_t* st) {
+    cli_and_save(st->flags);
+    asm volatile ("movl %%cr0, %0" : "=r"(st->cr0));
+    asm volatile ("                         \n\
+            clts                            \n\
+            movdqu  %%xmm0, (%0)            \n\
+            movdqu  %%xmm1, 16(%0)          \n\
+            movdqu  %%xmm2, 32(%0)          \n\
+            movdqu  %%xmm3, 48(%0)          \n\
+            "
+            :
+            : "r"(st->xmm)
+            : "memory"
+    );
+}
+
+/* Gives the SSE registers back to their owner and restores CR0.TS and interrupts */
+static void sse_end(sse_state_t* st) {
+    asm volatile ("                         \n\
+            movdqu  (%0), %%xmm0            \n\
+            movdqu  16(%0), %%xmm1          \n\
+            movdqu  32(%0), %%xmm2          \n\
+            movdqu  48(%0), %%xmm3          \n\
+            "
+            :
+            : "r"(st->xmm)
+            : "memory"
+    );
+    asm volatile ("movl %0, %%cr0" : : "r"(st->cr0) : "memory");
+    restore_flags(st->flags);
+}
+
+/* void mem_enable_sse2(void);
+ * Inputs: none
+ * Return Value: none
+ * Function: lets memcpy and memset use SSE2, called once CPUID showed SSE2
+ *           and CR4.OSFXSR is set */
+void mem_enable_sse2(void) {
+    mem_sse2 = 1;
+}
+
+/* uint32_t mem_has_sse2(void);
+ * Inputs: none
+ * Return Value: 1 if memcpy and memset use SSE2
+ * Function: tells whether the SSE2 variants may be called */
+uint32_t mem_has_sse2(void) {
+    return mem_sse2;
+}
+
+/* void* memcpy_sse2(void* dest, const void* src, uint32_t n);
+ * Inputs:      void* dest = destination of copy
+ *         const void* src = source of copy
+ *              uint32_t n = number of byets to copy
+ * Return Value: pointer to dest
+ * Function: copy n bytes of src to dest, 64 bytes at a time into 16 byte
+ *           aligned stores. Copies of MEM_NT_MIN bytes and more use
+ *           non-temporal stores so they don't flush the cache. Interrupts
+ *           are only held off for MEM_SSE_CHUNK bytes at a time. */
+void* memcpy_sse2(void* dest, const void* src, uint32_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    uint32_t head = (-(uint32_t)d) & (SSE_ALIGN - 1);
+    uint32_t nt = (n >= MEM_NT_MIN);
+    uint32_t blocks, chunk;
+    sse_state_t st;
+
+    if(head > n)
+        head = n;
+    memcpy_rep(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    while(n >= SSE_BLOCK){
+        chunk = (n < MEM_SSE_CHUNK) ? n : MEM_SSE_CHUNK;
+        blocks = chunk / SSE_BLOCK;
+        n -= blocks * SSE_BLOCK;
+
+        sse_begin(&st);
+        if(nt){
+            asm volatile ("                     \n\
+                    1:                          \n\
+                    movdqu  (%0), %%xmm0        \n\
+                    movdqu  16(%0), %%xmm1      \n\
+                    movdqu  32(%0), %%xmm2      \n\
+                    movdqu  48(%0), %%xmm3      \n\
+                    movntdq %%xmm0, (%1)        \n\
+                    movntdq %%xmm1, 16(%1)      \n\
+                    movntdq %%xmm2, 32(%1)      \n\
+                    movntdq %%xmm3, 48(%1)      \n\
+                    addl    $64, %0             \n\
+                    addl    $64, %1             \n\
+                    decl    %2                  \n\
+                    jnz     1b                  \n\
+                    sfence                      \n\
+                    "
+                    : "+r"(s), "+r"(d), "+r"(blocks)
+                    :
+                    : "memory", "cc"
+            );
+        } else {
+            asm volatile ("                     \n\
+                    1:                          \n\
+                    movdqu  (%0), %%xmm0        \n\
+                    movdqu  16(%0), %%xmm1      \n\
+                    movdqu  32(%0), %%xmm2      \n\
+                    movdqu  48(%0), %%xmm3      \n\
+                    movdqa  %%xmm0, (%1)        \n\
+                    movdqa  %%xmm1, 16(%1)      \n\
+                    movdqa  %%xmm2, 32(%1)      \n\
+                    movdqa  %%xmm3, 48(%1)      \n\
+                    addl    $64, %0             \n\
+                    addl    $64, %1             \n\
+                    decl    %2                  \n\
+                    jnz     1b                  \n\
+                    "
+                    : "+r"(s), "+r"(d), "+r"(blocks)
+                    :
+                    : "memory", "cc"
+            );
+        }
+        sse_end(&st);
+    }
+
+    memcpy_rep(d, s, n);
+    return dest;
+}
+
+/* void* memset_sse2(void* s, int32_t c, uint32_t n);
+ * Inputs:    void* s = pointer to memory
+ *          int32_t c = value to set memory to
+ *         uint32_t n = number of bytes to set
+ * Return Value: new string
+ * Function: set n consecutive bytes of pointer s to value c with 16 byte
+ *           aligned stores, non-temporal from MEM_NT_MIN bytes on */
+void* memset_sse2(void* s, int32_t c, uint32_t n) {
+    uint8_t* d = (uint8_t*)s;
+    uint32_t head = (-(uint32_t)d) & (SSE_ALIGN - 1);
+    uint32_t nt = (n >= MEM_NT_MIN);
+    uint32_t pattern;
+    uint32_t blocks, chunk;
+    sse_state_t st;
+
+    c &= 0xFF;
+    pattern = c << 24 | c << 16 | c << 8 | c;
+
+    if(head > n)
+        head = n;
+    memset_rep(d, c, head);
+    d += head;
+    n -= head;
+
+    while(n >= SSE_BLOCK){
+        chunk = (n < MEM_SSE_CHUNK) ? n : MEM_SSE_CHUNK;
+        blocks = chunk / SSE_BLOCK;
+        n -= blocks * SSE_BLOCK;
+
+        sse_begin(&st);
+        if(nt){
+            asm volatile ("                     \n\
+                    movd    %2, %%xmm0          \n\
+                    pshufd  $0, %%xmm0, %%xmm0  \n\
+                    1:                          \n\
+                    movntdq %%xmm0, (%0)        \n\
+                    movntdq %%xmm0, 16(%0)      \n\
+                    movntdq %%xmm0, 32(%0)      \n\
+                    movntdq %%xmm0, 48(%0)      \n\
+                    addl    $64, %0             \n\
+                    decl    %1                  \n\
+                    jnz     1b                  \n\
+                    sfence                      \n\
+                    "
+                    : "+r"(d), "+r"(blocks)
+                    : "r"(pattern)
+                    : "memory", "cc"
+            );
+        } else {
+            asm volatile ("                     \n\
+                    movd    %2, %%xmm0          \n\
+                    pshufd  $0, %%xmm0, %%xmm0  \n\
+                    1:                          \n\
+                    movdqa  %%xmm0, (%0)        \n\
+                    movdqa  %%xmm0, 16(%0)      \n\
+                    movdqa  %%xmm0, 32(%0)      \n\
+                    movdqa  %%xmm0, 48(%0)      \n\
+                    addl    $64, %0             \n\
+                    decl    %1                  \n\
+                    jnz     1b                  \n\
+                    "
+                    : "+r"(d), "+r"(blocks)
+                    : "r"(pattern)
+                    : "memory", "cc"
+            );
+        }
+        sse_end(&st);
+    }
+
+    memset_rep(d, c, n);
+    return s;
+}
+
 /* void* memmove(void* dest, const void* src, uint32_t n);
  * Description: Optimized memmove (used for overlapping memory areas)
  * Inputs:      void* dest = destination of move
@@ -526,6 +862,10 @@ void* memcpy(void* dest, const void* src, uint32_t n) {
  * Return Value: pointer to dest
  * Function: move n bytes of src to dest */
 void* memmove(void* dest, const void* src, uint32_t n) {
+    // Copying forward is safe unless dest starts inside src
+    if((uint32_t)dest <= (uint32_t)src || (uint32_t)dest >= (uint32_t)src + n)
+        return memcpy(dest, src, n);
+
     asm volatile ("                             \n\
             movw    %%ds, %%dx                  \n\
             movw    %%dx, %%es                  \n\
@@ -537,6 +877,7 @@ void* memmove(void* dest, const void* src, uint32_t n) {
             std                                 \n\
             .memmove_go:                        \n\
             rep     movsb                       \n\
+            cld                                 \n\
             "
             :
             : "D"(dest), "S"(src), "c"(n)
@@ -611,8 +952,13 @@ int8_t* strncpy(int8_t* dest, const int8_t* src, uint32_t n) {
  * Return Value: void
  * Function: increments video memory. To be used to test rtc */
 void test_interrupts(void) {
+    uint8_t t = get_curr_term();
     int32_t i;
+
+    console_select(t);
     for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
-        video_mem[i << 1]++;
+        ((uint8_t *)video_mem)[i << 1]++;
     }
+    mark_rows(0, NUM_ROWS - 1);
+    console_flush(t);
 }
@@ -11,6 +11,13 @@
 #define NUM_COLS    80
 #define NUM_ROWS    25
 
+#define MEM_SSE_MIN     256         // Smallest memcpy/memset handed to the SSE2 variants
+#define MEM_NT_MIN      0x40000     // From here on stores bypass the cache (256kB)
+#define MEM_SSE_CHUNK   0x10000     // Most bytes copied with interrupts off (64kB)
+#define SSE_ALIGN       16          // Alignment of an SSE store
+#define SSE_BLOCK       64          // Bytes moved per loop iteration
+#define SSE_SAVED_REGS  4           // xmm0-xmm3
+
 int32_t printf(int8_t *format, ...);
 void putc(uint8_t c);
 void backspace();
@@ -19,6 +26,10 @@ void set_screen_y(int i);
 int get_screen_x();
 int get_screen_y();
 void scroll_up();
+void screen_scroll(int top, int bottom, int n, uint16_t blank);
+void screen_write_cells(int x, int y, const uint16_t* cells, int n);
+void screen_fill_cells(int x, int y, uint16_t cell, int n);
+void screen_target(uint16_t* cells, volatile uint32_t* dirty);
 void update_cursor();
 int32_t puts(int8_t *s);
 int8_t *itoa(uint32_t value, int8_t* buf, int32_t radix);
@@ -30,6 +41,12 @@ void* memset(void* s, int32_t c, uint32_t n);
 void* memset_word(void* s, int32_t c, uint32_t n);
 void* memset_dword(void* s, int32_t c, uint32_t n);
 void* memcpy(void* dest, const void* src, uint32_t n);
+void* memset_rep(void* s, int32_t c, uint32_t n);
+void* memcpy_rep(void* dest, const void* src, uint32_t n);
+void* memset_sse2(void* s, int32_t c, uint32_t n);
+void* memcpy_sse2(void* dest, const void* src, uint32_t n);
+void mem_enable_sse2(void);
+uint32_t mem_has_sse2(void);
 void* memmove(void* dest, const void* src, uint32_t n);
 int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n);
 int8_t* strcpy(int8_t* dest, const int8_t*src);
@@ -86,6 +103,18 @@ static inline uint32_t inl(port) {
     return val;
 }
 
+/* Reads the low 32 bits of the time-stamp counter. Good for measuring
+ * intervals of a few seconds or less. */
+static inline uint32_t rdtsc_low(void) {
+    uint32_t lo;
+    asm volatile ("rdtsc"
+            : "=a"(lo)
+            :
+            : "edx"
+    );
+    return lo;
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -109,7 +138,7 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile ("outl %l1, (%w0)"     \
+    asm volatile ("outl %k1, (%w0)"     \
             :                           \
             : "d"(port), "a"(data)      \
             : "memory", "cc"            \
@@ -54,6 +54,17 @@ void initialize_paging() {
     base_dir[1].MB_dir.P = 1;        // Present
     base_dir[1].MB_dir.PS = 1;       // Page Size
     base_dir[1].MB_dir.address = 1;  // Address should point to the physical memory of the kernel page (doubt)
+
+    // Identity map the frame pool with 4MB supervisor pages so the kernel can touch any frame directly.
+    for(i = FRAME_POOL_START >> 22; i < FRAME_POOL_END >> 22; i++){
+        base_dir[i].MB_dir.R_W = 1;      // Read/Write
+        base_dir[i].MB_dir.U_S = 0;      // Supervisor only
+        base_dir[i].MB_dir.PS = 1;       // Page Size
+        base_dir[i].MB_dir.add_20_13 = 0;
+        base_dir[i].MB_dir.RSVD = 0;
+        base_dir[i].MB_dir.address = i;  // Identity map
+        base_dir[i].MB_dir.P = 1;        // Present
+    }
  
     load_directory((uint32_t*) base_dir);
     }
@@ -62,30 +73,27 @@ void initialize_paging() {
 
 /* MP3.3!!!
  * paging_for_execute
- *   DESCRIPTION: Sets up the paging for execute system call and will also be called in halt system call to restore parent paging. The PID input plays a significant role in accessing the physical memeory of each program. 
- *   INPUTS: uint32_t pid.
+ *   DESCRIPTION: Maps the user memory of a process at 128MB. Called when a process is started, switched to,
+ *                and in halt to restore the parent. The page table is what tells processes apart, every
+ *                process has its own one (see alloc_user_pages).
+ *   INPUTS: page_table - the process' user page table, NULL to leave user memory unmapped.
  *   OUTPUTS: none.
  *   RETURN VALUE: none.
+ *   SIDE EFFECTS: Flushes the TLB.
  */
 
-void paging_for_execute(uint32_t pid) {
+void paging_for_execute(uint32_t* page_table) {
    uint32_t index; // to find
 
-   index = (0x08000000>>22); //0x08000000 is the index where the program info will be stored (virtual mem)
-    base_dir[index].MB_dir.P = 1; // Present is 1
-    base_dir[index].MB_dir.R_W = 1; // Read-Write is 1
-    base_dir[index].MB_dir.U_S = 1; // Supervisor mode
-    base_dir[index].MB_dir.PWT = 0;
-    base_dir[index].MB_dir.PCD = 0;
-    base_dir[index].MB_dir.A= 0;
-    base_dir[index].MB_dir.D = 0;
-    base_dir[index].MB_dir.PS = 1; // Page Size is 1
-    base_dir[index].MB_dir.G = 0;
-    base_dir[index].MB_dir.AVL_11_9 = 0;
-    base_dir[index].MB_dir.PAT = 0;
-    base_dir[index].MB_dir.add_20_13= 0;
-    base_dir[index].MB_dir.RSVD = 0;
-    base_dir[index].MB_dir.address = 2+pid; // find using PID; 
+   index = (USER_PAGES_START>>22); //0x08000000 is the index where the program info will be stored (virtual mem)
+    base_dir[index].KB_dir.val = 0;
+    if(page_table != NULL){
+        base_dir[index].KB_dir.P = 1; // Present is 1
+        base_dir[index].KB_dir.R_W = 1; // Read-Write is 1, the page table entries decide
+        base_dir[index].KB_dir.U_S = 1; // User mode
+        base_dir[index].KB_dir.PS = 0; // 4KB pages
+        base_dir[index].KB_dir.address = (uint32_t)page_table >> 12;
+    }
 
     flush_tlb(); // flush tlb
 
@@ -116,42 +124,47 @@ void flush_tlb() {
 
 /* MP3.4!!!
  * initialize_paging_vidmem
- *   DESCRIPTION: We use to set the virtual and physicals addresses for vidmem.
+ *   DESCRIPTION: Builds the vidmap page table of every terminal. Each one maps a single page at
+ *                VIDEO_VIRTUAL: the screen for terminal 0, which is shown first, and the backing
+ *                page for the others. Processes get one of them through paging_vidmap.
  *   INPUTS: none.
  *   OUTPUTS: none.
  *   RETURN VALUE: none.
- *   SIDE EFFECTS: Flushes tlb, sets the paging for vidmem.
+ *   SIDE EFFECTS: none.
  */
 void initialize_paging_vidmem() {
-    int j = 0;
-    // Initialize page table for vidmem.
-    for(j = 0; j < TABLE_SIZE; j++){
-        pte_vidmap[j].PWT = 0;      // Write-through
-        pte_vidmap[j].PCD = 0;      // Cache Disable
-        pte_vidmap[j].A = 0;        // Accessed
-        pte_vidmap[j].D = 0;        // Dirty
-        pte_vidmap[j].PAT = 0;      // Page Attribute Table
-        pte_vidmap[j].G = 0;        // Global
-        pte_vidmap[j].AVL_3 = 0;    // Available
-        pte_vidmap[j].address = (uint32_t)VIDEO >> 12;  
-        pte_vidmap[j].P = 1;        // Present
-        pte_vidmap[j].R_W = 1;      // Read/Write
-        pte_vidmap[j].U_S = 1;      // User/Supervisor
+    int t, j;
+
+    for(t = 0; t < VIDMAP_TABLES; t++){
+        for(j = 0; j < TABLE_SIZE; j++)
+            pte_vidmap[t][j].val = 0;
+        pte_vidmap[t][0].address = (t == 0) ? (uint32_t)VIDEO >> 12 : ((uint32_t)VIDEO >> 12) + t + 1;
+        pte_vidmap[t][0].R_W = 1;      // Read/Write
+        pte_vidmap[t][0].U_S = 1;      // User/Supervisor
+        pte_vidmap[t][0].P = 1;        // Present
     }
-    // Align virtual address before using to map videomem to.
+}
+
+/*
+ * paging_vidmap
+ *   DESCRIPTION: Puts a terminal's vidmap page table at VIDEO_VIRTUAL, or takes VIDEO_VIRTUAL
+ *                away. Called for every process switch, before paging_for_execute flushes the TLB.
+ *   INPUTS: t - terminal of a process that called vidmap, -1 for a process that didn't
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: none, the caller flushes the TLB.
+ */
+void paging_vidmap(int32_t t) {
     uint32_t i = (uint32_t)VIDEO_VIRTUAL >> 22;
-    base_dir[i].KB_dir.P = 1;  
-    base_dir[i].KB_dir.R_W = 1;      
-    base_dir[i].KB_dir.U_S = 1;      
-    base_dir[i].KB_dir.PWT = 0;      
-    base_dir[i].KB_dir.PCD = 0;      
-    base_dir[i].KB_dir.A = 0;        
-    base_dir[i].KB_dir.PS = 0;       
-    base_dir[i].KB_dir.AVL_1 = 0;    
-    base_dir[i].KB_dir.AVL_4 = 0;    
-    base_dir[i].KB_dir.address = (uint32_t)pte_vidmap >> 12;  
 
-    flush_tlb();
+    base_dir[i].KB_dir.val = 0;
+    if(t >= 0 && t < VIDMAP_TABLES){
+        base_dir[i].KB_dir.R_W = 1;      // Read/Write
+        base_dir[i].KB_dir.U_S = 1;      // User/Supervisor
+        base_dir[i].KB_dir.PS = 0;       // 4KB pages
+        base_dir[i].KB_dir.address = (uint32_t)pte_vidmap[t] >> 12;
+        base_dir[i].KB_dir.P = 1;        // Present
+    }
 }
 
 ////////////////////////////////////// Checkpoint 5 ////////////////////////////////////////////////////
@@ -181,40 +194,488 @@ void initialize_terminal_vidmem_paging(uint8_t j){
 
 /* MP3.5!!!
  * map_to_vidmem_page
- *   DESCRIPTION: we set a virtual address to a point to a specific vidmem page.
- *   INPUTS: physical_address
+ *   DESCRIPTION: Points a terminal's vidmap page at the screen or at its backing page, one PTE.
+ *   INPUTS: t - terminal
+ *           physical_address - page the terminal's output goes to
  *   OUTPUTS: none.
  *   RETURN VALUE: none.
- *   SIDE EFFECTS: Flushes tlb, sets the paging for vidmem.
+ *   SIDE EFFECTS: Drops the stale translation of VIDEO_VIRTUAL.
  */
-void map_to_vidmem_page(uint8_t physical_address) {
-    int j = 0;
-    // Initialize page table for vidmem.
-    for(j = 0; j < TABLE_SIZE; j++){
-        pte_vidmap[j].PWT = 0;      // Write-through
-        pte_vidmap[j].PCD = 0;      // Cache Disable
-        pte_vidmap[j].A = 0;        // Accessed
-        pte_vidmap[j].D = 0;        // Dirty
-        pte_vidmap[j].PAT = 0;      // Page Attribute Table
-        pte_vidmap[j].G = 0;        // Global
-        pte_vidmap[j].AVL_3 = 0;    // Available
-        pte_vidmap[j].address = physical_address >> 12;  
-        pte_vidmap[j].P = 1;        // Present
-        pte_vidmap[j].R_W = 1;      // Read/Write
-        pte_vidmap[j].U_S = 1;      // User/Supervisor
+void map_to_vidmem_page(uint32_t t, uint32_t physical_address) {
+    if(t >= VIDMAP_TABLES)
+        return;
+
+    pte_vidmap[t][0].address = physical_address >> 12;
+    asm volatile("invlpg (%0)" : : "r"(VIDEO_VIRTUAL) : "memory");
+}
+
+////////////////////////////////////// Frame pool ////////////////////////////////////////////////////
+
+// Free frames are kept on an intrusive stack: the first word of every free frame holds the next one.
+static uint32_t* free_frame_head = NULL;
+static uint32_t num_free_frames = 0;
+// Frames from here up were never handed out and aren't on the stack, so boot doesn't touch them all.
+static uint32_t frame_pool_next = FRAME_POOL_START;
+// Users of every frame, a frame goes back on the stack when its count drops to 0.
+static uint16_t frame_refs[NUM_FRAMES];
+
+#define FRAME_INDEX(addr)   (((uint32_t)(addr) - FRAME_POOL_START) / FRAME_SIZE)
+
+/*
+ * init_frame_pool
+ *   DESCRIPTION: Makes every 4KB frame between FRAME_POOL_START and FRAME_POOL_END free. The stack starts
+ *                empty, frames nobody had yet are handed out from the bottom of the pool up.
+ *   INPUTS: none.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: Must run after initialize_paging has mapped the pool.
+ */
+void init_frame_pool() {
+    free_frame_head = NULL;
+    frame_pool_next = FRAME_POOL_START;
+    num_free_frames = NUM_FRAMES;
+    memset(frame_refs, 0, sizeof(frame_refs));
+}
+
+/*
+ * alloc_frame
+ *   DESCRIPTION: Pops one 4KB frame off the free stack in O(1), or takes the next frame never used
+ *                before once the stack is empty.
+ *   INPUTS: none.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: Kernel (identity mapped) address of the frame, or NULL if the pool is empty.
+ *   SIDE EFFECTS: The frame contents are not cleared, its reference count starts at 1.
+ */
+void* alloc_frame() {
+    uint32_t flags;
+    uint32_t* frame;
+
+    cli_and_save(flags);
+    frame = free_frame_head;
+    if(frame != NULL){
+        free_frame_head = (uint32_t*)*frame;
+    } else if(frame_pool_next < FRAME_POOL_END){
+        frame = (uint32_t*)frame_pool_next;
+        frame_pool_next += FRAME_SIZE;
+    }
+    if(frame != NULL){
+        num_free_frames--;
+        frame_refs[FRAME_INDEX(frame)] = 1;
+    }
+    restore_flags(flags);
+
+    return frame;
+}
+
+/*
+ * free_frame
+ *   DESCRIPTION: Drops a reference to a frame obtained from alloc_frame, returning it to the pool in O(1)
+ *                once nobody uses it.
+ *   INPUTS: frame - frame to release.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: Ignores NULL, free frames and addresses outside of the pool.
+ */
+void free_frame(void* frame) {
+    uint32_t flags;
+    uint32_t addr = (uint32_t)frame;
+
+    if(addr < FRAME_POOL_START || addr >= FRAME_POOL_END || (addr & (FRAME_SIZE - 1)))
+        return;
+
+    cli_and_save(flags);
+    if(frame_refs[FRAME_INDEX(frame)] == 0 || --frame_refs[FRAME_INDEX(frame)] > 0){
+        restore_flags(flags);
+        return;
+    }
+    *(uint32_t**)frame = free_frame_head;
+    free_frame_head = (uint32_t*)frame;
+    num_free_frames++;
+    restore_flags(flags);
+}
+
+/* Getter for the number of frames left in the pool */
+uint32_t free_frame_count() {
+    return num_free_frames;
+}
+
+/*
+ * frame_get
+ *   DESCRIPTION: Adds a reference to an allocated frame, for a frame mapped by more than one process.
+ *   INPUTS: frame - frame to share.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: The frame takes one more free_frame to release.
+ */
+void frame_get(void* frame) {
+    uint32_t flags;
+    uint32_t addr = (uint32_t)frame;
+
+    if(addr < FRAME_POOL_START || addr >= FRAME_POOL_END)
+        return;
+
+    cli_and_save(flags);
+    if(frame_refs[FRAME_INDEX(addr)] > 0)
+        frame_refs[FRAME_INDEX(addr)]++;
+    restore_flags(flags);
+}
+
+/* Getter for the number of references to a frame, 0 if it is free or not in the pool */
+uint32_t frame_refcount(void* frame) {
+    uint32_t addr = (uint32_t)frame;
+
+    if(addr < FRAME_POOL_START || addr >= FRAME_POOL_END)
+        return 0;
+    return frame_refs[FRAME_INDEX(addr)];
+}
+
+////////////////////////////////////// User pages ////////////////////////////////////////////////////
+
+/*
+ * map_user_frame
+ *   DESCRIPTION: Points a user page table entry at a frame.
+ *   INPUTS: entry - entry to fill in.
+ *           frame - frame the page should use.
+ *           writable - 0 to map the page read only.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: Clears the copy-on-write mark, the caller invalidates the TLB entry.
+ */
+static void map_user_frame(page_table_entry_t* entry, void* frame, uint32_t writable) {
+    entry->val = 0;
+    entry->address = (uint32_t)frame >> 12;
+    entry->R_W = writable ? 1 : 0;
+    entry->U_S = 1;
+    entry->P = 1;
+}
+
+/*
+ * alloc_user_pages
+ *   DESCRIPTION: Gets an empty user page table. Nothing is mapped yet, pages are added as the
+ *                process touches them (see handle_user_page_fault).
+ *   INPUTS: none.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: the page table, NULL if the frame pool is empty.
+ *   SIDE EFFECTS: Takes a frame from the frame pool.
+ */
+uint32_t* alloc_user_pages() {
+    uint32_t* page_table = (uint32_t*)alloc_frame();
+
+    if(page_table != NULL)
+        memset(page_table, 0, FRAME_SIZE);
+    return page_table;
+}
+
+/*
+ * clear_user_pages
+ *   DESCRIPTION: Unmaps every page of a user page table, keeping the table itself.
+ *   INPUTS: page_table - table to empty.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: Drops a reference to every mapped frame, flushes the TLB.
+ */
+void clear_user_pages(uint32_t* page_table) {
+    page_table_entry_t* entries = (page_table_entry_t*)page_table;
+    int i;
+
+    if(page_table == NULL)
+        return;
+
+    for(i = 0; i < TABLE_SIZE; i++){
+        if(entries[i].P)
+            free_frame((void*)(entries[i].address << 12));
+        entries[i].val = 0;
+    }
+    flush_tlb();
+}
+
+/*
+ * free_user_pages
+ *   DESCRIPTION: Unmaps every page of a user page table and frees the table.
+ *   INPUTS: page_table - table to free, must not be mapped by anyone anymore.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: Returns frames to the frame pool.
+ */
+void free_user_pages(uint32_t* page_table) {
+    if(page_table == NULL)
+        return;
+
+    clear_user_pages(page_table);
+    free_frame(page_table);
+}
+
+/*
+ * copy_user_pages
+ *   DESCRIPTION: Makes dst map the same user memory as src for fork. No page is copied: every writable page
+ *                becomes read only and copy-on-write in both tables, so whoever writes to it first gets a
+ *                copy of its own. The cost is one pass over the page table, not 4MB of copying.
+ *   INPUTS: dst - table of the new process, emptied first.
+ *           src - table of the process being copied.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: Write protects src, adds a reference to every mapped frame, flushes the TLB.
+ */
+void copy_user_pages(uint32_t* dst, uint32_t* src) {
+    page_table_entry_t* from = (page_table_entry_t*)src;
+    page_table_entry_t* to = (page_table_entry_t*)dst;
+    uint32_t flags;
+    int i;
+
+    if(dst == NULL || src == NULL)
+        return;
+
+    clear_user_pages(dst);
+
+    cli_and_save(flags);
+    for(i = 0; i < TABLE_SIZE; i++){
+        if(!from[i].P)
+            continue;
+        if(from[i].R_W){
+            from[i].R_W = 0;
+            from[i].AVL_3 |= PTE_COW;
+        }
+        to[i] = from[i];
+        frame_get((void*)(from[i].address << 12));
     }
-    // Align virtual address before using to map videomem to.
-    uint32_t i = VIDEO_VIRTUAL >> 22;
-    base_dir[i].KB_dir.P = 1;  
-    base_dir[i].KB_dir.R_W = 1;      
-    base_dir[i].KB_dir.U_S = 1;      
-    base_dir[i].KB_dir.PWT = 0;      
-    base_dir[i].KB_dir.PCD = 0;      
-    base_dir[i].KB_dir.A = 0;        
-    base_dir[i].KB_dir.PS = 0;       
-    base_dir[i].KB_dir.AVL_1 = 0;    
-    base_dir[i].KB_dir.AVL_4 = 0;    
-    base_dir[i].KB_dir.address = (uint32_t)pte_vidmap >> 12;  
+    restore_flags(flags);
 
+    // src is usually the mapped table, its stale writable TLB entries have to go
     flush_tlb();
 }
+
+/*
+ * user_page_frame
+ *   DESCRIPTION: Looks up the frame behind a user page.
+ *   INPUTS: page_table - user page table to look in.
+ *           vaddr - any address in the page.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: the frame, NULL if the page is not mapped or vaddr is not user memory.
+ *   SIDE EFFECTS: none.
+ */
+void* user_page_frame(uint32_t* page_table, uint32_t vaddr) {
+    page_table_entry_t* entry;
+
+    if(page_table == NULL || vaddr < USER_PAGES_START || vaddr >= USER_PAGES_END)
+        return NULL;
+
+    entry = (page_table_entry_t*)page_table + ((vaddr - USER_PAGES_START) / FRAME_SIZE);
+    return entry->P ? (void*)(entry->address << 12) : NULL;
+}
+
+/*
+ * user_page_writable
+ *   DESCRIPTION: Tells whether the kernel may write to a page of the running process' user memory.
+ *                A missing page is filled in and a copy-on-write page copied when the write faults,
+ *                only a page that is mapped read only for good (program text) can't be written.
+ *   INPUTS: vaddr - any address in the page.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: 1 if a write won't fail, 0 otherwise (or if vaddr is not user memory).
+ *   SIDE EFFECTS: none.
+ */
+uint32_t user_page_writable(uint32_t vaddr) {
+    page_directories_t* pde = &base_dir[USER_PAGES_START >> 22];
+    page_table_entry_t* entry;
+
+    if(vaddr < USER_PAGES_START || vaddr >= USER_PAGES_END || !pde->KB_dir.P)
+        return 0;
+    if(pde->KB_dir.PS)
+        return pde->KB_dir.R_W;
+
+    entry = (page_table_entry_t*)(pde->KB_dir.address << 12) + ((vaddr - USER_PAGES_START) / FRAME_SIZE);
+    return !entry->P || entry->R_W || (entry->AVL_3 & PTE_COW);
+}
+
+/*
+ * map_user_page
+ *   DESCRIPTION: Maps a frame at a user page, replacing whatever was mapped there.
+ *   INPUTS: page_table - user page table to change.
+ *           vaddr - any address in the page.
+ *           frame - frame to map, the page table takes over the caller's reference.
+ *           writable - 0 to map the page read only (writes then fault).
+ *   OUTPUTS: none.
+ *   RETURN VALUE: 0 on success, -1 if vaddr is not user memory.
+ *   SIDE EFFECTS: Drops the reference to a replaced frame, the caller flushes the TLB if the table is in use.
+ */
+int32_t map_user_page(uint32_t* page_table, uint32_t vaddr, void* frame, uint32_t writable) {
+    page_table_entry_t* entry;
+    uint32_t flags;
+
+    if(page_table == NULL || vaddr < USER_PAGES_START || vaddr >= USER_PAGES_END)
+        return -1;
+
+    entry = (page_table_entry_t*)page_table + ((vaddr - USER_PAGES_START) / FRAME_SIZE);
+
+    cli_and_save(flags);
+    if(entry->P)
+        free_frame((void*)(entry->address << 12));
+    map_user_frame(entry, frame, writable);
+    restore_flags(flags);
+
+    return 0;
+}
+
+/*
+ * handle_user_page_fault
+ *   DESCRIPTION: Resolves a page fault in user memory of the running process. A missing page gets a zeroed
+ *                frame, a write to a copy-on-write page gets a private copy (or just becomes writable again
+ *                if no one else maps the frame anymore).
+ *   INPUTS: addr - faulting address (CR2).
+ *           err - error code the processor pushed.
+ *   OUTPUTS: none.
+ *   RETURN VALUE: 0 if the access can be retried, -1 if it really is an invalid access.
+ *   SIDE EFFECTS: May take a frame from the frame pool, invalidates the page's TLB entry.
+ */
+int32_t handle_user_page_fault(uint32_t addr, uint32_t err) {
+    page_directories_t* pde = &base_dir[USER_PAGES_START >> 22];
+    page_table_entry_t* entry;
+    uint32_t flags;
+    uint8_t* frame;
+    uint8_t* old;
+    int32_t ret = -1;
+
+    if(addr < USER_PAGES_START || addr >= USER_PAGES_END || !pde->KB_dir.P || pde->KB_dir.PS)
+        return -1;
+
+    entry = (page_table_entry_t*)(pde->KB_dir.address << 12) + ((addr - USER_PAGES_START) / FRAME_SIZE);
+
+    cli_and_save(flags);
+    if(!(err & PF_ERR_PRESENT)){
+        // First touch, hand out a zeroed page
+        frame = (uint8_t*)alloc_frame();
+        if(frame != NULL){
+            memset(frame, 0, FRAME_SIZE);
+            map_user_frame(entry, frame, 1);
+            ret = 0;
+        }
+    } else if((err & PF_ERR_WRITE) && (entry->AVL_3 & PTE_COW)){
+        old = (uint8_t*)(entry->address << 12);
+        if(frame_refcount(old) == 1){
+            // Everybody else already copied the page, it is ours alone
+            map_user_frame(entry, old, 1);
+            ret = 0;
+        } else if((frame = (uint8_t*)alloc_frame()) != NULL){
+            memcpy(frame, old, FRAME_SIZE);
+            map_user_frame(entry, frame, 1);
+            free_frame(old);
+            ret = 0;
+        }
+    }
+    restore_flags(flags);
+
+    if(ret == 0)
+        asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+    return ret;
+}
+
+/*
+ * map_low_pages
+ *   DESCRIPTION: Identity maps (or unmaps) supervisor pages in the first 4MB, for reaching BIOS tables and
+ *                the AP start-up code. The video pages are left alone.
+ *   INPUTS: start - first address
+ *           end - address past the last one
+ *           present - 1 to map, 0 to unmap
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: Flushes the TLB.
+ */
+void map_low_pages(uint32_t start, uint32_t end, uint32_t present) {
+    uint32_t j;
+
+    for(j = start / FRAME_SIZE; j < (end + FRAME_SIZE - 1) / FRAME_SIZE && j < TABLE_SIZE; j++){
+        if(j >= (VIDEO >> 12) && j < (VIDEO >> 12) + VIDEO_PAGES)
+            continue;
+        pte[j].address = j;
+        pte[j].U_S = 0;
+        pte[j].R_W = 1;
+        pte[j].P = present ? 1 : 0;
+    }
+    flush_tlb();
+}
+
+/*
+ * map_mmio
+ *   DESCRIPTION: Identity maps the 4MB page holding a device's registers, uncached and supervisor only.
+ *   INPUTS: phys - any address of the registers
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: Flushes the TLB.
+ */
+void map_mmio(uint32_t phys) {
+    uint32_t i = phys >> 22;
+
+    base_dir[i].MB_dir.R_W = 1;      // Read/Write
+    base_dir[i].MB_dir.U_S = 0;      // Supervisor only
+    base_dir[i].MB_dir.PWT = 1;      // Write-through
+    base_dir[i].MB_dir.PCD = 1;      // Cache Disable
+    base_dir[i].MB_dir.PS = 1;       // Page Size
+    base_dir[i].MB_dir.add_20_13 = 0;
+    base_dir[i].MB_dir.RSVD = 0;
+    base_dir[i].MB_dir.address = i;  // Identity map
+    base_dir[i].MB_dir.P = 1;        // Present
+    flush_tlb();
+}
+
+/*
+ * map_firmware_page
+ *   DESCRIPTION: Identity maps the 4MB page holding a firmware table, supervisor only, unless something
+ *                is already mapped there.
+ *   INPUTS: phys - any address in the table
+ *   OUTPUTS: none.
+ *   RETURN VALUE: 1 if the page was mapped here and must be given back with unmap_firmware_page, 0 if it
+ *                 already was identity mapped, -1 if the address is in use for something else.
+ *   SIDE EFFECTS: Flushes the TLB.
+ */
+int32_t map_firmware_page(uint32_t phys) {
+    uint32_t i = phys >> 22;
+
+    if(base_dir[i].MB_dir.P)
+        return (base_dir[i].MB_dir.PS && base_dir[i].MB_dir.address == i) ? 0 : -1;
+
+    base_dir[i].MB_dir.val = 0;
+    base_dir[i].MB_dir.R_W = 1;      // Read/Write
+    base_dir[i].MB_dir.PS = 1;       // Page Size
+    base_dir[i].MB_dir.address = i;  // Identity map
+    base_dir[i].MB_dir.P = 1;        // Present
+    flush_tlb();
+    return 1;
+}
+
+/*
+ * unmap_firmware_page
+ *   DESCRIPTION: Takes away a page map_firmware_page mapped, the tables may sit where user memory is
+ *                mapped later.
+ *   INPUTS: phys - any address in the page
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: Flushes the TLB.
+ */
+void unmap_firmware_page(uint32_t phys) {
+    base_dir[phys >> 22].MB_dir.val = 0;
+    flush_tlb();
+}
+
+/*
+ * paging_fbmap
+ *   DESCRIPTION: Maps the 4MB page of the framebuffer at FB_VIRTUAL for a process that called fbmap,
+ *                uncached like the kernel's own mapping of it, or takes FB_VIRTUAL away. Called for
+ *                every process switch along with paging_vidmap.
+ *   INPUTS: phys - start of the framebuffer, 4MB aligned, 0 for a process that didn't call fbmap
+ *   OUTPUTS: none.
+ *   RETURN VALUE: none.
+ *   SIDE EFFECTS: none, the caller flushes the TLB.
+ */
+void paging_fbmap(uint32_t phys) {
+    uint32_t i = FB_VIRTUAL >> 22;
+
+    base_dir[i].MB_dir.val = 0;
+    if(phys != 0){
+        base_dir[i].MB_dir.R_W = 1;      // Read/Write
+        base_dir[i].MB_dir.U_S = 1;      // User
+        base_dir[i].MB_dir.PWT = 1;      // Write-through
+        base_dir[i].MB_dir.PCD = 1;      // Cache Disable
+        base_dir[i].MB_dir.PS = 1;       // Page Size
+        base_dir[i].MB_dir.address = phys >> 22;
+        base_dir[i].MB_dir.P = 1;        // Present
+    }
+}
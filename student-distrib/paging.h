@@ -13,10 +13,28 @@
 #define ALIGNBYTES 4096
 #define VIDEO 0xB8000
 #define VIDEO_VIRTUAL 0x08800000
+#define FB_VIRTUAL 0x08C00000      // Where fbmap puts the framebuffer, one 4MB page
 #define SIZE_4MB 0x400000 
 #define FOUR_MB 0x400000
 #define SHELL_ADDR 0x00800000  
 
+// Physical page pool handed out 4KB at a time (user pages, RAM filesystem blocks, pipe buffers, ...).
+// It starts right above the kernel page and is identity mapped.
+#define FRAME_POOL_START    0x00800000  // 8MB
+#define FRAME_POOL_END      0x03800000  // 56MB
+#define FRAME_SIZE          4096
+#define VIDEO_PAGES         4           // Screen plus a backup page per terminal, starting at VIDEO
+#define VIDMAP_TABLES       (VIDEO_PAGES - 1)   // One vidmap page table per terminal
+#define NUM_FRAMES          ((FRAME_POOL_END - FRAME_POOL_START) / FRAME_SIZE)
+
+// The 4MB of user memory at 128MB is mapped 4KB at a time through a page table of the running process.
+// Pages are filled in on first touch and shared copy-on-write after a fork.
+#define USER_PAGES_START    0x08000000  // 128MB
+#define USER_PAGES_END      0x08400000  // 132MB
+#define PTE_COW             0x1         // AVL_3 bit marking a read-only page that is copied on write
+#define PF_ERR_PRESENT      0x1         // Page fault error code: protection violation, not a missing page
+#define PF_ERR_WRITE        0x2         // Page fault error code: the access was a write
+
 typedef union page_dir_entry_4KB {
     uint32_t val;
     struct {
@@ -79,19 +97,41 @@ typedef union page_directories {
 page_directories_t base_dir[DIR_SIZE] __attribute__((aligned (ALIGNBYTES)));
 // Then, for the table, we will need 2^10 1024 tables with 1024 entries, pointing to pages.
 page_table_entry_t pte[TABLE_SIZE] __attribute__((aligned (ALIGNBYTES)));
-// Page table for vidmem.
-page_table_entry_t pte_vidmap[TABLE_SIZE] __attribute__((aligned(ALIGNBYTES)));
+// Vidmap page table of every terminal, only the first entry is used.
+page_table_entry_t pte_vidmap[VIDMAP_TABLES][TABLE_SIZE] __attribute__((aligned(ALIGNBYTES)));
 
 extern void initialize_paging();
 
 void load_directory(unsigned int* page_directory);
 
 ////////////////////////////Checkpoint 3/////////////////////////////////////////////////////////////////////////
-void paging_for_execute(uint32_t pid); 
+void paging_for_execute(uint32_t* page_table); 
 void flush_tlb(); 
 ////////////////////////////Checkpoint 4/////////////////////////////////////////////////////////////////////////
 void initialize_paging_vidmem();
+void paging_vidmap(int32_t t);
 ////////////////////////////Checkpoint 5/////////////////////////////////////////////////////////////////////////
 void initialize_terminal_vidmem_paging(uint8_t j);
-void map_to_vidmem_page(uint8_t physical_address);
+void map_to_vidmem_page(uint32_t t, uint32_t physical_address);
+////////////////////////////Frame pool///////////////////////////////////////////////////////////////////////////
+void init_frame_pool();
+void* alloc_frame();
+void free_frame(void* frame);
+uint32_t free_frame_count();
+void frame_get(void* frame);
+uint32_t frame_refcount(void* frame);
+////////////////////////////User pages///////////////////////////////////////////////////////////////////////////
+uint32_t* alloc_user_pages();
+void clear_user_pages(uint32_t* page_table);
+void free_user_pages(uint32_t* page_table);
+void copy_user_pages(uint32_t* dst, uint32_t* src);
+void* user_page_frame(uint32_t* page_table, uint32_t vaddr);
+uint32_t user_page_writable(uint32_t vaddr);
+int32_t map_user_page(uint32_t* page_table, uint32_t vaddr, void* frame, uint32_t writable);
+int32_t handle_user_page_fault(uint32_t addr, uint32_t err);
+void map_low_pages(uint32_t start, uint32_t end, uint32_t present);
+void map_mmio(uint32_t phys);
+int32_t map_firmware_page(uint32_t phys);
+void unmap_firmware_page(uint32_t phys);
+void paging_fbmap(uint32_t phys);
 
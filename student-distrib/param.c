@@ -0,0 +1,187 @@
+/* param.c - Kernel tunables set from the boot command line
+ *
+ * Every tunable is a uint32_t owned by the module that uses it, initialized to its compile time
+ * default. The table below gives each one a name, a type and the range it may be set to, and
+ * param_parse sets them from the "name=value" words of the multiboot command line before any
+ * of those modules start. Sizes of static arrays (MAX_TASKS, MAX_FILES, the terminals) stay
+ * compile time, the sizes below only limit how much of an array is used.
+ */
+
+#include "param.h"
+#include "lib.h"
+#include "boottime.h"
+#include "pit.h"
+#include "rtc.h"
+#include "console.h"
+#include "ldisc.h"
+#include "elf.h"
+#include "syscallhandler.h"
+
+static const param_t params[] = {
+    { "quiet",          PARAM_BOOL, &boot_flags,            BOOT_QUIET,     0, 0 },
+    { "boottime",       PARAM_BOOL, &boot_flags,            BOOT_TIMELINE,  0, 0 },
+    { "tests",          PARAM_BOOL, &boot_flags,            BOOT_TESTS,     0, 0 },
+    { "sched.preempt",  PARAM_BOOL, &sched_preempt,         1,              0, 0 },
+    { "sched.quantum",  PARAM_UINT, &sched_quantum,         0,              1, SCHED_MAX_QUANTUM },
+    { "pit.hz",         PARAM_UINT, &pit_hz,                0,              PIT_MIN_HZ, PIT_MAX_HZ },
+    { "rtc.hz",         PARAM_POW2, &rtc_hz,                0,              RTC_MIN_BASE_FREQ, RTC_MAX_BASE_FREQ },
+    { "console.flush",  PARAM_POW2, &console_flush_ticks,   0,              1, CONSOLE_MAX_FLUSH_TICKS },
+    { "tty.queue",      PARAM_UINT, &ldisc_queue_size,      0,              1, LDISC_QUEUE_SIZE },
+    { "cache.text",     PARAM_UINT, &text_cache_slots,      0,              0, TEXT_CACHE_SIZE },
+    { "trace",          PARAM_BOOL, &syscall_trace_on,      1,              0, 0 },
+};
+
+#define NUM_PARAMS  (sizeof(params) / sizeof(params[0]))
+
+static int8_t param_cmdline[PARAM_CMDLINE_MAX];     // Copy of the command line, cut into words
+static const int8_t* param_bad[PARAM_MAX_BAD];      // Words that weren't a parameter or a valid value
+static uint32_t param_nbad = 0;
+
+/*
+ * param_number
+ *   DESCRIPTION: Reads an unsigned decimal or 0x prefixed hex number.
+ *   INPUTS: s - the number, up to the end of the string
+ *   OUTPUTS: value - the number
+ *   RETURN VALUE: 0 on success, -1 if s isn't a number or doesn't fit 32 bits
+ *   SIDE EFFECTS: none
+ */
+static int32_t param_number(const int8_t* s, uint32_t* value) {
+    uint32_t base = 10, n = 0, digit;
+
+    if(s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s += 2;
+    }
+    if(*s == '\0')
+        return -1;
+
+    for(; *s != '\0'; s++) {
+        if(*s >= '0' && *s <= '9')
+            digit = *s - '0';
+        else if(base == 16 && *s >= 'a' && *s <= 'f')
+            digit = *s - 'a' + 10;
+        else if(base == 16 && *s >= 'A' && *s <= 'F')
+            digit = *s - 'A' + 10;
+        else
+            return -1;
+        if(n > (0xFFFFFFFF - digit) / base)
+            return -1;
+        n = n * base + digit;
+    }
+
+    *value = n;
+    return 0;
+}
+
+/*
+ * param_find
+ *   DESCRIPTION: Looks a parameter up by name.
+ *   INPUTS: name - parameter name
+ *   OUTPUTS: none
+ *   RETURN VALUE: the parameter, NULL if there is none by that name
+ *   SIDE EFFECTS: none
+ */
+const param_t* param_find(const int8_t* name) {
+    uint32_t i, len = strlen(name);
+
+    for(i = 0; i < NUM_PARAMS; i++) {
+        if(strlen(params[i].name) == len && strncmp(params[i].name, name, len) == 0)
+            return &params[i];
+    }
+    return NULL;
+}
+
+/*
+ * param_set
+ *   DESCRIPTION: Sets one parameter. A bool may be given bare to turn it on, anything else
+ *                needs a value that fits its type and range.
+ *   INPUTS: word - "name" or "name=value"
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 for an unknown name or a bad value (nothing is changed)
+ *   SIDE EFFECTS: Changes the parameter's variable
+ */
+int32_t param_set(const int8_t* word) {
+    int8_t name[PARAM_CMDLINE_MAX];
+    const int8_t* value = NULL;
+    const param_t* p;
+    uint32_t len, n;
+
+    for(len = 0; word[len] != '\0' && word[len] != '='; len++);
+    if(len == 0 || len >= PARAM_CMDLINE_MAX)
+        return -1;
+    strncpy(name, word, len);
+    name[len] = '\0';
+    if(word[len] == '=')
+        value = &word[len + 1];
+
+    p = param_find(name);
+    if(p == NULL)
+        return -1;
+
+    if(p->type == PARAM_BOOL) {
+        if(value == NULL || strncmp(value, "1", 2) == 0 || strncmp(value, "on", 3) == 0)
+            *p->var |= p->mask;
+        else if(strncmp(value, "0", 2) == 0 || strncmp(value, "off", 4) == 0)
+            *p->var &= ~p->mask;
+        else
+            return -1;
+        return 0;
+    }
+
+    if(value == NULL || param_number(value, &n) == -1 || n < p->min || n > p->max)
+        return -1;
+    if(p->type == PARAM_POW2 && (n & (n - 1)))
+        return -1;
+    *p->var = n;
+    return 0;
+}
+
+/*
+ * param_parse
+ *   DESCRIPTION: Sets the parameters on the command line. The first word is the kernel's path
+ *                and is skipped, words that aren't a valid parameter are kept for param_report.
+ *   INPUTS: cmdline - multiboot command line, NULL if the boot loader didn't pass one
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must run before paging hides the multiboot data and before the modules
+ *                 whose parameters it sets start
+ */
+void param_parse(const int8_t* cmdline) {
+    uint32_t i, start;
+
+    if(cmdline == NULL)
+        return;
+
+    // Copy the command line, every space becomes the end of a word
+    for(i = 0; i < PARAM_CMDLINE_MAX - 1 && cmdline[i] != '\0'; i++)
+        param_cmdline[i] = (cmdline[i] == ' ') ? '\0' : cmdline[i];
+    param_cmdline[i] = '\0';
+
+    // Skip the path, then set a parameter from every word
+    for(start = 0; start < i && param_cmdline[start] != '\0'; start++);
+    while(start < i) {
+        if(param_cmdline[start] == '\0') {
+            start++;
+            continue;
+        }
+        if(param_set(&param_cmdline[start]) == -1 && param_nbad < PARAM_MAX_BAD)
+            param_bad[param_nbad++] = &param_cmdline[start];
+        start += strlen(&param_cmdline[start]);
+    }
+}
+
+/*
+ * param_report
+ *   DESCRIPTION: Prints the command line words param_parse ignored, so a typo doesn't go
+ *                unnoticed. Runs once the screen is up, even on a quiet boot.
+ *   INPUTS: none
+ *   OUTPUTS: one line per ignored word
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void param_report(void) {
+    uint32_t i;
+
+    for(i = 0; i < param_nbad; i++)
+        printf("Ignoring boot parameter \"%s\"\n", param_bad[i]);
+}
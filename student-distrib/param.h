@@ -0,0 +1,38 @@
+/* param.h - Kernel tunables set from the boot command line */
+
+#ifndef _PARAM_H
+#define _PARAM_H
+
+#include "types.h"
+
+#define PARAM_CMDLINE_MAX       128         // Bytes of the command line kept, it's gone once paging is on
+#define PARAM_MAX_BAD           8           // Rejected words param_report remembers
+
+/* Parameter types */
+#define PARAM_BOOL              0           // "name", "name=1/on" sets mask in *var, "name=0/off" clears it
+#define PARAM_UINT              1           // "name=n", n in [min, max], decimal or 0x hex
+#define PARAM_POW2              2           // PARAM_UINT that must also be a power of two
+
+/* One tunable, e.g. "/boot/kernel sched.quantum=4 rtc.hz=2048 quiet" */
+typedef struct param {
+    const int8_t* name;
+    uint32_t type;
+    uint32_t* var;                          // Owned by the module the tunable belongs to
+    uint32_t mask;                          // PARAM_BOOL: bits of *var the parameter controls
+    uint32_t min;
+    uint32_t max;
+} param_t;
+
+/* Set every parameter given on the multiboot command line, first thing in entry */
+void param_parse(const int8_t* cmdline);
+
+/* Set one parameter from a "name" or "name=value" word */
+int32_t param_set(const int8_t* word);
+
+/* Look a parameter up by name */
+const param_t* param_find(const int8_t* name);
+
+/* Print the command line words param_parse ignored */
+void param_report(void);
+
+#endif /* _PARAM_H */
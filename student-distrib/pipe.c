@@ -0,0 +1,342 @@
+/* pipe.c - Kernel pipes: a one-frame ring buffer with sleeping readers and writers */
+
+#include "pipe.h"
+#include "lib.h"
+#include "paging.h"
+#include "pit.h"
+#include "uaccess.h"
+#include "fdtable.h"
+#include "signal.h"
+
+/* Wrong-direction operations always fail */
+static int32_t pipe_bad_read(int32_t inode, int32_t offset, int32_t nbytes, void* buf) { return -1; }
+static int32_t pipe_bad_write(int32_t fd, const void* buf, int32_t nbytes) { return -1; }
+
+file_op_jmp_tbl_t pipe_read_jmp_tbl = {&pipe_read, &pipe_bad_write, &pipe_open, &pipe_read_close, NULL, &pipe_read_poll};
+
+file_op_jmp_tbl_t pipe_write_jmp_tbl = {&pipe_bad_read, &pipe_write, &pipe_open, &pipe_write_close, NULL, &pipe_write_poll};
+
+static pipe_t pipes[MAX_PIPES];
+
+/*
+ * pipe_alloc
+ *   DESCRIPTION: Finds a free pipe slot and gives it a frame to buffer data in.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: pipe number on success, -1 on failure
+ *   SIDE EFFECTS: Takes a frame from the frame pool
+ */
+int32_t pipe_alloc(void) {
+    int32_t i;
+    uint32_t flags;
+    uint8_t* buf;
+
+    buf = (uint8_t*)alloc_frame();
+    if(buf == NULL)
+        return -1;
+
+    cli_and_save(flags);
+    for(i = 0; i < MAX_PIPES; i++){
+        if(pipes[i].buf == NULL){
+            pipes[i].buf = buf;
+            pipes[i].read_pos = 0;
+            pipes[i].count = 0;
+            pipes[i].readers = 1;
+            pipes[i].writers = 1;
+            init_wait_queue(&pipes[i].read_wait);
+            init_wait_queue(&pipes[i].write_wait);
+            restore_flags(flags);
+            return i;
+        }
+    }
+    restore_flags(flags);
+
+    free_frame(buf);
+    return -1;
+}
+
+/*
+ * pipe_fill_fd
+ *   DESCRIPTION: Points a file descriptor at one end of a pipe.
+ *   INPUTS: fd - descriptor to fill in
+ *           pipe_num - pipe the descriptor refers to
+ *           write_end - 1 for the write end, 0 for the read end
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none, the pipe's reader/writer counts are not changed
+ */
+void pipe_fill_fd(file_descriptor_t* fd, int32_t pipe_num, int32_t write_end) {
+    fd->file_op_jmp_tbl_ptr = write_end ? &pipe_write_jmp_tbl : &pipe_read_jmp_tbl;
+    fd->file_pos = 0;
+    fd->inode = pipe_num;
+    fd->flags = FD_IN_USE;
+}
+
+/*
+ * pipe_get
+ *   DESCRIPTION: Counts one more open end of a pipe, for a descriptor that was copied (fork).
+ *   INPUTS: pipe_num - pipe the copy refers to
+ *           write_end - 1 for the write end, 0 for the read end
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: The copy has to be released with pipe_release as well
+ */
+void pipe_get(int32_t pipe_num, int32_t write_end) {
+    uint32_t flags;
+    pipe_t* p;
+
+    if(pipe_num < 0 || pipe_num >= MAX_PIPES)
+        return;
+    p = &pipes[pipe_num];
+
+    cli_and_save(flags);
+    if(p->buf != NULL){
+        if(write_end)
+            p->writers++;
+        else
+            p->readers++;
+    }
+    restore_flags(flags);
+}
+
+/*
+ * pipe_release
+ *   DESCRIPTION: Drops one end of a pipe, waking the other side so it sees EOF or a broken pipe.
+ *   INPUTS: pipe_num - pipe to release
+ *           write_end - 1 for the write end, 0 for the read end
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Frees the pipe's frame once both ends are gone
+ */
+void pipe_release(int32_t pipe_num, int32_t write_end) {
+    uint32_t flags;
+    pipe_t* p;
+
+    if(pipe_num < 0 || pipe_num >= MAX_PIPES)
+        return;
+    p = &pipes[pipe_num];
+
+    cli_and_save(flags);
+    if(p->buf != NULL){
+        if(write_end){
+            if(p->writers > 0)
+                p->writers--;
+            wake_up(&p->read_wait);
+        } else {
+            if(p->readers > 0)
+                p->readers--;
+            wake_up(&p->write_wait);
+        }
+
+        if(p->readers == 0 && p->writers == 0){
+            free_frame(p->buf);
+            p->buf = NULL;
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * pipe_read
+ *   DESCRIPTION: Reads whatever is buffered (up to nbytes), sleeping while the pipe is empty.
+ *   INPUTS: inode - pipe number stored in the file descriptor
+ *           offset - ignored
+ *           nbytes - most bytes to read
+ *           buf - buffer to read into
+ *   OUTPUTS: buf - filled with pipe data
+ *   RETURN VALUE: bytes read, 0 once every writer is gone, -1 on failure
+ *   SIDE EFFECTS: Wakes writers waiting for space
+ */
+int32_t pipe_read(int32_t inode, int32_t offset, int32_t nbytes, void* buf) {
+    uint32_t flags;
+    uint32_t n;
+    uint32_t first;
+    pipe_t* p;
+
+    if(inode < 0 || inode >= MAX_PIPES || nbytes < 0 || !user_range_ok(buf, nbytes))
+        return -1;
+    p = &pipes[inode];
+
+    cli_and_save(flags);
+    while(p->count == 0){
+        // Nothing buffered and nobody left to write: end of file
+        if(p->buf == NULL || p->writers == 0){
+            restore_flags(flags);
+            return 0;
+        }
+        // Give up so a signal can be delivered
+        if(signal_pending(get_cur_pcb())){
+            restore_flags(flags);
+            return -1;
+        }
+        sleep_on(&p->read_wait);
+    }
+
+    n = (nbytes < p->count) ? nbytes : p->count;
+
+    // At most two spans, one up to the end of the ring and one from its start
+    first = PIPE_BUF_SIZE - p->read_pos;
+    if(first > n)
+        first = n;
+    copy_to_user(buf, p->buf + p->read_pos, first);
+    copy_to_user((uint8_t*)buf + first, p->buf, n - first);
+
+    p->read_pos = (p->read_pos + n) % PIPE_BUF_SIZE;
+    p->count -= n;
+
+    wake_up(&p->write_wait);
+    restore_flags(flags);
+
+    return n;
+}
+
+/*
+ * pipe_write
+ *   DESCRIPTION: Writes all nbytes into the pipe, sleeping whenever it is full. With O_NONBLOCK
+ *                on the descriptor it writes what fits and returns.
+ *   INPUTS: fd - file descriptor of the write end
+ *           buf - data to write
+ *           nbytes - number of bytes to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: bytes written, -1 if nothing could be written (no readers left)
+ *   SIDE EFFECTS: Wakes readers waiting for data
+ */
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes) {
+    uint32_t flags;
+    uint32_t written = 0;
+    uint32_t n;
+    uint32_t first;
+    uint32_t write_pos;
+    int32_t pipe_num;
+    file_descriptor_t* file;
+    pipe_t* p;
+
+    if(nbytes < 0 || !user_range_ok(buf, nbytes))
+        return -1;
+
+    file = fd_get(get_cur_pcb()->files, fd);
+    if(file == NULL)
+        return -1;
+
+    pipe_num = file->inode;
+    if(pipe_num < 0 || pipe_num >= MAX_PIPES)
+        return -1;
+    p = &pipes[pipe_num];
+
+    cli_and_save(flags);
+    while(written < nbytes){
+        while(p->buf != NULL && p->readers > 0 && p->count == PIPE_BUF_SIZE && !signal_pending(get_cur_pcb())
+              && !(file->flags & O_NONBLOCK))
+            sleep_on(&p->write_wait);
+
+        // Broken pipe, a signal to deliver or a full non-blocking pipe (what was written so far is returned)
+        if(p->buf == NULL || p->readers == 0 || p->count == PIPE_BUF_SIZE)
+            break;
+
+        n = PIPE_BUF_SIZE - p->count;
+        if(n > nbytes - written)
+            n = nbytes - written;
+
+        write_pos = (p->read_pos + p->count) % PIPE_BUF_SIZE;
+        first = PIPE_BUF_SIZE - write_pos;
+        if(first > n)
+            first = n;
+        copy_from_user(p->buf + write_pos, (const uint8_t*)buf + written, first);
+        copy_from_user(p->buf, (const uint8_t*)buf + written + first, n - first);
+
+        p->count += n;
+        written += n;
+
+        wake_up(&p->read_wait);
+    }
+    restore_flags(flags);
+
+    if(written == 0 && nbytes > 0)
+        return -1;
+    return written;
+}
+
+/*
+ * pipe_read_poll
+ *   DESCRIPTION: Read end readiness: readable with data buffered, hung up once every writer is gone.
+ *   INPUTS: inode - pipe number
+ *           pt - poll call to put on the pipe's read queue, NULL to just check
+ *   OUTPUTS: none
+ *   RETURN VALUE: POLLIN and/or POLLHUP, or POLLNVAL for a bad pipe number
+ *   SIDE EFFECTS: none
+ */
+uint32_t pipe_read_poll(int32_t inode, poll_table_t* pt) {
+    uint32_t flags;
+    uint32_t events = 0;
+    pipe_t* p;
+
+    if(inode < 0 || inode >= MAX_PIPES)
+        return POLLNVAL;
+    p = &pipes[inode];
+
+    cli_and_save(flags);
+    poll_wait(pt, &p->read_wait);
+    if(p->count > 0)
+        events |= POLLIN;
+    if(p->buf == NULL || p->writers == 0)
+        events |= POLLHUP;
+    restore_flags(flags);
+
+    return events;
+}
+
+/*
+ * pipe_write_poll
+ *   DESCRIPTION: Write end readiness: writable while there is room, an error once every reader is gone.
+ *   INPUTS: inode - pipe number
+ *           pt - poll call to put on the pipe's write queue, NULL to just check
+ *   OUTPUTS: none
+ *   RETURN VALUE: POLLOUT or POLLERR, or POLLNVAL for a bad pipe number
+ *   SIDE EFFECTS: none
+ */
+uint32_t pipe_write_poll(int32_t inode, poll_table_t* pt) {
+    uint32_t flags;
+    uint32_t events = 0;
+    pipe_t* p;
+
+    if(inode < 0 || inode >= MAX_PIPES)
+        return POLLNVAL;
+    p = &pipes[inode];
+
+    cli_and_save(flags);
+    poll_wait(pt, &p->write_wait);
+    if(p->buf == NULL || p->readers == 0)
+        events |= POLLERR;
+    else if(p->count < PIPE_BUF_SIZE)
+        events |= POLLOUT;
+    restore_flags(flags);
+
+    return events;
+}
+
+/* Pipes are created by the pipe system call, never opened by name */
+int32_t pipe_open(const uint8_t* filename) {
+    return -1;
+}
+
+/*
+ * pipe_read_close / pipe_write_close
+ *   DESCRIPTION: Close one end of the pipe the current process' descriptor refers to.
+ *   INPUTS: fd - file descriptor being closed
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 (always)
+ *   SIDE EFFECTS: See pipe_release
+ */
+int32_t pipe_read_close(int32_t fd) {
+    file_descriptor_t* file = fd_get(get_cur_pcb()->files, fd);
+    if(file != NULL)
+        pipe_release(file->inode, 0);
+    return 0;
+}
+
+int32_t pipe_write_close(int32_t fd) {
+    file_descriptor_t* file = fd_get(get_cur_pcb()->files, fd);
+    if(file != NULL)
+        pipe_release(file->inode, 1);
+    return 0;
+}
@@ -0,0 +1,50 @@
+/* pipe.h - Defines used for kernel pipes */
+
+#ifndef _PIPE_H
+#define _PIPE_H
+
+#include "types.h"
+#include "syscallhandler.h"
+
+/* Number of pipes that can exist at once */
+#define MAX_PIPES           16
+/* Each pipe buffers one frame of data */
+#define PIPE_BUF_SIZE       4096
+
+/* Ring buffer shared by a read end and a write end */
+typedef struct pipe {
+    uint8_t* buf;               // NULL when the pipe slot is free
+    uint32_t read_pos;          // Next byte to read
+    uint32_t count;             // Bytes currently buffered
+    uint32_t readers;           // Open read ends
+    uint32_t writers;           // Open write ends
+    wait_queue_t read_wait;     // Readers sleeping on an empty pipe
+    wait_queue_t write_wait;    // Writers sleeping on a full pipe
+} pipe_t;
+
+/* Jump tables for the two ends */
+extern file_op_jmp_tbl_t pipe_read_jmp_tbl;
+extern file_op_jmp_tbl_t pipe_write_jmp_tbl;
+
+/* Allocate a pipe with one open read end and one open write end */
+int32_t pipe_alloc(void);
+
+/* Fill in a file descriptor for one end of a pipe */
+void pipe_fill_fd(file_descriptor_t* fd, int32_t pipe_num, int32_t write_end);
+
+/* Count another open end for a copied descriptor */
+void pipe_get(int32_t pipe_num, int32_t write_end);
+
+/* Drop one end of a pipe without going through a file descriptor */
+void pipe_release(int32_t pipe_num, int32_t write_end);
+
+/* Pipe drivers */
+int32_t pipe_read(int32_t inode, int32_t offset, int32_t nbytes, void* buf);
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t pipe_open(const uint8_t* filename);
+int32_t pipe_read_close(int32_t fd);
+int32_t pipe_write_close(int32_t fd);
+uint32_t pipe_read_poll(int32_t inode, poll_table_t* pt);
+uint32_t pipe_write_poll(int32_t inode, poll_table_t* pt);
+
+#endif /* _PIPE_H */
@@ -1,27 +1,55 @@
 #include "pit.h"
+#include "apic.h"
+#include "fpu.h"
+#include "spinlock.h"
+#include "softirq.h"
+#include "workqueue.h"
+#include "rtc.h"
 #include "keyboard.h"
 #include "paging.h"
 #include "filesys.h"
 #include "x86_desc.h"
+#include "interrupts_link.h"
 
 pcb_t* curr_active_process = NULL;
 static uint8_t round_robin_term = 0;
 
+/* Protects process states, wait queues and curr_process */
+spinlock_t sched_lock = SPINLOCK_INIT("sched");
+
+/* Nonzero while the timer must not switch processes (see preempt_disable) */
+static volatile uint32_t preempt_count = 0;
+
+/* Set while schedule() is waiting for an interrupt to make something runnable */
+static volatile uint8_t sched_idle = 0;
+
+/* Where to save the boot stack if the first switch happens from kernel_main */
+static uint32_t boot_esp;
+
+uint32_t sched_preempt = 0;
+uint32_t sched_quantum = SCHED_QUANTUM;
+uint32_t pit_hz = PIT_DEFAULT_HZ;
+
+/* PIT interrupts the running process has had in its current turn */
+static uint32_t sched_slice = 0;
+
 /* MP3.5!!!
  * pit_init
- *   DESCRIPTION: Initializes the PIT to mode 3 on channel 0 with a specific frequency.
+ *   DESCRIPTION: Initializes the PIT to mode 3 on channel 0 at pit_hz.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Modifies PIT command register and channel 0 frequency, affecting system timing and interrupt behavior.
  */
 void pit_init(void) {
+    uint32_t divisor = PIT_HZ / pit_hz;
+
     // Change to square-wave form (mode 3)
-    outb(0x37, PIT_CMD_REG);
+    outb(PIT_MODE3_CH0, PIT_CMD_REG);
 
     // The divisor is shifted by 8 bits and sent in two parts because the PIT's data port can only accept 8 bits at a time, while the divisor is a 16-bit value.
-    outb((uint8_t) _100hz, PIT_CH0_PORT); 
-    outb((uint8_t) _100hz >> 8, PIT_CH0_PORT);  
+    outb((uint8_t) divisor, PIT_CH0_PORT); 
+    outb((uint8_t) (divisor >> 8), PIT_CH0_PORT);  
 
     // Enable IRQ and return
     enable_irq(PIT_IRQ);
@@ -35,90 +63,299 @@ void pit_init(void) {
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Switches process that is running
+ *   SIDE EFFECTS: Switches process that is running once it had sched_quantum interrupts
  */  
 extern void pit_interrupt_handler(void) {
+    uint32_t flags;
+
     // Start of critical section
-    cli();
+    cli_and_save(flags);
     
     // Send EOI for PIT_IRQ
     send_eoi(PIT_IRQ);
 
-    // Get process that is currently running and save ESP/EBP for context switch
-    curr_active_process = terminal_pcb_top[round_robin_term];
-
-    if(curr_active_process != NULL) {
-        asm volatile(
-            "movl %%esp, %0;"
-            "movl %%ebp, %1;"
-            : "=r"(curr_active_process->ESP), "=r"(curr_active_process->EBP) // Output operands
-            :
-            : "memory", "cc"
-        );
+    // Let the next runnable process have a turn, unless the scheduler is already idling
+    // on this stack waiting for somebody to wake up
+    if(!sched_idle && preempt_count == 0 && curr_process != NULL && curr_process->state == TASK_RUNNABLE
+       && ++sched_slice >= sched_quantum)
+        schedule();
+
+    // End of critical section
+    restore_flags(flags);
+}
+
+/*
+ * schedule
+ *   DESCRIPTION: Round robins over the PCBs and switches kernel stacks to the next runnable process.
+ *                If nothing can run, waits with interrupts on until an interrupt wakes somebody up.
+ *                Must be called with interrupts disabled; returns (still disabled) once the caller
+ *                is picked again.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Changes curr_process, paging, the TSS and the video memory mapping
+ */
+void schedule(void) {
+    pcb_t* prev = curr_process;
+    pcb_t* next = NULL;
+    uint32_t start;
+    int i;
+
+    // Whoever runs next starts a new turn
+    sched_slice = 0;
+
+    // Free processes that halted on a stack we are no longer using (closing their files
+    // may wake somebody up, so this happens before taking sched_lock). The worker thread
+    // does this with interrupts on once it runs.
+    if(!workqueue_running()){
+        for(i = 0; i < MAX_TASKS; i++){
+            if(pcbs[i].state == TASK_DEAD && &pcbs[i] != prev)
+                deallocate_pcb(&pcbs[i]);
+        }
     }
 
-    // Update which terminal's process we are running
-    round_robin_term = (round_robin_term+1) % PARENT_SHELL_NUM;
+    spin_lock(&sched_lock);
+
+    start = (prev != NULL && prev->PID != -1) ? prev->PID : 0;
+
+    while(next == NULL){
+        // Start after the previous process so everyone gets a turn, ending on prev itself
+        for(i = 1; i <= MAX_TASKS; i++){
+            pcb_t* cand = &pcbs[(start + i) % MAX_TASKS];
+            if(cand->PID != -1 && cand->state == TASK_RUNNABLE){
+                next = cand;
+                break;
+            }
+        }
+
+        if(next == NULL){
+            // Nothing to run: sleep until an interrupt (keyboard, RTC, ...) wakes a process
+            sched_idle = 1;
+            spin_unlock(&sched_lock);
+            asm volatile("sti; hlt; cli" : : : "memory");
+            spin_lock(&sched_lock);
+            sched_idle = 0;
+        }
+    }
 
-    // If the array is NULL, that means there is no active process and we can just return.
-    if(curr_active_process == NULL){
-        // End of critical section and return
-        sti();
+    if(next == prev){
+        spin_unlock(&sched_lock);
         return;
     }
 
-    // If nothing is running, we can return (new shells are created in execute if needed)
-    if(terminal_pcb_top[round_robin_term] == NULL) {
-        // End of critical section and return
-        sti();
+    curr_process = next;
+    spin_unlock(&sched_lock);
+
+    // Give the process its terminal's video page, if it asked for one
+    round_robin_term = next->terminal_number;
+    load_vidmap(next);
+
+    // Setup paging for new process
+    paging_for_execute(next->page_table);
+
+    // Save ss0 and esp0 for the next trap into the kernel
+    tss.ss0 = KERNEL_DS;
+    tss.esp0 = KERNEL_END_ADDR - ((next->PID) * KERNEL_TASK_SIZE) - sizeof(next);
+
+    // Arm #NM unless next still has its registers in the FPU
+    fpu_switch(next);
+
+    // An interrupt handler that switches away isn't timed, the others run before it returns
+    irq_timing_cancel();
+
+    // Context switch
+    context_switch((prev != NULL) ? &prev->ESP_context : &boot_esp, next->ESP_context);
+}
+
+/*
+ * preempt_disable
+ *   DESCRIPTION: Keeps the timer from switching processes until the matching preempt_enable, for
+ *                interrupt bottom halves that run with interrupts on but hold locks process context
+ *                takes. Calls nest.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void preempt_disable(void) {
+    preempt_count++;
+    asm volatile("" : : : "memory");
+}
+
+/*
+ * preempt_enable
+ *   DESCRIPTION: Undoes a preempt_disable, the next timer tick switches processes again.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void preempt_enable(void) {
+    asm volatile("" : : : "memory");
+    preempt_count--;
+}
+
+/*
+ * init_wait_queue
+ *   DESCRIPTION: Removes every process from a wait queue without waking it.
+ *   INPUTS: wq - wait queue to empty
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void init_wait_queue(wait_queue_t* wq) {
+    memset(wq->waiters, 0, sizeof(wq->waiters));
+}
+
+/*
+ * sleep_on
+ *   DESCRIPTION: Marks the current process as sleeping on a wait queue and schedules something else.
+ *                Callers re-check their condition in a loop, so a spurious wake up is harmless.
+ *                Must be called with interrupts disabled.
+ *   INPUTS: wq - wait queue to sleep on
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May switch processes
+ */
+void sleep_on(wait_queue_t* wq) {
+    // Before the first process exists there is nothing to switch to, just wait for an interrupt
+    if(curr_process == NULL || curr_process->PID == -1){
+        asm volatile("sti; hlt; cli" : : : "memory");
         return;
+    }
+
+    spin_lock(&sched_lock);
+    wq->waiters[curr_process->PID / 32] |= (1 << (curr_process->PID % 32));
+    curr_process->wait = wq;
+    curr_process->state = TASK_SLEEPING;
+    spin_unlock(&sched_lock);
+    schedule();
+    curr_process->wait = NULL;
+}
 
-    } else {
+/*
+ * sleep_on_timeout
+ *   DESCRIPTION: Like sleep_on, but the process is also woken once ticks RTC interrupts have passed.
+ *                Timeouts are checked every RTC_TIMEOUT_TICKS, so they may run that much late.
+ *                Must be called with interrupts disabled.
+ *   INPUTS: wq - wait queue to sleep on
+ *           ticks - RTC ticks (rtc_hz per second) to wait at most
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the timeout has passed, 0 if woken before it
+ *   SIDE EFFECTS: May switch processes
+ */
+int32_t sleep_on_timeout(wait_queue_t* wq, uint32_t ticks) {
+    uint32_t deadline = rtc_get_ticks() + ticks;
 
-        // Sets up video memory for current process
-        vidmem_set(round_robin_term);
+    // 0 means no timeout
+    if(deadline == 0)
+        deadline = 1;
 
-        // Grab new process to execute
-        curr_active_process = (terminal_pcb_top[round_robin_term]);
+    if(curr_process != NULL && curr_process->PID != -1)
+        curr_process->wake_at = deadline;
+    sleep_on(wq);
+    if(curr_process != NULL && curr_process->PID != -1)
+        curr_process->wake_at = 0;
 
-        // Retunr if NULL
-        if(curr_active_process == NULL) {
-            // End of critical section and return
-            sti();
-            return;
-        }
+    return (int32_t)(rtc_get_ticks() - deadline) >= 0;
+}
 
-        // Setup paging for new process
-        paging_for_execute(curr_active_process->PID);
+/*
+ * wake_timeouts
+ *   DESCRIPTION: Makes every process whose sleep_on_timeout has expired runnable again.
+ *   INPUTS: now - current RTC tick
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Changes process states
+ */
+void wake_timeouts(uint32_t now) {
+    uint32_t flags;
+    int i;
 
-        // Null check 
-        if(curr_active_process == NULL) {
-            // send_eoi(PIT_IRQ);
-            sti();
-            return;
+    spin_lock_irqsave(&sched_lock, flags);
+    for(i = 0; i < MAX_TASKS; i++){
+        if(pcbs[i].state == TASK_SLEEPING && pcbs[i].wake_at != 0 && (int32_t)(now - pcbs[i].wake_at) >= 0){
+            pcbs[i].wake_at = 0;
+            pcbs[i].state = TASK_RUNNABLE;
         }
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
 
-        // Save ss0 and esp0 for context switch
-        tss.ss0 = KERNEL_DS;
-        tss.esp0 = KERNEL_END_ADDR - ((curr_active_process->PID) * KERNEL_TASK_SIZE) - sizeof(curr_active_process);
+/*
+ * wake_up
+ *   DESCRIPTION: Makes every process sleeping on a wait queue runnable and empties the queue.
+ *                Safe to call from interrupt handlers.
+ *   INPUTS: wq - wait queue to wake
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Changes process states
+ */
+void wake_up(wait_queue_t* wq) {
+    uint32_t flags;
+    int i;
 
-        // End of critical section
-        sti();
+    spin_lock_irqsave(&sched_lock, flags);
+    for(i = 0; i < MAX_TASKS; i++){
+        if((wq->waiters[i / 32] & (1 << (i % 32))) && pcbs[i].state == TASK_SLEEPING)
+            pcbs[i].state = TASK_RUNNABLE;
+    }
+    init_wait_queue(wq);
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
 
-        // Context switch
-        asm volatile(
-            "movl %0, %%esp ;" 
-            "movl %1, %%ebp ;"
-            :
-            : "r" (curr_active_process->ESP), "r" (curr_active_process->EBP)
-            : "esp", "ebp"
-        );
+/*
+ * poll_wait
+ *   DESCRIPTION: Called by a driver's poll callback, puts the current process on one of the
+ *                driver's wait queues without sleeping, so a wake_up on it ends the poll call's
+ *                sleep. Does nothing for a NULL table (the caller only wants the ready events).
+ *   INPUTS: pt - poll call's table, may be NULL
+ *           wq - driver wait queue to watch
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Records wq in pt for poll_release
+ */
+void poll_wait(poll_table_t* pt, wait_queue_t* wq) {
+    uint32_t flags;
+    uint32_t i;
+
+    if(pt == NULL || curr_process == NULL || curr_process->PID == -1)
+        return;
 
+    // Two descriptors of one device share a queue, keep it once
+    for(i = 0; i < pt->count; i++) {
+        if(pt->queues[i] == wq)
+            return;
     }
-    
-    // End of critical section
-    sti();
+    if(pt->count == POLL_MAX_FDS)
+        return;
+
+    spin_lock_irqsave(&sched_lock, flags);
+    wq->waiters[curr_process->PID / 32] |= (1 << (curr_process->PID % 32));
+    spin_unlock_irqrestore(&sched_lock, flags);
+    pt->queues[pt->count++] = wq;
+}
 
+/*
+ * poll_release
+ *   DESCRIPTION: Takes the current process off every queue poll_wait put it on, so a later
+ *                wake up of those queues doesn't disturb some other sleep.
+ *   INPUTS: pt - poll call's table
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Empties pt
+ */
+void poll_release(poll_table_t* pt) {
+    uint32_t flags;
+    uint32_t i;
+
+    if(curr_process != NULL && curr_process->PID != -1) {
+        spin_lock_irqsave(&sched_lock, flags);
+        for(i = 0; i < pt->count; i++)
+            pt->queues[i]->waiters[curr_process->PID / 32] &= ~(1 << (curr_process->PID % 32));
+        spin_unlock_irqrestore(&sched_lock, flags);
+    }
+    pt->count = 0;
 }
 
 /* MP3.5!!!
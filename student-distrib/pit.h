@@ -5,16 +5,30 @@
 #include "types.h" 
 #include "i8259.h" 
 #include "syscallhandler.h"
+#include "spinlock.h"
 
 #define PIT_CMD_REG 0x43
 #define PIT_CH0_PORT 0x40
-#define _100hz 11932       // 1.193182 mHz / 11932 = 100 Hz
+#define PIT_MODE3_CH0 0x36  // Channel 0, lobyte/hibyte, square wave, binary count
+#define PIT_DEFAULT_HZ 100
+#define PIT_MIN_HZ 19       // 1.193182 MHz / 19 fits the 16 bit divisor
+#define PIT_MAX_HZ 10000
+#define SCHED_QUANTUM 1     // PIT interrupts a process runs before the next one gets a turn
+#define SCHED_MAX_QUANTUM 100
 #define PIT_IRQ 0          // PIT is connected to IRQO
 #define PARENT_SHELL_NUM 3
 
+/* Tunables (param.c): start the PIT at boot, PIT interrupts per turn, PIT frequency */
+extern uint32_t sched_preempt;
+extern uint32_t sched_quantum;
+extern uint32_t pit_hz;
+
 /* Variable to store the current active process */
 extern pcb_t* curr_active_process;
 
+/* Protects process states, wait queues and curr_process */
+extern spinlock_t sched_lock;
+
 /* Initializes the pit */
 void pit_init(void);
 
@@ -24,4 +38,30 @@ extern void pit_interrupt_handler(void);
 /* Getter for round_robin_term */
 uint8_t get_round_robin_term();
 
+/* Switch to the next runnable process (interrupts must be disabled) */
+void schedule(void);
+
+/* Keep the timer from switching processes, and allow it again */
+void preempt_disable(void);
+void preempt_enable(void);
+
+/* Empty a wait queue */
+void init_wait_queue(wait_queue_t* wq);
+
+/* Put the current process to sleep on a wait queue (interrupts must be disabled) */
+void sleep_on(wait_queue_t* wq);
+
+/* sleep_on, giving up after ticks RTC interrupts; returns 1 on timeout */
+int32_t sleep_on_timeout(wait_queue_t* wq, uint32_t ticks);
+
+/* Wake the processes whose sleep_on_timeout expired */
+void wake_timeouts(uint32_t now);
+
+/* Make every process sleeping on a wait queue runnable again */
+void wake_up(wait_queue_t* wq);
+
+/* Watch a driver wait queue from a poll call, and stop watching all of them */
+void poll_wait(poll_table_t* pt, wait_queue_t* wq);
+void poll_release(poll_table_t* pt);
+
 #endif // PIT_H
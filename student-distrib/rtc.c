@@ -3,13 +3,68 @@
 #include "rtc.h"
 #include "lib.h"
 #include "i8259.h"
+#include "uaccess.h"
+#include "signal.h"
+#include "spinlock.h"
+#include "softirq.h"
+#include "pit.h"
+#include "console.h"
 
-uint32_t rtc_int_count = 0;
+uint32_t rtc_hz = RTC_DEFAULT_FREQ;                         // Rate of the RTC interrupts
 uint32_t rtc_global_count = RTC_DEFAULT_FREQ/RTC_MIN_FREQ;  // Initialize RTC interrupt frequency to 2 Hz
 uint32_t rtc_freq = RTC_MIN_FREQ;                           // Initialize RTC interrupt frequency to minimum (2 Hz)
+static uint32_t rtc_alarm_count = RTC_DEFAULT_FREQ * ALARM_SECONDS;    // Interrupts until the next SIG_ALARM
+static spinlock_t rtc_lock = SPINLOCK_INIT("rtc");                      // Protects the counters above
+
+static volatile uint32_t rtc_ticks = 0;                                 // Interrupts since boot
+static volatile uint32_t rtc_periods = 0;                               // Periods of rtc_freq since boot
+static wait_queue_t rtc_wait;                                           // Readers and pollers waiting for a period
+
+static void rtc_alarm_tasklet(uint32_t data);
+static tasklet_t rtc_alarm = TASKLET_INIT(rtc_alarm_tasklet, 0);       // Sends SIG_ALARM outside the interrupt
+
+static void rtc_timeout_tasklet(uint32_t data);
+static tasklet_t rtc_timeout = TASKLET_INIT(rtc_timeout_tasklet, 0);   // Wakes sleepers whose timeout passed
+
+/* rtc_timeout_tasklet
+ *   DESCRIPTION: Wakes up the processes whose sleep_on_timeout expired
+ *   INPUTS: data - unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Changes process states
+ */
+static void rtc_timeout_tasklet(uint32_t data) {
+    wake_timeouts(rtc_ticks);
+}
+
+/* rtc_alarm_tasklet
+ *   DESCRIPTION: Sends SIG_ALARM to the foreground process of every terminal
+ *   INPUTS: data - unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Marks the signal pending
+ */
+static void rtc_alarm_tasklet(uint32_t data) {
+    int t;
+
+    for(t = 0; t < 3; t++)
+        send_signal(terminal_pcb_top[t], SIG_ALARM);
+}
+
+/* rtc_period
+ *   DESCRIPTION: Interrupts in one period of the frequency processes asked for. A frequency
+ *                above rtc_hz gets a period every interrupt.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: interrupts, at least 1
+ *   SIDE EFFECTS: none
+ */
+static uint32_t rtc_period(void) {
+    return (rtc_hz > rtc_freq) ? rtc_hz / rtc_freq : 1;
+}
 
 /* rtc_init
- *   DESCRIPTION: This function initializes the RTC periodic interrupt
+ *   DESCRIPTION: This function initializes the RTC periodic interrupt at rtc_hz
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
@@ -19,6 +74,7 @@ void rtc_init(void) {
     /* Credit: https://wiki.osdev.org/RTC for logic */
     /* Declare variable(s) */
     char prev;  
+    uint32_t rate;
 
     /* Turn on periodic interrupt for RTC */
     outb(RTC_STATUS_REG_B, RTC_PORT_CMD);   /* Select register B and disable NMI */
@@ -26,9 +82,15 @@ void rtc_init(void) {
     outb(RTC_STATUS_REG_B, RTC_PORT_CMD);   /* Set index again since read sets index to register D */
     outb(prev | BIT_6_ON, RTC_PORT_DATA);   /* Write previous value ORed with 0x40 (turn on bit 6 of register B) */
     
-    /* Set RTC IRQ to 1024 Hz */
-    // outb(RTC_STATUS_REG_A, RTC_PORT_CMD);
-    // outb(RTC_DEFAULT_FREQ, RTC_PORT_DATA);
+    /* Set the RTC rate to rtc_hz, 1024 Hz is also what it starts at */
+    for(rate = RTC_BASE_RATE_LOG; (1U << (RTC_BASE_RATE_LOG - rate)) < rtc_hz; rate--);
+    outb(RTC_STATUS_REG_A, RTC_PORT_CMD);
+    prev = inb(RTC_PORT_DATA);
+    outb(RTC_STATUS_REG_A, RTC_PORT_CMD);
+    outb((prev & BIT_F0_MASK) | rate, RTC_PORT_DATA);
+    rtc_alarm_count = rtc_hz * ALARM_SECONDS;
+
+    init_wait_queue(&rtc_wait);
 
     /* Enable interrupts for the RTC */
     enable_irq(RTC_IRQ);
@@ -41,49 +103,111 @@ void rtc_init(void) {
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: When test_interrupts is enabled, monitor flashes
+ *   SIDE EFFECTS: When test_interrupts is enabled, monitor flashes. Sends SIG_ALARM to the
+ *                 foreground process of every terminal each ALARM_SECONDS (through
+ *                 the rtc_alarm tasklet).
  */  
 extern void rtc_interrupt_handler(void) {
+    uint32_t flags;
+
     // test_interrupts();
     // Start critical section
-    cli();
+    spin_lock_irqsave(&rtc_lock, flags);
     outb(RTC_STATUS_REG_C, RTC_PORT_CMD);   /* Select Register C */
     inb(RTC_PORT_DATA);                     /* Throw away contents */
 
+    /* Timeouts are checked every RTC_TIMEOUT_TICKS, ~31ms */
+    if((++rtc_ticks & (RTC_TIMEOUT_TICKS - 1)) == 0)
+        tasklet_schedule(&rtc_timeout);
+
+    /* The PIT isn't started, the RTC paces the console flush too */
+    console_tick(rtc_ticks);
+
     /* Check whether another cycle has passed */
     rtc_global_count--;
-    // If interrupt has occurred, raise flag and reset counter
+    // If a period has passed, count it, wake the readers and reset counter
     if(rtc_global_count == 0) {
-        rtc_int_count = 1;
-        rtc_global_count = RTC_DEFAULT_FREQ/rtc_freq;
-        // printf("%d", 1);
+        rtc_periods++;
+        rtc_global_count = rtc_period();
+        wake_up(&rtc_wait);
     }
 
+    if(--rtc_alarm_count == 0) {
+        rtc_alarm_count = rtc_hz * ALARM_SECONDS;
+        tasklet_schedule(&rtc_alarm);
+    }
+    spin_unlock(&rtc_lock);
+
     // End critical section
-    sti();
+    restore_flags(flags);
     
     // Signal end of interrupt
     send_eoi(RTC_IRQ);
 
 }
 
+/* rtc_reader
+ *   DESCRIPTION: Process whose RTC period count rtc_read and rtc_poll keep, NULL before any runs
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the current process' PCB or NULL
+ *   SIDE EFFECTS: none
+ */
+static pcb_t* rtc_reader(void) {
+    if(curr_process != NULL && curr_process->PID != -1)
+        return curr_process;
+    return NULL;
+}
+
 /* rtc_read
- *   DESCRIPTION: This function reads the RTC frequency. 
+ *   DESCRIPTION: This function reads the RTC frequency. Returns as soon as a period has
+ *                passed since the process' last read (or open), so a reader that
+ *                polls first doesn't lose the period it was told about.
  *   INPUTS: int32_t ls - file to read from
  *           void* buf - buffer to store what to set
  *           int32_t nbytes - number of bytes to read
  *   OUTPUTS: none
- *   RETURN VALUE: Returns 0 on success (always)
- *   SIDE EFFECTS: Blocks until interrupt from the RTC 
+ *   RETURN VALUE: Returns 0 on success, -1 if a signal cut the wait short
+ *   SIDE EFFECTS: Sleeps until the next interrupt period of the RTC
  */  
 int32_t rtc_read(int32_t inode_num, int32_t off, int32_t nbytes, void* buf) {
-    // Set RTC interrupt flag to 0
-    rtc_int_count = 0;
-    // Block until interrupt is raised by RTC
-    while(rtc_int_count == 0);
+    pcb_t* pcb = rtc_reader();
+    uint32_t seen;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    // Before any process runs there is nobody to remember a period for, wait for the next
+    seen = (pcb != NULL) ? pcb->rtc_seen : rtc_periods;
+    while(rtc_periods == seen) {
+        if(pcb != NULL && signal_pending(pcb)) {
+            restore_flags(flags);
+            return -1;
+        }
+        sleep_on(&rtc_wait);
+    }
+    if(pcb != NULL)
+        pcb->rtc_seen = rtc_periods;
+    restore_flags(flags);
     return 0;
 }
 
+/* rtc_poll
+ *   DESCRIPTION: RTC readiness: readable once a period passed since the process' last read
+ *   INPUTS: inode_num - unused
+ *           pt - poll call to put on the RTC wait queue, NULL to just check
+ *   OUTPUTS: none
+ *   RETURN VALUE: POLLIN if a read won't sleep, POLLOUT always
+ *   SIDE EFFECTS: none
+ */
+uint32_t rtc_poll(int32_t inode_num, poll_table_t* pt) {
+    pcb_t* pcb = rtc_reader();
+
+    poll_wait(pt, &rtc_wait);
+    if(pcb != NULL && pcb->rtc_seen != rtc_periods)
+        return POLLIN | POLLOUT;
+    return POLLOUT;
+}
+
 /* rtc_write
  *   DESCRIPTION: This function writes new RTC frequency.
  *   INPUTS: int32_t fd - file to read from
@@ -98,7 +222,8 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes) {
     int32_t to_ret;
     int32_t freq;
     // Get new frequency, change RTC frequency, and return success (or fail)
-    freq = *((int32_t*)buf);
+    if(nbytes < (int32_t)sizeof(int32_t) || copy_from_user(&freq, buf, sizeof(int32_t)) == -1)
+        return -1;
     to_ret = rtc_change_frequency(freq);
     return to_ret;
 }
@@ -111,6 +236,12 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes) {
  *   SIDE EFFECTS: Sets frequency of RTC interrupts to 2 Hz
  */  
 int32_t rtc_open(const uint8_t* fd) {
+    pcb_t* pcb = rtc_reader();
+
+    // The first read waits for a period that starts after the open
+    if(pcb != NULL)
+        pcb->rtc_seen = rtc_periods;
+
     // Set RTC frequency to 2 Hz and return pass
     rtc_change_frequency(RTC_MIN_FREQ);
     return 0;
@@ -129,6 +260,17 @@ int32_t rtc_close(int32_t fd) {
     return 0;
 }
 
+/* rtc_get_ticks
+ *   DESCRIPTION: Returns the number of RTC interrupts since boot, the clock sleep timeouts use.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: ticks, rtc_hz per second (wraps)
+ *   SIDE EFFECTS: none
+ */
+uint32_t rtc_get_ticks(void) {
+    return rtc_ticks;
+}
+
 /* rtc_change_frequency
  *   DESCRIPTION: This function changes the RTC frequency.
  *   INPUTS: uint32_t new_freq - frequency to set RTC interrupts to
@@ -138,22 +280,24 @@ int32_t rtc_close(int32_t fd) {
  *                 variables accordingly)
  */  
 int32_t rtc_change_frequency(uint32_t new_freq) {
-    // Start of critical section
-    cli();
+    uint32_t flags;
 
     // Check whether frequency to set is out of bounds or not a power of 2 (return -1 if so)
     if(new_freq < RTC_MIN_FREQ || new_freq > RTC_MAX_FREQ || (new_freq & (new_freq - 1))) {
         return -1;
     }
 
+    // Start of critical section, the handler reloads the counter from rtc_freq
+    spin_lock_irqsave(&rtc_lock, flags);
+
     // Update frequency for RTC interrupts
     rtc_freq = new_freq;
 
     // Set new rate for RTC interrupts for counter
-    rtc_global_count = RTC_MAX_FREQ/rtc_freq;
+    rtc_global_count = rtc_period();
 
     // End of critical section
-    sti();
+    spin_unlock_irqrestore(&rtc_lock, flags);
 
     // Return 0 on success
     return 0;
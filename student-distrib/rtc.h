@@ -12,16 +12,25 @@
 #define RTC_IRQ             8
 
 #define RTC_MAX_FREQ        1024
-#define RTC_DEFAULT_FREQ    1024
+#define RTC_DEFAULT_FREQ    1024        /* Rate the RTC interrupts at unless rtc.hz says otherwise */
 #define RTC_MIN_FREQ        2
+#define RTC_MIN_BASE_FREQ   256         /* Range of rtc.hz */
+#define RTC_MAX_BASE_FREQ   8192
+#define RTC_BASE_RATE_LOG   16          /* Register A rate r interrupts at 2^(16 - r) Hz */
 #define RTC_STATUS_REG_A    0x8A        /* Status Register A + disable NMI interrupts */
 #define RTC_STATUS_REG_B    0x8B        /* Status Register B + disable NMI interrupts */
 #define RTC_STATUS_REG_C    0x8C        /* Status Register C + disable NMI interrupts */
 
+#define RTC_TIMEOUT_TICKS   32          /* Interrupts between checks for expired sleep timeouts (power of two) */
+#define RTC_TENTH           (rtc_hz / 10)               /* Interrupts in a tenth of a second */
+
 #define BIT_6_ON            0x40
 #define BOT_4_MASK          0x0F
 #define BIT_F0_MASK         0xF0
 
+/* Rate the RTC interrupts at, ticks per second (tunable, param.c) */
+extern uint32_t rtc_hz;
+
 /* Initialize the RTC */
 void rtc_init(void);
 
@@ -31,6 +40,10 @@ extern void rtc_interrupt_handler(void);
 /* Read from the RTC */
 int32_t rtc_read(int32_t inode_num, int32_t off, int32_t nbytes, void* buf);
 
+/* RTC readiness for poll */
+struct poll_table;
+uint32_t rtc_poll(int32_t inode_num, struct poll_table* pt);
+
 /* Write the RTC frequency */
 int32_t rtc_write(int32_t fd, const void* buf,  int32_t nbytes);
 
@@ -43,4 +56,7 @@ int32_t rtc_close(int32_t fd);
 /* Change the frequency of RTC interrupts */
 extern int32_t rtc_change_frequency(uint32_t new_rate);
 
+/* RTC interrupts since boot, rtc_hz per second */
+uint32_t rtc_get_ticks(void);
+
 #endif /* _RTC_H */
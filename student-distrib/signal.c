@@ -0,0 +1,195 @@
+/* signal.c - Signal delivery
+ *
+ * Signals are marked pending in the PCB and delivered on the way back to user mode from
+ * a system call, interrupt or exception. A handler runs on the user stack with the interrupted
+ * registers saved under its arguments, and its return address points at a few bytes of code
+ * that call sigreturn to put them back.
+ */
+
+#include "signal.h"
+#include "lib.h"
+#include "x86_desc.h"
+#include "uaccess.h"
+
+/* movl $SIGRETURN_SYSCALL, %eax; int $0x80; nop */
+static const uint8_t sigreturn_code[SIGRETURN_CODE_SIZE] = {
+    0xB8, SIGRETURN_SYSCALL, 0x00, 0x00, 0x00, 0xCD, 0x80, 0x90
+};
+
+/* Signals that halt the process when it has no handler, the rest are ignored */
+#define SIG_KILL_MASK   ((1 << SIG_DIV_ZERO) | (1 << SIG_SEGFAULT) | (1 << SIG_INTERRUPT))
+
+/*
+ * user_frame
+ *   DESCRIPTION: Finds the IRET frame of the system call a process is in, at the top of its kernel stack.
+ *   INPUTS: pcb - process in a system call
+ *   OUTPUTS: none
+ *   RETURN VALUE: the frame, system_call's saved registers are right below it
+ *   SIDE EFFECTS: none
+ */
+static struct iret_frame_t* user_frame(pcb_t* pcb) {
+    return (struct iret_frame_t*)(KERNEL_END_ADDR - (pcb->PID) * KERNEL_TASK_SIZE - sizeof(pcb)) - 1;
+}
+
+/*
+ * send_signal
+ *   DESCRIPTION: Marks a signal pending. A signal the process ignores is dropped right away, any
+ *                other one also wakes the process if it sleeps on a wait queue, so a blocked read
+ *                can return and let the signal through. Safe to call from interrupt handlers.
+ *   INPUTS: pcb - process to signal
+ *           signum - signal to send
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May change the process' state
+ */
+void send_signal(pcb_t* pcb, int32_t signum) {
+    uint32_t flags;
+
+    if(pcb == NULL || signum < 0 || signum >= NUM_SIGNALS)
+        return;
+
+    cli_and_save(flags);
+    if(pcb->PID != -1 && (pcb->sig_handlers[signum] != 0 || (SIG_KILL_MASK & (1 << signum)))){
+        pcb->sig_pending |= (1 << signum);
+        if(pcb->state == TASK_SLEEPING && pcb->wait != NULL && !(pcb->sig_masked & (1 << signum)))
+            pcb->state = TASK_RUNNABLE;
+    }
+    restore_flags(flags);
+}
+
+/* Whether a sleeping process should give up and return to deliver a signal */
+int32_t signal_pending(pcb_t* pcb) {
+    return (pcb->sig_pending & ~pcb->sig_masked) != 0;
+}
+
+/*
+ * deliver_signals
+ *   DESCRIPTION: Delivers the lowest pending signal before a trap returns to user mode. Without a handler
+ *                the default action runs (halt with SIGNAL_KILL_STATUS, or nothing). With one, the
+ *                sigreturn code, the saved registers, the signal number and a return address are pushed
+ *                on the user stack and the trap returns into the handler instead. Every signal is held
+ *                back until the handler calls sigreturn.
+ *   INPUTS: regs - registers the trap saved
+ *           frame - IRET frame of the trap
+ *   OUTPUTS: regs, frame - changed to enter the handler
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May halt the current process
+ */
+void deliver_signals(struct pushal_t* regs, struct iret_frame_t* frame) {
+    pcb_t* pcb;
+    sig_context_t context;
+    uint32_t handler_args[2];
+    uint32_t pending;
+    uint32_t code_addr;
+    uint32_t user_esp;
+    int32_t signum;
+
+    // Only when going back to user mode, never into interrupted kernel code
+    if((frame->cs & 0x3) != 0x3)
+        return;
+
+    pcb = get_cur_pcb();
+    if(pcb->PID == -1)
+        return;
+
+    while((pending = pcb->sig_pending & ~pcb->sig_masked) != 0){
+        for(signum = 0; !(pending & (1 << signum)); signum++);
+        pcb->sig_pending &= ~(1 << signum);
+
+        if(pcb->sig_handlers[signum] == 0){
+            if(SIG_KILL_MASK & (1 << signum))
+                halt_process(SIGNAL_KILL_STATUS);
+            continue;
+        }
+
+        context.regs = *regs;
+        context.frame = *frame;
+
+        user_esp = frame->esp - SIGRETURN_CODE_SIZE;
+        code_addr = user_esp;
+        user_esp -= sizeof(sig_context_t);
+        handler_args[0] = code_addr;     // return address
+        handler_args[1] = signum;
+
+        // A stack the frame doesn't fit on can't run the handler either
+        if(copy_to_user((void*)code_addr, sigreturn_code, SIGRETURN_CODE_SIZE) == -1 ||
+           copy_to_user((void*)user_esp, &context, sizeof(sig_context_t)) == -1 ||
+           copy_to_user((void*)(user_esp - sizeof(handler_args)), handler_args, sizeof(handler_args)) == -1)
+            halt_process(SIGNAL_KILL_STATUS);
+
+        frame->esp = user_esp - sizeof(handler_args);
+        frame->eip = pcb->sig_handlers[signum];
+        pcb->sig_masked = ~0U;
+        return;
+    }
+}
+
+/*
+ * set_handler
+ *   DESCRIPTION: Sets the user function that runs when a signal is delivered.
+ *   INPUTS: signum - signal to handle
+ *           handler_address - handler, NULL to go back to the default action
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 for a bad signal number or a handler outside of user memory
+ *   SIDE EFFECTS: none
+ */
+int32_t set_handler(int32_t signum, void* handler_address) {
+    pcb_t* pcb = get_cur_pcb();
+
+    if(signum < 0 || signum >= NUM_SIGNALS)
+        return -1;
+    if(handler_address != NULL && !user_range_ok(handler_address, 1))
+        return -1;
+
+    pcb->sig_handlers[signum] = (uint32_t)handler_address;
+    return 0;
+}
+
+/*
+ * sigreturn
+ *   DESCRIPTION: Called by the code under a handler's return address. Copies the registers saved when
+ *                the signal was delivered back into the system call's frame, so returning from the
+ *                system call resumes the interrupted code.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the interrupted eax (system_call stores it back), -1 if the saved registers can't be read
+ *   SIDE EFFECTS: Unmasks signals
+ */
+int32_t sigreturn(void) {
+    pcb_t* pcb = get_cur_pcb();
+    struct iret_frame_t* frame = user_frame(pcb);
+    struct pushal_t* regs = (struct pushal_t*)frame - 1;
+    sig_context_t context;
+
+    // The handler's ret popped the return address, the signal number is still on the stack
+    if(copy_from_user(&context, (void*)(frame->esp + sizeof(uint32_t)), sizeof(sig_context_t)) == -1)
+        return -1;
+
+    // The saved registers come from user memory, they must not leave user mode or change IOPL
+    context.frame.cs = USER_CS;
+    context.frame.ss = USER_DS;
+    context.frame.eflags = (context.frame.eflags & SIG_USER_FLAGS) | EFLAGS_IF;
+
+    *regs = context.regs;
+    *frame = context.frame;
+    pcb->sig_masked = 0;
+
+    return context.regs.eax;
+}
+
+/*
+ * kill
+ *   DESCRIPTION: Sends a signal to a process.
+ *   INPUTS: pid - process to signal
+ *           signum - signal to send
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if there is no such process or signal
+ *   SIDE EFFECTS: see send_signal
+ */
+int32_t kill(int32_t pid, int32_t signum) {
+    if(pid < 0 || pid >= MAX_TASKS || pcbs[pid].PID == -1 || signum < 0 || signum >= NUM_SIGNALS)
+        return -1;
+
+    send_signal(&pcbs[pid], signum);
+    return 0;
+}
@@ -0,0 +1,40 @@
+/* signal.h - Defines used for signal delivery */
+
+#ifndef _SIGNAL_H
+#define _SIGNAL_H
+
+#include "types.h"
+#include "syscallhandler.h"
+#include "idt.h"
+
+/* System call number of sigreturn */
+#define SIGRETURN_SYSCALL   10
+/* Bytes of sigreturn code put on the user stack, rounded up to keep the stack aligned */
+#define SIGRETURN_CODE_SIZE 8
+/* Flags a signal handler may hand back through sigreturn (CF, PF, AF, ZF, SF, DF, OF) */
+#define SIG_USER_FLAGS      0x0CD5
+#define EFLAGS_IF           0x0200
+/* How often the foreground processes get SIG_ALARM */
+#define ALARM_SECONDS       10
+
+/* Saved on the user stack under a handler's arguments, put back by sigreturn */
+typedef struct sig_context {
+    struct pushal_t regs;
+    struct iret_frame_t frame;
+} sig_context_t;
+
+/* Mark a signal pending for a process, waking it if it sleeps */
+void send_signal(pcb_t* pcb, int32_t signum);
+
+/* Nonzero if a process has a signal waiting that should cut its sleep short */
+int32_t signal_pending(pcb_t* pcb);
+
+/* Called on every return to user mode, may redirect it to a handler or halt the process */
+void deliver_signals(struct pushal_t* regs, struct iret_frame_t* frame);
+
+/* Signal system calls */
+int32_t set_handler(int32_t signum, void* handler_address);
+int32_t sigreturn(void);
+int32_t kill(int32_t pid, int32_t signum);
+
+#endif /* _SIGNAL_H */
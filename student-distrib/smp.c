@@ -0,0 +1,598 @@
+/* smp.c - Finding and starting the other CPUs
+ *
+ * The ACPI MADT, or the older MP configuration table when there is no MADT, lists the CPUs, the
+ * IO-APIC and how the ISA IRQs are wired to it. The boot CPU switches interrupts from the 8259 to the
+ * IO-APIC and starts every other CPU (AP) with INIT-SIPI-SIPI. Each AP gets its own GDT copy, TSS,
+ * kernel stack and LAPIC timer.
+ *
+ * This only detects and starts the CPUs and routes the IRQs, it doesn't schedule on the APs.
+ * Processes still only run on the boot CPU: the scheduler and the rest of the kernel rely on
+ * curr_process and cli for mutual exclusion, so the APs idle in hlt and count their timer ticks
+ * until the kernel has per-CPU run queues and locking of its own.
+ */
+
+#include "smp.h"
+#include "boottime.h"
+#include "apic.h"
+#include "lib.h"
+#include "paging.h"
+
+/* Descriptor-table register image for lgdt/sgdt */
+typedef struct gdtr {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) gdtr_t;
+
+cpu_t cpus[MAX_CPUS];
+uint32_t num_cpus = 1;
+
+static uint8_t ap_stacks[MAX_CPUS][AP_STACK_SIZE] __attribute__((aligned(16)));
+static volatile uint32_t ap_boot_cpu;       // Index in cpus of the AP being started
+static uint32_t acpi_maps[ACPI_MAX_MAPS];   // 4MB pages acpi_map mapped, given back by acpi_unmap
+static uint32_t acpi_nmaps = 0;
+static uint32_t acpi_low_end = LOW_MEM_END; // End of the first 4MB pages acpi_map mapped
+
+/* In smp_boot.S */
+extern uint8_t ap_boot_start[];
+extern uint8_t ap_boot_end[];
+extern uint32_t ap_boot_cr0, ap_boot_cr3, ap_boot_cr4, ap_boot_stack;
+
+/* Returns 1 if len bytes at p add up to 0 */
+static uint32_t mp_checksum_ok(const uint8_t* p, uint32_t len) {
+    uint8_t sum = 0;
+
+    while(len-- > 0)
+        sum += *p++;
+    return sum == 0;
+}
+
+/* Sets the ISA IRQs to their own IO-APIC inputs with the ISA polarity and trigger mode */
+static void isa_irq_defaults(uint8_t* irq_pins, uint16_t* irq_flags) {
+    uint32_t i;
+
+    for(i = 0; i < ISA_IRQS; i++){
+        irq_pins[i] = i;
+        irq_flags[i] = 0;
+    }
+}
+
+/*
+ * mp_scan
+ *   DESCRIPTION: Looks for the MP floating pointer structure in a range of low memory.
+ *   INPUTS: addr - start of the range, 16 byte aligned
+ *           len - bytes to search
+ *   OUTPUTS: none
+ *   RETURN VALUE: the structure, NULL if it is not there
+ *   SIDE EFFECTS: none
+ */
+static mp_float_t* mp_scan(uint32_t addr, uint32_t len) {
+    mp_float_t* mpf;
+    uint32_t p;
+
+    for(p = addr; p + sizeof(mp_float_t) <= addr + len; p += MP_ALIGN){
+        mpf = (mp_float_t*)p;
+        if(mpf->signature == MP_FLOAT_SIG && mpf->length > 0 && mp_checksum_ok((uint8_t*)mpf, mpf->length * MP_ALIGN))
+            return mpf;
+    }
+    return NULL;
+}
+
+/*
+ * mp_find
+ *   DESCRIPTION: Searches where the MP spec allows the floating pointer to be: the first KB of the
+ *                EBDA (or the last KB of base memory without one) and the BIOS ROM.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the structure, NULL if the BIOS has none
+ *   SIDE EFFECTS: Low memory must be mapped
+ */
+static mp_float_t* mp_find(void) {
+    uint32_t ebda = *(uint16_t*)BDA_EBDA_SEG << 4;
+    uint32_t base_end = *(uint16_t*)BDA_BASE_KB * 1024;
+    mp_float_t* mpf = NULL;
+
+    if(ebda != 0 && ebda < LOW_MEM_END)
+        mpf = mp_scan(ebda, EBDA_SCAN_SIZE);
+    else if(base_end >= EBDA_SCAN_SIZE && base_end <= LOW_MEM_END)
+        mpf = mp_scan(base_end - EBDA_SCAN_SIZE, EBDA_SCAN_SIZE);
+
+    if(mpf == NULL)
+        mpf = mp_scan(BIOS_ROM_START, BIOS_ROM_SIZE);
+    return mpf;
+}
+
+/*
+ * mp_parse
+ *   DESCRIPTION: Reads the CPUs, the first enabled IO-APIC and the ISA IRQ wiring out of the MP
+ *                configuration table. The boot CPU goes to cpus[0].
+ *   INPUTS: conf - configuration table
+ *   OUTPUTS: ioapic_addr - IO-APIC address, 0 if there is none
+ *            irq_pins, irq_flags - IO-APIC input and polarity/trigger flags of every ISA IRQ
+ *   RETURN VALUE: 0 on success, -1 if the table is broken
+ *   SIDE EFFECTS: Fills cpus and num_cpus
+ */
+static int32_t mp_parse(mp_config_t* conf, uint32_t* ioapic_addr, uint8_t* irq_pins, uint16_t* irq_flags) {
+    uint8_t isa_bus[MP_MAX_BUSES];
+    uint32_t ioapic_id = 0;
+    uint8_t* entry;
+    uint8_t* end;
+    uint32_t i;
+
+    if(conf->signature != MP_CONFIG_SIG || !mp_checksum_ok((uint8_t*)conf, conf->length))
+        return -1;
+
+    memset(isa_bus, 0, sizeof(isa_bus));
+    isa_irq_defaults(irq_pins, irq_flags);
+    *ioapic_addr = 0;
+    num_cpus = 1;
+
+    entry = (uint8_t*)conf + sizeof(mp_config_t);
+    end = (uint8_t*)conf + conf->length;
+    for(i = 0; i < conf->entry_count && entry < end; i++){
+        switch(*entry){
+        case MP_ENTRY_CPU: {
+            mp_cpu_t* cpu = (mp_cpu_t*)entry;
+            if(cpu->flags & MP_CPU_BSP)
+                cpus[0].apic_id = cpu->apic_id;
+            else if((cpu->flags & MP_CPU_ENABLED) && num_cpus < MAX_CPUS)
+                cpus[num_cpus++].apic_id = cpu->apic_id;
+            entry += MP_CPU_ENTRY_SIZE;
+            break;
+        }
+        case MP_ENTRY_BUS: {
+            mp_bus_t* bus = (mp_bus_t*)entry;
+            if(strncmp((int8_t*)bus->name, (int8_t*)"ISA", 3) == 0)
+                isa_bus[bus->id] = 1;
+            entry += MP_ENTRY_SIZE;
+            break;
+        }
+        case MP_ENTRY_IOAPIC: {
+            mp_ioapic_t* io = (mp_ioapic_t*)entry;
+            if((io->flags & MP_IOAPIC_ENABLED) && *ioapic_addr == 0){
+                *ioapic_addr = io->addr;
+                ioapic_id = io->id;
+            }
+            entry += MP_ENTRY_SIZE;
+            break;
+        }
+        case MP_ENTRY_IRQ: {
+            mp_irq_t* irq = (mp_irq_t*)entry;
+            if(irq->irq_type == MP_IRQ_INT && isa_bus[irq->src_bus] && irq->src_irq < ISA_IRQS &&
+               (irq->dst_ioapic == ioapic_id || irq->dst_ioapic == MP_ALL_IOAPICS)){
+                irq_pins[irq->src_irq] = irq->dst_pin;
+                irq_flags[irq->src_irq] = irq->flags;
+            }
+            entry += MP_ENTRY_SIZE;
+            break;
+        }
+        case MP_ENTRY_LINT:
+            entry += MP_ENTRY_SIZE;
+            break;
+        default:
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * acpi_map
+ *   DESCRIPTION: Makes a firmware table readable wherever it is in physical memory. Pages that weren't
+ *                mapped yet are remembered for acpi_unmap.
+ *   INPUTS: phys - physical address of the table
+ *           len - bytes of it to map
+ *   OUTPUTS: none
+ *   RETURN VALUE: the table, NULL if it can't be mapped
+ *   SIDE EFFECTS: Flushes the TLB
+ */
+static void* acpi_map(uint32_t phys, uint32_t len) {
+    uint32_t page;
+
+    if(len == 0 || phys + len < phys)
+        return NULL;
+
+    // The first 4MB go through the low page table, acpi_unmap unmaps up to acpi_low_end
+    if(phys < FOUR_MB){
+        if(phys + len > FOUR_MB)
+            return NULL;
+        map_low_pages(phys, phys + len, 1);
+        if(phys + len > acpi_low_end)
+            acpi_low_end = phys + len;
+        return (void*)phys;
+    }
+
+    for(page = phys >> 22; page <= (phys + len - 1) >> 22; page++){
+        if(acpi_nmaps == ACPI_MAX_MAPS)
+            return NULL;
+        switch(map_firmware_page(page << 22)){
+        case 1:
+            acpi_maps[acpi_nmaps++] = page << 22;
+            break;
+        case -1:
+            return NULL;
+        }
+    }
+    return (void*)phys;
+}
+
+/*
+ * acpi_unmap
+ *   DESCRIPTION: Gives back every page acpi_map mapped, save the first 1MB smp_init unmaps itself.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Flushes the TLB
+ */
+static void acpi_unmap(void) {
+    while(acpi_nmaps > 0)
+        unmap_firmware_page(acpi_maps[--acpi_nmaps]);
+    if(acpi_low_end > LOW_MEM_END)
+        map_low_pages(LOW_MEM_END, acpi_low_end, 0);
+    acpi_low_end = LOW_MEM_END;
+}
+
+/*
+ * acpi_table
+ *   DESCRIPTION: Maps a whole ACPI table and checks its signature and checksum.
+ *   INPUTS: phys - physical address of the table
+ *           signature - the signature it must have
+ *   OUTPUTS: none
+ *   RETURN VALUE: the table, NULL if it is missing or broken
+ *   SIDE EFFECTS: Maps the table through acpi_map
+ */
+static acpi_header_t* acpi_table(uint32_t phys, uint32_t signature) {
+    acpi_header_t* header = acpi_map(phys, sizeof(acpi_header_t));
+
+    if(header == NULL || header->signature != signature || header->length < sizeof(acpi_header_t))
+        return NULL;
+    if(acpi_map(phys, header->length) == NULL || !mp_checksum_ok((uint8_t*)header, header->length))
+        return NULL;
+    return header;
+}
+
+/*
+ * acpi_scan
+ *   DESCRIPTION: Looks for the ACPI RSDP in a range of low memory.
+ *   INPUTS: addr - start of the range, 16 byte aligned
+ *           len - bytes to search
+ *   OUTPUTS: none
+ *   RETURN VALUE: the RSDP, NULL if it is not there
+ *   SIDE EFFECTS: none
+ */
+static acpi_rsdp_t* acpi_scan(uint32_t addr, uint32_t len) {
+    acpi_rsdp_t* rsdp;
+    uint32_t p;
+
+    for(p = addr; p + sizeof(acpi_rsdp_t) <= addr + len; p += MP_ALIGN){
+        rsdp = (acpi_rsdp_t*)p;
+        if(rsdp->signature[0] == ACPI_RSDP_SIG_LO && rsdp->signature[1] == ACPI_RSDP_SIG_HI &&
+           mp_checksum_ok((uint8_t*)rsdp, ACPI_RSDP_SIZE))
+            return rsdp;
+    }
+    return NULL;
+}
+
+/*
+ * acpi_find_madt
+ *   DESCRIPTION: Finds the RSDP in the first KB of the EBDA or the BIOS area, then the MADT through the
+ *                RSDT. The 32 bit RSDT is enough, the kernel can't reach tables above 4GB anyway.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the MADT, NULL if the firmware has no ACPI or no MADT
+ *   SIDE EFFECTS: Low memory must be mapped, maps the tables through acpi_map
+ */
+static madt_t* acpi_find_madt(void) {
+    uint32_t ebda = *(uint16_t*)BDA_EBDA_SEG << 4;
+    acpi_rsdp_t* rsdp = NULL;
+    acpi_header_t* rsdt;
+    uint32_t* entries;
+    uint32_t i, n;
+
+    if(ebda != 0 && ebda < LOW_MEM_END)
+        rsdp = acpi_scan(ebda, EBDA_SCAN_SIZE);
+    if(rsdp == NULL)
+        rsdp = acpi_scan(ACPI_ROM_START, ACPI_ROM_SIZE);
+    if(rsdp == NULL)
+        return NULL;
+
+    rsdt = acpi_table(rsdp->rsdt, ACPI_RSDT_SIG);
+    if(rsdt == NULL)
+        return NULL;
+
+    entries = (uint32_t*)(rsdt + 1);
+    n = (rsdt->length - sizeof(acpi_header_t)) / sizeof(uint32_t);
+    for(i = 0; i < n; i++){
+        acpi_header_t* table = acpi_map(entries[i], sizeof(acpi_header_t));
+        if(table != NULL && table->signature == ACPI_MADT_SIG)
+            return (madt_t*)acpi_table(entries[i], ACPI_MADT_SIG);
+    }
+    return NULL;
+}
+
+/*
+ * madt_parse
+ *   DESCRIPTION: Reads the enabled CPUs, the IO-APIC that takes the ISA IRQs and the IRQs wired to
+ *                another input (interrupt source overrides) out of the MADT. The MADT doesn't mark the
+ *                boot CPU, smp_init moves it to cpus[0] once its LAPIC is up.
+ *   INPUTS: madt - the table
+ *   OUTPUTS: ioapic_addr - IO-APIC address, 0 if there is none
+ *            irq_pins, irq_flags - IO-APIC input and polarity/trigger flags of every ISA IRQ
+ *   RETURN VALUE: 0 on success, -1 if the table is broken or lists no CPU
+ *   SIDE EFFECTS: Fills cpus and num_cpus
+ */
+static int32_t madt_parse(madt_t* madt, uint32_t* ioapic_addr, uint8_t* irq_pins, uint16_t* irq_flags) {
+    uint32_t irq_gsi[ISA_IRQS];
+    uint32_t gsi_base = 0;
+    uint8_t* entry;
+    uint8_t* end;
+    uint32_t i;
+
+    isa_irq_defaults(irq_pins, irq_flags);
+    for(i = 0; i < ISA_IRQS; i++)
+        irq_gsi[i] = i;
+    *ioapic_addr = 0;
+    num_cpus = 0;
+
+    entry = (uint8_t*)madt + sizeof(madt_t);
+    end = (uint8_t*)madt + madt->header.length;
+    while(entry + 2 <= end){
+        if(entry[1] < 2 || entry + entry[1] > end)
+            return -1;
+
+        switch(*entry){
+        case MADT_LAPIC: {
+            madt_lapic_t* cpu = (madt_lapic_t*)entry;
+            if((cpu->flags & MADT_LAPIC_ENABLED) && num_cpus < MAX_CPUS)
+                cpus[num_cpus++].apic_id = cpu->apic_id;
+            break;
+        }
+        case MADT_IOAPIC: {
+            // The ISA IRQs are on the IO-APIC whose inputs start at global interrupt 0
+            madt_ioapic_t* io = (madt_ioapic_t*)entry;
+            if(*ioapic_addr == 0 && io->gsi_base == 0){
+                *ioapic_addr = io->addr;
+                gsi_base = io->gsi_base;
+            }
+            break;
+        }
+        case MADT_OVERRIDE: {
+            madt_override_t* o = (madt_override_t*)entry;
+            if(o->bus == MADT_ISA_BUS && o->src_irq < ISA_IRQS){
+                irq_gsi[o->src_irq] = o->gsi;
+                irq_flags[o->src_irq] = o->flags;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        entry += entry[1];
+    }
+
+    for(i = 0; i < ISA_IRQS; i++)
+        irq_pins[i] = irq_gsi[i] - gsi_base;
+
+    if(num_cpus == 0){
+        num_cpus = 1;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * boot_cpu_first
+ *   DESCRIPTION: Moves the entry of the calling (boot) CPU to cpus[0], or gives cpus[0] its APIC ID if
+ *                the table left it out.
+ *   INPUTS: apic_id - APIC ID of the boot CPU
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Reorders cpus
+ */
+static void boot_cpu_first(uint32_t apic_id) {
+    uint32_t i;
+
+    for(i = 0; i < num_cpus; i++){
+        if(cpus[i].apic_id == apic_id){
+            cpus[i].apic_id = cpus[0].apic_id;
+            break;
+        }
+    }
+    cpus[0].apic_id = apic_id;
+}
+
+/*
+ * cpu_load_descriptors
+ *   DESCRIPTION: Gives the calling AP a copy of the GDT whose TSS entry points at its own TSS, and
+ *                loads it together with the shared IDT.
+ *   INPUTS: cpu - the calling CPU
+ *           stack_top - kernel stack the TSS reports
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Loads GDTR, TR and IDTR
+ */
+static void cpu_load_descriptors(cpu_t* cpu, uint32_t stack_top) {
+    seg_desc_t* tss_desc = &cpu->gdt[KERNEL_TSS >> 3];
+    gdtr_t gdtr;
+
+    asm volatile("sgdt %0" : "=m"(gdtr));
+    memcpy(cpu->gdt, (void*)gdtr.base, sizeof(cpu->gdt));
+
+    memset(&cpu->tss, 0, sizeof(cpu->tss));
+    cpu->tss.ldt_segment_selector = KERNEL_LDT;
+    cpu->tss.ss0 = KERNEL_DS;
+    cpu->tss.esp0 = stack_top;
+
+    // The copy of the boot CPU's entry is marked busy, ltr needs an available TSS
+    SET_TSS_PARAMS((*tss_desc), &cpu->tss, tss_size);
+    tss_desc->type = TSS_AVAILABLE;
+
+    gdtr.base = (uint32_t)cpu->gdt;
+    gdtr.limit = sizeof(cpu->gdt) - 1;
+    asm volatile("lgdt %0" : : "m"(gdtr) : "memory");
+    ltr(KERNEL_TSS);
+    asm volatile("lidt %0" : : "m"(idt_desc_ptr) : "memory");
+}
+
+/*
+ * ap_main
+ *   DESCRIPTION: Sets up an AP after smp_boot.S turned on paging, reports it online and idles.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: Enables interrupts on the AP
+ */
+void ap_main(void) {
+    cpu_t* cpu = &cpus[ap_boot_cpu];
+
+    cpu_load_descriptors(cpu, ap_boot_stack);
+    lapic_cpu_init();
+    cpu->online = 1;
+
+    sti();
+    while(1)
+        asm volatile("hlt");
+}
+
+/*
+ * start_ap
+ *   DESCRIPTION: Starts one AP with INIT-SIPI-SIPI and waits for it to come online.
+ *   INPUTS: i - index of the AP in cpus
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the AP came online, -1 otherwise
+ *   SIDE EFFECTS: The start-up code must already be at AP_BOOT_ADDR
+ */
+static int32_t start_ap(uint32_t i) {
+    uint32_t ms;
+
+    ap_boot_cpu = i;
+    ap_boot_stack = (uint32_t)ap_stacks[i] + AP_STACK_SIZE;
+
+    lapic_send_ipi(cpus[i].apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL | LAPIC_ICR_ASSERT);
+    pit_delay_us(AP_INIT_DELAY_US);
+    lapic_send_ipi(cpus[i].apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+
+    // The second SIPI is for CPUs that missed the first one
+    lapic_send_ipi(cpus[i].apic_id, LAPIC_ICR_STARTUP | (AP_BOOT_ADDR >> 12));
+    pit_delay_us(AP_SIPI_DELAY_US);
+    if(!cpus[i].online)
+        lapic_send_ipi(cpus[i].apic_id, LAPIC_ICR_STARTUP | (AP_BOOT_ADDR >> 12));
+
+    for(ms = 0; ms < AP_START_TIMEOUT_MS && !cpus[i].online; ms++)
+        pit_delay_us(1000);
+
+    return cpus[i].online ? 0 : -1;
+}
+
+/*
+ * smp_init
+ *   DESCRIPTION: Reads the MADT (or the MP table without one), sets up the boot CPU's LAPIC, moves the
+ *                ISA IRQs to the IO-APIC and starts the APs. Without either table (or with one of the MP
+ *                default configurations) the kernel stays on the 8259 with one CPU.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Maps the APIC registers, must run with interrupts off after paging and fpu_init
+ */
+void smp_init(void) {
+    uint8_t irq_pins[ISA_IRQS];
+    uint16_t irq_flags[ISA_IRQS];
+    uint32_t ioapic_addr, lapic_addr;
+    uint32_t imcr = 0;
+    const int8_t* source;
+    mp_float_t* mpf;
+    madt_t* madt;
+    uint32_t i, started;
+
+    cpus[0].online = 1;
+    map_low_pages(0, LOW_MEM_END, 1);
+
+    madt = acpi_find_madt();
+    if(madt != NULL && madt_parse(madt, &ioapic_addr, irq_pins, irq_flags) == 0){
+        lapic_addr = madt->lapic;
+        source = "MADT";
+    }
+    else{
+        mpf = mp_find();
+        if(mpf == NULL || mpf->default_config != 0 || mpf->config == 0 || mpf->config >= LOW_MEM_END ||
+           mp_parse((mp_config_t*)mpf->config, &ioapic_addr, irq_pins, irq_flags) == -1){
+            num_cpus = 1;
+            acpi_unmap();
+            map_low_pages(0, LOW_MEM_END, 0);
+            if(!boot_quiet())
+                printf("SMP: no MADT or MP table, one CPU on the 8259\n");
+            return;
+        }
+        lapic_addr = ((mp_config_t*)mpf->config)->lapic;
+        imcr = mpf->features & MP_IMCR_PRESENT;
+        source = "MP table";
+    }
+    acpi_unmap();
+
+    map_mmio(lapic_addr);
+    lapic_init(lapic_addr);
+    boot_cpu_first(lapic_id());
+
+    if(ioapic_addr != 0){
+        // Disconnect the 8259 from the BSP's LINT0 if the board routes it through the IMCR
+        if(imcr){
+            outb(IMCR_SELECT, IMCR_ADDR_PORT);
+            outb(IMCR_APIC, IMCR_DATA_PORT);
+        }
+        map_mmio(ioapic_addr);
+        ioapic_init(ioapic_addr, cpus[0].apic_id, irq_pins, irq_flags);
+    }
+
+    memcpy((void*)AP_BOOT_ADDR, ap_boot_start, ap_boot_end - ap_boot_start);
+    asm volatile("movl %%cr0, %0" : "=r"(ap_boot_cr0));
+    asm volatile("movl %%cr3, %0" : "=r"(ap_boot_cr3));
+    asm volatile("movl %%cr4, %0" : "=r"(ap_boot_cr4));
+
+    started = 1;
+    for(i = 1; i < num_cpus; i++){
+        if(start_ap(i) == 0)
+            started++;
+        else
+            printf("SMP: CPU with APIC ID %u did not start\n", cpus[i].apic_id);
+    }
+
+    map_low_pages(0, LOW_MEM_END, 0);
+    if(!boot_quiet())
+        printf("SMP: %u of %u CPUs online from the %s, IRQs through the %s\n", started, num_cpus, source,
+               ioapic_active() ? "IO-APIC" : "8259");
+}
+
+/*
+ * this_cpu
+ *   DESCRIPTION: Finds the calling CPU from its APIC ID.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the CPU's entry in cpus
+ *   SIDE EFFECTS: none
+ */
+cpu_t* this_cpu(void) {
+    uint32_t id;
+    uint32_t i;
+
+    if(!lapic_present())
+        return &cpus[0];
+
+    id = lapic_id();
+    for(i = 0; i < num_cpus; i++){
+        if(cpus[i].apic_id == id)
+            return &cpus[i];
+    }
+    return &cpus[0];
+}
+
+/*
+ * apic_timer_handler
+ *   DESCRIPTION: LAPIC timer tick of any CPU, counts the tick.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Sends the LAPIC EOI
+ */
+void apic_timer_handler(void) {
+    this_cpu()->ticks++;
+    lapic_eoi();
+}
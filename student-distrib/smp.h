@@ -0,0 +1,206 @@
+/* smp.h - Defines for finding and starting the other CPUs */
+
+#ifndef _SMP_H
+#define _SMP_H
+
+#define MAX_CPUS            8
+#define AP_BOOT_ADDR        0x7000      // Where the AP start-up code is copied, page aligned below 1MB
+#define AP_STACK_SIZE       4096
+#define GDT_ENTRIES         8           // Entries in the GDT of x86_desc.S
+#define CR0_PE              0x00000001
+
+#ifndef ASM
+
+#include "types.h"
+#include "x86_desc.h"
+
+#define LOW_MEM_END         0x100000    // The MP tables and the start-up code are all below 1MB
+#define BDA_EBDA_SEG        0x40E       // BIOS data area: segment of the extended BIOS data area
+#define BDA_BASE_KB         0x413       // BIOS data area: KB of base memory
+#define BIOS_ROM_START      0xF0000
+#define BIOS_ROM_SIZE       0x10000
+#define EBDA_SCAN_SIZE      1024
+#define MP_ALIGN            16
+#define MP_FLOAT_SIG        0x5F504D5F  // "_MP_"
+#define MP_CONFIG_SIG       0x504D4350  // "PCMP"
+#define MP_IMCR_PRESENT     0x80        // Feature byte 2: the PIC is wired in through the IMCR
+#define MP_ENTRY_CPU        0
+#define MP_ENTRY_BUS        1
+#define MP_ENTRY_IOAPIC     2
+#define MP_ENTRY_IRQ        3
+#define MP_ENTRY_LINT       4
+#define MP_CPU_ENTRY_SIZE   20
+#define MP_ENTRY_SIZE       8           // Size of every entry but a processor's
+#define MP_CPU_ENABLED      0x1
+#define MP_CPU_BSP          0x2
+#define MP_IOAPIC_ENABLED   0x1
+#define MP_IRQ_INT          0           // Vectored interrupt, the kind routed to devices
+#define MP_ALL_IOAPICS      0xFF
+#define MP_MAX_BUSES        256
+#define IMCR_ADDR_PORT      0x22
+#define IMCR_DATA_PORT      0x23
+#define IMCR_SELECT         0x70
+#define IMCR_APIC           0x01
+#define AP_INIT_DELAY_US    10000
+#define AP_SIPI_DELAY_US    200
+#define AP_START_TIMEOUT_MS 100
+#define TSS_AVAILABLE       0x9         // TSS descriptor type, not busy
+#define ACPI_RSDP_SIG_LO    0x20445352  // "RSD "
+#define ACPI_RSDP_SIG_HI    0x20525450  // "PTR "
+#define ACPI_RSDT_SIG       0x54445352  // "RSDT"
+#define ACPI_MADT_SIG       0x43495041  // "APIC"
+#define ACPI_RSDP_SIZE      20          // Bytes of the RSDP the checksum covers, ACPI 1.0 part
+#define ACPI_ROM_START      0xE0000     // The RSDP is in the EBDA or in 0xE0000-0xFFFFF
+#define ACPI_ROM_SIZE       0x20000
+#define ACPI_MAX_MAPS       4           // 4MB pages mapped at once to read the RSDT and the MADT
+#define MADT_LAPIC          0
+#define MADT_IOAPIC         1
+#define MADT_OVERRIDE       2           // Interrupt source override: an ISA IRQ not on its own pin
+#define MADT_LAPIC_ENABLED  0x1
+#define MADT_ISA_BUS        0
+
+/* MP floating pointer structure */
+typedef struct mp_float {
+    uint32_t signature;
+    uint32_t config;            // Physical address of the configuration table
+    uint8_t length;             // In 16 byte units
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t default_config;     // Non zero: one of the default configurations, no table
+    uint8_t features;
+    uint8_t reserved[3];
+} __attribute__((packed)) mp_float_t;
+
+/* MP configuration table header, the entries follow it */
+typedef struct mp_config {
+    uint32_t signature;
+    uint16_t length;
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t oem_id[8];
+    uint8_t product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic;             // Physical address of the local APICs
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} __attribute__((packed)) mp_config_t;
+
+typedef struct mp_cpu {
+    uint8_t type;
+    uint8_t apic_id;
+    uint8_t apic_version;
+    uint8_t flags;
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} __attribute__((packed)) mp_cpu_t;
+
+typedef struct mp_bus {
+    uint8_t type;
+    uint8_t id;
+    uint8_t name[6];            // "ISA   ", "PCI   ", ...
+} __attribute__((packed)) mp_bus_t;
+
+typedef struct mp_ioapic {
+    uint8_t type;
+    uint8_t id;
+    uint8_t version;
+    uint8_t flags;
+    uint32_t addr;
+} __attribute__((packed)) mp_ioapic_t;
+
+typedef struct mp_irq {
+    uint8_t type;
+    uint8_t irq_type;
+    uint16_t flags;             // Polarity and trigger mode
+    uint8_t src_bus;
+    uint8_t src_irq;
+    uint8_t dst_ioapic;
+    uint8_t dst_pin;
+} __attribute__((packed)) mp_irq_t;
+
+/* ACPI root system description pointer, the ACPI 1.0 part */
+typedef struct acpi_rsdp {
+    uint32_t signature[2];
+    uint8_t checksum;
+    uint8_t oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt;              // Physical address of the RSDT
+} __attribute__((packed)) acpi_rsdp_t;
+
+/* Header every ACPI table starts with */
+typedef struct acpi_header {
+    uint32_t signature;
+    uint32_t length;            // Of the whole table, header included
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t oem_id[6];
+    uint8_t oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+/* ACPI multiple APIC description table, the entries follow it */
+typedef struct madt {
+    acpi_header_t header;
+    uint32_t lapic;             // Physical address of the local APICs
+    uint32_t flags;
+} __attribute__((packed)) madt_t;
+
+typedef struct madt_lapic {
+    uint8_t type;
+    uint8_t length;
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed)) madt_lapic_t;
+
+typedef struct madt_ioapic {
+    uint8_t type;
+    uint8_t length;
+    uint8_t id;
+    uint8_t reserved;
+    uint32_t addr;
+    uint32_t gsi_base;          // First global system interrupt on its inputs
+} __attribute__((packed)) madt_ioapic_t;
+
+typedef struct madt_override {
+    uint8_t type;
+    uint8_t length;
+    uint8_t bus;
+    uint8_t src_irq;
+    uint32_t gsi;
+    uint16_t flags;             // Polarity and trigger mode, same bits as the MP table's
+} __attribute__((packed)) madt_override_t;
+
+/* State of one CPU, cpus[0] is the boot CPU */
+typedef struct cpu {
+    uint32_t apic_id;
+    volatile uint32_t online;                   // 1 once the CPU runs kernel code
+    volatile uint32_t ticks;                    // LAPIC timer interrupts taken
+    seg_desc_t gdt[GDT_ENTRIES] __attribute__((aligned(8)));   // Copy of the GDT with this CPU's TSS
+    tss_t tss;
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+extern uint32_t num_cpus;
+
+/* Find the CPUs, switch to the IO-APIC and start the APs */
+void smp_init(void);
+
+/* The cpu_t of the calling CPU */
+cpu_t* this_cpu(void);
+
+/* LAPIC timer interrupt, every CPU */
+void apic_timer_handler(void);
+
+/* First C code an AP runs */
+void ap_main(void);
+
+#endif /* ASM */
+
+#endif /* _SMP_H */
@@ -0,0 +1,267 @@
+/* softirq.c - Deferred interrupt work: softirqs and tasklets
+ *
+ * Interrupt handlers only do what can't wait (acknowledge the device, grab its data) with
+ * interrupts off and raise a softirq for the rest. Pending softirqs run with interrupts on
+ * when an interrupt returns to code that had interrupts on, and before a system call returns
+ * to user mode. They don't nest and the timer doesn't switch processes while they run, so a
+ * softirq handler may take locks that process context takes with interrupts off. Jobs too
+ * long even for that go to the worker thread (workqueue.c).
+ */
+
+#include "softirq.h"
+#include "lib.h"
+#include "pit.h"
+#include "signal.h"
+#include "spinlock.h"
+
+static void (*softirq_handlers[NUM_SOFTIRQS])(void);
+static volatile uint32_t softirq_pending = 0;       // Bit nr set while softirq nr has to run
+static volatile uint32_t in_softirq = 0;            // Set while do_softirq runs handlers
+
+// Tasklets waiting for the tasklet softirq, in the order they were scheduled
+static tasklet_t* tasklet_head = NULL;
+static tasklet_t* tasklet_tail = NULL;
+static spinlock_t tasklet_lock = SPINLOCK_INIT("tasklet");
+
+// Interrupt-off time of the handler running right now
+static uint32_t irq_entry_tsc = 0;
+static volatile uint32_t irq_timing = 0;
+
+static uint32_t irq_off_cycles[NUM_IRQ_SLOTS];      // Longest handler run per slot
+static uint32_t irq_counts[NUM_IRQ_SLOTS];
+static uint32_t softirq_max_cycles = 0;             // Longest do_softirq pass
+
+/*
+ * tasklet_action
+ *   DESCRIPTION: Tasklet softirq, runs every tasklet scheduled so far.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Runs the tasklets with interrupts enabled
+ */
+static void tasklet_action(void) {
+    tasklet_t* list;
+    tasklet_t* t;
+    uint32_t flags;
+
+    spin_lock_irqsave(&tasklet_lock, flags);
+    list = tasklet_head;
+    tasklet_head = tasklet_tail = NULL;
+    spin_unlock_irqrestore(&tasklet_lock, flags);
+
+    while(list != NULL) {
+        t = list;
+        list = t->next;
+        // Cleared first, so the tasklet may schedule itself again
+        t->scheduled = 0;
+        t->func(t->data);
+    }
+}
+
+/*
+ * softirq_init
+ *   DESCRIPTION: Registers the tasklet softirq.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void softirq_init(void) {
+    open_softirq(SOFTIRQ_TASKLET, tasklet_action);
+}
+
+/*
+ * open_softirq
+ *   DESCRIPTION: Sets the handler a softirq runs.
+ *   INPUTS: nr - softirq number
+ *           handler - function to run when the softirq is raised
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void open_softirq(uint32_t nr, void (*handler)(void)) {
+    if(nr < NUM_SOFTIRQS)
+        softirq_handlers[nr] = handler;
+}
+
+/*
+ * raise_softirq
+ *   DESCRIPTION: Marks a softirq pending. Safe to call from interrupt handlers.
+ *   INPUTS: nr - softirq number
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void raise_softirq(uint32_t nr) {
+    if(nr < NUM_SOFTIRQS)
+        asm volatile("lock; orl %1, %0" : "+m"(softirq_pending) : "r"(1 << nr) : "memory", "cc");
+}
+
+/*
+ * do_softirq
+ *   DESCRIPTION: Runs pending softirqs with interrupts enabled, until none are pending or
+ *                SOFTIRQ_MAX_RESTART passes were made. Does nothing if softirqs are already
+ *                running further down the stack; they pick up whatever is raised meanwhile.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Returns with EFLAGS as it found them, keeps the timer from switching processes
+ *                 while the handlers run
+ */
+void do_softirq(void) {
+    uint32_t flags;
+    uint32_t pending;
+    uint32_t start;
+    uint32_t cycles;
+    uint32_t nr;
+    int restarts = SOFTIRQ_MAX_RESTART;
+
+    cli_and_save(flags);
+    if(in_softirq || softirq_pending == 0) {
+        restore_flags(flags);
+        return;
+    }
+
+    in_softirq = 1;
+    preempt_disable();
+    start = rdtsc_low();
+
+    while((pending = softirq_pending) != 0 && restarts-- > 0) {
+        softirq_pending = 0;
+        sti();
+        for(nr = 0; nr < NUM_SOFTIRQS; nr++) {
+            if((pending & (1 << nr)) && softirq_handlers[nr] != NULL)
+                softirq_handlers[nr]();
+        }
+        cli();
+    }
+
+    cycles = rdtsc_low() - start;
+    if(cycles > softirq_max_cycles)
+        softirq_max_cycles = cycles;
+
+    preempt_enable();
+    in_softirq = 0;
+    restore_flags(flags);
+}
+
+/*
+ * tasklet_schedule
+ *   DESCRIPTION: Queues a tasklet to run from the tasklet softirq, unless it is queued already.
+ *                Safe to call from interrupt handlers.
+ *   INPUTS: t - tasklet to run
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Raises SOFTIRQ_TASKLET
+ */
+void tasklet_schedule(tasklet_t* t) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&tasklet_lock, flags);
+    if(!t->scheduled) {
+        t->scheduled = 1;
+        t->next = NULL;
+        if(tasklet_tail != NULL)
+            tasklet_tail->next = t;
+        else
+            tasklet_head = t;
+        tasklet_tail = t;
+        raise_softirq(SOFTIRQ_TASKLET);
+    }
+    spin_unlock_irqrestore(&tasklet_lock, flags);
+}
+
+/*
+ * irq_enter
+ *   DESCRIPTION: Starts timing a device interrupt handler, called by IRQ_LNK before the handler.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void irq_enter(void) {
+    irq_entry_tsc = rdtsc_low();
+    irq_timing = 1;
+}
+
+/*
+ * irq_exit
+ *   DESCRIPTION: Records how long the handler ran with interrupts off, then runs pending softirqs
+ *                if the interrupted code had interrupts on (it can't be in the middle of a critical
+ *                section then). A handler that switched processes isn't timed, the time includes
+ *                whatever ran in between.
+ *   INPUTS: slot - IRQ_SLOT_* of the interrupt
+ *           frame - IRET frame of the interrupt
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May run softirqs
+ */
+void irq_exit(uint32_t slot, struct iret_frame_t* frame) {
+    uint32_t cycles;
+
+    if(irq_timing && slot < NUM_IRQ_SLOTS) {
+        cycles = rdtsc_low() - irq_entry_tsc;
+        if(cycles > irq_off_cycles[slot])
+            irq_off_cycles[slot] = cycles;
+        irq_counts[slot]++;
+    }
+    irq_timing = 0;
+
+    if(softirq_pending && (frame->eflags & EFLAGS_IF))
+        do_softirq();
+}
+
+/*
+ * irq_timing_cancel
+ *   DESCRIPTION: Stops timing the running interrupt handler, called when it switches processes.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void irq_timing_cancel(void) {
+    irq_timing = 0;
+}
+
+/*
+ * irq_off_max
+ *   DESCRIPTION: Longest time a handler in a slot ran with interrupts off.
+ *   INPUTS: slot - IRQ_SLOT_* to look at
+ *   OUTPUTS: none
+ *   RETURN VALUE: TSC cycles, 0 for a bad slot
+ *   SIDE EFFECTS: none
+ */
+uint32_t irq_off_max(uint32_t slot) {
+    return (slot < NUM_IRQ_SLOTS) ? irq_off_cycles[slot] : 0;
+}
+
+/*
+ * irq_count
+ *   DESCRIPTION: Number of timed interrupts in a slot.
+ *   INPUTS: slot - IRQ_SLOT_* to look at
+ *   OUTPUTS: none
+ *   RETURN VALUE: interrupt count, 0 for a bad slot
+ *   SIDE EFFECTS: none
+ */
+uint32_t irq_count(uint32_t slot) {
+    return (slot < NUM_IRQ_SLOTS) ? irq_counts[slot] : 0;
+}
+
+/*
+ * irq_stats_print
+ *   DESCRIPTION: Prints the interrupt count and worst interrupt-off time of every slot that saw
+ *                an interrupt, and the longest softirq pass.
+ *   INPUTS: none
+ *   OUTPUTS: one line per slot
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void irq_stats_print(void) {
+    uint32_t slot;
+
+    for(slot = 0; slot < NUM_IRQ_SLOTS; slot++) {
+        if(irq_counts[slot] != 0)
+            printf("IRQ %u: %u interrupts, off at most %u cycles\n", slot, irq_counts[slot], irq_off_cycles[slot]);
+    }
+    printf("softirqs: longest pass %u cycles\n", softirq_max_cycles);
+}
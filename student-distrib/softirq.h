@@ -0,0 +1,66 @@
+/* softirq.h - Deferred interrupt work: softirqs and tasklets */
+
+#ifndef _SOFTIRQ_H
+#define _SOFTIRQ_H
+
+/* Slots irq_exit keeps interrupt-off times for, passed by IRQ_LNK in interrupts_link.S */
+#define IRQ_SLOT_PIT        0
+#define IRQ_SLOT_KEYBOARD   1
+#define IRQ_SLOT_RTC        8
+#define NUM_IRQ_SLOTS       16
+
+/* Softirq numbers, lower numbers run first */
+#define SOFTIRQ_KEYBOARD    0
+#define SOFTIRQ_TASKLET     1
+#define NUM_SOFTIRQS        2
+
+#define SOFTIRQ_MAX_RESTART 10          // Passes do_softirq makes before leaving the rest for later
+
+#ifndef ASM
+
+#include "types.h"
+#include "idt.h"
+
+/* Work an interrupt handler hands to the tasklet softirq. Runs once per tasklet_schedule
+ * (scheduling it again before it runs does nothing), with interrupts enabled. */
+typedef struct tasklet {
+    struct tasklet* next;
+    void (*func)(uint32_t data);
+    uint32_t data;
+    volatile uint32_t scheduled;        // 1 while on the pending list
+} tasklet_t;
+
+#define TASKLET_INIT(tasklet_func, tasklet_data)    { NULL, tasklet_func, tasklet_data, 0 }
+
+/* Register the tasklet softirq */
+void softirq_init(void);
+
+/* Set the handler of a softirq */
+void open_softirq(uint32_t nr, void (*handler)(void));
+
+/* Mark a softirq pending, it runs before the next return from an interrupt or system call */
+void raise_softirq(uint32_t nr);
+
+/* Run pending softirqs with interrupts enabled */
+void do_softirq(void);
+
+/* Queue a tasklet on the tasklet softirq */
+void tasklet_schedule(tasklet_t* t);
+
+/* Called by IRQ_LNK around every device interrupt handler */
+void irq_enter(void);
+void irq_exit(uint32_t slot, struct iret_frame_t* frame);
+
+/* Stop timing the running handler, it is switching processes */
+void irq_timing_cancel(void);
+
+/* Longest time (TSC cycles) a handler ran with interrupts off, and the number of interrupts */
+uint32_t irq_off_max(uint32_t slot);
+uint32_t irq_count(uint32_t slot);
+
+/* Print interrupt counts and worst-case interrupt-off and softirq times */
+void irq_stats_print(void);
+
+#endif /* ASM */
+
+#endif /* _SOFTIRQ_H */
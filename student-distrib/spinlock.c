@@ -0,0 +1,310 @@
+/* spinlock.c - Spinlocks and reader-writer locks
+ *
+ * Only the boot processor runs processes, so on their own these locks only matter once other
+ * processors touch shared state. Together with the irqsave variants they replace bare cli/sti
+ * pairs: a critical section says which data it protects, can't return with interrupts left off
+ * by accident, and with LOCK_STATS defined shows how long and how often it is held.
+ */
+
+#include "spinlock.h"
+
+#ifdef LOCK_STATS
+static lock_stats_t* stat_locks[MAX_STAT_LOCKS];      // Every lock taken so far, for lock_stats_print
+static const char* stat_names[MAX_STAT_LOCKS];
+static uint32_t num_stat_locks = 0;
+#endif
+
+/*
+ * atomic_xchg
+ *   DESCRIPTION: Stores a value and returns the old one in a single locked instruction.
+ *   INPUTS: addr - word to swap
+ *           val - value to store
+ *   OUTPUTS: none
+ *   RETURN VALUE: the previous value of *addr
+ *   SIDE EFFECTS: none
+ */
+static inline uint32_t atomic_xchg(volatile uint32_t* addr, uint32_t val) {
+    asm volatile("xchgl %0, %1"
+            : "+r"(val), "+m"(*addr)
+            :
+            : "memory");
+    return val;
+}
+
+/*
+ * atomic_cmpxchg
+ *   DESCRIPTION: Stores new_val if *addr still holds old_val, in a single locked instruction.
+ *   INPUTS: addr - word to update
+ *           old_val - value *addr has to hold
+ *           new_val - value to store
+ *   OUTPUTS: none
+ *   RETURN VALUE: the value *addr held, old_val if the store happened
+ *   SIDE EFFECTS: none
+ */
+static inline int32_t atomic_cmpxchg(volatile int32_t* addr, int32_t old_val, int32_t new_val) {
+    int32_t prev;
+
+    asm volatile("lock; cmpxchgl %2, %1"
+            : "=a"(prev), "+m"(*addr)
+            : "r"(new_val), "0"(old_val)
+            : "memory", "cc");
+    return prev;
+}
+
+/* Tell the processor we are in a spin loop */
+static inline void cpu_relax(void) {
+    asm volatile("pause" : : : "memory");
+}
+
+#ifdef LOCK_STATS
+/*
+ * stats_acquired
+ *   DESCRIPTION: Accounts for a lock being taken and starts timing the hold.
+ *   INPUTS: stats - the lock's statistics
+ *           name - the lock's name
+ *           spins - loop iterations spent waiting, 0 if the lock was free
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Registers the lock for lock_stats_print the first time
+ */
+static void stats_acquired(lock_stats_t* stats, const char* name, uint32_t spins) {
+    if(!stats->registered && num_stat_locks < MAX_STAT_LOCKS) {
+        stats->registered = 1;
+        stat_names[num_stat_locks] = name;
+        stat_locks[num_stat_locks++] = stats;
+    }
+
+    stats->acquired++;
+    if(spins != 0) {
+        stats->contended++;
+        stats->spins += spins;
+    }
+    stats->hold_start = rdtsc_low();
+}
+
+/*
+ * stats_released
+ *   DESCRIPTION: Ends the hold started in stats_acquired.
+ *   INPUTS: stats - the lock's statistics
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void stats_released(lock_stats_t* stats) {
+    uint32_t held = rdtsc_low() - stats->hold_start;
+
+    if(held > stats->hold_max)
+        stats->hold_max = held;
+    stats->hold_total += held;
+}
+#endif
+
+/*
+ * spin_lock_init
+ *   DESCRIPTION: Initializes a spinlock to unlocked.
+ *   INPUTS: lock - lock to initialize
+ *           name - name lock_stats_print shows
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void spin_lock_init(spinlock_t* lock, const char* name) {
+    lock->locked = 0;
+    lock->name = name;
+#ifdef LOCK_STATS
+    memset(&lock->stats, 0, sizeof(lock->stats));
+#endif
+}
+
+/*
+ * spin_lock
+ *   DESCRIPTION: Takes a spinlock, spinning until whoever holds it lets go. Waits on a plain read so
+ *                the cache line isn't bounced around by locked writes while the lock is held.
+ *   INPUTS: lock - lock to take
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void spin_lock(spinlock_t* lock) {
+    uint32_t spins = 0;
+
+    while(atomic_xchg(&lock->locked, 1) != 0) {
+        while(lock->locked) {
+            cpu_relax();
+            spins++;
+        }
+    }
+
+#ifdef LOCK_STATS
+    stats_acquired(&lock->stats, lock->name, spins);
+#endif
+}
+
+/*
+ * spin_trylock
+ *   DESCRIPTION: Takes a spinlock if nobody holds it.
+ *   INPUTS: lock - lock to take
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the lock was taken, 0 if it is held
+ *   SIDE EFFECTS: none
+ */
+int32_t spin_trylock(spinlock_t* lock) {
+    if(atomic_xchg(&lock->locked, 1) != 0)
+        return 0;
+
+#ifdef LOCK_STATS
+    stats_acquired(&lock->stats, lock->name, 0);
+#endif
+    return 1;
+}
+
+/*
+ * spin_unlock
+ *   DESCRIPTION: Releases a spinlock.
+ *   INPUTS: lock - lock to release
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void spin_unlock(spinlock_t* lock) {
+#ifdef LOCK_STATS
+    stats_released(&lock->stats);
+#endif
+    // x86 doesn't reorder stores with older loads or stores, a compiler barrier is enough
+    asm volatile("" : : : "memory");
+    lock->locked = 0;
+}
+
+/*
+ * spin_is_locked
+ *   DESCRIPTION: Tells whether somebody holds a spinlock.
+ *   INPUTS: lock - lock to check
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if held, 0 if not
+ *   SIDE EFFECTS: none
+ */
+int32_t spin_is_locked(spinlock_t* lock) {
+    return lock->locked != 0;
+}
+
+/*
+ * rwlock_init
+ *   DESCRIPTION: Initializes a reader-writer lock to unlocked.
+ *   INPUTS: lock - lock to initialize
+ *           name - name lock_stats_print shows
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void rwlock_init(rwlock_t* lock, const char* name) {
+    lock->count = 0;
+    lock->name = name;
+#ifdef LOCK_STATS
+    memset(&lock->stats, 0, sizeof(lock->stats));
+#endif
+}
+
+/*
+ * read_lock
+ *   DESCRIPTION: Takes a reader-writer lock for reading, spinning while a writer holds it.
+ *   INPUTS: lock - lock to take
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void read_lock(rwlock_t* lock) {
+    uint32_t spins = 0;
+    int32_t count;
+
+    while(1) {
+        count = lock->count;
+        if(count != RW_WRITER && atomic_cmpxchg(&lock->count, count, count + 1) == count)
+            break;
+        cpu_relax();
+        spins++;
+    }
+
+#ifdef LOCK_STATS
+    // Readers overlap, only count them; hold times are kept for writers
+    lock->stats.acquired++;
+    if(spins != 0) {
+        lock->stats.contended++;
+        lock->stats.spins += spins;
+    }
+#endif
+}
+
+/*
+ * read_unlock
+ *   DESCRIPTION: Drops a read hold on a reader-writer lock.
+ *   INPUTS: lock - lock to release
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void read_unlock(rwlock_t* lock) {
+    asm volatile("lock; decl %0" : "+m"(lock->count) : : "memory", "cc");
+}
+
+/*
+ * write_lock
+ *   DESCRIPTION: Takes a reader-writer lock for writing, spinning until no reader or writer holds it.
+ *   INPUTS: lock - lock to take
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void write_lock(rwlock_t* lock) {
+    uint32_t spins = 0;
+
+    while(atomic_cmpxchg(&lock->count, 0, RW_WRITER) != 0) {
+        while(lock->count != 0) {
+            cpu_relax();
+            spins++;
+        }
+    }
+
+#ifdef LOCK_STATS
+    stats_acquired(&lock->stats, lock->name, spins);
+#endif
+}
+
+/*
+ * write_unlock
+ *   DESCRIPTION: Releases a reader-writer lock held for writing.
+ *   INPUTS: lock - lock to release
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void write_unlock(rwlock_t* lock) {
+#ifdef LOCK_STATS
+    stats_released(&lock->stats);
+#endif
+    asm volatile("" : : : "memory");
+    lock->count = 0;
+}
+
+/*
+ * lock_stats_print
+ *   DESCRIPTION: Prints acquisitions, contention and hold times (TSC cycles) of every lock taken so far.
+ *   INPUTS: none
+ *   OUTPUTS: one line per lock
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void lock_stats_print(void) {
+#ifdef LOCK_STATS
+    lock_stats_t* stats;
+    uint32_t i;
+
+    for(i = 0; i < num_stat_locks; i++) {
+        stats = stat_locks[i];
+        printf("%s: %u taken, %u contended (%u spins), hold max %u avg %u\n",
+               stat_names[i], stats->acquired, stats->contended, stats->spins,
+               stats->hold_max, stats->acquired ? stats->hold_total / stats->acquired : 0);
+    }
+#else
+    printf("lock statistics are off, define LOCK_STATS in spinlock.h\n");
+#endif
+}
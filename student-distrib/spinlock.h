@@ -0,0 +1,102 @@
+/* spinlock.h - Spinlocks and reader-writer locks */
+
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+#include "types.h"
+#include "lib.h"
+
+/* Uncomment to count acquisitions, contention and hold times for every lock (lock_stats_print) */
+/* #define LOCK_STATS */
+
+#define MAX_STAT_LOCKS      32          // Locks lock_stats_print keeps track of
+#define RW_WRITER           (-1)        // rwlock count while a writer holds it
+
+/* Statistics kept for a lock when LOCK_STATS is defined */
+typedef struct lock_stats {
+    uint32_t acquired;                  // Times the lock was taken
+    uint32_t contended;                 // Times it was already held when somebody wanted it
+    uint32_t spins;                     // Loop iterations spent waiting for it
+    uint32_t hold_start;                // TSC when the current (write) holder took it
+    uint32_t hold_max;                  // Longest hold in TSC cycles
+    uint32_t hold_total;                // Sum of all holds in TSC cycles (wraps)
+    uint32_t registered;                // 1 once lock_stats_print knows about the lock
+} lock_stats_t;
+
+typedef struct spinlock {
+    volatile uint32_t locked;           // 1 while somebody holds the lock
+    const char* name;
+#ifdef LOCK_STATS
+    lock_stats_t stats;
+#endif
+} spinlock_t;
+
+typedef struct rwlock {
+    volatile int32_t count;             // Readers holding the lock, RW_WRITER while a writer does
+    const char* name;
+#ifdef LOCK_STATS
+    lock_stats_t stats;
+#endif
+} rwlock_t;
+
+/* Initializers for locks defined at file scope */
+#define SPINLOCK_INIT(lock_name)    { 0, lock_name }
+#define RWLOCK_INIT(lock_name)      { 0, lock_name }
+
+/* Spinlocks. Any lock an interrupt handler takes has to be taken with the irqsave
+ * variants everywhere else, or the handler spins forever on a lock its own processor holds. */
+void spin_lock_init(spinlock_t* lock, const char* name);
+void spin_lock(spinlock_t* lock);
+int32_t spin_trylock(spinlock_t* lock);
+void spin_unlock(spinlock_t* lock);
+int32_t spin_is_locked(spinlock_t* lock);
+
+/* Reader-writer locks, any number of readers or a single writer */
+void rwlock_init(rwlock_t* lock, const char* name);
+void read_lock(rwlock_t* lock);
+void read_unlock(rwlock_t* lock);
+void write_lock(rwlock_t* lock);
+void write_unlock(rwlock_t* lock);
+
+/* Print the statistics of every lock taken so far (nothing unless LOCK_STATS is defined) */
+void lock_stats_print(void);
+
+/* Disable interrupts, saving EFLAGS into "flags", then take the lock */
+#define spin_lock_irqsave(lock, flags)          \
+do {                                            \
+    cli_and_save(flags);                        \
+    spin_lock(lock);                            \
+} while (0)
+
+/* Release the lock, then put EFLAGS back the way spin_lock_irqsave found it */
+#define spin_unlock_irqrestore(lock, flags)     \
+do {                                            \
+    spin_unlock(lock);                          \
+    restore_flags(flags);                       \
+} while (0)
+
+#define read_lock_irqsave(lock, flags)          \
+do {                                            \
+    cli_and_save(flags);                        \
+    read_lock(lock);                            \
+} while (0)
+
+#define read_unlock_irqrestore(lock, flags)     \
+do {                                            \
+    read_unlock(lock);                          \
+    restore_flags(flags);                       \
+} while (0)
+
+#define write_lock_irqsave(lock, flags)         \
+do {                                            \
+    cli_and_save(flags);                        \
+    write_lock(lock);                           \
+} while (0)
+
+#define write_unlock_irqrestore(lock, flags)    \
+do {                                            \
+    write_unlock(lock);                         \
+    restore_flags(flags);                       \
+} while (0)
+
+#endif /* _SPINLOCK_H */
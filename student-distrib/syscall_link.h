@@ -1,8 +1,13 @@
 #ifndef SYSCALL_LINK_H
 #define SYSCALL_LINK_H
 
+/* Highest system call number in syscall_jmp_table */
+#define NUM_SYSCALLS    19
+
 #ifndef ASM
     extern void system_call();
+    /* Where a child made by fork first returns to user mode */
+    extern void fork_return();
 #endif
 
 #endif
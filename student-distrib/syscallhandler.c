@@ -3,88 +3,414 @@
 #include "x86_desc.h"
 #include "paging.h"
 #include "pit.h"
+#include "pipe.h"
+#include "interrupts_link.h"
+#include "uaccess.h"
+#include "fdtable.h"
+#include "syscall_link.h"
+#include "signal.h"
+#include "elf.h"
+#include "fpu.h"
+#include "spinlock.h"
+#include "workqueue.h"
+#include "console.h"
 
 
 file_op_jmp_tbl_t file_jmp_tbl = {&read_file, &write_file, &open_file, &close_file};
 
 file_op_jmp_tbl_t dir_jmp_tbl = {&read_directory, &write_dir, &open_dir, &close_dir};
 
-file_op_jmp_tbl_t rtc_jmp_tbl = {&rtc_read, &rtc_write, &rtc_open, &rtc_close};
+file_op_jmp_tbl_t rtc_jmp_tbl = {&rtc_read, &rtc_write, &rtc_open, &rtc_close, NULL, &rtc_poll};
 
-file_op_jmp_tbl_t term_jmp_tbl = {&terminal_read, &terminal_write, &terminal_open, &terminal_close};
+file_op_jmp_tbl_t term_jmp_tbl = {&terminal_read, &terminal_write, &terminal_open, &terminal_close, &terminal_ioctl, &terminal_poll};
+
+/* Stdin/stdout descriptors installed in fd 0 and 1 of every process */
+static int32_t stdio_bad_read(int32_t inode, int32_t offset, int32_t nbytes, void* buf) { return -1; }
+static int32_t stdio_bad_write(int32_t fd, const void* buf, int32_t nbytes) { return -1; }
+static int32_t stdio_close(int32_t fd) { return 0; }
+
+file_op_jmp_tbl_t stdin_jmp_tbl = {&terminal_read, &stdio_bad_write, &terminal_open, &stdio_close, &terminal_ioctl, &terminal_poll};
+
+file_op_jmp_tbl_t stdout_jmp_tbl = {&stdio_bad_read, &terminal_write, &terminal_open, &stdio_close, &terminal_ioctl, &terminal_poll};
 
 uint32_t curr_pid;
 pcb_t* par_pcb;
 
+/* Print every system call as it returns (the trace parameter) */
+uint32_t syscall_trace_on = 0;
+
+/* Protects which PCBs are in use (their PIDs) and the parent/child links waitpid walks */
+static spinlock_t pcb_lock = SPINLOCK_INIT("pcb");
+
+static void reap_dead(uint32_t data);
+
+/* Frees processes that halted without a parent, run by the worker thread */
+static work_t reap_work = WORK_INIT(reap_dead, 0);
+
+/*
+ * parse_command
+ *   DESCRIPTION: Splits a command into the program name and the argument string that follows it.
+ *   INPUTS: command - command string (does not need to be NUL terminated)
+ *           length - number of characters of command to look at
+ *   OUTPUTS: file_cmd - program name, NUL terminated (empty if it is too long to be a file name)
+ *            arg_len - length of the argument string, without leading or trailing spaces
+ *   RETURN VALUE: pointer to the start of the arguments inside command
+ *   SIDE EFFECTS: none
+ */
+static const uint8_t* parse_command(const uint8_t* command, uint32_t length, uint8_t* file_cmd, uint32_t* arg_len) {
+    uint32_t i = 0;
+    uint32_t cmd_len = 0;
+    uint32_t args_start;
+
+    memset(file_cmd, '\0', FILENAME_LEN + 1);
+
+    // Skip extra spacing before the command
+    while(i < length && command[i] == ' ')
+        i++;
+
+    // Program name runs up to the next space
+    while(i < length && command[i] != ' ') {
+        if(cmd_len < FILENAME_LEN)
+            file_cmd[cmd_len] = command[i];
+        cmd_len++;
+        i++;
+    }
+
+    // No file has a longer name, don't let a prefix match one
+    if(cmd_len > FILENAME_LEN)
+        file_cmd[0] = '\0';
+
+    // Arguments are everything after the spaces that follow the command
+    while(i < length && command[i] == ' ')
+        i++;
+    args_start = i;
+
+    // Drop trailing spaces (left in front of a '|')
+    while(length > args_start && command[length - 1] == ' ')
+        length--;
+
+    *arg_len = length - args_start;
+    return command + args_start;
+}
+
+/*
+ * set_args
+ *   DESCRIPTION: Stores a process' argument string for getargs and the argv block.
+ *   INPUTS: pcb - process the arguments belong to
+ *           args - argument string (does not need to be NUL terminated)
+ *           arg_len - length of args
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Overwrites pcb->cmd_args
+ */
+static void set_args(pcb_t* pcb, const uint8_t* args, uint32_t arg_len) {
+    if(arg_len > MAX_ARG_BYTES - 1)
+        arg_len = MAX_ARG_BYTES - 1;
+    memcpy(pcb->cmd_args, args, arg_len);
+    pcb->cmd_args[arg_len] = '\0';
+}
+
+/*
+ * setup_user_stack
+ *   DESCRIPTION: Writes argc, argv and envp to the top of the user stack, so that _start's call to
+ *                main passes main(argc, argv, envp). The strings sit at the very top of the user page
+ *                with the pointer vectors below them; everything is written in a single pass after
+ *                one counting pass over the arguments. The user page of the process must be mapped.
+ *   INPUTS: file_cmd - program name, becomes argv[0]
+ *           args - argument string, split on spaces into argv[1..argc-1]
+ *   OUTPUTS: none
+ *   RETURN VALUE: initial user stack pointer (pointing at argc)
+ *   SIDE EFFECTS: Overwrites the top of the user page
+ */
+static uint32_t setup_user_stack(const uint8_t* file_cmd, const uint8_t* args) {
+    uint32_t argc = 1;
+    uint32_t str_bytes;
+    uint32_t in_word = 0;
+    uint32_t i;
+    uint32_t* frame;
+    uint32_t* argv;
+    uint8_t* str;
+
+    // Size the block: program name plus every space separated argument, each NUL terminated
+    str_bytes = strlen((const int8_t*)file_cmd) + 1;
+    for(i = 0; args[i] != '\0'; i++) {
+        if(args[i] != ' ') {
+            if(!in_word)
+                argc++;
+            in_word = 1;
+            str_bytes++;
+        } else if(in_word) {
+            in_word = 0;
+            str_bytes++;
+        }
+    }
+    if(in_word)
+        str_bytes++;
+
+    // Strings on top, then argv[argc + 1] and an empty envp[1], then main's three arguments
+    str = (uint8_t*)(USER_MEM_END - str_bytes);
+    argv = (uint32_t*)(((uint32_t)str & ~0x3) - (argc + 2) * sizeof(uint32_t));
+    frame = argv - 3;
+    frame[0] = argc;
+    frame[1] = (uint32_t)argv;
+    frame[2] = (uint32_t)(argv + argc + 1);
+
+    // Copy the strings and fill argv as we go
+    *argv++ = (uint32_t)str;
+    for(i = 0; file_cmd[i] != '\0'; i++)
+        *str++ = file_cmd[i];
+    *str++ = '\0';
+
+    in_word = 0;
+    for(i = 0; args[i] != '\0'; i++) {
+        if(args[i] != ' ') {
+            if(!in_word)
+                *argv++ = (uint32_t)str;
+            in_word = 1;
+            *str++ = args[i];
+        } else if(in_word) {
+            in_word = 0;
+            *str++ = '\0';
+        }
+    }
+    if(in_word)
+        *str++ = '\0';
+
+    *argv++ = 0;    // argv[argc]
+    *argv = 0;      // envp[0], there is no environment to inherit yet
+
+    return (uint32_t)frame;
+}
+
+/*
+ * load_program
+ *   DESCRIPTION: Maps the segments of an executable into the process' page table and records its entry point.
+ *   INPUTS: pcb - process the program is loaded for
+ *           file_cmd - name of the executable
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: Fills pcb->page_table, sets pcb->EIP
+ */
+static int32_t load_program(pcb_t* pcb, const uint8_t* file_cmd) {
+    dentry_t dentry_3;
+
+    if(read_dentry_by_name(file_cmd, &dentry_3)!=0){
+        return -1;
+    } 
+
+    return elf_load(dentry_3.inode_num, pcb->page_table, &pcb->EIP);
+}
+
+/*
+ * set_stdio
+ *   DESCRIPTION: Installs fd 0 and fd 1 of a process, defaulting to the terminal.
+ *   INPUTS: pcb - process to set up
+ *           in - descriptor to use as stdin, or NULL for the terminal
+ *           out - descriptor to use as stdout, or NULL for the terminal
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Overwrites fd 0 and fd 1
+ */
+static void set_stdio(pcb_t* pcb, file_descriptor_t* in, file_descriptor_t* out) {
+    file_descriptor_t term_in = {&stdin_jmp_tbl, 0, 0, 1};
+    file_descriptor_t term_out = {&stdout_jmp_tbl, 0, 0, 1};
+
+    fd_install(pcb->files, 0, (in != NULL) ? in : &term_in);
+    fd_install(pcb->files, 1, (out != NULL) ? out : &term_out);
+}
+
+/*
+ * close_fd
+ *   DESCRIPTION: Closes any open descriptor of the current process, including stdin and stdout.
+ *   INPUTS: fd - file descriptor to close
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: Allows the file descriptor to be reused
+ */
+static int32_t close_fd(int32_t fd) {
+    pcb_t* cur_pb_ptr = get_cur_pcb();
+    file_descriptor_t* file = fd_get(cur_pb_ptr->files, fd);
+    int32_t is_closed;
+
+    // If file is already closed, then return fail (-1)
+    if(file == NULL) {
+        return -1;
+    }
+
+    // Othewise, let the driver clean up (it may still look the descriptor up), then free the slot
+    is_closed = file->file_op_jmp_tbl_ptr->close(fd);
+    fd_free(cur_pb_ptr->files, fd);
+    return is_closed;
+}
+
+/*
+ * release_files
+ *   DESCRIPTION: Closes every descriptor of the current process and frees its descriptor table.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Leaves the process with no descriptor table
+ */
+static void release_files(void) {
+    pcb_t* cur_pb_ptr = get_cur_pcb();
+    int i;
+
+    if(cur_pb_ptr->files == NULL)
+        return;
+
+    for(i = 0; i < cur_pb_ptr->files->size; i++) {
+        close_fd(i);
+    }
+
+    fd_table_free(cur_pb_ptr->files);
+    cur_pb_ptr->files = NULL;
+}
+
+/*
+ * release_children
+ *   DESCRIPTION: Detaches the spawned and forked children of a halting process. Children that already
+ *                halted are freed, the others are freed when they halt since nobody will wait for them.
+ *   INPUTS: pcb - halting process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Changes the children's parent and state
+ */
+void release_children(pcb_t* pcb) {
+    int i;
+
+    for(i = 0; i < MAX_TASKS; i++) {
+        if(pcbs[i].PID == -1 || pcbs[i].parent_pcb != pcb || !pcbs[i].async)
+            continue;
+        pcbs[i].parent_pcb = NULL;
+        pcbs[i].async = 0;
+        if(pcbs[i].state == TASK_ZOMBIE)
+            process_dead(&pcbs[i]);
+    }
+}
+
+/*
+ * process_dead
+ *   DESCRIPTION: Marks a halted process that nobody will wait for as dead and gets it freed: by the
+ *                worker thread once it runs, before that right here, or by schedule() for the
+ *                running process whose kernel stack is still in use.
+ *   INPUTS: pcb - the process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Queues reap_work or frees the PCB
+ */
+void process_dead(pcb_t* pcb) {
+    pcb->state = TASK_DEAD;
+    if(workqueue_running())
+        queue_work(&reap_work);
+    else if(pcb != curr_process)
+        deallocate_pcb(pcb);
+}
+
 /* MP3.3!!! 
  * execute
  *   DESCRIPTION: Executes a command by setting up paging and the pcbs, loading the program into memory, and switching to user mode.
+ *                A command of the form "a | b | c" starts every stage but the last as its own process with its
+ *                stdout connected to the next stage's stdin through a pipe; the last stage runs as the child.
  *   INPUTS: command - a pointer to the command string to be executed
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on success, -1 on failure
  *   SIDE EFFECTS: Modifies paging structures and kernel stack, changes process context
  */
 int execute(const uint8_t* command) {
-    // 1. Parse the command to get the filename of the program to be executed. (Not need for CP3)
-        // Declare local variables
-        cli();
-        int i, j;
-        uint8_t file_cmd[MAX_FN_LENGTH];
-        uint8_t file_args[MAX_FN_LENGTH];
-        uint8_t length = strlen((const int8_t*)command);
-        uint8_t cmd_len = 0;
-        uint8_t arg_len = 0;
-        uint8_t cmd_offset = 0;
-
-        // Initialize file_cmd and file_arg arrays
-        for(i = 0; i < MAX_FN_LENGTH; i++) {
-            file_cmd[i] = '\0';
-            file_args[i] = '\0';
-        }
+    file_descriptor_t pipe_in;
+    file_descriptor_t pipe_out;
+    uint8_t kcommand[MAX_ARG_BYTES];
+    uint32_t length;
+    uint32_t i;
+    uint32_t stage_start = 0;
+    int32_t pipe_num;
+    int32_t have_in = 0;
+    int32_t status;
+    uint32_t flags;
+    int terminal;
+
+    cli_and_save(flags);
+
+    // Work on a kernel copy of the command line, longer commands fail rather than get cut off
+    if(strncpy_from_user(kcommand, command, MAX_ARG_BYTES) == -1) {
+        restore_flags(flags);
+        return -1;
+    }
 
-        // Parse commands
-        for(i = 0; i < length; i++) {
-            // If input is not space then add to file_cmd buffer and increment length
-            if(command[i] != ' ') {
-                file_cmd[cmd_len] = command[i];
-                cmd_len++;
-            // Otherwise, increment offset for extra spacing before command and break if there is a command
-            } else {
-                cmd_offset++;
-                if(cmd_len > 0) {
-                    break;
-                }
-            }
-        }
+    length = strlen((const int8_t*)kcommand);
 
-        // Parse arguments
-        for(i = cmd_len + cmd_offset; i < length; i++) {
-            // If input is space, check whether there is an argument; if there is then break, else continue
-            if(command[i] == ' ') {
-                if(arg_len > 0)
-                    break;
-                else
-                    continue;
-            // Otherwise loop through rest of command buffer and add to file_args buffer
-            } else {
-                j = i;
-                while (j < length) {
-                    file_args[arg_len] = command[j];
-                    arg_len++;
-                    j++;
-                }
-                file_args[arg_len] = '\0';
-                break;
-            }
+    // Processes in a pipeline share the terminal of whoever started them
+    terminal = (curr_process != NULL && curr_process->PID != -1) ? curr_process->terminal_number : get_curr_term();
+
+    for(i = 0; i < length; i++) {
+        if(kcommand[i] != '|')
+            continue;
+
+        // Everything before the '|' writes into a new pipe
+        pipe_num = pipe_alloc();
+        if(pipe_num == -1)
+            break;
+        pipe_fill_fd(&pipe_out, pipe_num, 1);
+
+        // End the stage where the '|' was
+        kcommand[i] = '\0';
+
+        if(create_process(kcommand + stage_start, terminal, have_in ? &pipe_in : NULL, &pipe_out) == NULL) {
+            pipe_release(pipe_num, 0);
+            pipe_release(pipe_num, 1);
+            break;
         }
 
+        // The new process owns the write end (and the previous read end), keep the read end for the next stage
+        pipe_fill_fd(&pipe_in, pipe_num, 0);
+        have_in = 1;
+        stage_start = i + 1;
+    }
+
+    // Stopped early: drop the read end nobody will use and fail
+    if(i < length) {
+        if(have_in)
+            pipe_release(pipe_in.inode, 0);
+        restore_flags(flags);
+        return -1;
+    }
+
+    // Returns here with the child's status once it halts
+    status = exec_program(kcommand + stage_start, length - stage_start, have_in ? &pipe_in : NULL);
+    if(status == -1 && have_in)
+        pipe_release(pipe_in.inode, 0);
+
+    restore_flags(flags);
+    return status;
+}
+
+/*
+ * exec_program
+ *   DESCRIPTION: Runs one program as a child of the current process and switches to it in user mode.
+ *                Only returns (through halt_return) once the child halts.
+ *   INPUTS: command - program name and arguments
+ *           length - number of characters in command
+ *           in - descriptor to use as stdin, or NULL for the terminal
+ *   OUTPUTS: none
+ *   RETURN VALUE: -1 on failure, otherwise the child's halt status is returned from execute
+ *   SIDE EFFECTS: Modifies paging structures and kernel stack, changes process context
+ */
+int exec_program(const uint8_t* command, uint32_t length, file_descriptor_t* in) {
+    // 1. Parse the command to get the filename of the program to be executed.
+        uint8_t file_cmd[FILENAME_LEN + 1];
+        const uint8_t* file_args;
+        uint32_t arg_len;
+        uint32_t user_esp;
+
+        file_args = parse_command(command, length, file_cmd, &arg_len);
+
     // 2. Check if the file exists in the filesystem and is executable.
         if(executable_file_check((int32_t*) file_cmd) == -1){
             return -1;
         }
 
     // 3. Allocate a PCB for the new task.
-        // init_pcbs();
+        pcb_t* parent = curr_process;
         pcb_t* curr_pcb = allocate_pcb(); 
 
         if (curr_pcb == NULL) {
@@ -96,9 +422,9 @@ int execute(const uint8_t* command) {
 
         curr_pid = curr_pcb->PID;
         if(curr_pid != 0){
-            curr_pcb->parent_pcb = curr_process;
+            curr_pcb->parent_pcb = parent;
             if(curr_pcb->PID > 2) { 
-                curr_pcb->terminal_number = get_curr_term();
+                curr_pcb->terminal_number = (parent != NULL && parent->PID != -1) ? parent->terminal_number : get_curr_term();
             }
         } else {
             par_pcb = curr_pcb;
@@ -116,40 +442,42 @@ int execute(const uint8_t* command) {
                 terminal_pcb_top[2] = curr_pcb;
                 break;
             default:
-                terminal_pcb_top[get_curr_term()] = curr_pcb;
+                terminal_pcb_top[curr_pcb->terminal_number] = curr_pcb;
         }
 
 
         // Set the commad arguements for the PCB
-        for(i = 0; i < FILENAME_LEN; i++){
-            curr_pcb->cmd_args[i] = '\0';
-        }
+        set_args(curr_pcb, file_args, arg_len);
 
-        strncpy((int8_t*)curr_pcb->cmd_args, (int8_t*)file_args, arg_len);
+        // Terminal (or the pipe from the previous stage) as stdin, terminal as stdout
+        set_stdio(curr_pcb, in, NULL);
 
     // 4. Set up the kernel stack for the new task.
         setup_kernel_stack(curr_pcb);
 
     // 5. Set up paging for the new task.
-        paging_for_execute(curr_pcb->PID);
+        load_vidmap(curr_pcb);
+        paging_for_execute(curr_pcb->page_table);
 
 
     // 6. Load the program image from the filesystem into memory.
-        dentry_t dentry_3;
-        uint32_t inode_num; 
-        int read1,read2;
-        read1 = 0;
-        read2 = 0;
+        if(load_program(curr_pcb, file_cmd) == -1){
+            curr_process = parent;
+            if(parent != NULL && parent->PID != -1){
+                load_vidmap(parent);
+                paging_for_execute(parent->page_table);
+            }
+            deallocate_pcb(curr_pcb);
+            return -1;
+        }
 
-        if(read_dentry_by_name((const uint8_t*)file_cmd, &dentry_3)!=0){
-                return -1;
-            } 
-            
-        inode_num = dentry_3.inode_num;
-        read1 = read_data(inode_num,INSTR_START,(uint8_t*)&curr_pcb->EIP,INSTR_LENGTH);
-        read2 = read_data(inode_num, 0, (uint8_t*)PROG_INFO_ADDR,100000); // 0 and 100000 because we want to read the whole thing.
+        // argc, argv and envp go on top of the new user stack
+        user_esp = setup_user_stack(file_cmd, curr_pcb->cmd_args);
 
-        if(read1 == - 1 || read2 == -1) return -1;
+        // The parent waits in here until the child halts, the child is what runs now
+        if(parent != NULL && parent != curr_pcb && parent->PID != -1)
+            parent->state = TASK_SLEEPING;
+        curr_pcb->state = TASK_RUNNABLE;
 
 
     // 7. Prepare for context switch to user mode.
@@ -164,7 +492,7 @@ int execute(const uint8_t* command) {
         uint32_t ucs; 
         uint32_t eiip; 
         uds = USER_DS;
-        esp = (uint32_t)PROG_IMG_ADDR; 
+        esp = user_esp; 
         ucs = USER_CS; 
         eiip = curr_process->EIP;
 
@@ -173,8 +501,8 @@ int execute(const uint8_t* command) {
         // IRET Context : 
         // Things required on the stack 
         // USER_DS, ESP(132MB) , EFLAG, CS, EIP (!!!!!Be Careful with the order!!!!!!!!)
-
-        sti(); 
+        // Interrupts stay off until the IRET loads USER_EFLAGS: a timer tick in between would
+        // switch away from a process whose kernel stack is only half set up
 
         asm volatile(
             "movl %%esp, %0;"
@@ -190,11 +518,11 @@ int execute(const uint8_t* command) {
         asm volatile(
             "pushl %0;"
             "pushl %1;"
-            "pushfl  ;"
+            "pushl %4;"
             "pushl %2;"
             "pushl %3;"
             :
-            : "r"(uds), "r"(esp), "r"(ucs), "r"(eiip)
+            : "r"(uds), "r"(esp), "r"(ucs), "r"(eiip), "i"(USER_EFLAGS)
             : "cc", "memory"
         );
         
@@ -206,27 +534,348 @@ int execute(const uint8_t* command) {
    
 }
 
+/*
+ * create_process
+ *   DESCRIPTION: Builds a process that starts running in user mode the next time the scheduler picks it,
+ *                without switching to it. The process has no parent; when it halts it is simply freed.
+ *   INPUTS: command - program name and arguments
+ *           terminal - terminal the process belongs to
+ *           in - descriptor to use as stdin, or NULL for the terminal
+ *           out - descriptor to use as stdout, or NULL for the terminal
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new process' PCB, NULL on failure (in and out are then still owned by the caller)
+ *   SIDE EFFECTS: Allocates a PCB, loads the program into the new process' user page
+ */
+pcb_t* create_process(const uint8_t* command, int terminal, file_descriptor_t* in, file_descriptor_t* out) {
+    uint8_t file_cmd[FILENAME_LEN + 1];
+    const uint8_t* file_args;
+    uint32_t arg_len;
+    uint32_t flags;
+    uint32_t user_esp = 0;
+    uint32_t* kstack;
+    int32_t loaded;
+    pcb_t* pcb;
+
+    if(command == NULL)
+        return NULL;
+
+    file_args = parse_command(command, strlen((const int8_t*)command), file_cmd, &arg_len);
+
+    cli_and_save(flags);
+
+    if(executable_file_check((int32_t*) file_cmd) == -1 || (pcb = allocate_pcb()) == NULL){
+        restore_flags(flags);
+        return NULL;
+    }
+
+    pcb->parent_pcb = NULL;
+    pcb->terminal_number = terminal;
+    set_args(pcb, file_args, arg_len);
+    set_stdio(pcb, in, out);
+
+    // Load the image and argv block through the new process' mapping, then put the running process' mapping back
+    paging_for_execute(pcb->page_table);
+    loaded = load_program(pcb, file_cmd);
+    if(loaded != -1)
+        user_esp = setup_user_stack(file_cmd, pcb->cmd_args);
+    if(curr_process != NULL && curr_process->PID != -1)
+        paging_for_execute(curr_process->page_table);
+
+    if(loaded == -1){
+        deallocate_pcb(pcb);
+        restore_flags(flags);
+        return NULL;
+    }
+
+    // Initial kernel stack: an IRET frame into user mode, task_start as the return address
+    // of context_switch, and the four registers context_switch pops
+    kstack = (uint32_t*)(KERNEL_END_ADDR - (pcb->PID) * KERNEL_TASK_SIZE - sizeof(pcb));
+    *(--kstack) = USER_DS;
+    *(--kstack) = user_esp;
+    *(--kstack) = USER_EFLAGS;
+    *(--kstack) = USER_CS;
+    *(--kstack) = pcb->EIP;
+    *(--kstack) = (uint32_t)task_start;
+    *(--kstack) = 0;    // ebp
+    *(--kstack) = 0;    // ebx
+    *(--kstack) = 0;    // esi
+    *(--kstack) = 0;    // edi
+
+    pcb->ESP_context = (uint32_t)kstack;
+    pcb->state = TASK_RUNNABLE;
+
+    restore_flags(flags);
+    return pcb;
+}
+
+/*
+ * create_kernel_thread
+ *   DESCRIPTION: Builds a process that runs a kernel function the next time the scheduler picks it.
+ *                It never returns to user mode, has no parent and keeps an empty address space.
+ *   INPUTS: entry - function the thread runs, must never return
+ *           name - name kept in the thread's argument string
+ *   OUTPUTS: none
+ *   RETURN VALUE: the thread's PCB, NULL if no PCB is free
+ *   SIDE EFFECTS: Allocates a PCB
+ */
+pcb_t* create_kernel_thread(void (*entry)(void), const int8_t* name) {
+    uint32_t flags;
+    uint32_t* kstack;
+    pcb_t* pcb;
+
+    cli_and_save(flags);
+
+    if((pcb = allocate_pcb()) == NULL){
+        restore_flags(flags);
+        return NULL;
+    }
+
+    pcb->parent_pcb = NULL;
+    pcb->terminal_number = 0;
+    strncpy((int8_t*)pcb->cmd_args, name, MAX_ARG_BYTES - 1);
+
+    // entry as the return address of context_switch (with a zero return address of its own
+    // above it) and the four registers context_switch pops
+    kstack = (uint32_t*)(KERNEL_END_ADDR - (pcb->PID) * KERNEL_TASK_SIZE - sizeof(pcb));
+    *(--kstack) = 0;
+    *(--kstack) = (uint32_t)entry;
+    *(--kstack) = 0;    // ebp
+    *(--kstack) = 0;    // ebx
+    *(--kstack) = 0;    // esi
+    *(--kstack) = 0;    // edi
+
+    pcb->ESP_context = (uint32_t)kstack;
+    pcb->state = TASK_RUNNABLE;
+
+    restore_flags(flags);
+    return pcb;
+}
+
+
+/*
+ * fork
+ *   DESCRIPTION: Creates a copy of the current process. The child shares the parent's user pages
+ *                copy-on-write, gets copies of its open descriptors and returns 0 from the same system
+ *                call the parent returns the child's PID from. The parent keeps running and collects
+ *                the child's status with waitpid, the child runs the next time the scheduler picks it.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: child's PID in the parent, 0 in the child, -1 on failure
+ *   SIDE EFFECTS: Allocates a PCB, write protects the parent's user pages
+ */
+int32_t fork(void) {
+    pcb_t* parent = get_cur_pcb();
+    pcb_t* child;
+    file_descriptor_t* file;
+    uint32_t* parent_frame;
+    uint32_t* kstack;
+    uint32_t flags;
+    int32_t fd;
+
+    cli_and_save(flags);
+
+    if(parent->PID == -1 || (child = allocate_pcb()) == NULL){
+        restore_flags(flags);
+        return -1;
+    }
+
+    if(fd_table_copy(child->files, parent->files) == -1){
+        deallocate_pcb(child);
+        restore_flags(flags);
+        return -1;
+    }
+
+    // The copied pipe ends are open twice now
+    for(fd = 0; fd < child->files->size; fd++){
+        file = fd_get(child->files, fd);
+        if(file != NULL && file->file_op_jmp_tbl_ptr == &pipe_read_jmp_tbl)
+            pipe_get(file->inode, 0);
+        else if(file != NULL && file->file_op_jmp_tbl_ptr == &pipe_write_jmp_tbl)
+            pipe_get(file->inode, 1);
+    }
+
+    copy_user_pages(child->page_table, parent->page_table);
+
+    child->parent_pcb = parent;
+    child->async = 1;
+    child->terminal_number = parent->terminal_number;
+    child->vidmap = parent->vidmap;
+    child->fbmap = parent->fbmap;
+    child->EIP = parent->EIP;
+    memcpy(child->cmd_args, parent->cmd_args, MAX_ARG_BYTES);
+    memcpy(child->sig_handlers, parent->sig_handlers, sizeof(child->sig_handlers));
+    fpu_copy(child, parent);
+
+    // The child's kernel stack starts with a copy of the parent's trap frame (IRET frame and the
+    // registers system_call saved), fork_return as the return address of context_switch, and the
+    // four registers context_switch pops
+    parent_frame = (uint32_t*)(KERNEL_END_ADDR - (parent->PID) * KERNEL_TASK_SIZE - sizeof(parent)) - SYSCALL_FRAME_WORDS;
+    kstack = (uint32_t*)(KERNEL_END_ADDR - (child->PID) * KERNEL_TASK_SIZE - sizeof(child)) - SYSCALL_FRAME_WORDS;
+    memcpy(kstack, parent_frame, SYSCALL_FRAME_WORDS * sizeof(uint32_t));
+    *(--kstack) = (uint32_t)fork_return;
+    *(--kstack) = 0;    // ebp
+    *(--kstack) = 0;    // ebx
+    *(--kstack) = 0;    // esi
+    *(--kstack) = 0;    // edi
+
+    child->ESP_context = (uint32_t)kstack;
+    child->state = TASK_RUNNABLE;
+
+    restore_flags(flags);
+    return child->PID;
+}
+
+
+/*
+ * spawn
+ *   DESCRIPTION: Starts a program as a child of the current process without waiting for it. The child
+ *                shares the caller's terminal and its status is collected with waitpid.
+ *   INPUTS: command - program name and arguments
+ *   OUTPUTS: none
+ *   RETURN VALUE: child's PID, -1 on failure
+ *   SIDE EFFECTS: Allocates a PCB, loads the program into the child's user memory
+ */
+int32_t spawn(const uint8_t* command) {
+    pcb_t* parent = get_cur_pcb();
+    uint8_t kcommand[MAX_ARG_BYTES];
+    pcb_t* child;
+    uint32_t flags;
+
+    if(parent->PID == -1 || strncpy_from_user(kcommand, command, MAX_ARG_BYTES) == -1)
+        return -1;
+
+    cli_and_save(flags);
+    child = create_process(kcommand, parent->terminal_number, NULL, NULL);
+    if(child != NULL) {
+        child->parent_pcb = parent;
+        child->async = 1;
+    }
+    restore_flags(flags);
+
+    return (child != NULL) ? child->PID : -1;
+}
+
+/*
+ * waitpid
+ *   DESCRIPTION: Waits for a child started by spawn or fork to halt and frees it.
+ *   INPUTS: pid - child to wait for, -1 for any child
+ *           status - where to store the child's halt status, may be NULL
+ *           options - WAIT_NOHANG to return right away if no child has halted yet
+ *   OUTPUTS: status - the child's halt status
+ *   RETURN VALUE: PID of the child that halted, 0 if WAIT_NOHANG is given and none has,
+ *                 -1 if there is no such child or status is not user memory
+ *   SIDE EFFECTS: May sleep, frees the child's PCB
+ */
+int32_t waitpid(int32_t pid, int32_t* status, int32_t options) {
+    pcb_t* cur = get_cur_pcb();
+    pcb_t* child;
+    uint32_t flags;
+    int32_t found;
+    int32_t child_pid;
+    int32_t child_status;
+    int i;
+
+    if(cur->PID == -1 || pid < -1 || pid >= MAX_TASKS)
+        return -1;
+    if(status != NULL && !user_range_writable(status, sizeof(int32_t)))
+        return -1;
+
+    spin_lock_irqsave(&pcb_lock, flags);
+    while(1) {
+        found = 0;
+        for(i = 0; i < MAX_TASKS; i++) {
+            child = &pcbs[i];
+            if(child->PID == -1 || child->parent_pcb != cur || !child->async)
+                continue;
+            if(pid != -1 && i != pid)
+                continue;
+            found = 1;
+
+            if(child->state == TASK_ZOMBIE) {
+                child_pid = child->PID;
+                child_status = child->exit_status;
+                spin_unlock(&pcb_lock);
+                deallocate_pcb(child);
+                restore_flags(flags);
+
+                if(status != NULL && copy_to_user(status, &child_status, sizeof(int32_t)) == -1)
+                    return -1;
+                return child_pid;
+            }
+        }
+
+        if(!found || (options & WAIT_NOHANG)) {
+            spin_unlock_irqrestore(&pcb_lock, flags);
+            return found ? 0 : -1;
+        }
+
+        // Halting children wake us up, signals cut the wait short
+        if(signal_pending(cur)) {
+            spin_unlock_irqrestore(&pcb_lock, flags);
+            return -1;
+        }
+        // Interrupts stay off across the unlock, so the child's wake up can't come before we sleep
+        spin_unlock(&pcb_lock);
+        sleep_on(&cur->child_wait);
+        spin_lock(&pcb_lock);
+    }
+}
 
 /* MP3.3!!! 
  * sys_halt
+ *   DESCRIPTION: Halt system call, only the low byte of the status reaches the parent.
+ *   INPUTS: status - the return status of the process
+ *   OUTPUTS: none
+ *   RETURN VALUE: see halt_process
+ *   SIDE EFFECTS: see halt_process
+ */
+int sys_halt(uint8_t status) {
+    return halt_process(status);
+}
+
+/*
+ * halt_process
  *   DESCRIPTION: Terminates a process and returns control to the parent process or starts a new shell if it's the base shell.
  *   INPUTS: status - the return status of the process
  *   OUTPUTS: none
  *   RETURN VALUE: The status of the halt operation; typically the status argument if successful
  *   SIDE EFFECTS: Modifies current process, updates PCB and paging
  */
-int sys_halt(uint8_t status) {
+int halt_process(uint32_t status) {
+    uint32_t curr_ebp, curr_esp;
+    pcb_t* child;
+
     // Get the pcb that we are currently executing.
-    cli();
-    
     if(curr_process == NULL) return -1;
-    uint32_t curr_ebp, curr_esp;
-    int i;
+
+    // Never returns to the caller, the parent's execute restores its own flags
+    cli();
+
     if(curr_process->PID > 2){
-        for(i = 0; i < MAX_FILES; i++) {
-            close(i);
+        release_files();
+        release_children(curr_process);
+        terminal_process_exit(curr_process->PID);
+
+        // Processes started by create_process have nobody to return to, free them and run something else
+        if(curr_process->parent_pcb == NULL){
+            process_dead(curr_process);
+            while(1)
+                schedule();
+        }
+
+        // The parent of a spawned or forked process is still running, leave it the status
+        if(curr_process->async){
+            curr_process->exit_status = status;
+            curr_process->state = TASK_ZOMBIE;
+            wake_up(&curr_process->parent_pcb->child_wait);
+            while(1)
+                schedule();
         }
+
+        spin_lock(&pcb_lock);
         curr_process->PID = -1;
+        curr_process->state = TASK_EMPTY;
+        spin_unlock(&pcb_lock);
 
         tss.ss0 = KERNEL_DS;
         tss.esp0 = KERNEL_END_ADDR - ((curr_process->parent_pcb->PID) * KERNEL_TASK_SIZE) - sizeof(curr_process);
@@ -235,26 +884,37 @@ int sys_halt(uint8_t status) {
         curr_ebp = curr_process->EBP;
         curr_esp = curr_process->ESP;
 
+        spin_lock(&sched_lock);
+        child = curr_process;
         curr_process = curr_process->parent_pcb;
-        terminal_pcb_top[get_curr_term()] = curr_process;
-
-        paging_for_execute(curr_process->PID);
+        curr_process->state = TASK_RUNNABLE;
+        spin_unlock(&sched_lock);
+        terminal_pcb_top[curr_process->terminal_number] = curr_process;
 
-        // Then, return the stack pointer to the parent stack.
+        load_vidmap(curr_process);
+        paging_for_execute(curr_process->page_table);
 
-        sti();
+        // Nobody maps the child's memory anymore
+        free_user_pages(child->page_table);
+        child->page_table = NULL;
+        fpu_release(child);
+        fpu_switch(curr_process);
 
-        halt_return(curr_ebp, curr_esp, (int)status);
+        // Then, return the stack pointer to the parent stack.
+        halt_return(curr_ebp, curr_esp, status);
 
     return (int)status;
 
     } else {
         // If there's no parent, create a new shell process.
-        for(i = 0; i < MAX_FILES; i++) {
-            curr_process->file_array[i].flags = 0;
-            curr_process->file_array[i].file_pos = 0;
-        }
+        release_files();
+        release_children(curr_process);
+        terminal_process_exit(curr_process->PID);
+        clear_user_pages(curr_process->page_table);
+        spin_lock(&pcb_lock);
         curr_process->PID = -1;
+        curr_process->state = TASK_EMPTY;
+        spin_unlock(&pcb_lock);
         terminals[get_round_robin_term()].running_pid = -1;
         execute((uint8_t*)"shell");
         return 0;
@@ -263,6 +923,24 @@ int sys_halt(uint8_t status) {
     return 0;  
 }
 
+/*
+ * reap_dead
+ *   DESCRIPTION: Frees every process that halted without a parent. Runs on the worker thread, so
+ *                none of them is on its stack anymore and the freeing happens with interrupts on.
+ *   INPUTS: data - unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Frees PCBs, their pages and their descriptors
+ */
+static void reap_dead(uint32_t data) {
+    int i;
+
+    for (i = 0; i < MAX_TASKS; i++) {
+        if (pcbs[i].state == TASK_DEAD && &pcbs[i] != curr_process)
+            deallocate_pcb(&pcbs[i]);
+    }
+}
+
 /* MP3.3!!! 
  * allocate_pcb
  *   DESCRIPTION: Allocates a PCB for a new process from the array of PCBs.
@@ -272,15 +950,39 @@ int sys_halt(uint8_t status) {
  *   SIDE EFFECTS: Updates the PCB array, assigns a PID
  */ 
 pcb_t* allocate_pcb() {
+    uint32_t flags;
     int i;
+
+    spin_lock_irqsave(&pcb_lock, flags);
     for (i = 0; i < MAX_TASKS; i++) {
         if (pcbs[i].PID == -1) {  // Check if the PCB is unused
+            // Every process starts with a descriptor table of its own
+            if (pcbs[i].files == NULL && (pcbs[i].files = fd_table_alloc()) == NULL)
+                break;
+            // and an empty address space, pages are added as it touches them
+            if (pcbs[i].page_table == NULL && (pcbs[i].page_table = alloc_user_pages()) == NULL)
+                break;
+            pcbs[i].async = 0;
+            pcbs[i].exit_status = 0;
+            init_wait_queue(&pcbs[i].child_wait);
+            pcbs[i].wait = NULL;
+            pcbs[i].wake_at = 0;
+            pcbs[i].rtc_seen = 0;
+            pcbs[i].vidmap = 0;
+            pcbs[i].fbmap = 0;
+            // New programs start with every signal on its default action
+            pcbs[i].sig_pending = 0;
+            pcbs[i].sig_masked = 0;
+            memset(pcbs[i].sig_handlers, 0, sizeof(pcbs[i].sig_handlers));
+            fpu_release(&pcbs[i]);
             pcbs[i].PID = i;      // Assign a new PID 
             curr_pid = i;
             terminals[get_round_robin_term()].running_pid = i;
+            spin_unlock_irqrestore(&pcb_lock, flags);
             return &pcbs[i];      // Return a pointer to the allocated PCB
         }
     }
+    spin_unlock_irqrestore(&pcb_lock, flags);
     return NULL;  
 }
 
@@ -290,37 +992,33 @@ pcb_t* allocate_pcb() {
  *   INPUTS: pcb - pointer to the PCB of the process
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Modifies the kernel stack.
+ *   SIDE EFFECTS: Makes pcb the current process.
  */
 void setup_kernel_stack(pcb_t* pcb) {
-    // Determine the starting address of the kernel stack based on the PID. 
-    uint32_t stack_start_addr = KERNEL_END_ADDR - ( (1 + pcb->PID) * KERNEL_TASK_SIZE);
-
-    // Copy the PCB data to this location
-    memcpy((void*)stack_start_addr, pcb, sizeof(pcb_t));
-
+    // The PCB stays in pcbs (get_cur_pcb finds it from the stack pointer), copying it to the
+    // bottom of the stack would only eat into the 8kB the process has now that it holds a
+    // MAX_ARG_BYTES argument string
     curr_process = pcb;
+    fpu_switch(pcb);
 }
 
 /* MP3.3!!! 
  * get_cur_pcb
- *   DESCRIPTION: Retrieves the current process's PCB based on the stack pointer.
+ *   DESCRIPTION: Retrieves the current process's PCB based on the stack pointer (the entry in pcbs, not the
+ *                copy at the bottom of the kernel stack, so changes made through it are seen by the scheduler).
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: Pointer to the current process's PCB
  *   SIDE EFFECTS: none
  */
 pcb_t* get_cur_pcb(){
-    pcb_t* cur_pcb;
+    uint32_t esp;
     asm volatile(                 
-        "movl %%esp, %%eax              ;"
-        "andl %1, %%eax                 ;"
-        "movl %%eax, %0                 ;"
-        :"=r"(cur_pcb)          // Output to store cur_pcb val
-        :"g"(0xFFFFE000)        // Bit mask for 8KB
-        :"%eax"                 // Clobbers EAX
+        "movl %%esp, %0                 ;"
+        :"=r"(esp)              // Output to store esp val
     );
-    return cur_pcb;
+    // Kernel stack of PID p spans [8MB - (p+1)*8KB, 8MB - p*8KB)
+    return &pcbs[((KERNEL_END_ADDR - 1 - esp) / KERNEL_TASK_SIZE) % MAX_TASKS];
 }
 
 /* MP3.3!!! 
@@ -336,17 +1034,32 @@ void init_pcbs() {
     for (i = 0; i < MAX_TASKS; i++) {
         pcbs[i].EBP = 0;
         pcbs[i].PID = -1;  // -1 indicates that the PCB is not in use
-        pcbs[i].page_directory = NULL;
+        pcbs[i].page_table = NULL;
         pcbs[i].parent_pcb = NULL;
         pcbs[i].EIP = 0;
-        for (j = 0; j < MAX_FILES; j++){
-            pcbs[i].file_array[j] = (file_descriptor_t){0};
-        }
-        for (j = 0; j < MAX_FN_LENGTH; j++){
+        pcbs[i].state = TASK_EMPTY;
+        pcbs[i].async = 0;
+        init_wait_queue(&pcbs[i].child_wait);
+        pcbs[i].wait = NULL;
+        pcbs[i].wake_at = 0;
+        pcbs[i].rtc_seen = 0;
+        pcbs[i].vidmap = 0;
+        pcbs[i].fbmap = 0;
+        pcbs[i].sig_pending = 0;
+        pcbs[i].sig_masked = 0;
+        memset(pcbs[i].sig_handlers, 0, sizeof(pcbs[i].sig_handlers));
+        pcbs[i].fpu_used = 0;
+        pcbs[i].files = NULL;
+        for (j = 0; j < MAX_ARG_BYTES; j++){
             pcbs[i].cmd_args[j] = '\0';
         }
     }
 
+    // Kernel code running on the boot stack (and the tests) uses PCB 0's descriptors,
+    // the first shell takes the table over
+    pcbs[0].files = fd_table_alloc();
+    set_stdio(&pcbs[0], NULL, NULL);
+
     // Set up the terminal numbers for the inital shells
     pcbs[0].terminal_number = 0;
     pcbs[1].terminal_number = 1;
@@ -362,18 +1075,26 @@ void init_pcbs() {
  *   SIDE EFFECTS: Resets the specified PCB to an unused state
  */
 void deallocate_pcb(pcb_t* pcb) {
+    uint32_t flags;
     int i;
     pcb->EBP = 0;
-    pcb->PID = -1;  // -1 indicates that the PCB is not in use
-    pcb->page_directory = NULL;
+    free_user_pages(pcb->page_table);
+    pcb->page_table = NULL;
     pcb->parent_pcb = NULL;
     pcb->EIP = 0;
-    for (i = 0; i < MAX_FILES; i++){
-        pcb->file_array[i] = (file_descriptor_t){0};
-    }
-    for (i = 0; i < MAX_FN_LENGTH; i++){
+    pcb->state = TASK_EMPTY;
+    pcb->async = 0;
+    fpu_release(pcb);
+    fd_table_free(pcb->files);
+    pcb->files = NULL;
+    for (i = 0; i < MAX_ARG_BYTES; i++){
         pcb->cmd_args[i] = '\0';
     }
+
+    // Hand the PCB back only once everything above is released
+    spin_lock_irqsave(&pcb_lock, flags);
+    pcb->PID = -1;  // -1 indicates that the PCB is not in use
+    spin_unlock_irqrestore(&pcb_lock, flags);
 }
 
 
@@ -391,18 +1112,15 @@ void deallocate_pcb(pcb_t* pcb) {
 int32_t read (int32_t fd, void* buf, int32_t nbytes) {
     // Declare local variables
     pcb_t* cur_pb_ptr;
+    file_descriptor_t* file;
     int32_t bytes_read;
 
-    // Check for valid inputs
-    if(buf == NULL) {
+    // Check for valid inputs, the whole buffer has to be writable user memory
+    if(fd < 0 || fd >= MAX_FILES) {
         return -1;
     }
 
-    if(fd < 0 || fd > MAX_FILES) {
-        return -1;
-    }
-
-    if(nbytes < 0) {
+    if(nbytes < 0 || !user_range_writable(buf, nbytes)) {
         return -1;
     }
 
@@ -410,23 +1128,28 @@ int32_t read (int32_t fd, void* buf, int32_t nbytes) {
     cur_pb_ptr = get_cur_pcb();      // Get pointer to current PCB
 
     // If file is closed, then return fail
-    if(fd > 1 && cur_pb_ptr->file_array[fd].flags == 0) {
+    file = fd_get(cur_pb_ptr->files, fd);
+    if(file == NULL) {
         return -1;
     }
 
-    sti();
-
-    // Since file is used, call read using jump table and return number of bytes read
-    switch (fd){
-        case 0:
-            return terminal_read(NULL, NULL, nbytes, buf);
-        case 1:
+    // A non-blocking read fails rather than sleep. Interrupts stay off from the check through
+    // the read, so nothing can take the data in between.
+    if(file->flags & O_NONBLOCK) {
+        if(file->file_op_jmp_tbl_ptr->poll != NULL &&
+           !(file->file_op_jmp_tbl_ptr->poll(file->inode, NULL) & (POLLIN | POLLHUP)))
             return -1;
-        default:
-            bytes_read = cur_pb_ptr->file_array[fd].file_op_jmp_tbl_ptr->read(cur_pb_ptr->file_array[fd].inode, cur_pb_ptr->file_array[fd].file_pos, nbytes, buf);
-            cur_pb_ptr->file_array[fd].file_pos += bytes_read;
+    } else {
+        sti();
     }
 
+    // Since file is used, call read using jump table and return number of bytes read
+    // (stdin is a terminal or pipe descriptor like any other)
+    bytes_read = file->file_op_jmp_tbl_ptr->read(file->inode, file->file_pos, nbytes, buf);
+
+    if(bytes_read > 0)
+        file->file_pos += bytes_read;
+
     return bytes_read;
 }
 
@@ -438,22 +1161,20 @@ int32_t read (int32_t fd, void* buf, int32_t nbytes) {
  *           nbytes - number of bytes to write
  *   OUTPUTS: none
  *   RETURN VALUE: number of bytes written on success, -1 on failure
- *   SIDE EFFECTS: None.
+ *   SIDE EFFECTS: Advances the file position in the file descriptor.
  */
 int32_t write (int32_t fd, void* buf, int32_t nbytes) {
     // Declare local variables
     pcb_t* cur_pb_ptr;
+    file_descriptor_t* file;
+    int32_t bytes_written;
 
-    // Check for valid inputs
-    if(buf == NULL) {
+    // Check for valid inputs, the whole buffer has to be user memory
+    if(fd < 0 || fd >= MAX_FILES) {
         return -1;
     }
 
-    if(fd < 0 || fd > MAX_FILES) {
-        return -1;
-    }
-
-    if(nbytes < 0) {
+    if(nbytes < 0 || !user_range_ok(buf, nbytes)) {
         return -1;
     }
 
@@ -461,19 +1182,19 @@ int32_t write (int32_t fd, void* buf, int32_t nbytes) {
     cur_pb_ptr = get_cur_pcb();      // Get pointer to current PCB
 
     // If file is closed, then return fail
-    if(fd > 1  && cur_pb_ptr->file_array[fd].flags == 0) {
+    file = fd_get(cur_pb_ptr->files, fd);
+    if(file == NULL) {
         return -1;
     }
 
-    // Since file is used, call read using jump table and return number of bytes read
-    switch (fd){
-        case 0:
-            return -1;
-        case 1:
-            return terminal_write(fd, buf, nbytes);
-        default:
-            return cur_pb_ptr->file_array[fd].file_op_jmp_tbl_ptr->write(fd, buf, nbytes);
-    }
+    // Since file is used, call write using jump table and return number of bytes written
+    // (stdout is a terminal or pipe descriptor like any other)
+    bytes_written = file->file_op_jmp_tbl_ptr->write(fd, buf, nbytes);
+
+    if(bytes_written > 0)
+        file->file_pos += bytes_written;
+
+    return bytes_written;
 }
 
 /* MP3.3!!! 
@@ -485,27 +1206,12 @@ int32_t write (int32_t fd, void* buf, int32_t nbytes) {
  *   SIDE EFFECTS: Allows the file desccriptor to be used in new task.
  */
 int32_t close (int32_t fd) {
-    // Declare local variables
-    pcb_t* cur_pb_ptr;
-    int32_t is_closed;
-
-    // Check for valid input
-    if(fd < 0 || fd > MAX_FILES) {
+    // Check for valid input, stdin and stdout stay open until the process halts
+    if(fd < 2 || fd >= MAX_FILES) {
         return -1;
     }
 
-    // Get the PCB
-    cur_pb_ptr = get_cur_pcb();
-
-    // If file is already closed, then return fail (-1)
-    if(cur_pb_ptr->file_array[fd].flags == 0) {
-        return -1;
-    }
-
-    // Othewise, reset file's members and return result of close (0 if pass, -1 if fail)
-    cur_pb_ptr->file_array[fd].flags = 0;
-    is_closed = cur_pb_ptr->file_array[fd].file_op_jmp_tbl_ptr->close(fd);
-    return is_closed;
+    return close_fd(fd);
 }
 
 /* MP3.3!!! 
@@ -519,59 +1225,281 @@ int32_t close (int32_t fd) {
 int32_t open (const uint8_t* filename){
     // Declare local variables
     pcb_t* cur_pb_ptr;
-    int i;
-    int32_t fd = -1;
+    file_descriptor_t file;
+    int32_t fd;
+    uint8_t name[FILENAME_LEN + 1];
 
-    // Check inputs
-    if(filename == NULL || *filename == '\0')
+    // Check inputs, names longer than FILENAME_LEN can't exist
+    if(strncpy_from_user(name, filename, FILENAME_LEN + 1) <= 0)
         return -1;
+    filename = name;
 
     dentry_t check_pos_dentry;
     if(read_dentry_by_name(filename, &check_pos_dentry))
         return -1;
     
-    // Get the PCB
-    cur_pb_ptr = get_cur_pcb();
-
-    // Get the first avaialble file desc
-    for(i = 2; i < MAX_FILES; i++){
-        if(cur_pb_ptr->file_array[i].flags == 0){
-            fd = i;
-            break;
-        }
-    }
-
-    // If no empty file desc
-    if(fd == -1)
-        return -1;
-
-    // Initalize PCB vals
-    cur_pb_ptr->file_array[fd].flags = 1;
-    cur_pb_ptr->file_array[fd].file_pos = 0;
-    cur_pb_ptr->file_array[fd].inode = check_pos_dentry.inode_num;
+    // Initalize descriptor vals
+    file.flags = FD_IN_USE;
+    file.file_pos = 0;
+    file.inode = check_pos_dentry.inode_num;
 
     // Set the correct jump table depending on the filetype
     switch(check_pos_dentry.filetype){
         case 0:
-            cur_pb_ptr->file_array[fd].file_op_jmp_tbl_ptr = &rtc_jmp_tbl;
+            file.file_op_jmp_tbl_ptr = &rtc_jmp_tbl;
             break;
         case 1: 
-            cur_pb_ptr->file_array[fd].file_op_jmp_tbl_ptr = &dir_jmp_tbl;
+            file.file_op_jmp_tbl_ptr = &dir_jmp_tbl;
             break;
         case 2:
-            cur_pb_ptr->file_array[fd].file_op_jmp_tbl_ptr = &file_jmp_tbl;
+            file.file_op_jmp_tbl_ptr = &file_jmp_tbl;
             break;
         default:
             return -1;
     }
 
+    // Get the PCB
+    cur_pb_ptr = get_cur_pcb();
+
+    // Get the lowest avaialble file desc (0 and 1 are stdin/stdout)
+    fd = fd_alloc(cur_pb_ptr->files, 2);
+    if(fd == -1)
+        return -1;
+    fd_install(cur_pb_ptr->files, fd, &file);
+
     // Call open
-    if(cur_pb_ptr->file_array[fd].file_op_jmp_tbl_ptr->open(filename))
+    if(file.file_op_jmp_tbl_ptr->open(filename)) {
+        fd_free(cur_pb_ptr->files, fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * create
+ *   DESCRIPTION: Create system call, creates an empty regular file in the RAM filesystem layer (or truncates
+ *                an existing one) and opens it.
+ *   INPUTS: filename - file being created
+ *   OUTPUTS: none
+ *   RETURN VALUE: file descriptor index on success, -1 on failure
+ *   SIDE EFFECTS: Adds a dentry or drops the file's data, flags a file descriptor in use.
+ */
+int32_t create (const uint8_t* filename){
+    // Declare local variables
+    pcb_t* cur_pb_ptr;
+    file_descriptor_t file;
+    int32_t fd;
+    int32_t inode;
+    uint8_t name[FILENAME_LEN + 1];
+
+    // Check inputs, names longer than FILENAME_LEN can't be stored
+    if(strncpy_from_user(name, filename, FILENAME_LEN + 1) <= 0)
         return -1;
+    filename = name;
+
+    // Get the PCB
+    cur_pb_ptr = get_cur_pcb();
+
+    // Get the lowest avaialble file desc before touching the filesystem
+    fd = fd_alloc(cur_pb_ptr->files, 2);
+    if(fd == -1)
+        return -1;
+
+    inode = fs_create(filename);
+    if(inode == -1) {
+        fd_free(cur_pb_ptr->files, fd);
+        return -1;
+    }
+
+    // Initalize descriptor vals
+    file.flags = FD_IN_USE;
+    file.file_pos = 0;
+    file.inode = inode;
+    file.file_op_jmp_tbl_ptr = &file_jmp_tbl;
+    fd_install(cur_pb_ptr->files, fd, &file);
 
     return fd;
 }
 
+/*
+ * ioctl
+ *   DESCRIPTION: Device control system call, hands a command to the driver behind a descriptor.
+ *                FIONBIO works on any descriptor and is handled here.
+ *   INPUTS: fd - descriptor of the device
+ *           cmd - driver specific command, or FIONBIO
+ *           arg - driver specific argument, usually a user pointer
+ *   OUTPUTS: whatever the driver writes through arg
+ *   RETURN VALUE: the driver's return value, -1 for a bad descriptor or a file that takes no ioctls
+ *   SIDE EFFECTS: see the driver
+ */
+int32_t ioctl(int32_t fd, uint32_t cmd, uint32_t arg) {
+    file_descriptor_t* file;
+    int32_t on;
+
+    if(fd < 0 || fd >= MAX_FILES)
+        return -1;
+
+    file = fd_get(get_cur_pcb()->files, fd);
+    if(file == NULL)
+        return -1;
+
+    if(cmd == FIONBIO) {
+        if(copy_from_user(&on, (const void*)arg, sizeof(on)) == -1)
+            return -1;
+        if(on)
+            file->flags |= O_NONBLOCK;
+        else
+            file->flags &= ~O_NONBLOCK;
+        return 0;
+    }
+
+    if(file->file_op_jmp_tbl_ptr->ioctl == NULL)
+        return -1;
+    return file->file_op_jmp_tbl_ptr->ioctl(file->inode, cmd, arg);
+}
+
+/*
+ * poll_scan
+ *   DESCRIPTION: One pass of poll over the descriptors, filling in revents.
+ *   INPUTS: fds - kernel copy of the caller's array
+ *           nfds - entries in fds
+ *           pt - table the drivers put the process on their wait queues through, NULL to just check
+ *   OUTPUTS: fds[].revents
+ *   RETURN VALUE: number of entries with a nonzero revents
+ *   SIDE EFFECTS: none
+ */
+static int32_t poll_scan(pollfd_t* fds, uint32_t nfds, poll_table_t* pt) {
+    file_descriptor_t* file;
+    uint32_t events;
+    int32_t ready = 0;
+    uint32_t i;
+
+    for(i = 0; i < nfds; i++) {
+        fds[i].revents = 0;
+        if(fds[i].fd < 0)
+            continue;
+
+        file = (fds[i].fd < MAX_FILES) ? fd_get(get_cur_pcb()->files, fds[i].fd) : NULL;
+        if(file == NULL)
+            events = POLLNVAL;
+        else if(file->file_op_jmp_tbl_ptr->poll == NULL)
+            events = POLLIN | POLLOUT;          // Files and directories never make anybody wait
+        else
+            events = file->file_op_jmp_tbl_ptr->poll(file->inode, pt);
+
+        // Errors and hang ups are reported whether they were asked for or not
+        fds[i].revents = events & (fds[i].events | POLLERR | POLLHUP | POLLNVAL);
+        if(fds[i].revents != 0)
+            ready++;
+    }
+    return ready;
+}
+
+/*
+ * poll
+ *   DESCRIPTION: Poll system call, waits until one of several descriptors can be read or written
+ *                without sleeping, or the timeout passes. Each pass asks every driver's poll
+ *                callback, which also puts the process on the driver's wait queue; the process
+ *                then sleeps until one of those queues is woken.
+ *   INPUTS: fds - array of descriptors and the events (POLLIN, POLLOUT) to wait for
+ *           nfds - entries in fds, at most POLL_MAX_FDS
+ *           timeout - milliseconds to wait at most, 0 to only check, negative to wait forever
+ *   OUTPUTS: fds[].revents - ready events of every entry
+ *   RETURN VALUE: number of entries with events, 0 on a timeout, -1 for bad arguments or on a signal
+ *   SIDE EFFECTS: May sleep. Timeouts count RTC ticks, so they run up to RTC_TIMEOUT_TICKS late.
+ */
+int32_t poll(pollfd_t* fds, uint32_t nfds, int32_t timeout) {
+    pollfd_t kfds[POLL_MAX_FDS];
+    poll_table_t pt;
+    uint32_t deadline = 0;
+    uint32_t flags;
+    int32_t ready;
+
+    if(nfds > POLL_MAX_FDS || copy_from_user(kfds, fds, nfds * sizeof(pollfd_t)) == -1)
+        return -1;
+
+    if(timeout > 0)
+        deadline = rtc_get_ticks() + (timeout / 1000) * rtc_hz + (timeout % 1000) * rtc_hz / 1000 + 1;
+
+    pt.count = 0;
+    init_wait_queue(&pt.wait);
+
+    // Interrupts stay off from each pass to the sleep, so no wake up is missed in between
+    cli_and_save(flags);
+    while(1) {
+        ready = poll_scan(kfds, nfds, (timeout != 0) ? &pt : NULL);
+        if(ready != 0 || timeout == 0)
+            break;
+        if(signal_pending(get_cur_pcb())) {
+            ready = -1;
+            break;
+        }
+        if(timeout > 0 && (int32_t)(rtc_get_ticks() - deadline) >= 0)
+            break;
+
+        if(timeout > 0)
+            sleep_on_timeout(&pt.wait, deadline - rtc_get_ticks());
+        else
+            sleep_on(&pt.wait);
+        poll_release(&pt);
+    }
+    poll_release(&pt);
+    restore_flags(flags);
+
+    if(ready >= 0 && copy_to_user(fds, kfds, nfds * sizeof(pollfd_t)) == -1)
+        return -1;
+    return ready;
+}
+
+/*
+ * pipe
+ *   DESCRIPTION: Pipe system call, creates a pipe and opens both of its ends in the current process.
+ *   INPUTS: fds - array of two ints to hold the descriptors
+ *   OUTPUTS: fds[0] - read end, fds[1] - write end
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: Flags two file descriptors in use, takes a frame for the pipe buffer.
+ */
+int32_t pipe (int32_t* fds){
+    // Declare local variables
+    pcb_t* cur_pb_ptr;
+    file_descriptor_t file;
+    int32_t read_fd;
+    int32_t write_fd;
+    int32_t pipe_num;
+    int32_t ends[2];
+
+    // Check inputs
+    if(!user_range_writable(fds, 2 * sizeof(int32_t)))
+        return -1;
+
+    // Get the PCB
+    cur_pb_ptr = get_cur_pcb();
+
+    // Get the two lowest avaialble file descs
+    read_fd = fd_alloc(cur_pb_ptr->files, 2);
+    if(read_fd == -1)
+        return -1;
+    write_fd = fd_alloc(cur_pb_ptr->files, 2);
+    pipe_num = (write_fd == -1) ? -1 : pipe_alloc();
+
+    // If not enough empty file descs or pipes
+    if(pipe_num == -1) {
+        fd_free(cur_pb_ptr->files, read_fd);
+        fd_free(cur_pb_ptr->files, write_fd);
+        return -1;
+    }
+
+    pipe_fill_fd(&file, pipe_num, 0);
+    fd_install(cur_pb_ptr->files, read_fd, &file);
+    pipe_fill_fd(&file, pipe_num, 1);
+    fd_install(cur_pb_ptr->files, write_fd, &file);
+
+    ends[0] = read_fd;
+    ends[1] = write_fd;
+    return copy_to_user(fds, ends, sizeof(ends));
+}
+
 /* MP3.4!!! 
  * getargs
  *   DESCRIPTION: 
@@ -584,6 +1512,7 @@ int32_t open (const uint8_t* filename){
 int32_t getargs (uint8_t* buf, int32_t nbytes) {
     // Declare local variables
     pcb_t* cur_pb_ptr;
+    uint32_t length;
 
     // Check for valid inputs
     if(buf == NULL || nbytes < 0) {
@@ -598,9 +1527,11 @@ int32_t getargs (uint8_t* buf, int32_t nbytes) {
         return -1;
     }    
 
-    // If there are, then copy them to user space
-    strncpy((int8_t*)buf, (int8_t*)(cur_pb_ptr->cmd_args), (uint32_t)nbytes);
-    return 0;
+    // If there are, then copy them (and the NUL) to user space
+    length = strlen((int8_t*)(cur_pb_ptr->cmd_args)) + 1;
+    if(length > (uint32_t)nbytes)
+        length = nbytes;
+    return copy_to_user(buf, cur_pb_ptr->cmd_args, length);
 }
 
 /* MP3.4!!! 
@@ -612,23 +1543,84 @@ int32_t getargs (uint8_t* buf, int32_t nbytes) {
  *   SIDE EFFECTS: Rewrites the video memory
  */
 int32_t vidmap (uint8_t** screen_start) {
+    uint8_t* address = (uint8_t*)(VIDEO_VIRTUAL);
+
     // Validate the pointer from the user space
-    if (screen_start == NULL) {
+    if (!user_range_writable(screen_start, sizeof(uint8_t*))) {
         return -1;
     }
 
-    int address = (uint32_t) screen_start;
-    if (address < USER_MEM_START || address > USER_MEM_END){
+    // From now on this process (and its forks) see their terminal's video page
+    get_cur_pcb()->vidmap = 1;
+    load_vidmap(get_cur_pcb());
+    flush_tlb();
+
+    // Provide the virtual address of the video memory
+    return copy_to_user(screen_start, &address, sizeof(uint8_t*));
+}
+
+/*
+ * fbmap
+ *   DESCRIPTION: Switches the display to the framebuffer (the console keeps drawing on it) and
+ *                maps the framebuffer at FB_VIRTUAL for this process and its forks, like vidmap does
+ *                for text mode. Other processes don't see it.
+ *   INPUTS: info - where to put the address and layout of the framebuffer
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success and -1 on failure (bad pointer, no Bochs/QEMU VGA)
+ *   SIDE EFFECTS: Leaves text mode for good
+ */
+int32_t fbmap(fb_info_t* info) {
+    fb_info_t fb;
+
+    // Validate the pointer from the user space
+    if (!user_range_writable(info, sizeof(fb_info_t))) {
         return -1;
     }
 
-    // Set the correct page values
-    initialize_paging_vidmem();
+    if (console_use_fb() == -1) {
+        return -1;
+    }
+    // Text mode programs of the shown terminal move to its backing page
+    vidmem_set(get_curr_term());
+    get_cur_pcb()->fbmap = 1;
+    load_vidmap(get_cur_pcb());
+    flush_tlb();
+
+    fb.addr = FB_VIRTUAL;
+    fb.width = FB_WIDTH;
+    fb.height = FB_HEIGHT;
+    fb.pitch = FB_PITCH;
+    fb.bpp = FB_BPP;
+    return copy_to_user(info, &fb, sizeof(fb_info_t));
+}
 
-    // Provide the virtual address of the video memory
-    *screen_start = (uint8_t*)(VIDEO_VIRTUAL);
+/*
+ * load_vidmap
+ *   DESCRIPTION: Gives VIDEO_VIRTUAL the mapping a process expects: its terminal's vidmap page
+ *                table if it called vidmap, nothing otherwise. Same for the framebuffer at
+ *                FB_VIRTUAL and fbmap. The caller flushes the TLB, as paging_for_execute does.
+ *   INPUTS: pcb - process about to run
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Changes the page directory
+ */
+void load_vidmap(pcb_t* pcb) {
+    paging_vidmap((pcb != NULL && pcb->vidmap) ? pcb->terminal_number : -1);
+    paging_fbmap((pcb != NULL && pcb->fbmap) ? fb_phys() : 0);
+}
 
-    return 0;
+/*
+ * syscall_trace
+ *   DESCRIPTION: Prints a system call and what it returned, system_call calls it for every call
+ *                while the trace parameter is on.
+ *   INPUTS: num - system call number
+ *           ret - its return value
+ *   OUTPUTS: one line on the current terminal
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void syscall_trace(int32_t num, int32_t ret) {
+    printf("[pid %d] syscall %d = %d\n", (curr_process != NULL) ? curr_process->PID : -1, num, ret);
 }
 
 /* MP3.5!!! 
@@ -640,7 +1632,11 @@ int32_t vidmap (uint8_t** screen_start) {
  *   SIDE EFFECTS: 
  */
 void occupy(int pid_to_occupy) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&pcb_lock, flags);
     pcbs[pid_to_occupy].PID = pid_to_occupy;      // Set PID to used.
+    spin_unlock_irqrestore(&pcb_lock, flags);
 }
 
 /* MP3.5!!! 
@@ -652,5 +1648,9 @@ void occupy(int pid_to_occupy) {
  *   SIDE EFFECTS: 
  */
 void unoccupy(int pid_to_occupy){
+    uint32_t flags;
+
+    spin_lock_irqsave(&pcb_lock, flags);
     pcbs[pid_to_occupy].PID = -1;      // Set PID to unused.
+    spin_unlock_irqrestore(&pcb_lock, flags);
 }
@@ -5,20 +5,73 @@
 #include "rtc.h"
 #include "filesys.h"
 #include "keyboard.h"
+#include "fb.h"
 
-#define MAX_TASKS 8     // The number of tasks we need for 3.3 is 2.
-#define MAX_FILES 8     // The number of files tasks can open at the same time is 8 for 3.3.
+#define MAX_TASKS 64    // Text is shared and user pages come from the frame pool, so the kernel stacks are the limit
+#define WAIT_QUEUE_WORDS (MAX_TASKS / 32)   // Words in a wait queue's PID bitmap
+#define FD_TABLE_INIT 8 // Descriptors every table starts with, stored inside the table itself
+#define MAX_FILES 256   // Most descriptors a table can grow to (one frame of descriptors)
+#define FD_MAP_WORDS (MAX_FILES / 32)   // Words in a table's free descriptor bitmap
 #define MAX_FN_LENGTH   32      // Max possible length of file name
+#ifndef MAX_ARG_BYTES
+#define MAX_ARG_BYTES   1024    // Longest command line execute accepts (and argument string a process keeps)
+#endif
 #define KERNEL_START_ADDR 0x400000  // 4MB
 #define KERNEL_END_ADDR 0x800000    // 8MB
 #define KERNEL_TASK_SIZE 0x2000    // 8kB
-#define INSTR_START 24
-#define INSTR_LENGTH 4
-#define PROG_INFO_ADDR 0x08048000
 #define PROG_IMG_ADDR 0x83FFFFC
 
 #define USER_MEM_START  0x08000000
 #define USER_MEM_END    0x08400000
+#define USER_EFLAGS     0x202       // IF set
+#define FPU_STATE_SIZE  512         // Size of an fxsave image
+#define SYSCALL_FRAME_WORDS 14      // IRET frame plus the registers system_call saves, at the top of the kernel stack
+
+/* Scheduler states for pcb_t.state */
+#define TASK_EMPTY      0           // No process (or PID only reserved)
+#define TASK_RUNNABLE   1           // Can be picked by schedule()
+#define TASK_SLEEPING   2           // Waiting on a wait queue or for a child
+#define TASK_DEAD       3           // Halted, kernel stack still in use until the next switch
+#define TASK_ZOMBIE     4           // Halted, exit status waiting for the parent's waitpid
+
+/* Signals, same numbers as the user library's enum signums */
+#define SIG_DIV_ZERO    0           // Divide error in user mode, kills by default
+#define SIG_SEGFAULT    1           // Any other exception in user mode, kills by default
+#define SIG_INTERRUPT   2           // Ctrl+C on the process' terminal, kills by default
+#define SIG_ALARM       3           // Every ALARM_SECONDS, ignored by default
+#define SIG_USER1       4           // Sent with kill, ignored by default
+#define NUM_SIGNALS     5
+#define SIGNAL_KILL_STATUS  256     // Halt status of a process killed by a signal
+
+/* waitpid options */
+#define WAIT_NOHANG     1           // Return 0 instead of sleeping when no child has halted yet
+
+/* file_descriptor_t.flags */
+#define FD_IN_USE       0x1
+#define O_NONBLOCK      0x2         // Reads and writes that would sleep return -1 instead
+
+/* Descriptor ioctls handled by the ioctl system call itself */
+#define FIONBIO         0x5421      // arg: int32_t*, nonzero sets O_NONBLOCK, 0 clears it
+
+/* poll events, same bits as the user library's */
+#define POLLIN          0x01        // A read won't sleep
+#define POLLOUT         0x04        // A write won't sleep
+#define POLLERR         0x08        // Write end of a pipe nobody reads
+#define POLLHUP         0x10        // Read end of a pipe nobody writes, reads return 0
+#define POLLNVAL        0x20        // Not an open descriptor
+#define POLL_MAX_FDS    16          // Descriptors one poll call can watch
+
+// Set of sleeping tasks, one bit per PID
+typedef struct wait_queue {
+    uint32_t waiters[WAIT_QUEUE_WORDS];
+} wait_queue_t;
+
+// Wait queues a poll call sleeps on, filled in by the drivers' poll callbacks through poll_wait
+typedef struct poll_table {
+    wait_queue_t* queues[POLL_MAX_FDS];
+    uint32_t count;
+    wait_queue_t wait;                          // What the poll call itself sleeps on, for signals
+} poll_table_t;
 
 // Jump table for file operations
 typedef struct file_op_jmp_tbl {
@@ -26,6 +79,8 @@ typedef struct file_op_jmp_tbl {
     int32_t (*write) (int32_t fd, const void* buf, int32_t nbytes);
     int32_t (*open) (const uint8_t* filename);
     int32_t (*close) (int32_t fd);
+    int32_t (*ioctl) (int32_t inode, uint32_t cmd, uint32_t arg);     // NULL if the file takes no ioctls
+    uint32_t (*poll) (int32_t inode, poll_table_t* pt);               // Ready POLL* events, NULL if always ready
     // Add more as needed
 } file_op_jmp_tbl_t;
 
@@ -37,6 +92,15 @@ typedef struct file_descriptor {
     uint32_t flags;
 } file_descriptor_t;
 
+// Descriptor table of a process
+typedef struct fd_table {
+    uint32_t in_use;                            // 0 if the table is free
+    uint32_t size;                              // Number of descriptors in fds
+    uint32_t free_map[FD_MAP_WORDS];            // Bit set = descriptor free, only bits below size are ever set
+    file_descriptor_t* fds;                     // inline_fds, or a frame once the table has grown
+    file_descriptor_t inline_fds[FD_TABLE_INIT];
+} fd_table_t;
+
 typedef struct pcb {
     uint32_t EIP;                               // Entry point of the program for this process
     uint32_t EBP; 
@@ -44,12 +108,26 @@ typedef struct pcb {
     uint32_t EIP_context;                               // Entry point of the program for this process
     uint32_t EBP_context; 
     uint32_t ESP_context;                                 
-    uint32_t* page_directory;                   // Pointer to the process' page directory
+    uint32_t* page_table;                       // Page table mapping the process' user memory
     int terminal_number;
-    file_descriptor_t file_array[MAX_FILES];    // Array of file descriptors.
+    fd_table_t* files;                          // Table of file descriptors.
     uint32_t PID;                               // Process ID
     struct pcb* parent_pcb;                     // Pointer to parent task's PCB, will use for clean up.
-    uint8_t cmd_args[MAX_FN_LENGTH];            // Array of program's command line arguments
+    uint8_t cmd_args[MAX_ARG_BYTES];            // Program's command line arguments, as returned by getargs
+    uint32_t state;                             // TASK_EMPTY, TASK_RUNNABLE or TASK_SLEEPING
+    uint32_t async;                             // 1 if the parent keeps running (spawn, fork) and collects the status with waitpid
+    int32_t exit_status;                        // Halt status of a zombie
+    wait_queue_t child_wait;                    // Where the process sleeps in waitpid
+    wait_queue_t* wait;                         // Queue the process sleeps on in sleep_on, NULL otherwise
+    uint32_t wake_at;                           // RTC tick sleep_on_timeout gives up at, 0 for no timeout
+    uint32_t rtc_seen;                          // RTC period the process last read, see rtc_read
+    uint32_t vidmap;                            // 1 once the process called vidmap, it then sees its terminal at VIDEO_VIRTUAL
+    uint32_t fbmap;                             // 1 once the process called fbmap, it then sees the framebuffer at FB_VIRTUAL
+    uint32_t sig_pending;                       // Signals sent but not delivered yet, one bit per signal
+    uint32_t sig_masked;                        // Signals held back until sigreturn
+    uint32_t sig_handlers[NUM_SIGNALS];         // User handler of every signal, 0 for the default action
+    uint32_t fpu_used;                          // 1 once the process has touched the FPU, fpu_state is then valid
+    uint8_t fpu_state[FPU_STATE_SIZE] __attribute__((aligned(16)));   // fxsave image while another process owns the FPU
 } pcb_t;
 
 // Execute Variables:
@@ -68,9 +146,21 @@ void deallocate_pcb(pcb_t* pcb);
 /* Execute system call */
 int execute(const uint8_t* command);
 
+/* Run one program of a command as a child of the current process */
+int exec_program(const uint8_t* command, uint32_t length, file_descriptor_t* in);
+
 /* Halt system call */
 int sys_halt(uint8_t status);
 
+/* Halt the current process with any status (256 is kept, unlike through sys_halt) */
+int halt_process(uint32_t status);
+
+/* Detach the spawned and forked children of a halting process */
+void release_children(pcb_t* pcb);
+
+/* Mark a halted process nobody waits for dead and get it freed */
+void process_dead(pcb_t* pcb);
+
 /* Read system call */
 int32_t read (int32_t fd, void* buf, int32_t nbytes);
 
@@ -89,8 +179,53 @@ int32_t getargs (uint8_t* buf, int32_t nbytes);
 /* Vid mem system call */
 int32_t vidmap (uint8_t** screen_start);
 
+/* Map VIDEO_VIRTUAL the way a process about to run sees it */
+void load_vidmap(pcb_t* pcb);
+
+/* Pipe system call */
+int32_t pipe(int32_t* fds);
+
+/* Device control system call */
+int32_t ioctl(int32_t fd, uint32_t cmd, uint32_t arg);
+
+/* Wait for descriptors to become readable or writable */
+typedef struct pollfd {
+    int32_t fd;                                 // Descriptor to watch, negative to skip the entry
+    int16_t events;                             // POLLIN and/or POLLOUT
+    int16_t revents;                            // Filled in: ready events, plus POLLERR, POLLHUP or POLLNVAL
+} pollfd_t;
+
+int32_t poll(pollfd_t* fds, uint32_t nfds, int32_t timeout);
+
+/* Switch to the framebuffer and map it into user space */
+int32_t fbmap(fb_info_t* info);
+
+/* Tunable (param.c): print every system call as it returns */
+extern uint32_t syscall_trace_on;
+
+/* Print a system call and its return value, called by system_call */
+void syscall_trace(int32_t num, int32_t ret);
+
+/* Build a process that starts running the next time the scheduler picks it */
+pcb_t* create_process(const uint8_t* command, int terminal, file_descriptor_t* in, file_descriptor_t* out);
+
+/* Build a process that runs a kernel function and never enters user mode */
+pcb_t* create_kernel_thread(void (*entry)(void), const int8_t* name);
+
+/* Fork system call */
+int32_t fork(void);
+
+/* Start a program without waiting for it */
+int32_t spawn(const uint8_t* command);
+
+/* Wait for a child started by spawn or fork to halt */
+int32_t waitpid(int32_t pid, int32_t* status, int32_t options);
+
+/* Create (or truncate) a file system call */
+int32_t create(const uint8_t* filename);
+
 /* Set ESP, EBP, and return */
-extern void halt_return(uint32_t ebp, uint32_t esp, uint8_t status);
+extern void halt_return(uint32_t ebp, uint32_t esp, uint32_t status);
 
 /* Holds PID values for shells */
 void occupy(int pid_to_occupy);
@@ -6,6 +6,23 @@
 #include "filesys.h"
 #include "syscallhandler.h"
 #include "paging.h"
+#include "pipe.h"
+#include "uaccess.h"
+#include "signal.h"
+#include "elf.h"
+#include "fpu.h"
+#include "smp.h"
+#include "apic.h"
+#include "spinlock.h"
+#include "softirq.h"
+#include "workqueue.h"
+#include "ldisc.h"
+#include "vt100.h"
+#include "console.h"
+#include "fb.h"
+#include "pit.h"
+#include "boottime.h"
+#include "param.h"
 
 
 #define PASS 1
@@ -629,25 +646,43 @@ int sys_call_rtc_test(){
 
 /* sys_write_file_test
  * 
- * Asserts that system call write/open works for files
+ * Asserts that system call write/open works for files (the RAM layer makes them writable)
  * Inputs: None
  * Outputs: PASS/FAIL
- * Side Effects: None
- * Coverage: open, write (sys_call)
+ * Side Effects: Leaves an empty WRITE_TEST_FILE in the RAM layer
+ * Coverage: open, write, read (sys_call)
  */
 int sys_call_write_file_test() {
 	TEST_HEADER;
 	int32_t fd;
 	uint8_t* filename;
-	filename = (uint8_t*)"frame1.txt"; 
+	filename = (uint8_t*)WRITE_TEST_FILE; 
 	char buf[100];
+	char check[100];
+	int i;
+
+	for(i = 0; i < 100; i++)
+		buf[i] = 'a' + (i % 26);
 
+	// A scratch file, files programs read (frame1.txt for fish) stay as they are
+	if(fs_create(filename) == -1) return FAIL;
 	if((fd = open(filename)) == -1) return FAIL;
 
-	// Should not be able to write, so return PASS if -1s
-	if((write(fd, buf, 100)) == -1) return PASS;
+	// Write goes through, then read it back with a fresh descriptor
+	if((write(fd, buf, 100)) != 100) return FAIL;
+	close(fd);
 
-	return FAIL;
+	if((fd = open(filename)) == -1) return FAIL;
+	if((read(fd, check, 100)) != 100) return FAIL;
+	close(fd);
+
+	for(i = 0; i < 100; i++)
+		if(check[i] != buf[i]) return FAIL;
+
+	// Creating it again truncates it
+	fs_create(filename);
+
+	return PASS;
 }
 
 /* sys_call_write_dir_test
@@ -815,6 +850,1307 @@ int pcb_kernel_stack_test() {
     return FAIL;
 }
 
+/* RAM filesystem tests */
+
+/* ramfs_create_append_test
+ *
+ * Asserts that a created file grows across block boundaries and truncates on re-create
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Leaves an empty "ramfs.tmp" in the RAM layer
+ * Coverage: fs_create, fs_write, fs_truncate, read_data
+ */
+int ramfs_create_append_test() {
+	TEST_HEADER;
+	int32_t inode;
+	uint32_t off;
+	int i;
+	uint8_t buf[RAMFS_CHUNK];
+	uint8_t check[RAMFS_CHUNK];
+
+	if((inode = fs_create((uint8_t*)"ramfs.tmp")) == -1) return FAIL;
+
+	// Odd-sized chunks so writes straddle block boundaries
+	for(off = 0; off < 3 * BLOCK_SIZE; off += RAMFS_CHUNK){
+		for(i = 0; i < RAMFS_CHUNK; i++)
+			buf[i] = (uint8_t)(off + i);
+		if(fs_write(inode, off, buf, RAMFS_CHUNK) != RAMFS_CHUNK) return FAIL;
+	}
+	if(fs_file_length(inode) != off) return FAIL;
+
+	if(read_data(inode, BLOCK_SIZE - 7, check, RAMFS_CHUNK) != RAMFS_CHUNK) return FAIL;
+	for(i = 0; i < RAMFS_CHUNK; i++)
+		if(check[i] != (uint8_t)(BLOCK_SIZE - 7 + i)) return FAIL;
+
+	// Creating it again truncates
+	if(fs_create((uint8_t*)"ramfs.tmp") != inode) return FAIL;
+	if(fs_file_length(inode) != 0) return FAIL;
+
+	return PASS;
+}
+
+/* ramfs_throughput_bench
+ *
+ * Measures sequential append and overwrite throughput of the RAM layer in TSC cycles
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Leaves an empty "ramfs.bench" in the RAM layer
+ * Coverage: fs_create, fs_write, fs_truncate
+ */
+int ramfs_throughput_bench() {
+	TEST_HEADER;
+	int32_t inode;
+	uint32_t off;
+	uint32_t start, append_cycles, overwrite_cycles;
+	static uint8_t buf[BLOCK_SIZE];
+
+	memset(buf, 'x', BLOCK_SIZE);
+	if((inode = fs_create((uint8_t*)"ramfs.bench")) == -1) return FAIL;
+
+	start = rdtsc_low();
+	for(off = 0; off < RAMFS_BENCH_BYTES; off += BLOCK_SIZE)
+		if(fs_write(inode, off, buf, BLOCK_SIZE) != BLOCK_SIZE) return FAIL;
+	append_cycles = rdtsc_low() - start;
+
+	start = rdtsc_low();
+	for(off = 0; off < RAMFS_BENCH_BYTES; off += BLOCK_SIZE)
+		if(fs_write(inode, off, buf, BLOCK_SIZE) != BLOCK_SIZE) return FAIL;
+	overwrite_cycles = rdtsc_low() - start;
+
+	printf("append:    %u KB in %u cycles (%u cycles/KB)\n", RAMFS_BENCH_BYTES >> 10, append_cycles, append_cycles / (RAMFS_BENCH_BYTES >> 10));
+	printf("overwrite: %u KB in %u cycles (%u cycles/KB)\n", RAMFS_BENCH_BYTES >> 10, overwrite_cycles, overwrite_cycles / (RAMFS_BENCH_BYTES >> 10));
+
+	return !fs_truncate(inode);
+}
+
+/* Pipe tests */
+
+/* pipe_ring_test
+ *
+ * Asserts that data written to a pipe comes back out in order across the ring's wrap point,
+ * and that the read end sees EOF once the write end is closed
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: pipe, pipe_read, pipe_write, pipe_release
+ */
+int pipe_ring_test() {
+	TEST_HEADER;
+	int32_t fds[2];
+	int32_t off;
+	int i;
+	uint8_t buf[PIPE_TEST_CHUNK];
+	uint8_t check[PIPE_TEST_CHUNK];
+
+	if(pipe(fds) == -1) return FAIL;
+
+	// Write and drain odd-sized chunks so the ring wraps several times
+	for(off = 0; off < 4 * PIPE_BUF_SIZE; off += PIPE_TEST_CHUNK){
+		for(i = 0; i < PIPE_TEST_CHUNK; i++)
+			buf[i] = (uint8_t)(off + i);
+		if(write(fds[1], buf, PIPE_TEST_CHUNK) != PIPE_TEST_CHUNK) return FAIL;
+		if(read(fds[0], check, PIPE_TEST_CHUNK) != PIPE_TEST_CHUNK) return FAIL;
+		for(i = 0; i < PIPE_TEST_CHUNK; i++)
+			if(check[i] != buf[i]) return FAIL;
+	}
+
+	// Buffered data is still readable after the writer goes away, then EOF
+	if(write(fds[1], buf, 10) != 10) return FAIL;
+	if(close(fds[1]) != 0) return FAIL;
+	if(read(fds[0], check, PIPE_TEST_CHUNK) != 10) return FAIL;
+	if(read(fds[0], check, PIPE_TEST_CHUNK) != 0) return FAIL;
+	if(close(fds[0]) != 0) return FAIL;
+
+	return PASS;
+}
+
+/* User access tests */
+
+/* uaccess_range_test
+ *
+ * Asserts that user ranges are checked as a whole once a process is running
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Pretends for the duration of the test that the boot stack belongs to PID 0
+ * Coverage: user_range_ok, copy_to_user, strncpy_from_user
+ */
+int uaccess_range_test() {
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t saved_pid = get_cur_pcb()->PID;
+	uint8_t name[FILENAME_LEN + 1];
+
+	// Kernel callers are trusted
+	if(!user_range_ok((void*)KERNEL_START_ADDR, 4)) return FAIL;
+
+	get_cur_pcb()->PID = 0;
+	if(!user_range_ok((void*)USER_MEM_START, USER_MEM_END - USER_MEM_START)) result = FAIL;
+	if(user_range_ok((void*)(USER_MEM_END - 4), 8)) result = FAIL;
+	if(user_range_ok((void*)(USER_MEM_START - 1), 2)) result = FAIL;
+	if(user_range_ok((void*)KERNEL_START_ADDR, 4)) result = FAIL;
+	if(user_range_ok((void*)0xFFFFFFF0, 0x20)) result = FAIL;
+	if(copy_to_user((void*)KERNEL_START_ADDR, name, 1) != -1) result = FAIL;
+	if(strncpy_from_user(name, (uint8_t*)"frame0.txt", FILENAME_LEN + 1) != -1) result = FAIL;
+	get_cur_pcb()->PID = saved_pid;
+
+	return result;
+}
+
+/* uaccess_readonly_test
+ *
+ * Asserts that the kernel refuses to write into read only program pages
+ * (where the write would fault in ring 0), but still writes into pages that
+ * are missing or copy-on-write, and that the checks stop at the first bad page
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Pretends for the duration of the test that the boot stack belongs to PID 0
+ * Coverage: user_range_writable, user_page_writable, copy_to_user
+ */
+int uaccess_readonly_test() {
+	TEST_HEADER;
+	uint32_t* table = alloc_user_pages();
+	uint8_t* frame = (uint8_t*)alloc_frame();
+	uint8_t* text = (uint8_t*)(USER_PAGES_START + UACCESS_TEST_PAGE * FRAME_SIZE);
+	uint32_t saved_pid = get_cur_pcb()->PID;
+	uint32_t value = COW_TEST_VALUE;
+	int result = PASS;
+
+	if(table == NULL || frame == NULL){
+		free_user_pages(table);
+		free_frame(frame);
+		return FAIL;
+	}
+
+	// One read only page, like program text, with missing pages around it
+	memset(frame, 0, FRAME_SIZE);
+	map_user_page(table, (uint32_t)text, frame, 0);
+	paging_for_execute(table);
+	get_cur_pcb()->PID = 0;
+
+	if(user_range_writable(text, 1)) result = FAIL;
+	if(user_range_writable(text - 4, 8)) result = FAIL;
+	if(copy_to_user(text, &value, sizeof(value)) != -1) result = FAIL;
+	if(*(uint32_t*)text != 0) result = FAIL;
+
+	// A missing page is filled in on the write
+	if(!user_range_writable(text + FRAME_SIZE, FRAME_SIZE)) result = FAIL;
+	if(copy_to_user(text + FRAME_SIZE, &value, sizeof(value)) != 0) result = FAIL;
+
+	// The same page copy-on-write is fine, the write gets a private copy
+	((page_table_entry_t*)table)[UACCESS_TEST_PAGE].AVL_3 |= PTE_COW;
+	if(!user_range_writable(text, 1)) result = FAIL;
+	if(copy_to_user(text, &value, sizeof(value)) != 0 || *(uint32_t*)text != COW_TEST_VALUE) result = FAIL;
+
+	get_cur_pcb()->PID = saved_pid;
+	paging_for_execute((curr_process != NULL) ? curr_process->page_table : NULL);
+	free_user_pages(table);
+
+	return result;
+}
+
+/* File descriptor table tests */
+
+/* fd_table_grow_test
+ *
+ * Asserts that open hands out the lowest free descriptor and keeps working past the
+ * descriptors a table starts with
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Leaves the boot PCB's table grown
+ * Coverage: open, close, fd_alloc, fd_free, table growth
+ */
+int fd_table_grow_test() {
+	TEST_HEADER;
+	int32_t fd;
+	int i;
+	int result = PASS;
+
+	for(i = 2; i < FD_TEST_OPEN; i++){
+		if(open((uint8_t*)"frame0.txt") != i) result = FAIL;
+	}
+
+	// A hole is filled before anything above it
+	if(close(FD_TABLE_INIT / 2) != 0) result = FAIL;
+	if(close(FD_TABLE_INIT + 1) != 0) result = FAIL;
+	if((fd = open((uint8_t*)"frame0.txt")) != FD_TABLE_INIT / 2) result = FAIL;
+	if((fd = open((uint8_t*)"frame0.txt")) != FD_TABLE_INIT + 1) result = FAIL;
+
+	// Out of range descriptors are rejected, including MAX_FILES itself
+	if(close(MAX_FILES) != -1) result = FAIL;
+	if(read(MAX_FILES, &fd, 1) != -1) result = FAIL;
+
+	for(i = 2; i < FD_TEST_OPEN; i++)
+		close(i);
+
+	return result;
+}
+
+/* Copy-on-write tests */
+
+/* cow_page_test
+ *
+ * Asserts that user pages are filled in on first touch, shared read only by
+ * copy_user_pages and copied by the first write
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Maps and unmaps user memory
+ * Coverage: alloc_user_pages, copy_user_pages, handle_user_page_fault, frame refcounts
+ */
+int cow_page_test() {
+	TEST_HEADER;
+	uint32_t* parent = alloc_user_pages();
+	uint32_t* child = alloc_user_pages();
+	volatile uint32_t* word = (uint32_t*)(USER_PAGES_START + COW_TEST_PAGE * FRAME_SIZE);
+	page_table_entry_t* entries = (page_table_entry_t*)parent;
+	uint32_t free_before;
+	int result = PASS;
+
+	if(parent == NULL || child == NULL){
+		free_user_pages(parent);
+		free_user_pages(child);
+		return FAIL;
+	}
+	free_before = free_frame_count();
+
+	// First touch maps a zeroed page
+	paging_for_execute(parent);
+	if(*word != 0) result = FAIL;
+	*word = COW_TEST_VALUE;
+	if(free_frame_count() != free_before - 1) result = FAIL;
+
+	// The copy shares the frame read only
+	copy_user_pages(child, parent);
+	if(entries[COW_TEST_PAGE].R_W) result = FAIL;
+	if(frame_refcount((void*)(entries[COW_TEST_PAGE].address << 12)) != 2) result = FAIL;
+	if(free_frame_count() != free_before - 1) result = FAIL;
+
+	// Writing gives the writer its own copy, the other side keeps the old value
+	*word = COW_TEST_VALUE + 1;
+	if(free_frame_count() != free_before - 2) result = FAIL;
+	paging_for_execute(child);
+	if(*word != COW_TEST_VALUE) result = FAIL;
+
+	// The last user of a frame just gets write access back
+	*word = COW_TEST_VALUE + 2;
+	if(free_frame_count() != free_before - 2) result = FAIL;
+
+	paging_for_execute((curr_process != NULL) ? curr_process->page_table : NULL);
+	free_user_pages(parent);
+	free_user_pages(child);
+	if(free_frame_count() != free_before + 2) result = FAIL;
+
+	return result;
+}
+
+/* ELF loader tests */
+
+/* elf_shared_text_test
+ *
+ * Asserts that two instances of the same program share their read only
+ * text page, get private data pages and leave the rest for demand paging
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Loads "shell" into two scratch page tables
+ * Coverage: elf_load, text page cache, map_user_page
+ */
+int elf_shared_text_test() {
+	TEST_HEADER;
+	uint32_t* first = alloc_user_pages();
+	uint32_t* second = alloc_user_pages();
+	page_table_entry_t* entries = (page_table_entry_t*)first;
+	uint32_t text = (ELF_TEST_TEXT - USER_PAGES_START) / FRAME_SIZE;
+	dentry_t dentry;
+	uint32_t entry_first = 0, entry_second = 0;
+	void* frame;
+	int result = PASS;
+
+	if(first == NULL || second == NULL || read_dentry_by_name((uint8_t*)"shell", &dentry) != 0){
+		free_user_pages(first);
+		free_user_pages(second);
+		return FAIL;
+	}
+
+	if(elf_load(dentry.inode_num, first, &entry_first) != 0) result = FAIL;
+	if(elf_load(dentry.inode_num, second, &entry_second) != 0) result = FAIL;
+	if(entry_first != entry_second || entry_first < ELF_TEST_TEXT || entry_first >= ELF_TEST_DATA) result = FAIL;
+
+	// Text is one frame for both, mapped read only, plus the cache's reference
+	frame = user_page_frame(first, ELF_TEST_TEXT);
+	if(frame == NULL || frame != user_page_frame(second, ELF_TEST_TEXT)) result = FAIL;
+	if(frame != NULL && frame_refcount(frame) < 3) result = FAIL;
+	if(entries[text].R_W) result = FAIL;
+
+	// Data is private and writable, nothing past it is mapped yet
+	if(user_page_frame(first, ELF_TEST_DATA) == NULL || user_page_frame(first, ELF_TEST_DATA) == user_page_frame(second, ELF_TEST_DATA)) result = FAIL;
+	if(!entries[text + 1].R_W) result = FAIL;
+	if(user_page_frame(first, ELF_TEST_DATA + FRAME_SIZE) != NULL) result = FAIL;
+
+	// Files that are not executables are rejected
+	if(read_dentry_by_name((uint8_t*)"frame0.txt", &dentry) != 0 || elf_load(dentry.inode_num, second, &entry_second) != -1) result = FAIL;
+
+	free_user_pages(first);
+	free_user_pages(second);
+	return result;
+}
+
+/* elf_instance_cost_test
+ *
+ * Asserts that every further instance of a loaded program only costs
+ * its writable pages, so MAX_TASKS copies fit in the frame pool
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Loads "shell" into ELF_TEST_INSTANCES scratch page tables
+ * Coverage: elf_load, text page cache, MAX_TASKS
+ */
+int elf_instance_cost_test() {
+	TEST_HEADER;
+	uint32_t* tables[ELF_TEST_INSTANCES];
+	dentry_t dentry;
+	uint32_t entry;
+	uint32_t free_before;
+	int result = PASS;
+	int i;
+
+	if(read_dentry_by_name((uint8_t*)"shell", &dentry) != 0)
+		return FAIL;
+
+	for(i = 0; i < ELF_TEST_INSTANCES; i++){
+		tables[i] = alloc_user_pages();
+		if(tables[i] == NULL){
+			result = FAIL;
+			continue;
+		}
+		free_before = free_frame_count();
+		if(elf_load(dentry.inode_num, tables[i], &entry) != 0) result = FAIL;
+
+		// After the first load the text is cached, only the data page is new
+		if(i > 0 && free_frame_count() != free_before - 1) result = FAIL;
+	}
+
+	for(i = 0; i < ELF_TEST_INSTANCES; i++)
+		free_user_pages(tables[i]);
+
+	return result;
+}
+
+/* Process tests */
+
+/* waitpid_zombie_test
+ *
+ * Asserts that waitpid only collects children started by spawn or fork, returns
+ * right away with WAIT_NOHANG and frees a halted child
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Borrows PCB WAIT_TEST_PID as a fake child
+ * Coverage: waitpid
+ */
+int waitpid_zombie_test() {
+	TEST_HEADER;
+	pcb_t* self = get_cur_pcb();
+	pcb_t* child = &pcbs[WAIT_TEST_PID];
+	uint32_t saved_pid = self->PID;
+	int result = PASS;
+
+	if(child->PID != -1) return FAIL;
+	self->PID = 0;
+
+	// No children at all
+	if(waitpid(-1, NULL, WAIT_NOHANG) != -1) result = FAIL;
+
+	// A running child only reports that nothing halted yet
+	child->PID = WAIT_TEST_PID;
+	child->parent_pcb = self;
+	child->async = 1;
+	child->state = TASK_RUNNABLE;
+	if(waitpid(-1, NULL, WAIT_NOHANG) != 0) result = FAIL;
+	if(waitpid(WAIT_TEST_PID + 1, NULL, WAIT_NOHANG) != -1) result = FAIL;
+
+	// A halted one is collected once
+	child->state = TASK_ZOMBIE;
+	child->exit_status = WAIT_TEST_STATUS;
+	if(waitpid(WAIT_TEST_PID, NULL, 0) != WAIT_TEST_PID) result = FAIL;
+	if(child->PID != -1 || child->state != TASK_EMPTY) result = FAIL;
+	if(waitpid(-1, NULL, WAIT_NOHANG) != -1) result = FAIL;
+
+	deallocate_pcb(child);
+	self->PID = saved_pid;
+
+	return result;
+}
+
+/* orphan_zombie_test
+ *
+ * Asserts that a halted child whose parent halts before collecting it is
+ * freed, by the worker thread when it runs or right away before that
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Borrows PCB WAIT_TEST_PID as a fake child, enables interrupts
+ * Coverage: release_children, process_dead, reap_dead
+ */
+int orphan_zombie_test() {
+	TEST_HEADER;
+	pcb_t* self = get_cur_pcb();
+	pcb_t* child = &pcbs[WAIT_TEST_PID];
+	int i;
+	int result = PASS;
+
+	if(child->PID != -1) return FAIL;
+
+	child->PID = WAIT_TEST_PID;
+	child->parent_pcb = self;
+	child->async = 1;
+	child->state = TASK_ZOMBIE;
+	child->exit_status = WAIT_TEST_STATUS;
+	release_children(self);
+	if(child->parent_pcb != NULL || child->async) result = FAIL;
+
+	// The worker frees it the next time it gets to run
+	if(workqueue_running()) {
+		sti();
+		for(i = 0; i < REAP_TEST_WAITS && child->state != TASK_EMPTY; i++)
+			rtc_read(0, 0, 0, NULL);
+	}
+	if(child->PID != -1 || child->state != TASK_EMPTY) {
+		result = FAIL;
+		deallocate_pcb(child);
+	}
+
+	return result;
+}
+
+/* Signal tests */
+
+/* signal_frame_test
+ *
+ * Asserts that ignored signals are dropped, and that delivering a handled one
+ * builds the handler's frame on the user stack and masks further signals
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Maps and unmaps user memory, resets the boot PCB's signal state
+ * Coverage: send_signal, set_handler, deliver_signals
+ */
+int signal_frame_test() {
+	TEST_HEADER;
+	pcb_t* self = get_cur_pcb();
+	uint32_t saved_pid = self->PID;
+	uint32_t* pages = alloc_user_pages();
+	uint32_t handler = USER_PAGES_START + FRAME_SIZE;
+	struct pushal_t regs;
+	struct iret_frame_t frame;
+	uint32_t* user_stack;
+	int result = PASS;
+
+	if(pages == NULL) return FAIL;
+	self->PID = 0;
+	paging_for_execute(pages);
+
+	// Bad signal numbers and handlers outside of user memory are rejected
+	if(set_handler(NUM_SIGNALS, (void*)handler) != -1) result = FAIL;
+	if(set_handler(SIG_USER1, (void*)KERNEL_START_ADDR) != -1) result = FAIL;
+
+	// Nobody handles ALARM, so it is not even kept
+	send_signal(self, SIG_ALARM);
+	if(self->sig_pending != 0) result = FAIL;
+
+	if(set_handler(SIG_USER1, (void*)handler) != 0) result = FAIL;
+	send_signal(self, SIG_USER1);
+	if(self->sig_pending != (1 << SIG_USER1)) result = FAIL;
+
+	memset(&regs, 0, sizeof(regs));
+	frame.eip = USER_PAGES_START;
+	frame.cs = USER_CS;
+	frame.eflags = USER_EFLAGS;
+	frame.esp = USER_PAGES_END - SIG_TEST_STACK_GAP;
+	frame.ss = USER_DS;
+	deliver_signals(&regs, &frame);
+
+	// The handler runs with the return address and signal number on top of the stack
+	user_stack = (uint32_t*)frame.esp;
+	if(frame.eip != handler) result = FAIL;
+	if(user_stack[0] != USER_PAGES_END - SIG_TEST_STACK_GAP - SIGRETURN_CODE_SIZE) result = FAIL;
+	if(user_stack[1] != SIG_USER1) result = FAIL;
+	if(((sig_context_t*)&user_stack[2])->frame.eip != USER_PAGES_START) result = FAIL;
+	if(self->sig_pending != 0 || self->sig_masked == 0) result = FAIL;
+
+	self->sig_masked = 0;
+	set_handler(SIG_USER1, NULL);
+	paging_for_execute((curr_process != NULL) ? curr_process->page_table : NULL);
+	free_user_pages(pages);
+	self->PID = saved_pid;
+
+	return result;
+}
+
+/* FPU tests */
+
+/* fpu_lazy_switch_test
+ *
+ * Asserts that a process only gets the FPU on its first FPU instruction, starts
+ * with a clean FPU and finds its own state again after another process used it
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Borrows two free PCBs, takes #NM faults in the kernel
+ * Coverage: fpu_switch, fpu_take, device_not_avail_handler, fpu_release
+ */
+int fpu_lazy_switch_test() {
+	TEST_HEADER;
+	pcb_t* saved = curr_process;
+	pcb_t* first = &pcbs[FPU_TEST_PID_A];
+	pcb_t* second = &pcbs[FPU_TEST_PID_B];
+	uint16_t cw = FPU_TEST_CW;
+	uint32_t cr0;
+	int result = PASS;
+
+	if(first->PID != -1 || second->PID != -1)
+		return FAIL;
+	first->PID = FPU_TEST_PID_A;
+	second->PID = FPU_TEST_PID_B;
+	fpu_release(first);
+	fpu_release(second);
+
+	// Switching in a process that does not own the FPU arms #NM
+	curr_process = first;
+	fpu_switch(first);
+	asm volatile("movl %%cr0, %0" : "=r"(cr0));
+	if(!(cr0 & CR0_TS)) result = FAIL;
+
+	// First use takes the FPU, the new control word only lives in the registers
+	asm volatile("fldcw %0" : : "m"(cw) : "memory");
+	if(!first->fpu_used) result = FAIL;
+
+	// The second process starts from a clean FPU
+	curr_process = second;
+	fpu_switch(second);
+	asm volatile("fnstcw %0" : "=m"(cw) : : "memory");
+	if(cw != FPU_DEFAULT_CW) result = FAIL;
+
+	// Going back brings the first process' control word back
+	curr_process = first;
+	fpu_switch(first);
+	asm volatile("fnstcw %0" : "=m"(cw) : : "memory");
+	if(cw != FPU_TEST_CW) result = FAIL;
+
+	// Still the owner, so no trap the next time it runs
+	fpu_switch(first);
+	asm volatile("movl %%cr0, %0" : "=r"(cr0));
+	if(cr0 & CR0_TS) result = FAIL;
+
+	fpu_release(first);
+	fpu_release(second);
+	first->PID = -1;
+	second->PID = -1;
+	curr_process = saved;
+	fpu_switch(saved);
+
+	return result;
+}
+
+/* Memory copy tests */
+
+/* mem_sse2_copy_test
+ *
+ * Asserts that the SSE2 memcpy and memset agree with the rep variants for
+ * every alignment and for sizes on both sides of MEM_NT_MIN
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Maps and unmaps user memory as a scratch buffer
+ * Coverage: memcpy_sse2, memset_sse2, memcpy, memset, memmove
+ */
+int mem_sse2_copy_test() {
+	TEST_HEADER;
+	uint32_t* pages = alloc_user_pages();
+	uint8_t* src = (uint8_t*)USER_PAGES_START;
+	uint8_t* dst = src + MEM_TEST_BYTES + SSE_ALIGN;
+	uint32_t sizes[] = {0, 1, SSE_BLOCK - 1, MEM_SSE_MIN + 3, MEM_SSE_CHUNK + SSE_BLOCK + 5, MEM_NT_MIN + 7};
+	uint32_t off, i, j;
+	int result = PASS;
+
+	if(pages == NULL) return FAIL;
+	if(!mem_has_sse2()){
+		free_user_pages(pages);
+		return PASS;
+	}
+	paging_for_execute(pages);
+
+	for(i = 0; i < MEM_TEST_BYTES + SSE_ALIGN; i++)
+		src[i] = (uint8_t)(i * 7 + 1);
+
+	for(off = 0; off < SSE_ALIGN && result == PASS; off += 3){
+		for(j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++){
+			// Guard bytes on both sides must survive
+			memset_rep(dst, MEM_TEST_GUARD, MEM_TEST_BYTES + SSE_ALIGN);
+			memcpy_sse2(dst + off, src + (SSE_ALIGN - off) % SSE_ALIGN, sizes[j]);
+			if(off > 0 && dst[off - 1] != MEM_TEST_GUARD) result = FAIL;
+			if(dst[off + sizes[j]] != MEM_TEST_GUARD) result = FAIL;
+			for(i = 0; i < sizes[j]; i++)
+				if(dst[off + i] != src[(SSE_ALIGN - off) % SSE_ALIGN + i]) { result = FAIL; break; }
+
+			memset_sse2(dst + off, MEM_TEST_FILL, sizes[j]);
+			if(off > 0 && dst[off - 1] != MEM_TEST_GUARD) result = FAIL;
+			if(dst[off + sizes[j]] != MEM_TEST_GUARD) result = FAIL;
+			for(i = 0; i < sizes[j]; i++)
+				if(dst[off + i] != MEM_TEST_FILL) { result = FAIL; break; }
+		}
+	}
+
+	// memmove still handles a destination inside the source
+	memcpy(dst, src, MEM_SSE_MIN * 2);
+	memmove(dst + 1, dst, MEM_SSE_MIN);
+	for(i = 0; i < MEM_SSE_MIN; i++)
+		if(dst[i + 1] != src[i]) { result = FAIL; break; }
+
+	paging_for_execute((curr_process != NULL) ? curr_process->page_table : NULL);
+	free_user_pages(pages);
+
+	return result;
+}
+
+/* mem_copy_bench
+ *
+ * Prints the cost of the rep and SSE2 memcpy/memset variants in cycles per
+ * byte (hundredths) for sizes from 16 B to 4 MB, the 4 MB source is the
+ * kernel page and the destination a scratch user page table
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Maps and unmaps user memory
+ * Coverage: memcpy_rep, memcpy_sse2, memset_rep, memset_sse2
+ */
+int mem_copy_bench() {
+	TEST_HEADER;
+	uint32_t* pages = alloc_user_pages();
+	uint8_t* src = (uint8_t*)KERNEL_START_ADDR;
+	uint8_t* dst = (uint8_t*)USER_PAGES_START;
+	uint32_t size, reps, r;
+	uint32_t start, cpy_rep, cpy_sse, set_rep, set_sse;
+
+	if(pages == NULL) return FAIL;
+	paging_for_execute(pages);
+
+	// Fault the whole destination in before timing anything
+	memset_rep(dst, 0, MEM_BENCH_MAX);
+
+	printf("size     cpy rep  cpy sse2 set rep  set sse2 (cycles/100B)\n");
+	for(size = MEM_BENCH_MIN; size <= MEM_BENCH_MAX; size *= MEM_BENCH_STEP){
+		reps = MEM_BENCH_MAX / size;
+		cpy_sse = set_sse = 0;
+
+		start = rdtsc_low();
+		for(r = 0; r < reps; r++)
+			memcpy_rep(dst, src, size);
+		cpy_rep = rdtsc_low() - start;
+
+		start = rdtsc_low();
+		for(r = 0; r < reps; r++)
+			memset_rep(dst, r, size);
+		set_rep = rdtsc_low() - start;
+
+		if(mem_has_sse2()){
+			start = rdtsc_low();
+			for(r = 0; r < reps; r++)
+				memcpy_sse2(dst, src, size);
+			cpy_sse = rdtsc_low() - start;
+
+			start = rdtsc_low();
+			for(r = 0; r < reps; r++)
+				memset_sse2(dst, r, size);
+			set_sse = rdtsc_low() - start;
+		}
+
+		// reps * size is always MEM_BENCH_MAX
+		printf("%u\t %u\t  %u\t   %u\t    %u\n", size,
+			cpy_rep / (MEM_BENCH_MAX / 100), cpy_sse / (MEM_BENCH_MAX / 100),
+			set_rep / (MEM_BENCH_MAX / 100), set_sse / (MEM_BENCH_MAX / 100));
+	}
+
+	paging_for_execute((curr_process != NULL) ? curr_process->page_table : NULL);
+	free_user_pages(pages);
+
+	return PASS;
+}
+
+/* SMP tests */
+
+/* smp_cpu_test
+ *
+ * Asserts that every CPU smp_init started is online with its own TSS and
+ * that the APs' LAPIC timers tick
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Busy waits SMP_TEST_WAIT_US
+ * Coverage: smp_init, ap_main, this_cpu, apic_timer_handler
+ */
+int smp_cpu_test() {
+	TEST_HEADER;
+	uint32_t ticks[MAX_CPUS];
+	seg_desc_t* desc;
+	uint32_t i;
+	int result = PASS;
+
+	if(num_cpus < 1 || num_cpus > MAX_CPUS) return FAIL;
+	if(!cpus[0].online || this_cpu() != &cpus[0]) return FAIL;
+
+	for(i = 1; i < num_cpus; i++){
+		if(!cpus[i].online) continue;
+
+		// Each AP's TSS descriptor points at its own TSS
+		desc = &cpus[i].gdt[KERNEL_TSS >> 3];
+		if((desc->base_15_00 | (desc->base_23_16 << 16) | (desc->base_31_24 << 24)) != (uint32_t)&cpus[i].tss) result = FAIL;
+		ticks[i] = cpus[i].ticks;
+	}
+
+	pit_delay_us(SMP_TEST_WAIT_US);
+
+	for(i = 1; i < num_cpus; i++){
+		if(cpus[i].online && cpus[i].ticks == ticks[i]) result = FAIL;
+	}
+
+	return result;
+}
+
+/* Returns the current EFLAGS */
+static uint32_t read_eflags(void) {
+	uint32_t flags;
+	cli_and_save(flags);
+	restore_flags(flags);
+	return flags;
+}
+
+/* spinlock_test
+ *
+ * Asserts that the irqsave lock variants put IF back the way they found it,
+ * that a held spinlock can't be taken again, that readers share an rwlock and
+ * shut writers out, and that a rejected RTC frequency leaves interrupts alone
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Enables interrupts
+ * Coverage: spin_lock_irqsave, spin_trylock, read_lock, write_lock, rtc_change_frequency
+ */
+int spinlock_test() {
+	TEST_HEADER;
+	spinlock_t lock = SPINLOCK_INIT("test");
+	rwlock_t rw = RWLOCK_INIT("test_rw");
+	uint32_t flags;
+	int i;
+	int result = PASS;
+
+	sti();
+
+	spin_lock_irqsave(&lock, flags);
+	if(read_eflags() & EFLAGS_IF) result = FAIL;
+	if(spin_trylock(&lock) || !spin_is_locked(&lock)) result = FAIL;
+	spin_unlock_irqrestore(&lock, flags);
+	if(!(read_eflags() & EFLAGS_IF) || spin_is_locked(&lock)) result = FAIL;
+
+	// Nested irqsave sections only turn interrupts back on at the outermost one
+	cli();
+	spin_lock_irqsave(&lock, flags);
+	spin_unlock_irqrestore(&lock, flags);
+	if(read_eflags() & EFLAGS_IF) result = FAIL;
+	sti();
+
+	for(i = 0; i < LOCK_TEST_READERS; i++)
+		read_lock(&rw);
+	if(rw.count != LOCK_TEST_READERS) result = FAIL;
+	for(i = 0; i < LOCK_TEST_READERS; i++)
+		read_unlock(&rw);
+
+	write_lock(&rw);
+	if(rw.count != RW_WRITER) result = FAIL;
+	write_unlock(&rw);
+	if(rw.count != 0) result = FAIL;
+
+	// Used to return with interrupts still disabled
+	if(rtc_change_frequency(LOCK_TEST_BAD_FREQ) != -1) result = FAIL;
+	if(!(read_eflags() & EFLAGS_IF)) result = FAIL;
+
+	lock_stats_print();
+
+	return result;
+}
+
+/* Counts how often the deferred work test functions ran */
+static volatile uint32_t deferred_runs = 0;
+
+static void deferred_count(uint32_t data) {
+	deferred_runs += data;
+}
+
+/* softirq_test
+ *
+ * Asserts that a tasklet scheduled twice before the softirq runs runs once,
+ * with interrupts on, that a job can't be queued for the worker twice, and
+ * that the RTC interrupt shows up in the IRQ-off statistics
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Enables interrupts, leaves a job on the worker queue
+ * Coverage: tasklet_schedule, do_softirq, queue_work, irq_enter, irq_exit
+ */
+int softirq_test() {
+	TEST_HEADER;
+	static tasklet_t tasklet = TASKLET_INIT(deferred_count, 1);
+	static work_t work = WORK_INIT(deferred_count, 0);
+	uint32_t rtc_irqs;
+	int result = PASS;
+
+	cli();
+	deferred_runs = 0;
+	tasklet_schedule(&tasklet);
+	tasklet_schedule(&tasklet);
+	if(deferred_runs != 0) result = FAIL;
+	do_softirq();
+	if(deferred_runs != 1 || tasklet.scheduled) result = FAIL;
+	// do_softirq hands EFLAGS back the way it found them
+	if(read_eflags() & EFLAGS_IF) result = FAIL;
+
+	if(workqueue_running()) {
+		if(queue_work(&work) != 0) result = FAIL;
+		if(queue_work(&work) != -1) result = FAIL;
+	}
+
+	rtc_irqs = irq_count(IRQ_SLOT_RTC);
+	sti();
+	rtc_read(0, 0, 0, NULL);
+	if(irq_count(IRQ_SLOT_RTC) == rtc_irqs || irq_off_max(IRQ_SLOT_RTC) == 0) result = FAIL;
+
+	irq_stats_print();
+
+	return result;
+}
+
+/* ldisc_test
+ *
+ * Asserts that raw input comes out of a line discipline in order, that the
+ * queue refuses bytes once full, that modes with unknown flags are refused
+ * and that reads are ready according to the VMIN/VTIME rules
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None, works on a line discipline of its own
+ * Coverage: ldisc_receive, ldisc_take, ldisc_set_mode, ldisc_read_ready, ldisc_read_deadline
+ */
+int ldisc_test() {
+	TEST_HEADER;
+	static ldisc_t ld;
+	term_mode_t mode;
+	uint8_t buf[LDISC_TEST_BYTES];
+	int i;
+	int result = PASS;
+
+	ldisc_init(&ld);
+	for(i = 0; i < LDISC_TEST_BYTES; i++)
+		if(ldisc_receive(&ld, 'a' + i) != 0) result = FAIL;
+	if(ldisc_count(&ld) != LDISC_TEST_BYTES) result = FAIL;
+	if(ldisc_take(&ld, buf, LDISC_TEST_BYTES) != LDISC_TEST_BYTES) result = FAIL;
+	for(i = 0; i < LDISC_TEST_BYTES; i++)
+		if(buf[i] != 'a' + i) result = FAIL;
+
+	for(i = 0; i < LDISC_QUEUE_SIZE; i++)
+		ldisc_receive(&ld, 'x');
+	if(ldisc_receive(&ld, 'x') != -1) result = FAIL;
+	ldisc_flush(&ld);
+	if(ldisc_count(&ld) != 0) result = FAIL;
+
+	mode.lflag = LDISC_TEST_BAD_FLAG;
+	mode.vmin = 1;
+	mode.vtime = 0;
+	if(ldisc_set_mode(&ld, &mode, 0) != -1 || !(ld.mode.lflag & LDISC_ICANON)) result = FAIL;
+
+	// VMIN 2, VTIME 0: wait for two bytes, or fewer if fewer were asked for
+	mode.lflag = 0;
+	mode.vmin = 2;
+	if(ldisc_set_mode(&ld, &mode, 0) != 0 || ld.owner != 0) result = FAIL;
+	ldisc_receive(&ld, 'a');
+	if(ldisc_read_ready(&ld, LDISC_TEST_BYTES)) result = FAIL;
+	if(!ldisc_read_ready(&ld, 1)) result = FAIL;
+	if(ldisc_read_deadline(&ld, 0) != 0) result = FAIL;
+
+	// VMIN 0, VTIME 0: never waits
+	ldisc_flush(&ld);
+	mode.vmin = 0;
+	ldisc_set_mode(&ld, &mode, 0);
+	if(!ldisc_read_ready(&ld, LDISC_TEST_BYTES)) result = FAIL;
+
+	// VMIN 0, VTIME > 0: waits for one byte, timer runs from the start of the read
+	mode.vtime = LDISC_TEST_VTIME;
+	ldisc_set_mode(&ld, &mode, 0);
+	if(ldisc_read_ready(&ld, LDISC_TEST_BYTES)) result = FAIL;
+	if(ldisc_read_deadline(&ld, 1) != 1 + LDISC_TEST_VTIME * RTC_TENTH) result = FAIL;
+
+	// VMIN > 0, VTIME > 0: no timer until the first byte
+	mode.vmin = 2;
+	ldisc_set_mode(&ld, &mode, 0);
+	if(ldisc_read_deadline(&ld, 1) != 0) result = FAIL;
+	ldisc_receive(&ld, 'a');
+	if(ldisc_read_deadline(&ld, 1) != ld.last_rx + LDISC_TEST_VTIME * RTC_TENTH) result = FAIL;
+
+	return result;
+}
+
+/* Non-blocking I/O tests */
+
+/* poll_nonblock_test
+ *
+ * Asserts that poll reports an empty pipe as writable only, a pipe with
+ * data as readable and a pipe without writers as hung up, that a
+ * non-blocking read of an empty pipe and a non-blocking write to a full
+ * one return instead of sleeping, and that bad descriptors get POLLNVAL
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None, both ends are closed again
+ * Coverage: poll, ioctl FIONBIO, pipe_read_poll, pipe_write_poll, O_NONBLOCK
+ */
+int poll_nonblock_test() {
+	TEST_HEADER;
+	static uint8_t buf[PIPE_BUF_SIZE];
+	int32_t fds[2];
+	pollfd_t pfds[3];
+	int32_t on = 1;
+	int result = PASS;
+
+	if(pipe(fds) == -1) return FAIL;
+
+	pfds[0].fd = fds[0];
+	pfds[0].events = POLLIN;
+	pfds[1].fd = fds[1];
+	pfds[1].events = POLLOUT;
+	pfds[2].fd = POLL_TEST_BAD_FD;
+	pfds[2].events = POLLIN;
+	if(poll(pfds, 3, 0) != 2) result = FAIL;
+	if(pfds[0].revents != 0 || pfds[1].revents != POLLOUT || pfds[2].revents != POLLNVAL) result = FAIL;
+
+	// Empty pipe: a non-blocking read fails instead of sleeping
+	if(ioctl(fds[0], FIONBIO, (uint32_t)&on) != 0) result = FAIL;
+	if(read(fds[0], buf, POLL_TEST_BYTES) != -1) result = FAIL;
+
+	if(write(fds[1], buf, POLL_TEST_BYTES) != POLL_TEST_BYTES) result = FAIL;
+	pfds[2].fd = -1;
+	if(poll(pfds, 3, POLL_TEST_TIMEOUT) != 2 || pfds[0].revents != POLLIN) result = FAIL;
+	if(read(fds[0], buf, PIPE_BUF_SIZE) != POLL_TEST_BYTES) result = FAIL;
+
+	// Full pipe: a non-blocking write stores what fits and returns
+	if(ioctl(fds[1], FIONBIO, (uint32_t)&on) != 0) result = FAIL;
+	if(write(fds[1], buf, PIPE_BUF_SIZE) != PIPE_BUF_SIZE) result = FAIL;
+	if(write(fds[1], buf, POLL_TEST_BYTES) != -1) result = FAIL;
+	if(poll(&pfds[1], 1, 0) != 0) result = FAIL;
+
+	// No writers left: hung up, and reads see the end of the data
+	close(fds[1]);
+	if(poll(pfds, 1, 0) != 1 || pfds[0].revents != (POLLIN | POLLHUP)) result = FAIL;
+	if(read(fds[0], buf, PIPE_BUF_SIZE) != PIPE_BUF_SIZE) result = FAIL;
+	if(read(fds[0], buf, PIPE_BUF_SIZE) != 0) result = FAIL;
+	close(fds[0]);
+
+	return result;
+}
+
+/* Terminal output tests */
+
+/* Cell the kernel drew at row y, column x of the shown terminal */
+static uint16_t screen_cell(int x, int y) {
+	return console_cells(get_curr_term())[y * NUM_COLS + x];
+}
+
+/* Cell of the screen itself at row y, column x */
+static uint16_t video_cell(int x, int y) {
+	return ((uint16_t*)VIDEO)[y * NUM_COLS + x];
+}
+
+/* Hand a string to a renderer */
+static void vt_test_write(vt100_t* vt, const char* s) {
+	vt100_write(vt, (const uint8_t*)s, strlen((const int8_t*)s));
+}
+
+/* vt100_test
+ *
+ * Asserts that the VT100 renderer positions the cursor, colors and erases
+ * cells and scrolls only the scroll region, with a sequence split across
+ * writes
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Clears the screen
+ * Coverage: vt100_write, screen_write_cells, screen_fill_cells, screen_scroll
+ */
+int vt100_test() {
+	TEST_HEADER;
+	static vt100_t vt;
+	int result = PASS;
+
+	vt100_init(&vt);
+	console_select(get_curr_term());
+
+	// Red X at row 5, column 10 (1-based)
+	vt_test_write(&vt, "\033[2J\033[5;10H\033[31mX");
+	if(screen_cell(9, 4) != VT_TEST_RED_X) result = FAIL;
+	if(get_screen_x() != 10 || get_screen_y() != 4) result = FAIL;
+
+	// Bold white on blue, with the sequence split in two writes
+	vt_test_write(&vt, "\033[1;");
+	vt_test_write(&vt, "44mc\033[0m");
+	if(screen_cell(10, 4) != VT_TEST_BOLD_C) result = FAIL;
+
+	// Erase the row back to default blanks
+	vt_test_write(&vt, "\033[5;1H\033[K");
+	if(screen_cell(9, 4) != VT_TEST_BLANK || screen_cell(10, 4) != VT_TEST_BLANK) result = FAIL;
+
+	// Rows 2-4 scroll, row 1 and row 5 stay
+	vt_test_write(&vt, "\033[1;1Ht\033[5;1Hb\033[2;4r\033[4;1Hx\n");
+	if((screen_cell(0, 2) & 0xFF) != 'x' || (screen_cell(0, 3) & 0xFF) != ' ') result = FAIL;
+	if((screen_cell(0, 0) & 0xFF) != 't' || (screen_cell(0, 4) & 0xFF) != 'b') result = FAIL;
+
+	vt_test_write(&vt, "\033[r\033c");
+	console_flush(get_curr_term());
+
+	return result;
+}
+
+/* console_test
+ *
+ * Asserts that drawing only reaches the screen when the terminal is
+ * flushed, and that a flush copies every row a span touched
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Clears the screen
+ * Coverage: console_select, console_flush, screen_write_cells, screen_fill_cells
+ */
+int console_test() {
+	TEST_HEADER;
+	uint16_t cells[2] = { CONSOLE_TEST_CELL, CONSOLE_TEST_CELL };
+	uint8_t t = get_curr_term();
+	uint32_t flags;
+	int result = PASS;
+
+	clear();
+	if(video_cell(0, 0) != VT_TEST_BLANK) result = FAIL;
+
+	// Interrupts off, so the periodic flush can't get in between
+	cli_and_save(flags);
+	console_select(t);
+	screen_write_cells(3, 3, cells, 2);
+	screen_fill_cells(NUM_COLS - 1, 5, CONSOLE_TEST_CELL, 2);
+	if(screen_cell(3, 3) != CONSOLE_TEST_CELL || video_cell(3, 3) != VT_TEST_BLANK) result = FAIL;
+
+	console_flush(t);
+	if(video_cell(3, 3) != CONSOLE_TEST_CELL || video_cell(4, 3) != CONSOLE_TEST_CELL) result = FAIL;
+	if(video_cell(NUM_COLS - 1, 5) != CONSOLE_TEST_CELL || video_cell(0, 6) != CONSOLE_TEST_CELL) result = FAIL;
+	if(video_cell(1, 6) != VT_TEST_BLANK) result = FAIL;
+	restore_flags(flags);
+
+	clear();
+	return result;
+}
+
+/* fb_render_test
+ *
+ * Asserts that text rendered for the framebuffer puts the foreground color
+ * on every pixel of a full block and the background color on every pixel
+ * of a blank, without leaving text mode
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Reads the font out of VGA plane 2
+ * Coverage: fb_load_font, fb_render_row
+ */
+int fb_render_test() {
+	TEST_HEADER;
+	static uint16_t cells[NUM_COLS];
+	static uint32_t pixels[FONT_HEIGHT * FB_WIDTH];
+	int x, line;
+	int result = PASS;
+
+	for(x = 0; x < NUM_COLS; x++)
+		cells[x] = FB_TEST_BLANK;
+	cells[0] = FB_TEST_BLOCK;
+
+	if(fb_load_font() != 0) result = FAIL;
+	fb_render_row(cells, pixels, FB_WIDTH);
+
+	for(line = 0; line < FONT_HEIGHT; line++) {
+		for(x = 0; x < FONT_WIDTH; x++) {
+			if(pixels[line * FB_WIDTH + x] != FB_TEST_WHITE) result = FAIL;
+			if(pixels[line * FB_WIDTH + FONT_WIDTH + x] != FB_TEST_BLUE) result = FAIL;
+		}
+	}
+	if(pixels[FONT_HEIGHT * FB_WIDTH - 1] != FB_TEST_BLUE) result = FAIL;
+
+	return result;
+}
+
+/* vidmap_table_test
+ *
+ * Asserts that VIDEO_VIRTUAL follows the vidmap page table of the terminal
+ * handed to paging_vidmap, that repointing one PTE moves it to another
+ * page, and that a process without vidmap doesn't see it at all
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: paging_vidmap, map_to_vidmem_page, vidmem_set
+ */
+int vidmap_table_test() {
+	TEST_HEADER;
+	uint32_t pde = VIDEO_VIRTUAL >> 22;
+	uint32_t saved_pde = base_dir[pde].KB_dir.val;
+	uint16_t* backing = (uint16_t*)CONSOLE_BACKING(VIDMAP_TEST_TERM);
+	uint16_t saved_cell = backing[0];
+	uint32_t flags;
+	int result = PASS;
+
+	cli_and_save(flags);
+	paging_vidmap(VIDMAP_TEST_TERM);
+	map_to_vidmem_page(VIDMAP_TEST_TERM, (uint32_t)backing);
+	flush_tlb();
+	if(!base_dir[pde].KB_dir.P || base_dir[pde].KB_dir.address != (uint32_t)pte_vidmap[VIDMAP_TEST_TERM] >> 12) result = FAIL;
+
+	// A store through the user window lands in the terminal's backing page
+	*(volatile uint16_t*)VIDEO_VIRTUAL = VIDMAP_TEST_CELL;
+	if(backing[0] != VIDMAP_TEST_CELL) result = FAIL;
+	backing[0] = saved_cell;
+	vidmem_set(VIDMAP_TEST_TERM);
+
+	paging_vidmap(-1);
+	if(base_dir[pde].KB_dir.P) result = FAIL;
+
+	base_dir[pde].KB_dir.val = saved_pde;
+	flush_tlb();
+	restore_flags(flags);
+
+	return result;
+}
+
+/* fbmap_table_test
+ *
+ * Asserts that FB_VIRTUAL only maps the framebuffer for a process that
+ * called fbmap, and that switching to any other process takes it away
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: paging_fbmap, load_vidmap
+ */
+int fbmap_table_test() {
+	TEST_HEADER;
+	static pcb_t caller, other;
+	uint32_t pde = FB_VIRTUAL >> 22;
+	uint32_t flags;
+	int result = PASS;
+
+	caller.fbmap = 1;
+	caller.vidmap = 0;
+	other.fbmap = 0;
+	other.vidmap = 0;
+
+	cli_and_save(flags);
+	load_vidmap(&caller);
+	if(!base_dir[pde].MB_dir.P || !base_dir[pde].MB_dir.U_S || base_dir[pde].MB_dir.address != fb_phys() >> 22) result = FAIL;
+
+	load_vidmap(&other);
+	if(base_dir[pde].MB_dir.P) result = FAIL;
+	load_vidmap(NULL);
+	if(base_dir[pde].MB_dir.P) result = FAIL;
+
+	// Back to what the running process sees
+	load_vidmap(curr_process);
+	flush_tlb();
+	restore_flags(flags);
+
+	return result;
+}
+
+/* boot_lazy_init_test
+ *
+ * Asserts that frames come out of the lazily handed out pool page aligned,
+ * distinct and owned once, that freeing them puts the count back and the
+ * last one freed is the next one handed out, and that a boot step can still
+ * be closed after boot without breaking the timeline
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: init_frame_pool, alloc_frame, free_frame, boot_step
+ */
+int boot_lazy_init_test() {
+	TEST_HEADER;
+	void* frames[BOOT_TEST_FRAMES];
+	uint32_t before = free_frame_count();
+	uint32_t addr;
+	int i, j;
+	int result = PASS;
+
+	for(i = 0; i < BOOT_TEST_FRAMES; i++) {
+		frames[i] = alloc_frame();
+		addr = (uint32_t)frames[i];
+		if(frames[i] == NULL || addr < FRAME_POOL_START || addr >= FRAME_POOL_END || (addr & (FRAME_SIZE - 1))) {
+			result = FAIL;
+			break;
+		}
+		if(frame_refcount(frames[i]) != 1) result = FAIL;
+		for(j = 0; j < i; j++)
+			if(frames[j] == frames[i]) result = FAIL;
+	}
+	if(result == PASS && free_frame_count() != before - BOOT_TEST_FRAMES) result = FAIL;
+
+	for(j = 0; j < i; j++)
+		free_frame(frames[j]);
+	if(free_frame_count() != before) result = FAIL;
+
+	// Freed frames go on the stack, ahead of the never used ones
+	if(i > 0) {
+		frames[0] = alloc_frame();
+		if(frames[0] != frames[i - 1]) result = FAIL;
+		free_frame(frames[0]);
+	}
+
+	boot_step("boot_lazy_init_test");
+	if(boot_quiet() != boot_flag(BOOT_QUIET)) result = FAIL;
+
+	return result;
+}
+
+/* param_test
+ *
+ * Asserts that command line words set numeric and bool parameters, that
+ * hex values are read, and that unknown names, missing values, values out
+ * of range, garbage and non powers of two are refused without changing
+ * the parameter
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (the parameters are put back)
+ * Coverage: param_set, param_find
+ */
+int param_test() {
+	TEST_HEADER;
+	uint32_t saved_quantum = sched_quantum;
+	uint32_t saved_flags = boot_flags;
+	uint32_t saved_rtc_hz = rtc_hz;
+	const param_t* p;
+	int result = PASS;
+
+	if(param_set("sched.quantum=" PARAM_TEST_QUANTUM_STR) != 0 || sched_quantum != PARAM_TEST_QUANTUM) result = FAIL;
+	if(param_set("sched.quantum=0x10") != 0 || sched_quantum != 0x10) result = FAIL;
+	if(param_set("sched.quantum=0") != -1) result = FAIL;
+	if(param_set("sched.quantum=99999999999") != -1) result = FAIL;
+	if(param_set("sched.quantum=4x") != -1) result = FAIL;
+	if(param_set("sched.quantum=") != -1) result = FAIL;
+	if(param_set("sched.quantum") != -1) result = FAIL;
+	if(sched_quantum != 0x10) result = FAIL;
+
+	// rtc.hz must be a power of two in range, neither of these may reach the RTC
+	if(param_set("rtc.hz=3000") != -1) result = FAIL;
+	if(param_set("rtc.hz=2") != -1) result = FAIL;
+	if(rtc_hz != saved_rtc_hz) result = FAIL;
+
+	// Bools work bare or with a value, and only touch their own bit
+	if(param_set("boottime=off") != 0 || boot_flag(BOOT_TIMELINE)) result = FAIL;
+	if(param_set("boottime") != 0 || !boot_flag(BOOT_TIMELINE)) result = FAIL;
+	if(param_set("boottime=maybe") != -1 || !boot_flag(BOOT_TIMELINE)) result = FAIL;
+	if((boot_flags & ~BOOT_TIMELINE) != (saved_flags & ~BOOT_TIMELINE)) result = FAIL;
+
+	if(param_set("no.such.param=1") != -1) result = FAIL;
+	if(param_set("=1") != -1) result = FAIL;
+	p = param_find("cache.text");
+	if(p == NULL || p->type != PARAM_UINT || p->var != &text_cache_slots) result = FAIL;
+
+	sched_quantum = saved_quantum;
+	boot_flags = saved_flags;
+
+	return result;
+}
+
 /* Checkpoint 4 tests */
 /* Checkpoint 5 tests */
 
@@ -852,4 +2188,65 @@ void launch_tests(){
 	// TEST_OUTPUT("sys_call_write_file_test", sys_call_write_file_test());
 	// TEST_OUTPUT("sys_call_write_dir_test", sys_call_write_dir_test());
 	// TEST_OUTPUT("sys_call_stdio", sys_call_stdio());
+
+	// RAM filesystem tests
+	// TEST_OUTPUT("ramfs_create_append_test", ramfs_create_append_test());
+	// TEST_OUTPUT("ramfs_throughput_bench", ramfs_throughput_bench());
+
+	// Pipe tests
+	// TEST_OUTPUT("pipe_ring_test", pipe_ring_test());
+
+	// User access tests
+	// TEST_OUTPUT("uaccess_range_test", uaccess_range_test());
+	// TEST_OUTPUT("uaccess_readonly_test", uaccess_readonly_test());
+
+	// File descriptor table tests
+	// TEST_OUTPUT("fd_table_grow_test", fd_table_grow_test());
+
+	// Copy-on-write tests
+	// TEST_OUTPUT("cow_page_test", cow_page_test());
+
+	// ELF loader tests
+	// TEST_OUTPUT("elf_shared_text_test", elf_shared_text_test());
+	// TEST_OUTPUT("elf_instance_cost_test", elf_instance_cost_test());
+
+	// Process tests
+	// TEST_OUTPUT("waitpid_zombie_test", waitpid_zombie_test());
+	// TEST_OUTPUT("orphan_zombie_test", orphan_zombie_test());
+
+	// Signal tests
+	// TEST_OUTPUT("signal_frame_test", signal_frame_test());
+
+	// FPU tests
+	// TEST_OUTPUT("fpu_lazy_switch_test", fpu_lazy_switch_test());
+
+	// Memory copy tests
+	// TEST_OUTPUT("mem_sse2_copy_test", mem_sse2_copy_test());
+	// TEST_OUTPUT("mem_copy_bench", mem_copy_bench());
+
+	// SMP tests
+	// TEST_OUTPUT("smp_cpu_test", smp_cpu_test());
+
+	// Locking tests
+	// TEST_OUTPUT("spinlock_test", spinlock_test());
+
+	// Deferred work tests
+	// TEST_OUTPUT("softirq_test", softirq_test());
+
+	// Line discipline tests
+	// TEST_OUTPUT("ldisc_test", ldisc_test());
+
+	// Non-blocking I/O tests
+	// TEST_OUTPUT("poll_nonblock_test", poll_nonblock_test());
+
+	// Terminal output tests
+	// TEST_OUTPUT("vt100_test", vt100_test());
+	// TEST_OUTPUT("console_test", console_test());
+	// TEST_OUTPUT("fb_render_test", fb_render_test());
+	// TEST_OUTPUT("vidmap_table_test", vidmap_table_test());
+	// TEST_OUTPUT("fbmap_table_test", fbmap_table_test());
+
+	// Boot tests
+	// TEST_OUTPUT("boot_lazy_init_test", boot_lazy_init_test());
+	// TEST_OUTPUT("param_test", param_test());
 }
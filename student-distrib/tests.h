@@ -7,6 +7,53 @@
 #define LS_SIZE         5349
 #define MAX_FN_LENGTH   32
 #define NUM_FILES       17
+#define RAMFS_CHUNK     1000
+#define WRITE_TEST_FILE "write.tmp"     // Scratch file of sys_call_write_file_test
+#define RAMFS_BENCH_BYTES   0x100000
+#define PIPE_TEST_CHUNK 1000
+#define FD_TEST_OPEN    20
+#define COW_TEST_PAGE   5
+#define COW_TEST_VALUE  0x391
+#define UACCESS_TEST_PAGE   7
+#define ELF_TEST_TEXT   0x08048000  // Text page of the fsdir programs
+#define ELF_TEST_DATA   0x08049000  // Data page of the fsdir programs
+#define ELF_TEST_INSTANCES  MAX_TASKS
+#define WAIT_TEST_PID   5
+#define WAIT_TEST_STATUS    7
+#define REAP_TEST_WAITS     8       // RTC periods the worker gets to free an orphaned zombie
+#define SIG_TEST_STACK_GAP  16
+#define FPU_TEST_PID_A  6
+#define FPU_TEST_PID_B  7
+#define FPU_TEST_CW     0x037A      // Default control word with the precision field changed
+#define FPU_DEFAULT_CW  0x037F      // Control word after fninit
+#define MEM_TEST_BYTES  (MEM_NT_MIN + 2 * SSE_BLOCK)    // Largest copy mem_sse2_copy_test makes, plus slack
+#define MEM_TEST_GUARD  0xA5
+#define MEM_TEST_FILL   0x3C
+#define MEM_BENCH_MIN   16
+#define MEM_BENCH_MAX   0x400000    // 4MB, the source is the whole kernel page
+#define MEM_BENCH_STEP  4
+#define SMP_TEST_WAIT_US    50000   // Five LAPIC timer periods
+#define LOCK_TEST_READERS   3
+#define LOCK_TEST_BAD_FREQ  3       // Not a power of two
+#define LDISC_TEST_BYTES    4
+#define LDISC_TEST_BAD_FLAG 0x80
+#define LDISC_TEST_VTIME    5
+#define POLL_TEST_BYTES     100
+#define POLL_TEST_BAD_FD    (MAX_FILES - 1)     // Never opened by the tests
+#define POLL_TEST_TIMEOUT   1000                // ms, only waited for if the test fails
+#define VT_TEST_RED_X       0x0458      // 'X', red on black
+#define VT_TEST_BOLD_C      0x1F63      // 'c', bright white on blue
+#define VT_TEST_BLANK       0x0720      // ' ', light gray on black
+#define CONSOLE_TEST_CELL   0x2F23      // '#', bright white on green
+#define FB_TEST_BLOCK       0x1FDB      // Full block, bright white on blue
+#define FB_TEST_BLANK       0x1F20      // ' ', bright white on blue
+#define FB_TEST_WHITE       0xFFFFFF
+#define FB_TEST_BLUE        0x0000AA
+#define VIDMAP_TEST_TERM    1
+#define VIDMAP_TEST_CELL    0x0E21      // '!', yellow on black
+#define BOOT_TEST_FRAMES    8           // Frames boot_lazy_init_test takes and gives back
+#define PARAM_TEST_QUANTUM  4
+#define PARAM_TEST_QUANTUM_STR "4"
 
 // test launcher
 void launch_tests();
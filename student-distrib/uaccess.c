@@ -0,0 +1,144 @@
+/* uaccess.c - Copying between kernel buffers and user programs
+ *
+ * Every system call that is handed a user pointer goes through here: the whole range
+ * is checked against what the current process has mapped once, then copied in bulk.
+ */
+
+#include "uaccess.h"
+#include "lib.h"
+#include "paging.h"
+#include "syscallhandler.h"
+
+/*
+ * user_span
+ *   DESCRIPTION: Finds how many bytes starting at addr the current process may touch: up to the
+ *                end of its program page, or of the video memory page once it has called vidmap.
+ *                Kernel callers (boot code, the tests, restarting a base shell) run with no live
+ *                process and pass kernel buffers, so they are not limited.
+ *   INPUTS: addr - start of the range
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of usable bytes, 0 if addr is not user memory
+ *   SIDE EFFECTS: none
+ */
+static uint32_t user_span(uint32_t addr) {
+    if(get_cur_pcb()->PID == -1)
+        return 0xFFFFFFFF - addr;
+
+    if(addr >= USER_MEM_START && addr < USER_MEM_END)
+        return USER_MEM_END - addr;
+
+    if(base_dir[VIDEO_VIRTUAL >> 22].KB_dir.P && addr >= VIDEO_VIRTUAL && addr < VIDEO_VIRTUAL + ALIGNBYTES)
+        return VIDEO_VIRTUAL + ALIGNBYTES - addr;
+
+    return 0;
+}
+
+/*
+ * user_range_ok
+ *   DESCRIPTION: Checks a whole range against the current process' mappings in one go.
+ *   INPUTS: addr - start of the range
+ *           n - number of bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the range is usable, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int32_t user_range_ok(const void* addr, uint32_t n) {
+    if(addr == NULL)
+        return 0;
+    return n <= user_span((uint32_t)addr);
+}
+
+/*
+ * user_range_writable
+ *   DESCRIPTION: Checks a range the kernel is about to write to. On top of user_range_ok every
+ *                program page in it must be writable, a write to read only text would fault in
+ *                the kernel, which can't recover from it.
+ *   INPUTS: addr - start of the range
+ *           n - number of bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the range can be written, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int32_t user_range_writable(void* addr, uint32_t n) {
+    uint32_t page, end;
+
+    if(!user_range_ok(addr, n))
+        return 0;
+    if(get_cur_pcb()->PID == -1 || n == 0)
+        return 1;
+
+    // The vidmap page is always writable, only program pages are checked
+    end = (uint32_t)addr + n - 1;
+    for(page = (uint32_t)addr & ~(FRAME_SIZE - 1); page <= end && page < USER_PAGES_END; page += FRAME_SIZE){
+        if(page >= USER_PAGES_START && !user_page_writable(page))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * copy_to_user
+ *   DESCRIPTION: Validates a user destination once and copies into it with memcpy
+ *                (dword rep movsl after aligning the destination).
+ *   INPUTS: to - user destination
+ *           from - kernel source
+ *           n - number of bytes
+ *   OUTPUTS: to - filled with n bytes of from
+ *   RETURN VALUE: 0 on success, -1 if the destination is not user memory or read only
+ *   SIDE EFFECTS: none
+ */
+int32_t copy_to_user(void* to, const void* from, uint32_t n) {
+    if(!user_range_writable(to, n))
+        return -1;
+    memcpy(to, from, n);
+    return 0;
+}
+
+/*
+ * copy_from_user
+ *   DESCRIPTION: Validates a user source once and copies out of it in bulk.
+ *   INPUTS: to - kernel destination
+ *           from - user source
+ *           n - number of bytes
+ *   OUTPUTS: to - filled with n bytes of from
+ *   RETURN VALUE: 0 on success, -1 if the source is not user memory
+ *   SIDE EFFECTS: none
+ */
+int32_t copy_from_user(void* to, const void* from, uint32_t n) {
+    if(!user_range_ok(from, n))
+        return -1;
+    memcpy(to, from, n);
+    return 0;
+}
+
+/*
+ * strncpy_from_user
+ *   DESCRIPTION: Copies a user string into a kernel buffer, never reading past the end of
+ *                the region the string starts in.
+ *   INPUTS: to - kernel buffer of n bytes
+ *           from - user string
+ *           n - size of to
+ *   OUTPUTS: to - NUL terminated copy of from
+ *   RETURN VALUE: length of the string, -1 if from is bad or the string does not fit
+ *   SIDE EFFECTS: none
+ */
+int32_t strncpy_from_user(uint8_t* to, const uint8_t* from, uint32_t n) {
+    uint32_t i;
+    uint32_t limit;
+
+    if(from == NULL || n == 0)
+        return -1;
+
+    limit = user_span((uint32_t)from);
+    if(limit > n)
+        limit = n;
+
+    for(i = 0; i < limit; i++){
+        to[i] = from[i];
+        if(to[i] == '\0')
+            return i;
+    }
+
+    to[(limit < n) ? limit : n - 1] = '\0';
+    return -1;
+}
@@ -0,0 +1,23 @@
+/* uaccess.h - Copying between kernel buffers and user programs */
+
+#ifndef _UACCESS_H
+#define _UACCESS_H
+
+#include "types.h"
+
+/* Checks that [addr, addr + n) lies in memory the current process may touch, 1 if so */
+int32_t user_range_ok(const void* addr, uint32_t n);
+
+/* user_range_ok for a destination: also checks that no page of the range is read only, 1 if so */
+int32_t user_range_writable(void* addr, uint32_t n);
+
+/* Copy n bytes to a user buffer, 0 on success and -1 on a bad or read only range */
+int32_t copy_to_user(void* to, const void* from, uint32_t n);
+
+/* Copy n bytes from a user buffer, 0 on success and -1 on a bad range */
+int32_t copy_from_user(void* to, const void* from, uint32_t n);
+
+/* Copy a NUL terminated user string of at most n - 1 characters, returns its length or -1 */
+int32_t strncpy_from_user(uint8_t* to, const uint8_t* from, uint32_t n);
+
+#endif /* _UACCESS_H */
@@ -0,0 +1,505 @@
+/* vt100.c - VT100/ANSI escape sequence renderer for terminal output
+ *
+ * terminal_write hands everything a process writes to the renderer of the terminal on screen.
+ * Printable characters are gathered into a span of cells and copied to video memory in one go
+ * when the span ends (a control character, an escape sequence, a wrap or the end of the write),
+ * and the hardware cursor is moved once per write instead of once per character.
+ *
+ * Understood: cursor movement (CSI A B C D E F G H f d, ESC 7/8, CSI s/u), erasing (CSI J, K),
+ * line insertion and deletion (CSI L, M), scrolling (CSI S, T, ESC D/M), scroll regions
+ * (CSI r), colors (CSI m: 0, 1, 7, 22, 27, 30-37, 39, 40-47, 49, 90-97, 100-107) and reset
+ * (ESC c). Anything else is dropped.
+ */
+
+#include "vt100.h"
+
+#define ESC         0x1B
+#define CAN         0x18                // Cancels a sequence
+#define SUB         0x1A                // Cancels a sequence
+#define VT_PARAM_MAX    9999            // Larger numbers are clamped
+
+/* ANSI color order (black, red, green, yellow, blue, magenta, cyan, white) to VGA's */
+static const uint8_t ansi_to_vga[8] = {0, 4, 2, 6, 1, 5, 3, 7};
+
+/* Cursor while vt100_write runs, screen_x/screen_y in lib.c hold it in between */
+static int cur_x;
+static int cur_y;
+
+/*
+ * vt_update_attr
+ *   DESCRIPTION: Works out the VGA attribute byte of the current SGR state.
+ *   INPUTS: vt - renderer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Sets vt->attr
+ */
+static void vt_update_attr(vt100_t* vt) {
+    uint8_t fg = vt->fg | (vt->bold ? 0x8 : 0);
+    uint8_t bg = vt->bg;
+
+    // Bit 3 of the background is blink on VGA, so reversed colors lose their intensity
+    if(vt->reverse)
+        vt->attr = ((fg & 0x7) << 4) | bg;
+    else
+        vt->attr = (bg << 4) | fg;
+}
+
+/* Cell erased areas get: a space in the current colors */
+static uint16_t vt_blank(vt100_t* vt) {
+    return (vt->attr << 8) | ' ';
+}
+
+/*
+ * vt_flush
+ *   DESCRIPTION: Copies the pending span of printable characters to video memory.
+ *   INPUTS: vt - renderer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Empties the span
+ */
+static void vt_flush(vt100_t* vt) {
+    if(vt->span_len != 0) {
+        screen_write_cells(vt->span_x, vt->span_y, vt->span, vt->span_len);
+        vt->span_len = 0;
+    }
+}
+
+/*
+ * vt_linefeed
+ *   DESCRIPTION: Moves the cursor down a row, scrolling the region when it is on the region's
+ *                last row. Below the region it just stops at the bottom of the screen.
+ *   INPUTS: vt - renderer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May scroll the screen
+ */
+static void vt_linefeed(vt100_t* vt) {
+    vt_flush(vt);
+    if(cur_y == vt->bottom)
+        screen_scroll(vt->top, vt->bottom, 1, vt_blank(vt));
+    else if(cur_y < NUM_ROWS - 1)
+        cur_y++;
+}
+
+/*
+ * vt_reverse_linefeed
+ *   DESCRIPTION: Moves the cursor up a row, scrolling the region down when it is on the region's
+ *                first row.
+ *   INPUTS: vt - renderer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May scroll the screen
+ */
+static void vt_reverse_linefeed(vt100_t* vt) {
+    vt_flush(vt);
+    if(cur_y == vt->top)
+        screen_scroll(vt->top, vt->bottom, -1, vt_blank(vt));
+    else if(cur_y > 0)
+        cur_y--;
+}
+
+/*
+ * vt_print
+ *   DESCRIPTION: Adds a printable character at the cursor to the pending span, starting a new
+ *                span if the cursor isn't where the last one ends, and wraps at the end of the row.
+ *   INPUTS: vt - renderer
+ *           c - character to print
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Moves the cursor
+ */
+static void vt_print(vt100_t* vt, uint8_t c) {
+    if(vt->span_len != 0 && (vt->span_y != cur_y || vt->span_x + vt->span_len != cur_x))
+        vt_flush(vt);
+    if(vt->span_len == 0) {
+        vt->span_x = cur_x;
+        vt->span_y = cur_y;
+    }
+    vt->span[vt->span_len++] = (vt->attr << 8) | c;
+
+    if(++cur_x >= NUM_COLS) {
+        cur_x = 0;
+        vt_linefeed(vt);
+    }
+}
+
+/*
+ * vt_control
+ *   DESCRIPTION: Carries out a C0 control character.
+ *   INPUTS: vt - renderer
+ *           c - control character
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Moves the cursor, may scroll
+ */
+static void vt_control(vt100_t* vt, uint8_t c) {
+    switch(c) {
+        case '\n':
+            // Like the kernel's putc, a newline also returns the carriage
+            cur_x = 0;
+            vt_linefeed(vt);
+            break;
+        case '\r':
+            cur_x = 0;
+            break;
+        case '\b':
+            if(cur_x > 0)
+                cur_x--;
+            break;
+        case '\t':
+            cur_x = (cur_x / VT_TAB_WIDTH + 1) * VT_TAB_WIDTH;
+            if(cur_x >= NUM_COLS)
+                cur_x = NUM_COLS - 1;
+            break;
+        case CAN:
+        case SUB:
+            vt->state = VT_NORMAL;
+            break;
+        default:
+            // Bell and the rest have nothing to show
+            break;
+    }
+}
+
+/* Parameter i of the current CSI sequence, def if it is missing or 0 */
+static int vt_param(vt100_t* vt, int i, int def) {
+    if(i < vt->nparams && i < VT_MAX_PARAMS && vt->params[i] != 0)
+        return vt->params[i];
+    return def;
+}
+
+/* Keep a value within [lo, hi] */
+static int vt_clamp(int v, int lo, int hi) {
+    if(v < lo)
+        return lo;
+    if(v > hi)
+        return hi;
+    return v;
+}
+
+/*
+ * vt_sgr
+ *   DESCRIPTION: Select Graphic Rendition, applies every parameter of a CSI m sequence in order.
+ *   INPUTS: vt - renderer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Changes the colors of what is printed and erased from now on
+ */
+static void vt_sgr(vt100_t* vt) {
+    int i;
+    int p;
+    int n = (vt->nparams == 0) ? 1 : vt->nparams;
+
+    if(n > VT_MAX_PARAMS)
+        n = VT_MAX_PARAMS;
+
+    for(i = 0; i < n; i++) {
+        p = (i < vt->nparams) ? vt->params[i] : 0;
+        if(p == 0) {
+            vt->fg = VT_DEFAULT_FG;
+            vt->bg = VT_DEFAULT_BG;
+            vt->bold = 0;
+            vt->reverse = 0;
+        } else if(p == 1) {
+            vt->bold = 1;
+        } else if(p == 7) {
+            vt->reverse = 1;
+        } else if(p == 22) {
+            vt->bold = 0;
+        } else if(p == 27) {
+            vt->reverse = 0;
+        } else if(p >= 30 && p <= 37) {
+            vt->fg = ansi_to_vga[p - 30];
+        } else if(p == 39) {
+            vt->fg = VT_DEFAULT_FG;
+        } else if(p >= 40 && p <= 47) {
+            vt->bg = ansi_to_vga[p - 40];
+        } else if(p == 49) {
+            vt->bg = VT_DEFAULT_BG;
+        } else if(p >= 90 && p <= 97) {
+            vt->fg = ansi_to_vga[p - 90] | 0x8;
+        } else if(p >= 100 && p <= 107) {
+            // No bright backgrounds without turning blink off in the attribute controller
+            vt->bg = ansi_to_vga[p - 100];
+        }
+    }
+    vt_update_attr(vt);
+}
+
+/*
+ * vt_erase
+ *   DESCRIPTION: CSI J and CSI K: erases part of the screen or of the cursor's row.
+ *   INPUTS: vt - renderer
+ *           final - 'J' or 'K'
+ *           mode - 0 from the cursor on, 1 up to the cursor, 2 all of it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void vt_erase(vt100_t* vt, uint8_t final, int mode) {
+    int first = (final == 'J') ? 0 : NUM_COLS * cur_y;
+    int last = (final == 'J') ? NUM_COLS * NUM_ROWS : NUM_COLS * (cur_y + 1);
+    int pos = NUM_COLS * cur_y + cur_x;
+
+    if(mode == 0)
+        first = pos;
+    else if(mode == 1)
+        last = pos + 1;
+    else if(mode != 2)
+        return;
+
+    screen_fill_cells(first % NUM_COLS, first / NUM_COLS, vt_blank(vt), last - first);
+}
+
+/*
+ * vt_csi
+ *   DESCRIPTION: Carries out a complete CSI sequence.
+ *   INPUTS: vt - renderer
+ *           final - the sequence's final byte
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Moves the cursor, changes colors, erases or scrolls
+ */
+static void vt_csi(vt100_t* vt, uint8_t final) {
+    int n = vt_param(vt, 0, 1);
+    int t;
+    int b;
+
+    // Private modes (cursor visibility and such) aren't supported
+    if(vt->private_seq)
+        return;
+
+    switch(final) {
+        case 'A':       // Cursor up, stopping at the top margin when inside the region
+            cur_y = vt_clamp(cur_y - n, (cur_y >= vt->top) ? vt->top : 0, NUM_ROWS - 1);
+            break;
+        case 'B':       // Cursor down, stopping at the bottom margin when inside the region
+            cur_y = vt_clamp(cur_y + n, 0, (cur_y <= vt->bottom) ? vt->bottom : NUM_ROWS - 1);
+            break;
+        case 'C':       // Cursor forward
+            cur_x = vt_clamp(cur_x + n, 0, NUM_COLS - 1);
+            break;
+        case 'D':       // Cursor back
+            cur_x = vt_clamp(cur_x - n, 0, NUM_COLS - 1);
+            break;
+        case 'E':       // Start of a following row
+            cur_y = vt_clamp(cur_y + n, 0, (cur_y <= vt->bottom) ? vt->bottom : NUM_ROWS - 1);
+            cur_x = 0;
+            break;
+        case 'F':       // Start of a previous row
+            cur_y = vt_clamp(cur_y - n, (cur_y >= vt->top) ? vt->top : 0, NUM_ROWS - 1);
+            cur_x = 0;
+            break;
+        case 'G':       // Column
+            cur_x = vt_clamp(n - 1, 0, NUM_COLS - 1);
+            break;
+        case 'd':       // Row
+            cur_y = vt_clamp(n - 1, 0, NUM_ROWS - 1);
+            break;
+        case 'H':       // Row and column, 1-based
+        case 'f':
+            cur_y = vt_clamp(vt_param(vt, 0, 1) - 1, 0, NUM_ROWS - 1);
+            cur_x = vt_clamp(vt_param(vt, 1, 1) - 1, 0, NUM_COLS - 1);
+            break;
+        case 'J':       // Erase in display
+        case 'K':       // Erase in line
+            vt_erase(vt, final, (vt->nparams != 0) ? vt->params[0] : 0);
+            break;
+        case 'L':       // Insert lines at the cursor, pushing the rest of the region down
+            if(cur_y >= vt->top && cur_y <= vt->bottom)
+                screen_scroll(cur_y, vt->bottom, -n, vt_blank(vt));
+            break;
+        case 'M':       // Delete lines at the cursor, pulling the rest of the region up
+            if(cur_y >= vt->top && cur_y <= vt->bottom)
+                screen_scroll(cur_y, vt->bottom, n, vt_blank(vt));
+            break;
+        case 'S':       // Scroll the region up
+            screen_scroll(vt->top, vt->bottom, n, vt_blank(vt));
+            break;
+        case 'T':       // Scroll the region down
+            screen_scroll(vt->top, vt->bottom, -n, vt_blank(vt));
+            break;
+        case 'm':
+            vt_sgr(vt);
+            break;
+        case 'r':       // Scroll region, the cursor goes home
+            t = vt_param(vt, 0, 1) - 1;
+            b = vt_param(vt, 1, NUM_ROWS) - 1;
+            if(t < b && b < NUM_ROWS) {
+                vt->top = t;
+                vt->bottom = b;
+                cur_x = 0;
+                cur_y = 0;
+            }
+            break;
+        case 's':
+            vt->saved_x = cur_x;
+            vt->saved_y = cur_y;
+            break;
+        case 'u':
+            cur_x = vt->saved_x;
+            cur_y = vt->saved_y;
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * vt_escape
+ *   DESCRIPTION: Handles the byte after ESC.
+ *   INPUTS: vt - renderer
+ *           c - byte after ESC
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May start a CSI sequence, move the cursor, scroll or reset the screen
+ */
+static void vt_escape(vt100_t* vt, uint8_t c) {
+    vt->state = VT_NORMAL;
+
+    switch(c) {
+        case '[':
+            vt->state = VT_CSI;
+            vt->private_seq = 0;
+            vt->nparams = 0;
+            vt->params[0] = 0;
+            break;
+        case '7':
+            vt->saved_x = cur_x;
+            vt->saved_y = cur_y;
+            break;
+        case '8':
+            cur_x = vt->saved_x;
+            cur_y = vt->saved_y;
+            break;
+        case 'D':       // Index
+            vt_linefeed(vt);
+            break;
+        case 'E':       // Next line
+            cur_x = 0;
+            vt_linefeed(vt);
+            break;
+        case 'M':       // Reverse index
+            vt_reverse_linefeed(vt);
+            break;
+        case 'c':       // Reset
+            vt100_init(vt);
+            screen_fill_cells(0, 0, vt_blank(vt), NUM_COLS * NUM_ROWS);
+            cur_x = 0;
+            cur_y = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * vt_csi_byte
+ *   DESCRIPTION: Collects the parameters of a CSI sequence and carries it out at its final byte.
+ *   INPUTS: vt - renderer
+ *           c - next byte of the sequence
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see vt_csi
+ */
+static void vt_csi_byte(vt100_t* vt, uint8_t c) {
+    int i;
+
+    if(c >= '0' && c <= '9') {
+        if(vt->nparams == 0)
+            vt->nparams = 1;
+        i = vt->nparams - 1;
+        if(i < VT_MAX_PARAMS) {
+            vt->params[i] = vt->params[i] * 10 + (c - '0');
+            if(vt->params[i] > VT_PARAM_MAX)
+                vt->params[i] = VT_PARAM_MAX;
+        }
+    } else if(c == ';') {
+        // An empty first parameter still counts
+        if(vt->nparams == 0)
+            vt->nparams = 1;
+        // One past VT_MAX_PARAMS marks the extra ones as dropped
+        if(vt->nparams <= VT_MAX_PARAMS) {
+            if(vt->nparams < VT_MAX_PARAMS)
+                vt->params[vt->nparams] = 0;
+            vt->nparams++;
+        }
+    } else if(c == '?' && vt->nparams == 0) {
+        vt->private_seq = 1;
+    } else if(c >= 0x40 && c <= 0x7E) {
+        vt->state = VT_NORMAL;
+        vt_csi(vt, c);
+    }
+    // Intermediate bytes (0x20-0x2F) change nothing we support
+}
+
+/*
+ * vt100_init
+ *   DESCRIPTION: Resets a renderer: default colors, whole screen as scroll region, no sequence
+ *                half read and nothing pending.
+ *   INPUTS: vt - renderer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void vt100_init(vt100_t* vt) {
+    vt->state = VT_NORMAL;
+    vt->private_seq = 0;
+    vt->nparams = 0;
+    vt->fg = VT_DEFAULT_FG;
+    vt->bg = VT_DEFAULT_BG;
+    vt->bold = 0;
+    vt->reverse = 0;
+    vt->top = 0;
+    vt->bottom = NUM_ROWS - 1;
+    vt->saved_x = 0;
+    vt->saved_y = 0;
+    vt->span_len = 0;
+    vt_update_attr(vt);
+}
+
+/*
+ * vt100_write
+ *   DESCRIPTION: Interprets output for the screen, starting at the cursor lib.c keeps. Sequences
+ *                may be split across calls. The caller selects the renderer's terminal
+ *                (console_select), holds it (term_lock) and flushes it afterwards.
+ *   INPUTS: vt - renderer of the terminal
+ *           buf - bytes to interpret
+ *           n - number of bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Writes video memory, moves the cursor and the hardware cursor
+ */
+void vt100_write(vt100_t* vt, const uint8_t* buf, int32_t n) {
+    uint8_t c;
+    int32_t i;
+
+    cur_x = get_screen_x();
+    cur_y = get_screen_y();
+
+    for(i = 0; i < n; i++) {
+        c = buf[i];
+
+        if(c == ESC) {
+            vt_flush(vt);
+            vt->state = VT_ESC;
+        } else if(c < 0x20 || c == 0x7F) {
+            if(c != 0x7F) {
+                vt_flush(vt);
+                vt_control(vt, c);
+            }
+        } else if(vt->state == VT_ESC) {
+            vt_escape(vt, c);
+        } else if(vt->state == VT_CSI) {
+            vt_flush(vt);
+            vt_csi_byte(vt, c);
+        } else {
+            vt_print(vt, c);
+        }
+    }
+
+    vt_flush(vt);
+    set_screen_x(cur_x);
+    set_screen_y(cur_y);
+    update_cursor();
+}
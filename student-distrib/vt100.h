@@ -0,0 +1,51 @@
+/* vt100.h - VT100/ANSI escape sequence renderer for terminal output */
+
+#ifndef _VT100_H
+#define _VT100_H
+
+#include "types.h"
+#include "lib.h"
+
+#define VT_MAX_PARAMS       8           // Numbers a CSI sequence may carry, the rest are dropped
+#define VT_TAB_WIDTH        8
+
+/* Parser states */
+#define VT_NORMAL           0
+#define VT_ESC              1           // Seen ESC
+#define VT_CSI              2           // Seen ESC [
+
+/* Default colors: light gray on black, same as the kernel's own output */
+#define VT_DEFAULT_FG       7
+#define VT_DEFAULT_BG       0
+
+typedef struct vt100 {
+    uint8_t state;
+    uint8_t private_seq;                // CSI started with '?', e.g. cursor show/hide (ignored)
+    uint8_t nparams;
+    uint16_t params[VT_MAX_PARAMS];
+
+    uint8_t fg;                         // SGR state, VGA color numbers
+    uint8_t bg;
+    uint8_t bold;
+    uint8_t reverse;
+    uint8_t attr;                       // VGA attribute byte the state above comes to
+
+    uint8_t top;                        // Scroll region, rows top to bottom inclusive
+    uint8_t bottom;
+    uint8_t saved_x;                    // Cursor saved by ESC 7 / CSI s
+    uint8_t saved_y;
+
+    // Printable characters not on the screen yet: one span of cells on row span_y from span_x
+    uint16_t span[NUM_COLS];
+    uint8_t span_x;
+    uint8_t span_y;
+    uint8_t span_len;
+} vt100_t;
+
+/* Reset a renderer to default colors, the whole screen as scroll region and no pending sequence */
+void vt100_init(vt100_t* vt);
+
+/* Interpret n bytes of output into the terminal picked with console_select */
+void vt100_write(vt100_t* vt, const uint8_t* buf, int32_t n);
+
+#endif /* _VT100_H */
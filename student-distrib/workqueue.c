@@ -0,0 +1,110 @@
+/* workqueue.c - Kernel worker thread for deferred jobs
+ *
+ * Jobs too long to run from a softirq are queued for a kernel thread that runs them one at a
+ * time like any other process: with interrupts on, preemptible by the timer, and sleeping
+ * when there is nothing to do.
+ */
+
+#include "workqueue.h"
+#include "lib.h"
+#include "pit.h"
+#include "spinlock.h"
+#include "syscallhandler.h"
+
+static work_t* work_head = NULL;
+static work_t* work_tail = NULL;
+static spinlock_t work_lock = SPINLOCK_INIT("work");
+static wait_queue_t work_wait;
+static pcb_t* worker = NULL;
+
+/*
+ * worker_thread
+ *   DESCRIPTION: Body of the worker thread, runs queued jobs in order and sleeps while there are none.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none, never returns
+ *   SIDE EFFECTS: Runs the jobs with interrupts enabled
+ */
+static void worker_thread(void) {
+    work_t* work;
+
+    // context_switch comes here with interrupts off
+    while(1) {
+        spin_lock(&work_lock);
+        while(work_head == NULL) {
+            // Interrupts stay off across the unlock, so a job queued now wakes us up
+            spin_unlock(&work_lock);
+            sleep_on(&work_wait);
+            spin_lock(&work_lock);
+        }
+
+        work = work_head;
+        work_head = work->next;
+        if(work_head == NULL)
+            work_tail = NULL;
+        spin_unlock(&work_lock);
+
+        // Cleared first, so the job may queue itself again
+        work->queued = 0;
+        sti();
+        work->func(work->data);
+        cli();
+    }
+}
+
+/*
+ * workqueue_init
+ *   DESCRIPTION: Starts the worker thread. Jobs queued before this wait for it.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if no PCB is free
+ *   SIDE EFFECTS: Takes a PCB
+ */
+int32_t workqueue_init(void) {
+    init_wait_queue(&work_wait);
+    worker = create_kernel_thread(worker_thread, (const int8_t*)"kworker");
+    return (worker != NULL) ? 0 : -1;
+}
+
+/*
+ * workqueue_running
+ *   DESCRIPTION: Tells whether the worker thread was started.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if it runs, 0 if not
+ *   SIDE EFFECTS: none
+ */
+int32_t workqueue_running(void) {
+    return worker != NULL;
+}
+
+/*
+ * queue_work
+ *   DESCRIPTION: Adds a job to the end of the worker thread's queue, unless it is queued already.
+ *   INPUTS: work - job to run
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if queued, -1 if it already was
+ *   SIDE EFFECTS: Wakes up the worker thread
+ */
+int32_t queue_work(work_t* work) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&work_lock, flags);
+    if(work->queued) {
+        spin_unlock_irqrestore(&work_lock, flags);
+        return -1;
+    }
+
+    work->queued = 1;
+    work->next = NULL;
+    if(work_tail != NULL)
+        work_tail->next = work;
+    else
+        work_head = work;
+    work_tail = work;
+    spin_unlock(&work_lock);
+
+    wake_up(&work_wait);
+    restore_flags(flags);
+    return 0;
+}
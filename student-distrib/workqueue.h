@@ -0,0 +1,28 @@
+/* workqueue.h - Kernel worker thread for deferred jobs */
+
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#include "types.h"
+
+/* A job for the worker thread. Runs once per queue_work, in process context with
+ * interrupts enabled, so it may take as long as it needs. */
+typedef struct work {
+    struct work* next;
+    void (*func)(uint32_t data);
+    uint32_t data;
+    volatile uint32_t queued;           // 1 while waiting for the worker
+} work_t;
+
+#define WORK_INIT(work_func, work_data)     { NULL, work_func, work_data, 0 }
+
+/* Start the worker thread */
+int32_t workqueue_init(void);
+
+/* Whether the worker thread exists */
+int32_t workqueue_running(void);
+
+/* Hand a job to the worker thread (safe from interrupt handlers) */
+int32_t queue_work(work_t* work);
+
+#endif /* _WORKQUEUE_H */
@@ -5,15 +5,46 @@
 
 #define BUFSIZE 1024
 
+static volatile int32_t interrupted = 0;
+
+/* Ctrl+C at the prompt only throws the line away */
+static void
+on_interrupt (int32_t signum)
+{
+    interrupted = 1;
+}
+
+/* Report background jobs that finished since the last prompt */
+static void
+reap_jobs ()
+{
+    int32_t pid, status;
+    uint8_t num[12];
+
+    while (0 < (pid = ece391_waitpid (-1, &status, WNOHANG))) {
+	ece391_fdputs (1, (uint8_t*)"[");
+	ece391_fdputs (1, ece391_itoa (pid, num, 10));
+	ece391_fdputs (1, (uint8_t*)"] done\n");
+    }
+}
+
 int main ()
 {
     int32_t cnt, rval;
     uint8_t buf[BUFSIZE];
+    uint8_t num[12];
     ece391_fdputs (1, (uint8_t*)"Starting 391 Shell\n");
+    ece391_set_handler (INTERRUPT, on_interrupt);
 
     while (1) {
+	reap_jobs ();
         ece391_fdputs (1, (uint8_t*)"391OS> ");
 	if (-1 == (cnt = ece391_read (0, buf, BUFSIZE-1))) {
+	    if (interrupted) {
+		interrupted = 0;
+		ece391_fdputs (1, (uint8_t*)"\n");
+		continue;
+	    }
 	    ece391_fdputs (1, (uint8_t*)"read from keyboard failed\n");
 	    return 3;
 	}
@@ -24,6 +55,22 @@ int main ()
 	    return 0;
 	if ('\0' == buf[0])
 	    continue;
+	/* "cmd &" runs cmd in the background */
+	while (cnt > 0 && ' ' == buf[cnt - 1])
+	    buf[--cnt] = '\0';
+	if (cnt > 0 && '&' == buf[cnt - 1]) {
+	    buf[--cnt] = '\0';
+	    while (cnt > 0 && ' ' == buf[cnt - 1])
+		buf[--cnt] = '\0';
+	    if (-1 == (rval = ece391_spawn (buf))) {
+		ece391_fdputs (1, (uint8_t*)"no such command\n");
+	    } else {
+		ece391_fdputs (1, (uint8_t*)"[");
+		ece391_fdputs (1, ece391_itoa (rval, num, 10));
+		ece391_fdputs (1, (uint8_t*)"]\n");
+	    }
+	    continue;
+	}
 	rval = ece391_execute (buf);
 	if (-1 == rval)
 	    ece391_fdputs (1, (uint8_t*)"no such command\n");
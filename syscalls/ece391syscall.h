@@ -11,6 +11,9 @@
  * task.  Negative returns from execute indicate that the desired program
  * could not be found.
  */ 
+struct pollfd;
+struct fb_info;
+
 extern int32_t ece391_halt (uint8_t status);
 extern int32_t ece391_execute (const uint8_t* command);
 extern int32_t ece391_read (int32_t fd, void* buf, int32_t nbytes);
@@ -21,6 +24,56 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_create (const uint8_t* filename);
+extern int32_t ece391_pipe (int32_t* fds);
+extern int32_t ece391_fork (void);
+extern int32_t ece391_spawn (const uint8_t* command);
+extern int32_t ece391_waitpid (int32_t pid, int32_t* status, int32_t options);
+extern int32_t ece391_kill (int32_t pid, int32_t signum);
+extern int32_t ece391_ioctl (int32_t fd, uint32_t cmd, uint32_t arg);
+extern int32_t ece391_poll (struct pollfd* fds, uint32_t nfds, int32_t timeout);
+extern int32_t ece391_fbmap (struct fb_info* info);
+
+/* ece391_waitpid options */
+#define WNOHANG 1
+
+/* Terminal ioctls and input modes */
+#define TCGETMODE 0x5401
+#define TCSETMODE 0x5402
+#define TCFLUSH   0x540B
+#define ICANON    0x1
+#define ECHO      0x2
+
+struct term_mode {
+	uint32_t lflag;
+	uint8_t vmin;
+	uint8_t vtime;
+};
+
+/* Non-blocking descriptors: ece391_ioctl (fd, FIONBIO, &on) */
+#define FIONBIO   0x5421
+
+/* ece391_poll events */
+#define POLLIN    0x01
+#define POLLOUT   0x04
+#define POLLERR   0x08
+#define POLLHUP   0x10
+#define POLLNVAL  0x20
+
+struct pollfd {
+	int32_t fd;
+	int16_t events;
+	int16_t revents;
+};
+
+/* Framebuffer from ece391_fbmap, 32 bits per pixel as 0x00RRGGBB */
+struct fb_info {
+	uint32_t addr;
+	uint32_t width;
+	uint32_t height;
+	uint32_t pitch;
+	uint32_t bpp;
+};
 
 enum signums {
 	DIV_ZERO = 0,
@@ -11,5 +11,14 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_CREATE  11
+#define SYS_PIPE    12
+#define SYS_FORK    13
+#define SYS_SPAWN   14
+#define SYS_WAITPID 15
+#define SYS_KILL    16
+#define SYS_IOCTL   17
+#define SYS_POLL    18
+#define SYS_FBMAP   19
 
 #endif /* ECE391SYSNUM_H */